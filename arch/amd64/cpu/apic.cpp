@@ -107,8 +107,6 @@ namespace APIC
 
 	void APIC::EOI()
 	{
-		Memory::SwapPT swap =
-			Memory::SwapPT(KernelPageTable, thisPageTable);
 		if (this->x2APICSupported)
 			wrmsr(MSR_X2APIC_EOI, 0);
 		else
@@ -18,6 +18,7 @@
 #include <smp.hpp>
 
 #include <memory.hpp>
+#include <rcu.hpp>
 #include <acpi.hpp>
 #include <ints.hpp>
 #include <assert.h>
@@ -57,9 +58,6 @@ nsa CPUData *GetCurrentCPU()
 	int CoreID = 0;
 	if (CPUEnabled.load(std::memory_order_acquire) == true)
 	{
-		Memory::SwapPT swap =
-			Memory::SwapPT(KernelPageTable, thisPageTable);
-
 		if (apic->x2APIC)
 			CoreID = int(CPU::x64::rdmsr(CPU::x64::MSR_X2APIC_APICID));
 		else
@@ -91,6 +89,7 @@ extern "C" void StartCPU()
 	CPU::Interrupts(CPU::Enable);
 	KPrint("\e058C19CPU \e8888FF%d \e058C19is online", CoreID);
 	CPUEnabled.store(true, std::memory_order_release);
+	RCU::EnterIdle();
 	CPU::Halt(true);
 }
 
@@ -292,6 +292,30 @@ namespace Memory
 		return nullptr;
 	}
 
+	PageTableEntry *Virtual::LookupPTE(void *VirtualAddress)
+	{
+		uintptr_t Address = (uintptr_t)VirtualAddress;
+		Address &= 0xFFFFFFFFFFFFF000;
+
+		PageMapIndexer Index = PageMapIndexer(Address);
+		PageMapLevel4 *PML4 = &this->pTable->Entries[Index.PMLIndex];
+		if (!PML4->Present)
+			return nullptr;
+
+		PageDirectoryPointerTableEntryPtr *PDPTEPtr = (PageDirectoryPointerTableEntryPtr *)((uintptr_t)PML4->Address << 12);
+		PageDirectoryPointerTableEntry *PDPTE = &PDPTEPtr->Entries[Index.PDPTEIndex];
+		if (!PDPTE->Present || PDPTE->PageSize)
+			return nullptr;
+
+		PageDirectoryEntryPtr *PDEPtr = (PageDirectoryEntryPtr *)(PDPTE->GetAddress() << 12);
+		PageDirectoryEntry *PDE = &PDEPtr->Entries[Index.PDEIndex];
+		if (!PDE->Present || PDE->PageSize)
+			return nullptr;
+
+		PageTableEntryPtr *PTEPtr = (PageTableEntryPtr *)(PDE->GetAddress() << 12);
+		return &PTEPtr->Entries[Index.PTEIndex];
+	}
+
 	void Virtual::Map(void *VirtualAddress, void *PhysicalAddress, uint64_t Flags, MapType Type)
 	{
 		SmartLock(this->MemoryLock);
@@ -302,6 +326,9 @@ namespace Memory
 		}
 
 		Flags |= PTFlag::P;
+		if ((Flags & PTFlag::US) && VirtualAddress != PhysicalAddress &&
+			(uintptr_t)VirtualAddress < KernelAllocator.GetTotalMemory())
+			this->pTable->ShadowsDirectMap = true;
 
 		PageMapIndexer Index = PageMapIndexer((uintptr_t)VirtualAddress);
 		// Clear any flags that are not 1 << 0 (Present) - 1 << 5 (Accessed) because rest are for page table entries only
@@ -311,7 +338,7 @@ namespace Memory
 		PageDirectoryPointerTableEntryPtr *PDPTEPtr = nullptr;
 		if (!PML4->Present)
 		{
-			PDPTEPtr = (PageDirectoryPointerTableEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageDirectoryPointerTableEntryPtr) + 1));
+			PDPTEPtr = (PageDirectoryPointerTableEntryPtr *)this->NewTable(sizeof(PageDirectoryPointerTableEntryPtr));
 			memset(PDPTEPtr, 0, sizeof(PageDirectoryPointerTableEntryPtr));
 			PML4->Present = true;
 			PML4->SetAddress((uintptr_t)PDPTEPtr >> 12);
@@ -333,7 +360,7 @@ namespace Memory
 		PageDirectoryEntryPtr *PDEPtr = nullptr;
 		if (!PDPTE->Present)
 		{
-			PDEPtr = (PageDirectoryEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageDirectoryEntryPtr) + 1));
+			PDEPtr = (PageDirectoryEntryPtr *)this->NewTable(sizeof(PageDirectoryEntryPtr));
 			memset(PDEPtr, 0, sizeof(PageDirectoryEntryPtr));
 			PDPTE->Present = true;
 			PDPTE->SetAddress((uintptr_t)PDEPtr >> 12);
@@ -355,7 +382,7 @@ namespace Memory
 		PageTableEntryPtr *PTEPtr = nullptr;
 		if (!PDE->Present)
 		{
-			PTEPtr = (PageTableEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageTableEntryPtr) + 1));
+			PTEPtr = (PageTableEntryPtr *)this->NewTable(sizeof(PageTableEntryPtr));
 			memset(PTEPtr, 0, sizeof(PageTableEntryPtr));
 			PDE->Present = true;
 			PDE->SetAddress((uintptr_t)PTEPtr >> 12);
@@ -365,10 +392,13 @@ namespace Memory
 		PDE->raw |= DirectoryFlags;
 
 		PageTableEntry *PTE = &PTEPtr->Entries[Index.PTEIndex];
+		/* Not present entries are never cached */
+		bool Stale = PTE->Present;
 		PTE->Present = true;
 		PTE->raw |= Flags;
 		PTE->SetAddress((uintptr_t)PhysicalAddress >> 12);
-		CPU::x64::invlpg(VirtualAddress);
+		if (Stale)
+			TLB::Invalidate(this->pTable, (uintptr_t)VirtualAddress);
 
 #ifdef DEBUG
 /* https://stackoverflow.com/a/3208376/9352057 */
@@ -443,7 +473,7 @@ namespace Memory
 
 		PTE.Present = false;
 		PTEPtr->Entries[Index.PTEIndex] = PTE;
-		CPU::x64::invlpg(VirtualAddress);
+		TLB::Invalidate(this->pTable, (uintptr_t)VirtualAddress);
 	}
 
 	void Virtual::Remap(void *VirtualAddress, void *PhysicalAddress, uint64_t Flags, MapType Type)
@@ -456,6 +486,9 @@ namespace Memory
 		}
 
 		Flags |= PTFlag::P;
+		if ((Flags & PTFlag::US) && VirtualAddress != PhysicalAddress &&
+			(uintptr_t)VirtualAddress < KernelAllocator.GetTotalMemory())
+			this->pTable->ShadowsDirectMap = true;
 
 		PageMapIndexer Index = PageMapIndexer((uintptr_t)VirtualAddress);
 		// Clear any flags that are not 1 << 0 (Present) - 1 << 5 (Accessed) because rest are for page table entries only
@@ -465,7 +498,7 @@ namespace Memory
 		PageDirectoryPointerTableEntryPtr *PDPTEPtr = nullptr;
 		if (!PML4->Present)
 		{
-			PDPTEPtr = (PageDirectoryPointerTableEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageDirectoryPointerTableEntryPtr) + 1));
+			PDPTEPtr = (PageDirectoryPointerTableEntryPtr *)this->NewTable(sizeof(PageDirectoryPointerTableEntryPtr));
 			memset(PDPTEPtr, 0, sizeof(PageDirectoryPointerTableEntryPtr));
 			PML4->Present = true;
 			PML4->SetAddress((uintptr_t)PDPTEPtr >> 12);
@@ -488,7 +521,7 @@ namespace Memory
 		PageDirectoryEntryPtr *PDEPtr = nullptr;
 		if (!PDPTE->Present)
 		{
-			PDEPtr = (PageDirectoryEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageDirectoryEntryPtr) + 1));
+			PDEPtr = (PageDirectoryEntryPtr *)this->NewTable(sizeof(PageDirectoryEntryPtr));
 			memset(PDEPtr, 0, sizeof(PageDirectoryEntryPtr));
 			PDPTE->Present = true;
 			PDPTE->SetAddress((uintptr_t)PDEPtr >> 12);
@@ -511,7 +544,7 @@ namespace Memory
 		PageTableEntryPtr *PTEPtr = nullptr;
 		if (!PDE->Present)
 		{
-			PTEPtr = (PageTableEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageTableEntryPtr) + 1));
+			PTEPtr = (PageTableEntryPtr *)this->NewTable(sizeof(PageTableEntryPtr));
 			memset(PTEPtr, 0, sizeof(PageTableEntryPtr));
 			PDE->Present = true;
 			PDE->SetAddress((uintptr_t)PTEPtr >> 12);
@@ -521,10 +554,12 @@ namespace Memory
 		PDE->raw |= DirectoryFlags;
 
 		PageTableEntry *PTE = &PTEPtr->Entries[Index.PTEIndex];
+		bool Stale = PTE->Present;
 		PTE->raw &= 0xFFF;
 		PTE->raw |= Flags;
 		PTE->Present = true;
 		PTE->SetAddress((uintptr_t)PhysicalAddress >> 12);
-		CPU::x64::invlpg(VirtualAddress);
+		if (Stale)
+			TLB::Invalidate(this->pTable, (uintptr_t)VirtualAddress);
 	}
 }
@@ -127,6 +127,20 @@ namespace Memory
 		return nullptr;
 	}
 
+	PageTableEntry *Virtual::LookupPTE(void *VirtualAddress)
+	{
+		uintptr_t Address = (uintptr_t)VirtualAddress;
+		Address &= 0xFFFFF000;
+
+		PageMapIndexer Index = PageMapIndexer(Address);
+		PageDirectoryEntry *PDE = &this->Table->Entries[Index.PDEIndex];
+		if (!PDE->Present || PDE->PageSize)
+			return nullptr;
+
+		PageTableEntryPtr *PTEPtr = (PageTableEntryPtr *)(PDE->GetAddress() << 12);
+		return &PTEPtr->Entries[Index.PTEIndex];
+	}
+
 	void Virtual::Map(void *VirtualAddress, void *PhysicalAddress, uint64_t Flags, MapType Type)
 	{
 		SmartLock(this->MemoryLock);
@@ -155,7 +169,7 @@ namespace Memory
 		PageTableEntryPtr *PTEPtr = nullptr;
 		if (!PDE->Present)
 		{
-			PTEPtr = (PageTableEntryPtr *)KernelAllocator.RequestPages(TO_PAGES(sizeof(PageTableEntryPtr) + 1));
+			PTEPtr = (PageTableEntryPtr *)this->NewTable(sizeof(PageTableEntryPtr));
 			memset(PTEPtr, 0, sizeof(PageTableEntryPtr));
 			PDE->Present = true;
 			PDE->SetAddress((uintptr_t)PTEPtr >> 12);
@@ -165,10 +179,13 @@ namespace Memory
 		PDE->raw |= (uintptr_t)DirectoryFlags;
 
 		PageTableEntry *PTE = &PTEPtr->Entries[Index.PTEIndex];
+		/* Not present entries are never cached */
+		bool Stale = PTE->Present;
 		PTE->Present = true;
 		PTE->raw |= (uintptr_t)Flags;
 		PTE->SetAddress((uintptr_t)PhysicalAddress >> 12);
-		CPU::x32::invlpg(VirtualAddress);
+		if (Stale)
+			TLB::Invalidate(this->pTable, (uintptr_t)VirtualAddress);
 
 #ifdef DEBUG
 /* https://stackoverflow.com/a/3208376/9352057 */
@@ -221,6 +238,6 @@ namespace Memory
 
 		PTE.Present = false;
 		PTEPtr->Entries[Index.PTEIndex] = PTE;
-		CPU::x32::invlpg(VirtualAddress);
+		TLB::Invalidate(this->pTable, (uintptr_t)VirtualAddress);
 	}
 }
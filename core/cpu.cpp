@@ -201,6 +201,9 @@ namespace CPU
 		asmv("movq %%cr3, %0"
 			 : "=r"(ret));
 
+		/* Drop the PCID */
+		ret = (void *)((uintptr_t)ret & ~0xFFFUL);
+
 		if (PT)
 		{
 			asmv("movq %0, %%cr3"
@@ -241,6 +244,8 @@ namespace CPU
 		bool UMIP = false;
 		bool SMEP = false;
 		bool SMAP = false;
+		bool PCID = false;
+		bool RDTSCP = false;
 	};
 
 	SupportedFeat GetCPUFeat()
@@ -251,23 +256,29 @@ namespace CPU
 		{
 			CPU::x86::AMD::CPUID0x00000001 cpuid1;
 			CPU::x86::AMD::CPUID0x00000007_ECX_0 cpuid7;
+			CPU::x86::AMD::CPUID0x80000001 cpuid80000001;
 
 			feat.PGE = cpuid1.EDX.PGE;
 			feat.SSE = cpuid1.EDX.SSE;
 			feat.SMEP = cpuid7.EBX.SMEP;
 			feat.SMAP = cpuid7.EBX.SMAP;
 			feat.UMIP = cpuid7.ECX.UMIP;
+			feat.PCID = cpuid1.ECX.PCID;
+			feat.RDTSCP = cpuid80000001.EDX.RDTSCP;
 		}
 		else if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_INTEL) == 0)
 		{
 			CPU::x86::Intel::CPUID0x00000001 cpuid1;
 			CPU::x86::Intel::CPUID0x00000007_0 cpuid7_0;
+			CPU::x86::Intel::CPUID0x80000001 cpuid80000001;
 
 			feat.PGE = cpuid1.EDX.PGE;
 			feat.SSE = cpuid1.EDX.SSE;
 			feat.SMEP = cpuid7_0.EBX.SMEP;
 			feat.SMAP = cpuid7_0.EBX.SMAP;
 			feat.UMIP = cpuid7_0.ECX.UMIP;
+			feat.PCID = cpuid1.ECX.PCID;
+			feat.RDTSCP = cpuid80000001.EDX.RDTSCP;
 		}
 
 		return feat;
@@ -377,6 +388,20 @@ namespace CPU
 		writecr4(cr4);
 		debug("Updated CR4.");
 
+#if defined(a64)
+		/* Process Context Identifiers
+			Tag TLB entries with the address space so switching
+			page tables doesn't flush them. The core ID is read
+			back with RDTSCP to find the per-core PCIDs.
+		*/
+		if (feat.PCID && feat.RDTSCP)
+		{
+			if (!BSP)
+				KPrint("PCID is supported.");
+			Memory::TLB::EnablePCID(Core);
+		}
+#endif
+
 		debug("Enabling PAT support...");
 		wrmsr(MSR_CR_PAT, 0x6 | (0x0 << 8) | (0x1 << 16));
 		if (!BSP++)
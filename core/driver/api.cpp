@@ -40,15 +40,11 @@ namespace Driver
 	{
 		dbg_api("%d, %#lx, %d", MajorID, (uintptr_t)Function, Type);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return -EINVAL;
 
-		DriverObject *drv = &itr->second;
-
 		switch (Type)
 		{
 		case _drf_Entry:
@@ -77,15 +73,11 @@ namespace Driver
 	{
 		dbg_api("%d, %s, %s, %s, %s, %s", MajorID, Name, Description, Author, Version, License);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return -EINVAL;
 
-		DriverObject *drv = &itr->second;
-
 		strncpy(drv->Name, Name, sizeof(drv->Name));
 		strncpy(drv->Description, Description, sizeof(drv->Description));
 		strncpy(drv->Author, Author, sizeof(drv->Author));
@@ -100,15 +92,11 @@ namespace Driver
 	{
 		dbg_api("%d, %d, %#lx", MajorID, IRQ, Handler);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return -EINVAL;
 
-		DriverObject *drv = &itr->second;
-
 		if (drv->InterruptHandlers->contains(IRQ))
 			return -EEXIST;
 
@@ -123,21 +111,24 @@ namespace Driver
 
 		debug("Overriding IRQ %d with %#lx", IRQ, Handler);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		foreach (auto &var in Drivers)
 		{
-			DriverObject *drv = &var.second;
+			SmartReadLock(DriverManager->DriversLock);
+			std::unordered_map<dev_t, DriverObject> &Drivers =
+				DriverManager->GetDrivers();
 
-			foreach (auto &ih in * drv->InterruptHandlers)
+			foreach (auto &var in Drivers)
 			{
-				if (ih.first == IRQ)
+				DriverObject *drv = &var.second;
+
+				foreach (auto &ih in * drv->InterruptHandlers)
 				{
-					debug("Removing IRQ %d: %#lx for %s", IRQ, (uintptr_t)ih.second, drv->Path);
-					Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))ih.second, IRQ);
-					drv->InterruptHandlers->erase(IRQ);
-					break;
+					if (ih.first == IRQ)
+					{
+						debug("Removing IRQ %d: %#lx for %s", IRQ, (uintptr_t)ih.second, drv->Path);
+						Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))ih.second, IRQ);
+						drv->InterruptHandlers->erase(IRQ);
+						break;
+					}
 				}
 			}
 		}
@@ -149,14 +140,11 @@ namespace Driver
 	{
 		dbg_api("%d, %d, %#lx", MajorID, IRQ, Handler);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return -EINVAL;
 
-		DriverObject *drv = &itr->second;
 		Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))Handler, IRQ);
 		drv->InterruptHandlers->erase(IRQ);
 		return 0;
@@ -166,14 +154,11 @@ namespace Driver
 	{
 		dbg_api("%d, %#lx", MajorID, Handler);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return -EINVAL;
 
-		DriverObject *drv = &itr->second;
 		foreach (auto &i in * drv->InterruptHandlers)
 		{
 			Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))Handler, i.first);
@@ -418,25 +403,22 @@ namespace Driver
 	{
 		dbg_api("%d, %d", MajorID, Pages);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-		auto itr = Drivers.find(MajorID);
-		assert(itr != Drivers.end());
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		assert(drv != nullptr);
 
-		return itr->second.vma->RequestPages(Pages);
+		return drv->vma->RequestPages(Pages);
 	}
 
 	void FreePages(dev_t MajorID, void *Pointer, size_t Pages)
 	{
 		dbg_api("%d, %#lx, %d", MajorID, Pointer, Pages);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		assert(itr != Drivers.end());
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		assert(drv != nullptr);
 
-		itr->second.vma->FreePages(Pointer, Pages);
+		drv->vma->FreePages(Pointer, Pages);
 	}
 
 	/* --------- */
@@ -550,11 +532,9 @@ namespace Driver
 	{
 		dbg_api("%d, %#lx, %#lx", MajorID, _Vendors, _Devices);
 
-		std::unordered_map<dev_t, DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(MajorID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->DriversLock);
+		DriverObject *drv = DriverManager->GetDriver(MajorID);
+		if (drv == nullptr)
 			return nullptr;
 
 		std::list<uint16_t> VendorIDs;
@@ -569,7 +549,7 @@ namespace Driver
 		if (Devices.empty())
 			return nullptr;
 
-		Memory::VirtualMemoryArea *vma = itr->second.vma;
+		Memory::VirtualMemoryArea *vma = drv->vma;
 		__PCIArray *head = nullptr;
 		__PCIArray *array = nullptr;
 
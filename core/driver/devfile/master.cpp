@@ -32,15 +32,49 @@ using namespace vfs;
 
 namespace Driver
 {
+	SlaveDeviceFile *MasterDeviceFile::GetSlave(maj_t ID, min_t MinorID)
+	{
+		SmartReadLock(SlavesLock);
+		auto itr = this->SlavesMap.find(ID);
+		if (itr == this->SlavesMap.end())
+			return nullptr;
+
+		Slaves slave = itr->second;
+		auto sdf = slave->find(MinorID);
+		if (sdf == slave->end())
+			return nullptr;
+		sdf->second->Users++;
+		return sdf->second;
+	}
+
+	SlaveDeviceFile *MasterDeviceFile::GetFirstSlave()
+	{
+		SmartReadLock(SlavesLock);
+		if (this->SlavesMap.empty())
+			return nullptr;
+		SlaveDeviceFile *sdf = this->SlavesMap.begin()->second->begin()->second;
+		sdf->Users++;
+		return sdf;
+	}
+
+	void MasterDeviceFile::PutSlave(SlaveDeviceFile *sdf)
+	{
+		sdf->Users--;
+	}
+
 	int MasterDeviceFile::open(int Flags, mode_t Mode)
 	{
 		switch (this->DeviceType)
 		{
 		default:
-			if (this->SlavesMap.empty())
+		{
+			SlaveDeviceFile *sdf = this->GetFirstSlave();
+			if (sdf == nullptr)
 				return -ENOSYS;
-			Slaves slave = this->SlavesMap.begin()->second;
-			return slave->begin()->second->open(Flags, Mode);
+			int ret = sdf->open(Flags, Mode);
+			this->PutSlave(sdf);
+			return ret;
+		}
 		}
 	}
 
@@ -49,10 +83,14 @@ namespace Driver
 		switch (this->DeviceType)
 		{
 		default:
-			if (this->SlavesMap.empty())
+		{
+			SlaveDeviceFile *sdf = this->GetFirstSlave();
+			if (sdf == nullptr)
 				return -ENOSYS;
-			Slaves slave = this->SlavesMap.begin()->second;
-			return slave->begin()->second->close();
+			int ret = sdf->close();
+			this->PutSlave(sdf);
+			return ret;
+		}
 		}
 	}
 
@@ -64,29 +102,25 @@ namespace Driver
 		{
 		case ddt_Keyboard:
 		{
-			while (KeyQueue.empty())
-				TaskManager->Yield();
-
 			/* Request scancode */
 			if (Size == 2 && Buffer[1] == 0x00)
 			{
-				while (RawKeyQueue.empty())
-					TaskManager->Yield();
-
-				Buffer[0] = RawKeyQueue.front();
-				RawKeyQueue.pop_front();
+				RawKeyQueue.PopWait(Buffer[0]);
 				return 1;
 			}
 
-			Buffer[0] = KeyQueue.front();
-			KeyQueue.pop_front();
+			KeyQueue.PopWait(Buffer[0]);
 			return 1;
 		}
 		default:
-			if (this->SlavesMap.empty())
+		{
+			SlaveDeviceFile *sdf = this->GetFirstSlave();
+			if (sdf == nullptr)
 				return 0;
-			Slaves slave = this->SlavesMap.begin()->second;
-			return slave->begin()->second->read(Buffer, Size, Offset);
+			size_t ret = sdf->read(Buffer, Size, Offset);
+			this->PutSlave(sdf);
+			return ret;
+		}
 		}
 	}
 
@@ -97,10 +131,14 @@ namespace Driver
 		switch (this->DeviceType)
 		{
 		default:
-			if (this->SlavesMap.empty())
+		{
+			SlaveDeviceFile *sdf = this->GetFirstSlave();
+			if (sdf == nullptr)
 				return 0;
-			Slaves slave = this->SlavesMap.begin()->second;
-			return slave->begin()->second->write(Buffer, Size, Offset);
+			size_t ret = sdf->write(Buffer, Size, Offset);
+			this->PutSlave(sdf);
+			return ret;
+		}
 		}
 	}
 
@@ -110,19 +148,24 @@ namespace Driver
 		switch (this->DeviceType)
 		{
 		default:
-			if (this->SlavesMap.empty())
+		{
+			SlaveDeviceFile *sdf = this->GetFirstSlave();
+			if (sdf == nullptr)
 				return -ENOSYS;
-			Slaves slave = this->SlavesMap.begin()->second;
-			return slave->begin()->second->ioctl(Request, Argp);
+			int ret = sdf->ioctl(Request, Argp);
+			this->PutSlave(sdf);
+			return ret;
+		}
 		}
 	}
 
 	void MasterDeviceFile::ClearBuffers()
 	{
-		this->RawKeyQueue.clear();
-		this->KeyQueue.clear();
+		this->RawKeyQueue.Clear();
+		this->KeyQueue.Clear();
 		/* ... */
 
+		SmartReadLock(SlavesLock);
 		foreach (auto &sm in this->SlavesMap)
 		{
 			Slaves slave = sm.second;
@@ -134,22 +177,14 @@ namespace Driver
 	int MasterDeviceFile::ReportKeyEvent(maj_t ID, min_t MinorID, uint8_t ScanCode)
 	{
 		debug("New key event: %02x", ScanCode);
-		if (this->SlavesMap.find(ID) == this->SlavesMap.end())
-			return -EINVAL;
-
-		std::unordered_map<min_t, SlaveDeviceFile *> *slave = this->SlavesMap[ID];
-		if ((*slave).find(MinorID) == (*slave).end())
+		SlaveDeviceFile *sdf = this->GetSlave(ID, MinorID);
+		if (sdf == nullptr)
 			return -EINVAL;
 
 		/* We are master, keep a copy of the scancode and
 			converted key */
 
-		if (RawKeyQueue.size() > 16)
-			RawKeyQueue.pop_front();
-		RawKeyQueue.push_back(ScanCode);
-
-		if (KeyQueue.size() > 16)
-			KeyQueue.pop_front();
+		RawKeyQueue.Push(ScanCode);
 
 		switch (ScanCode & ~KEY_PRESSED)
 		{
@@ -173,10 +208,11 @@ namespace Driver
 		}
 
 		if (ScanCode & KEY_PRESSED)
-			KeyQueue.push_back(GetScanCode(ScanCode, UpperCase || CapsLock));
+			KeyQueue.Push(GetScanCode(ScanCode, UpperCase || CapsLock));
 
-		SlaveDeviceFile *sdf = (*slave)[MinorID];
-		return sdf->ReportKeyEvent(ScanCode);
+		int ret = sdf->ReportKeyEvent(ScanCode);
+		this->PutSlave(sdf);
+		return ret;
 	}
 
 	int MasterDeviceFile::ReportMouseEvent(maj_t ID, min_t MinorID,
@@ -196,90 +232,104 @@ namespace Driver
 	int MasterDeviceFile::NewBlock(maj_t ID, min_t MinorID, drvOpen_t Open, drvClose_t Close,
 								   drvRead_t Read, drvWrite_t Write, drvIoctl_t Ioctl)
 	{
-		assert(this->SlavesMap.find(ID) != this->SlavesMap.end());
-		Slaves slave = this->SlavesMap[ID];
-		assert((*slave).find(MinorID) != (*slave).end());
-		SlaveDeviceFile *sdf = (*slave)[MinorID];
+		SlaveDeviceFile *sdf = this->GetSlave(ID, MinorID);
+		assert(sdf != nullptr);
 		sdf->Open = Open;
 		sdf->Close = Close;
 		sdf->Read = Read;
 		sdf->Write = Write;
 		sdf->Ioctl = Ioctl;
+		this->PutSlave(sdf);
 		return 0;
 	}
 
 	int MasterDeviceFile::NewAudio(maj_t ID, min_t MinorID, drvOpen_t Open, drvClose_t Close,
 								   drvRead_t Read, drvWrite_t Write, drvIoctl_t Ioctl)
 	{
-		assert(this->SlavesMap.find(ID) != this->SlavesMap.end());
-		Slaves slave = this->SlavesMap[ID];
-		assert((*slave).find(MinorID) != (*slave).end());
-		SlaveDeviceFile *sdf = (*slave)[MinorID];
+		SlaveDeviceFile *sdf = this->GetSlave(ID, MinorID);
+		assert(sdf != nullptr);
 		sdf->Open = Open;
 		sdf->Close = Close;
 		sdf->Read = Read;
 		sdf->Write = Write;
 		sdf->Ioctl = Ioctl;
+		this->PutSlave(sdf);
 		return 0;
 	}
 
 	int MasterDeviceFile::NewNet(maj_t ID, min_t MinorID, drvOpen_t Open, drvClose_t Close,
 								 drvRead_t Read, drvWrite_t Write, drvIoctl_t Ioctl)
 	{
-		assert(this->SlavesMap.find(ID) != this->SlavesMap.end());
-		Slaves slave = this->SlavesMap[ID];
-		assert((*slave).find(MinorID) != (*slave).end());
-		SlaveDeviceFile *sdf = (*slave)[MinorID];
+		SlaveDeviceFile *sdf = this->GetSlave(ID, MinorID);
+		assert(sdf != nullptr);
 		sdf->Open = Open;
 		sdf->Close = Close;
 		sdf->Read = Read;
 		sdf->Write = Write;
 		sdf->Ioctl = Ioctl;
+		this->PutSlave(sdf);
 		return 0;
 	}
 
 	dev_t MasterDeviceFile::Register(maj_t ID)
 	{
 		debug("Registering slave device %d", ID);
-		Slaves slave;
-		if (this->SlavesMap.find(ID) != this->SlavesMap.end())
-			slave = this->SlavesMap[ID];
-		else
-			slave = new std::unordered_map<min_t, SlaveDeviceFile *>();
+		min_t MinorID = this->SlaveIDCounter.fetch_add(1);
 
+		/* Creating the node takes the vfs lock, do it first */
 		char name[24];
-		sprintf(name, "%s%ld", this->SlaveName, this->SlaveIDCounter);
+		sprintf(name, "%s%ld", this->SlaveName, MinorID);
 		SlaveDeviceFile *sdf = new SlaveDeviceFile(name,
 												   this->SlaveParent,
 												   this->DeviceType,
 												   this->Type);
 
 		sdf->DeviceMajor = ID;
-		sdf->DeviceMinor = this->SlaveIDCounter;
+		sdf->DeviceMinor = MinorID;
+
+		CriticalSection cs;
+		SmartWriteLock(SlavesLock);
+		Slaves slave;
+		if (this->SlavesMap.find(ID) != this->SlavesMap.end())
+			slave = this->SlavesMap[ID];
+		else
+			slave = new std::unordered_map<min_t, SlaveDeviceFile *>();
 
-		(*slave)[this->SlaveIDCounter] = sdf;
+		(*slave)[MinorID] = sdf;
 		this->SlavesMap[ID] = slave;
-		return this->SlaveIDCounter++;
+		return MinorID;
 	}
 
 	int MasterDeviceFile::Unregister(maj_t ID, min_t MinorID)
 	{
 		debug("Unregistering slave device %d:%d", ID, MinorID);
-		if (this->SlavesMap.find(ID) == this->SlavesMap.end())
-			return -EINVAL;
+		SlaveDeviceFile *sdf;
+		Slaves Empty = nullptr;
+		{
+			CriticalSection cs;
+			SmartWriteLock(SlavesLock);
+			if (this->SlavesMap.find(ID) == this->SlavesMap.end())
+				return -EINVAL;
+
+			std::unordered_map<min_t, SlaveDeviceFile *> *slave = this->SlavesMap[ID];
+			if ((*slave).find(MinorID) == (*slave).end())
+				return -EINVAL;
+
+			sdf = (*slave)[MinorID];
+			slave->erase(MinorID);
+			if (slave->empty())
+			{
+				Empty = slave;
+				this->SlavesMap.erase(ID);
+			}
+		}
 
-		std::unordered_map<min_t, SlaveDeviceFile *> *slave = this->SlavesMap[ID];
-		if ((*slave).find(MinorID) == (*slave).end())
-			return -EINVAL;
+		/* Unlinked, wait for the lookups that found it before */
+		while (sdf->Users.load() > 0)
+			TaskManager->Yield();
 
-		SlaveDeviceFile *sdf = (*slave)[MinorID];
 		delete sdf;
-		slave->erase(MinorID);
-		if (slave->empty())
-		{
-			delete slave;
-			this->SlavesMap.erase(ID);
-		}
+		delete Empty;
 		return 0;
 	}
 
@@ -63,11 +63,7 @@ namespace Driver
 		{
 		case ddt_Keyboard:
 		{
-			while (KeyQueue.empty())
-				TaskManager->Yield();
-
-			Buffer[0] = KeyQueue.front();
-			KeyQueue.pop_front();
+			KeyQueue.PopWait(Buffer[0]);
 			return 1;
 		}
 		default:
@@ -107,15 +103,13 @@ namespace Driver
 
 	void SlaveDeviceFile::ClearBuffers()
 	{
-		KeyQueue.clear();
+		KeyQueue.Clear();
 		/* ... */
 	}
 
 	int SlaveDeviceFile::ReportKeyEvent(uint8_t ScanCode)
 	{
-		if (KeyQueue.size() > 16)
-			KeyQueue.pop_front();
-		KeyQueue.push_back(ScanCode);
+		KeyQueue.Push(ScanCode);
 		return 0;
 	}
 
@@ -32,6 +32,14 @@ using namespace vfs;
 
 namespace Driver
 {
+	DriverObject *Manager::GetDriver(dev_t MajorID)
+	{
+		auto itr = Drivers.find(MajorID);
+		if (itr == Drivers.end())
+			return nullptr;
+		return &itr->second;
+	}
+
 	void Manager::LoadAllDrivers()
 	{
 		if (Drivers.empty())
@@ -141,7 +149,13 @@ namespace Driver
 				}
 				Drv->InterruptHandlers->clear();
 			}
+		}
 
+		/* API calls use the driver under the read lock */
+		SmartWriteLock(DriversLock);
+		foreach (auto &var in Drivers)
+		{
+			DriverObject *Drv = &var.second;
 			delete Drv->vma, Drv->vma = nullptr;
 			delete Drv->InterruptHandlers, Drv->InterruptHandlers = nullptr;
 		}
@@ -550,12 +564,16 @@ namespace Driver
 			}
 			delete rDrv;
 
+			std::unordered_map<uint8_t, void *> *Handlers =
+				new std::unordered_map<uint8_t, void *>;
+
+			SmartWriteLock(DriversLock);
 			Drivers[MajorIDCounter++] = {
 				.BaseAddress = BaseAddress,
 				.EntryPoint = EntryPoint,
 				.vma = dVma,
 				.Path = drvNode->FullPath,
-				.InterruptHandlers = new std::unordered_map<uint8_t, void *>};
+				.InterruptHandlers = Handlers};
 
 			dev_t countr = MajorIDCounter - 1;
 			const char *drvName;
@@ -20,6 +20,7 @@
 #include <syscalls.hpp>
 #include <acpi.hpp>
 #include <smp.hpp>
+#include <rcu.hpp>
 #include <vector>
 #include <io.h>
 
@@ -71,40 +72,29 @@ namespace Interrupts
 		 */
 		void *Context;
 
-		/**
-		 * Priority of the event
-		 *
-		 * Used for sorting the events.
-		 *
-		 * This is incremented every time the event is called.
-		 *
-		 * This will improve performance by reducing the time
-		 * spent on searching for the event.
-		 */
-		unsigned long Priority;
-
 		/**
 		 * If this is true, the event is critical.
 		 *
 		 * This will make sure that the event will not be
-		 * removed by the kernel.
+		 * skipped by the kernel after a panic.
 		 *
 		 * This is used to prevent the kernel from removing
 		 * ACPI related handlers. (SCI interrupts)
 		 */
 		bool Critical;
 	};
-	std::list<Event> RegisteredEvents;
 
-#ifdef DEBUG
-#define SORT_DIVIDER 10
-#else
-#define SORT_DIVIDER 1
-#endif
+	struct EventTable : RCU::Head
+	{
+		std::list<Event> Events;
+	};
 
-#define SORT_START 10000
-	std::atomic_uint SortEvents = SORT_START / SORT_DIVIDER;
-	constexpr uint32_t SORT_ITR = (SORT_START * 100) / SORT_DIVIDER;
+	/* Read by every interrupt under RCU, writers publish a copy */
+	std::atomic<EventTable *> RegisteredEvents = nullptr;
+	/* Serializes the writers */
+	NewLock(EventsLock);
+	/* Set on panic, only critical events run after that */
+	static std::atomic_bool CriticalOnly = false;
 
 #if defined(a86)
 	/* APIC::APIC */ void *apic[MAX_CPU] = {nullptr};
@@ -112,6 +102,30 @@ namespace Interrupts
 #elif defined(aa64)
 #endif
 
+	static void FreeEvents(RCU::Head *Rcu)
+	{
+		delete static_cast<EventTable *>(Rcu);
+	}
+
+	/* Caller must hold EventsLock */
+	static EventTable *CopyEvents()
+	{
+		EventTable *Table = new EventTable;
+		EventTable *Old = RegisteredEvents.load(std::memory_order_relaxed);
+		if (Old)
+			Table->Events = Old->Events;
+		return Table;
+	}
+
+	/* Caller must hold EventsLock */
+	static void PublishEvents(EventTable *Table)
+	{
+		EventTable *Old = RegisteredEvents.load(std::memory_order_relaxed);
+		RCU::Assign(RegisteredEvents, Table);
+		if (Old)
+			RCU::Call(Old, FreeEvents);
+	}
+
 	void Initialize(int Core)
 	{
 #if defined(a64)
@@ -194,20 +208,19 @@ namespace Interrupts
 
 	nsa void RemoveAll()
 	{
-		forItr(itr, RegisteredEvents)
-		{
-			if (itr->Critical)
-				continue;
-			RegisteredEvents.erase(itr);
-		}
+		/* Runs in the panic handler, must not lock or allocate */
+		CriticalOnly.store(true, std::memory_order_release);
 	}
 
 	void AddHandler(void (*Callback)(CPU::TrapFrame *),
 					int InterruptNumber,
 					void *ctx, bool Critical)
 	{
+		SmartLock(EventsLock);
+		EventTable *Table = CopyEvents();
+
 		/* Just log a warning if the interrupt is already registered. */
-		foreach (auto ev in RegisteredEvents)
+		foreach (auto ev in Table->Events)
 		{
 			if (ev.IRQ == InterruptNumber &&
 				ev.Callback == Callback)
@@ -223,61 +236,101 @@ namespace Interrupts
 			 false,			  /* IsHandler */
 			 Callback,		  /* Callback */
 			 ctx,			  /* Context */
-			 0,				  /* Priority */
 			 Critical};		  /* Critical */
-		RegisteredEvents.push_back(newEvent);
+		Table->Events.push_back(newEvent);
+		PublishEvents(Table);
 		debug("Registered interrupt handler for IRQ%d to %#lx",
 			  InterruptNumber, Callback);
 	}
 
+	/* Called once a handler is unpublished, its code or
+		object may go away as soon as the caller returns */
+	static void WaitForHandlers()
+	{
+		RCU::Synchronize();
+	}
+
 	void RemoveHandler(void (*Callback)(CPU::TrapFrame *), int InterruptNumber)
 	{
-		forItr(itr, RegisteredEvents)
 		{
-			if (itr->IRQ == InterruptNumber &&
-				itr->Callback == Callback)
+			SmartLock(EventsLock);
+			EventTable *Table = CopyEvents();
+			bool Found = false;
+			forItr(itr, Table->Events)
+			{
+				if (itr->IRQ == InterruptNumber &&
+					itr->Callback == Callback)
+				{
+					Table->Events.erase(itr);
+					Found = true;
+					break;
+				}
+			}
+
+			if (!Found)
 			{
-				RegisteredEvents.erase(itr);
-				debug("Unregistered interrupt handler for IRQ%d to %#lx",
-					  InterruptNumber, Callback);
+				delete Table;
+				warn("Event %d not found.", InterruptNumber);
 				return;
 			}
+
+			PublishEvents(Table);
+			debug("Unregistered interrupt handler for IRQ%d to %#lx",
+				  InterruptNumber, Callback);
 		}
-		warn("Event %d not found.", InterruptNumber);
+		WaitForHandlers();
 	}
 
 	void RemoveHandler(void (*Callback)(CPU::TrapFrame *))
 	{
-		forItr(itr, RegisteredEvents)
 		{
-			if (itr->Callback == Callback)
+			SmartLock(EventsLock);
+			EventTable *Table = CopyEvents();
+			size_t Removed = Table->Events.remove_if([Callback](const Event &ev)
+													 {
+				if (ev.Callback != Callback)
+					return false;
+				debug("Removing handle %d %#lx", ev.IRQ,
+					  ev.IsHandler
+						  ? ev.Data
+						  : (void *)ev.Callback);
+				return true; });
+
+			if (Removed == 0)
 			{
-				debug("Removing handle %d %#lx", itr->IRQ,
-					  itr->IsHandler
-						  ? itr->Data
-						  : (void *)itr->Callback);
-
-				RegisteredEvents.erase(itr);
+				delete Table;
+				warn("Handle not found.");
+				return;
 			}
+			PublishEvents(Table);
 		}
-		warn("Handle not found.");
+		WaitForHandlers();
 	}
 
 	void RemoveHandler(int InterruptNumber)
 	{
-		forItr(itr, RegisteredEvents)
 		{
-			if (itr->IRQ == InterruptNumber)
+			SmartLock(EventsLock);
+			EventTable *Table = CopyEvents();
+			size_t Removed = Table->Events.remove_if([InterruptNumber](const Event &ev)
+													 {
+				if (ev.IRQ != InterruptNumber)
+					return false;
+				debug("Removing handle %d %#lx", ev.IRQ,
+					  ev.IsHandler
+						  ? ev.Data
+						  : (void *)ev.Callback);
+				return true; });
+
+			if (Removed == 0)
 			{
-				debug("Removing handle %d %#lx", itr->IRQ,
-					  itr->IsHandler
-						  ? itr->Data
-						  : (void *)itr->Callback);
-
-				RegisteredEvents.erase(itr);
+				delete Table;
+				warn("IRQ%d not found.", InterruptNumber);
+				return;
 			}
+			PublishEvents(Table);
 		}
-		warn("IRQ%d not found.", InterruptNumber);
+		WaitForHandlers();
 	}
 
 	extern "C" nsa void MainInterruptHandler(void *Data)
@@ -298,32 +351,42 @@ namespace Interrupts
 		if (unlikely(Frame->InterruptNumber == CPU::x86::IRQ31))
 			CPU::Stop();
 
+		RCU::InterruptEnter();
 		bool InterruptHandled = false;
 		int iEvNum = -1;
-		foreach (auto &ev in RegisteredEvents)
+		RCU::ReadLock();
+		EventTable *Table = RCU::Dereference(RegisteredEvents);
+		if (likely(Table))
 		{
-			iEvNum = ev.IRQ;
+			bool OnlyCritical = CriticalOnly.load(std::memory_order_acquire);
+			foreach (auto &ev in Table->Events)
+			{
+				if (unlikely(OnlyCritical && !ev.Critical))
+					continue;
+
+				iEvNum = ev.IRQ;
 #if defined(a86)
-			iEvNum += CPU::x86::IRQ0;
+				iEvNum += CPU::x86::IRQ0;
 #endif
-			if (iEvNum == s_cst(int, Frame->InterruptNumber))
-			{
-				if (ev.IsHandler)
-				{
-					Handler *hnd = (Handler *)ev.Data;
-					hnd->OnInterruptReceived(Frame);
-				}
-				else
+				if (iEvNum == s_cst(int, Frame->InterruptNumber))
 				{
-					if (ev.Context != nullptr)
-						ev.Callback((CPU::TrapFrame *)ev.Context);
+					if (ev.IsHandler)
+					{
+						Handler *hnd = (Handler *)ev.Data;
+						hnd->OnInterruptReceived(Frame);
+					}
 					else
-						ev.Callback(Frame);
+					{
+						if (ev.Context != nullptr)
+							ev.Callback((CPU::TrapFrame *)ev.Context);
+						else
+							ev.Callback(Frame);
+					}
+					InterruptHandled = true;
 				}
-				ev.Priority++;
-				InterruptHandled = true;
 			}
 		}
+		RCU::ReadUnlock();
 
 		CPUData *CoreData = GetCurrentCPU();
 		int Core = CoreData->ID;
@@ -334,30 +397,7 @@ namespace Interrupts
 				  Frame->InterruptNumber - 32, Core);
 		}
 
-		/* TODO: This should be done when the os is idle */
-		if (SortEvents++ > SORT_ITR)
-		{
-			debug("Sorting events");
-			SortEvents = 0;
-			RegisteredEvents.sort([](const Event &a, const Event &b)
-								  { return a.Priority < b.Priority; });
-
-#ifdef DEBUG
-			foreach (auto ev in RegisteredEvents)
-			{
-				void *func = ev.IsHandler
-								 ? ev.Data
-								 : (void *)ev.Callback;
-				const char *symbol = ev.IsHandler
-										 ? "class"
-										 : KernelSymbolTable->GetSymbol((uintptr_t)func);
-
-				debug("Event IRQ%d [%#lx %s] has priority %ld",
-					  ev.IRQ, func, symbol, ev.Priority);
-			}
-#endif
-		}
-
+		RCU::InterruptExit();
 		if (likely(apic[Core]))
 		{
 			APIC::APIC *this_apic = (APIC::APIC *)apic[Core];
@@ -375,7 +415,9 @@ namespace Interrupts
 
 	Handler::Handler(int InterruptNumber, bool Critical)
 	{
-		foreach (auto ev in RegisteredEvents)
+		SmartLock(EventsLock);
+		EventTable *Table = CopyEvents();
+		foreach (auto ev in Table->Events)
 		{
 			if (ev.IRQ == InterruptNumber)
 			{
@@ -392,9 +434,9 @@ namespace Interrupts
 			 true,			  /* IsHandler */
 			 nullptr,		  /* Callback */
 			 nullptr,		  /* Context */
-			 0,				  /* Priority */
 			 Critical};		  /* Critical */
-		RegisteredEvents.push_back(newEvent);
+		Table->Events.push_back(newEvent);
+		PublishEvents(Table);
 		debug("Registered interrupt handler for IRQ%d.",
 			  InterruptNumber);
 	}
@@ -416,15 +458,31 @@ namespace Interrupts
 		debug("Unregistering interrupt handler for IRQ%d.",
 			  this->InterruptNumber);
 
-		forItr(itr, RegisteredEvents)
 		{
-			if (itr->IRQ == this->InterruptNumber)
+			SmartLock(EventsLock);
+			EventTable *Table = CopyEvents();
+			bool Found = false;
+			forItr(itr, Table->Events)
 			{
-				RegisteredEvents.erase(itr);
+				if (itr->IRQ == this->InterruptNumber)
+				{
+					Table->Events.erase(itr);
+					Found = true;
+					break;
+				}
+			}
+
+			if (!Found)
+			{
+				delete Table;
+				warn("Event %d not found.", this->InterruptNumber);
 				return;
 			}
+			PublishEvents(Table);
 		}
-		warn("Event %d not found.", this->InterruptNumber);
+
+		/* OnInterruptReceived may still be running on another core */
+		WaitForHandlers();
 	}
 
 	void Handler::OnInterruptReceived(CPU::TrapFrame *Frame)
@@ -18,6 +18,7 @@
 #include <lock.hpp>
 
 #include <debug.h>
+#include <topn.hpp>
 #include <smp.hpp>
 
 #include "../kernel.h"
@@ -94,6 +95,166 @@ std::atomic_size_t LocksCount = 0;
 
 size_t GetLocksCount() { return LocksCount.load(); }
 
+namespace LockStat
+{
+	/* Keyed by Lock, Function is only trusted once Ready is set */
+	struct Site
+	{
+		std::atomic_uintptr_t Lock;
+		const char *Function;
+		std::atomic_bool Ready;
+		std::atomic_uint64_t Acquired;
+		std::atomic_uint64_t Contended;
+		std::atomic_uint64_t WaitCycles;
+		std::atomic_uint64_t MaxWait;
+		std::atomic_uint64_t HoldCycles;
+		std::atomic_uint64_t MaxHold;
+	};
+
+	/* Static, the table itself must not take any lock */
+	static Site Sites[LOCKSTAT_SITES];
+	static std::atomic_size_t Dropped = 0;
+	bool Enabled = false;
+
+	static inline void UpdateMax(std::atomic_uint64_t &Max, uint64_t Value)
+	{
+		uint64_t Current = Max.load(std::memory_order_relaxed);
+		while (Current < Value &&
+			   !Max.compare_exchange_weak(Current, Value,
+										  std::memory_order_relaxed))
+			;
+	}
+
+	static Site *GetSite(uintptr_t Lock, const char *Function)
+	{
+		/* One lock taken from several functions gets one site each */
+		size_t Start = HashPointer(Lock ^ (uintptr_t)Function) % LOCKSTAT_SITES;
+		for (size_t i = 0; i < LOCKSTAT_PROBES; i++)
+		{
+			Site *s = &Sites[(Start + i) % LOCKSTAT_SITES];
+			uintptr_t Current = s->Lock.load(std::memory_order_acquire);
+			if (Current == 0 &&
+				s->Lock.compare_exchange_strong(Current, Lock,
+												std::memory_order_acq_rel))
+			{
+				s->Function = Function;
+				s->Ready.store(true, std::memory_order_release);
+				return s;
+			}
+
+			/* A half claimed slot is skipped, never waited on. The
+			   claimer may be the code we interrupted. */
+			if (Current == Lock &&
+				s->Ready.load(std::memory_order_acquire) &&
+				s->Function == Function)
+				return s;
+		}
+		return nullptr;
+	}
+
+	Site *Acquired(const void *Lock, const char *Function,
+				   uint64_t Wait, bool Contended)
+	{
+		Site *s = GetSite((uintptr_t)Lock, Function);
+		if (unlikely(s == nullptr))
+		{
+			Dropped++;
+			return nullptr;
+		}
+
+		s->Acquired.fetch_add(1, std::memory_order_relaxed);
+		if (Contended)
+			s->Contended.fetch_add(1, std::memory_order_relaxed);
+		s->WaitCycles.fetch_add(Wait, std::memory_order_relaxed);
+		UpdateMax(s->MaxWait, Wait);
+		return s;
+	}
+
+	void Released(Site *s, uint64_t Hold)
+	{
+		s->HoldCycles.fetch_add(Hold, std::memory_order_relaxed);
+		UpdateMax(s->MaxHold, Hold);
+	}
+
+	void Enable()
+	{
+		__atomic_store_n(&Enabled, true, __ATOMIC_RELEASE);
+		trace("Lock statistics enabled");
+	}
+
+	void Disable()
+	{
+		__atomic_store_n(&Enabled, false, __ATOMIC_RELEASE);
+		trace("Lock statistics disabled, %ld dropped", Dropped.load());
+	}
+
+	void Reset()
+	{
+		/* Keys stay, held locks may still point at their site */
+		for (size_t i = 0; i < LOCKSTAT_SITES; i++)
+		{
+			Site *s = &Sites[i];
+			s->Acquired.store(0, std::memory_order_relaxed);
+			s->Contended.store(0, std::memory_order_relaxed);
+			s->WaitCycles.store(0, std::memory_order_relaxed);
+			s->MaxWait.store(0, std::memory_order_relaxed);
+			s->HoldCycles.store(0, std::memory_order_relaxed);
+			s->MaxHold.store(0, std::memory_order_relaxed);
+		}
+		Dropped.store(0);
+	}
+
+	size_t GetDropped() { return Dropped.load(); }
+
+	size_t GetSites(LockStatSite *Output, size_t Max)
+	{
+		if (Max == 0)
+			return 0;
+
+		size_t Count = 0;
+		for (size_t i = 0; i < LOCKSTAT_SITES; i++)
+		{
+			Site *s = &Sites[i];
+			if (!s->Ready.load(std::memory_order_acquire))
+				continue;
+
+			LockStatSite Entry;
+			Entry.Lock = s->Lock.load(std::memory_order_relaxed);
+			Entry.Function = s->Function;
+			Entry.Acquired = s->Acquired.load(std::memory_order_relaxed);
+			if (Entry.Acquired == 0)
+				continue;
+			Entry.Contended = s->Contended.load(std::memory_order_relaxed);
+			Entry.WaitCycles = s->WaitCycles.load(std::memory_order_relaxed);
+			Entry.MaxWait = s->MaxWait.load(std::memory_order_relaxed);
+			Entry.HoldCycles = s->HoldCycles.load(std::memory_order_relaxed);
+			Entry.MaxHold = s->MaxHold.load(std::memory_order_relaxed);
+
+			/* Total wait ranks a busy short lock next to a rare long one */
+			Count = InsertTop(Output, Count, Max, Entry, &LockStatSite::WaitCycles);
+		}
+		return Count;
+	}
+}
+
+/* Force unlock can come from another thread, it drops the owner's count */
+static inline Tasking::TCB *CountHeld()
+{
+	if (unlikely(TaskManager == nullptr))
+		return nullptr;
+
+	Tasking::TCB *Thread = thisThread;
+	if (likely(Thread != nullptr))
+		__atomic_add_fetch(&Thread->HeldLocks, 1, __ATOMIC_RELAXED);
+	return Thread;
+}
+
+static inline void UncountHeld(Tasking::TCB *Thread)
+{
+	if (Thread != nullptr)
+		__atomic_sub_fetch(&Thread->HeldLocks, 1, __ATOMIC_RELAXED);
+}
+
 void LockClass::Yield()
 {
 	if (CPU::Interrupts(CPU::Check) &&
@@ -148,14 +309,21 @@ void LockClass::DeadLock(SpinLockData &Lock)
 
 int LockClass::Lock(const char *FunctionName)
 {
+#ifdef DEBUG
 	LockData.AttemptingToGet = FunctionName;
 	LockData.StackPointerAttempt = (uintptr_t)__builtin_frame_address(0);
+#endif
 
+	uint64_t Start = LockStat::Begin();
+	bool Contended = false;
 Retry:
+	/* Only write the line once it looks free */
 	int i = 0;
-	while (IsLocked.exchange(true, std::memory_order_acquire) &&
-		   ++i < DEADLOCK_TIMEOUT)
+	while (++i < DEADLOCK_TIMEOUT &&
+		   (IsLocked.load(std::memory_order_relaxed) ||
+			IsLocked.exchange(true, std::memory_order_acquire)))
 	{
+		Contended = true;
 		this->Yield();
 	}
 
@@ -164,7 +332,9 @@ Retry:
 		DeadLock(LockData);
 		goto Retry;
 	}
+	LockStat::End(Stat, this, FunctionName, Start, Contended);
 
+#ifdef DEBUG
 	LockData.Count.fetch_add(1);
 	LockData.CurrentHolder.store(FunctionName);
 	LockData.StackPointerHolder.store((uintptr_t)__builtin_frame_address(0));
@@ -174,7 +344,9 @@ Retry:
 		LockData.Core.store(CoreData->ID);
 
 	LocksCount.fetch_add(1);
+#endif
 
+	Owner.store(CountHeld(), std::memory_order_relaxed);
 	__sync;
 	return 0;
 }
@@ -183,9 +355,14 @@ int LockClass::Unlock()
 {
 	__sync;
 
+	LockStat::Drop(Stat);
+	Tasking::TCB *Holder = Owner.exchange(nullptr, std::memory_order_relaxed);
 	IsLocked.store(false, std::memory_order_release);
+	UncountHeld(Holder);
+#ifdef DEBUG
 	LockData.Count.fetch_sub(1);
 	LocksCount.fetch_sub(1);
+#endif
 
 	return 0;
 }
@@ -225,15 +402,21 @@ int LockClass::TimeoutLock(const char *FunctionName, uint64_t Timeout)
 	if (!TimeManager)
 		return Lock(FunctionName);
 
+#ifdef DEBUG
 	LockData.AttemptingToGet.store(FunctionName);
 	LockData.StackPointerAttempt.store((uintptr_t)__builtin_frame_address(0));
+#endif
 
 	std::atomic_uint64_t Target = 0;
+	uint64_t Start = LockStat::Begin();
+	bool Contended = false;
 Retry:
 	int i = 0;
-	while (IsLocked.exchange(true, std::memory_order_acquire) &&
-		   ++i < DEADLOCK_TIMEOUT)
+	while (++i < DEADLOCK_TIMEOUT &&
+		   (IsLocked.load(std::memory_order_relaxed) ||
+			IsLocked.exchange(true, std::memory_order_acquire)))
 	{
+		Contended = true;
 		this->Yield();
 	}
 
@@ -245,7 +428,9 @@ Retry:
 		TimeoutDeadLock(LockData, Target.load());
 		goto Retry;
 	}
+	LockStat::End(Stat, this, FunctionName, Start, Contended);
 
+#ifdef DEBUG
 	LockData.Count.fetch_add(1);
 	LockData.CurrentHolder.store(FunctionName);
 	LockData.StackPointerHolder.store((uintptr_t)__builtin_frame_address(0));
@@ -255,7 +440,353 @@ Retry:
 		LockData.Core.store(CoreData->ID);
 
 	LocksCount.fetch_add(1);
+#endif
 
+	Owner.store(CountHeld(), std::memory_order_relaxed);
 	__sync;
 	return 0;
 }
+
+/* Queued waiters pause and yield after waiting for long */
+static inline void QueueWait(unsigned int &Spins)
+{
+	CPU::Pause();
+	if (++Spins < LOCK_SPIN_LIMIT)
+		return;
+
+	Spins = 0;
+	if (CPU::Interrupts(CPU::Check) &&
+		TaskManager &&
+		!TaskManager->IsPanic())
+	{
+		TaskManager->Yield();
+	}
+}
+
+int TicketLock::Lock(const char *FunctionName)
+{
+	/* The holder may never give it back */
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	uint64_t Start = LockStat::Begin();
+	uint32_t Ticket = Next.fetch_add(1, std::memory_order_relaxed);
+	bool Contended = Serving.load(std::memory_order_acquire) != Ticket;
+	unsigned int Spins = 0;
+	while (Serving.load(std::memory_order_acquire) != Ticket)
+		QueueWait(Spins);
+	LockStat::End(Stat, this, FunctionName, Start, Contended);
+	return 0;
+}
+
+int TicketLock::Unlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	LockStat::Drop(Stat);
+	/* Only the holder writes Serving */
+	Serving.store(Serving.load(std::memory_order_relaxed) + 1,
+				  std::memory_order_release);
+	return 0;
+}
+
+int MCSLock::Lock(const char *FunctionName)
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	uint64_t Start = LockStat::Begin();
+	bool Contended = this->Acquire();
+	LockStat::End(Stat, this, FunctionName, Start, Contended);
+	return 0;
+}
+
+/* True if we had to queue */
+bool MCSLock::Acquire()
+{
+	while (true)
+	{
+		Node *Prev = Tail.load(std::memory_order_relaxed);
+		if (Prev == nullptr)
+		{
+			if (Tail.compare_exchange_strong(Prev, &Head,
+											 std::memory_order_acquire))
+				return false;
+			continue;
+		}
+
+		Node Self;
+		Self.Waiting.store(true, std::memory_order_relaxed);
+		if (!Tail.compare_exchange_strong(Prev, &Self,
+										  std::memory_order_acq_rel))
+			continue;
+
+		Prev->Next.store(&Self, std::memory_order_release);
+		unsigned int Spins = 0;
+		while (Self.Waiting.load(std::memory_order_acquire))
+			QueueWait(Spins);
+
+		/* Self goes away with this frame, move its place to Head */
+		Node *Succ = Self.Next.load(std::memory_order_acquire);
+		if (Succ == nullptr)
+		{
+			Head.Next.store(nullptr, std::memory_order_relaxed);
+			Node *Expected = &Self;
+			if (Tail.compare_exchange_strong(Expected, &Head,
+											 std::memory_order_acq_rel))
+				return true;
+
+			/* Someone queued behind us and is linking in */
+			while ((Succ = Self.Next.load(std::memory_order_acquire)) == nullptr)
+				CPU::Pause();
+		}
+		Head.Next.store(Succ, std::memory_order_release);
+		return true;
+	}
+}
+
+int MCSLock::Unlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	LockStat::Drop(Stat);
+
+	Node *Succ = Head.Next.load(std::memory_order_acquire);
+	if (Succ == nullptr)
+	{
+		Node *Expected = &Head;
+		if (Tail.compare_exchange_strong(Expected, nullptr,
+										 std::memory_order_release))
+			return 0;
+
+		while ((Succ = Head.Next.load(std::memory_order_acquire)) == nullptr)
+			CPU::Pause();
+	}
+	Succ->Waiting.store(false, std::memory_order_release);
+	return 0;
+}
+
+int RWLock::ReadLock(const char *FunctionName)
+{
+	UNUSED(FunctionName);
+
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	unsigned int Spins = 0;
+	while (true)
+	{
+		uint32_t Old = State.load(std::memory_order_relaxed);
+		if (!(Old & (RWLOCK_WRITER | RWLOCK_WAITING)) &&
+			State.compare_exchange_weak(Old, Old + 1,
+										std::memory_order_acquire))
+			return 0;
+		QueueWait(Spins);
+	}
+}
+
+int RWLock::ReadUnlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	State.fetch_sub(1, std::memory_order_release);
+	return 0;
+}
+
+int RWLock::WriteLock(const char *FunctionName)
+{
+	UNUSED(FunctionName);
+
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	unsigned int Spins = 0;
+	while (true)
+	{
+		/* Taking it drops the waiting bit, other writers set it again */
+		uint32_t Old = State.load(std::memory_order_relaxed);
+		if ((Old & ~RWLOCK_WAITING) == 0)
+		{
+			if (State.compare_exchange_weak(Old, RWLOCK_WRITER,
+											std::memory_order_acquire))
+				return 0;
+			continue;
+		}
+
+		if (!(Old & RWLOCK_WAITING))
+			State.fetch_or(RWLOCK_WAITING, std::memory_order_relaxed);
+		QueueWait(Spins);
+	}
+}
+
+bool RWLock::TryWriteLock()
+{
+	if (unlikely(ForceUnlock))
+		return true;
+
+	uint32_t Old = State.load(std::memory_order_relaxed);
+	if ((Old & ~RWLOCK_WAITING) != 0)
+		return false;
+	return State.compare_exchange_strong(Old, RWLOCK_WRITER,
+										 std::memory_order_acquire);
+}
+
+int RWLock::WriteUnlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	State.fetch_and(~RWLOCK_WRITER, std::memory_order_release);
+	return 0;
+}
+
+/* Called with Guard held and interrupts disabled, drops Guard */
+void RWSemaphore::Enqueue(Waiter &w, bool CanBlock)
+{
+	if (CanBlock &&
+		TaskManager &&
+		!TaskManager->IsPanic() &&
+		thisThread != nullptr)
+	{
+		w.Thread = thisThread;
+		w.Next = Waiters;
+		Waiters = &w;
+
+		/* Interrupts are off, the wake up cannot come before this */
+		w.Thread->Block();
+	}
+	Guard.Unlock();
+}
+
+void RWSemaphore::Sleep(Waiter &w)
+{
+	/* Too early or in an interrupt, spin instead */
+	if (w.Thread == nullptr)
+	{
+		CPU::Pause();
+		return;
+	}
+
+	TaskManager->Yield();
+
+	/* Woken by something else, leave the queue */
+	CriticalSection cs;
+	Guard.Lock(__FUNCTION__);
+	for (Waiter **p = &Waiters; *p; p = &(*p)->Next)
+	{
+		if (*p != &w)
+			continue;
+		*p = w.Next;
+		break;
+	}
+	Guard.Unlock();
+}
+
+/* Called with Guard held, waiters try again */
+void RWSemaphore::WakeAll()
+{
+	while (Waiters)
+	{
+		/* The waiter's frame may go away once it runs */
+		Waiter *w = Waiters;
+		Waiters = w->Next;
+		w->Thread->Unblock();
+	}
+}
+
+int RWSemaphore::ReadLock(const char *FunctionName)
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	uint64_t Start = LockStat::Begin();
+	bool Contended = false;
+	while (true)
+	{
+		Waiter w = {nullptr, nullptr};
+		{
+			CriticalSection cs;
+			Guard.Lock(__FUNCTION__);
+			if (!Writer && WritersWaiting == 0)
+			{
+				Readers++;
+				Guard.Unlock();
+				break;
+			}
+			this->Enqueue(w, cs.IsInterruptsEnabled());
+		}
+		Contended = true;
+		this->Sleep(w);
+	}
+
+	/* Readers overlap, so only the wait is charged */
+	if (unlikely(Start != 0))
+		LockStat::Acquired(this, FunctionName,
+						   CPU::Counter() - Start, Contended);
+	return 0;
+}
+
+int RWSemaphore::ReadUnlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	CriticalSection cs;
+	Guard.Lock(__FUNCTION__);
+	if (--Readers == 0)
+		this->WakeAll();
+	Guard.Unlock();
+	return 0;
+}
+
+int RWSemaphore::WriteLock(const char *FunctionName)
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	uint64_t Start = LockStat::Begin();
+	bool Queued = false;
+	while (true)
+	{
+		Waiter w = {nullptr, nullptr};
+		{
+			CriticalSection cs;
+			Guard.Lock(__FUNCTION__);
+			if (!Writer && Readers == 0)
+			{
+				Writer = true;
+				if (Queued)
+					WritersWaiting--;
+				Guard.Unlock();
+				LockStat::End(Stat, this, FunctionName, Start, Queued);
+				return 0;
+			}
+
+			/* Keep new readers out until we are in */
+			if (!Queued)
+			{
+				WritersWaiting++;
+				Queued = true;
+			}
+			this->Enqueue(w, cs.IsInterruptsEnabled());
+		}
+		this->Sleep(w);
+	}
+}
+
+int RWSemaphore::WriteUnlock()
+{
+	if (unlikely(ForceUnlock))
+		return 0;
+
+	LockStat::Drop(Stat);
+	CriticalSection cs;
+	Guard.Lock(__FUNCTION__);
+	Writer = false;
+	this->WakeAll();
+	Guard.Unlock();
+	return 0;
+}
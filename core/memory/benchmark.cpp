@@ -0,0 +1,476 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory/benchmark.hpp>
+
+#include <memory.hpp>
+#include <task.hpp>
+#include <time.hpp>
+#include <debug.h>
+#include <atomic>
+
+#include "heap_allocators/Xalloc/Xalloc.hpp"
+#include "heap_allocators/liballoc_1_1/liballoc_1_1.h"
+#include "heap_allocators/rpmalloc/rpmalloc.h"
+#include "../../kernel.h"
+
+extern Memory::MemoryAllocatorType AllocatorType;
+extern Xalloc::V1 *XallocV1Allocator;
+extern Memory::SlabHeap KernelHeap;
+
+/* 16 linear steps per power of two, about 6% precision */
+#define HISTOGRAM_ROWS 61
+#define HISTOGRAM_STEPS 16
+
+namespace Memory
+{
+	enum TraceType
+	{
+		TraceUniform,
+		TraceBimodal,
+		TraceProducerConsumer,
+	};
+
+	static const char *TraceNames[] = {"uniform", "bimodal", "prodcons"};
+
+	struct AllocatorBackend
+	{
+		const char *Name;
+		bool (*Setup)();
+		void *(*Allocate)(size_t Size);
+		void (*Free)(void *Address, size_t Size);
+		void (*Teardown)();
+	};
+
+	/* ---------------------------------------------------------------- */
+
+	static Xalloc::V1 *BenchV1 = nullptr;
+	static Xalloc::V2 *BenchV2 = nullptr;
+
+	static bool NoSetup() { return true; }
+	static void NoTeardown() {}
+
+	static void *PagesAllocate(size_t Size) { return KernelAllocator.RequestPages(TO_PAGES(Size)); }
+	static void PagesFree(void *Address, size_t Size) { KernelAllocator.FreePages(Address, TO_PAGES(Size)); }
+
+	static bool XallocV1Setup()
+	{
+		/* V1 can't release its memory, keep one around */
+		if (BenchV1 == nullptr)
+			BenchV1 = XallocV1Allocator ? XallocV1Allocator : new Xalloc::V1(nullptr, false, false);
+		return true;
+	}
+	static void *XallocV1Allocate(size_t Size) { return BenchV1->malloc(Size); }
+	static void XallocV1Free(void *Address, size_t) { BenchV1->free(Address); }
+
+	static bool XallocV2Setup()
+	{
+		BenchV2 = new Xalloc::V2(nullptr);
+		return true;
+	}
+	static void *XallocV2Allocate(size_t Size) { return BenchV2->malloc(Size); }
+	static void XallocV2Free(void *Address, size_t) { BenchV2->free(Address); }
+	static void XallocV2Teardown()
+	{
+		delete BenchV2;
+		BenchV2 = nullptr;
+	}
+
+	static void *liballocAllocate(size_t Size) { return PREFIX(malloc)(Size); }
+	static void liballocFree(void *Address, size_t) { PREFIX(free)(Address); }
+
+	/* rpmalloc is only set up when it is the kernel allocator */
+	static bool rpmallocSetup() { return AllocatorType == MemoryAllocatorType::rpmalloc_; }
+	static void *rpmallocAllocate(size_t Size) { return rpmalloc(Size); }
+	static void rpmallocFree(void *Address, size_t) { rpfree(Address); }
+
+	static void *SlabAllocate(size_t Size) { return KernelHeap.malloc(Size); }
+	static void SlabFree(void *Address, size_t) { KernelHeap.free(Address); }
+
+	static const AllocatorBackend Backends[] = {
+		{"pages", NoSetup, PagesAllocate, PagesFree, NoTeardown},
+		{"xallocv1", XallocV1Setup, XallocV1Allocate, XallocV1Free, NoTeardown},
+		{"xallocv2", XallocV2Setup, XallocV2Allocate, XallocV2Free, XallocV2Teardown},
+		{"liballoc11", NoSetup, liballocAllocate, liballocFree, NoTeardown},
+		{"rpmalloc", rpmallocSetup, rpmallocAllocate, rpmallocFree, NoTeardown},
+		{"slab", NoSetup, SlabAllocate, SlabFree, NoTeardown},
+	};
+
+	/* ---------------------------------------------------------------- */
+
+	struct Histogram
+	{
+		uint32_t Counts[HISTOGRAM_ROWS][HISTOGRAM_STEPS];
+		size_t Total;
+
+		void Add(uint64_t Cycles)
+		{
+			size_t Row = 0, Step = Cycles;
+			if (Cycles >= HISTOGRAM_STEPS)
+			{
+				size_t Log = 63 - __builtin_clzll(Cycles);
+				Row = Log - 3;
+				Step = (Cycles >> (Log - 4)) & (HISTOGRAM_STEPS - 1);
+			}
+			Counts[Row][Step]++;
+			Total++;
+		}
+
+		void Merge(const Histogram &Other)
+		{
+			for (size_t r = 0; r < HISTOGRAM_ROWS; r++)
+				for (size_t s = 0; s < HISTOGRAM_STEPS; s++)
+					Counts[r][s] += Other.Counts[r][s];
+			Total += Other.Total;
+		}
+
+		uint64_t Percentile(size_t Percent)
+		{
+			size_t Target = (Total * Percent + 99) / 100;
+			size_t Seen = 0;
+			for (size_t r = 0; r < HISTOGRAM_ROWS; r++)
+			{
+				for (size_t s = 0; s < HISTOGRAM_STEPS; s++)
+				{
+					Seen += Counts[r][s];
+					if (Seen < Target || Seen == 0)
+						continue;
+					if (r == 0)
+						return s;
+					return (uint64_t)(HISTOGRAM_STEPS + s) << (r - 1);
+				}
+			}
+			return 0;
+		}
+	};
+
+	static Histogram *NewHistogram()
+	{
+		Histogram *h = (Histogram *)KernelAllocator.RequestPages(TO_PAGES(sizeof(Histogram)));
+		if (unlikely(h == nullptr))
+			return nullptr;
+		memset(h, 0, sizeof(Histogram));
+		return h;
+	}
+
+	static void DeleteHistogram(Histogram *h)
+	{
+		KernelAllocator.FreePages(h, TO_PAGES(sizeof(Histogram)));
+	}
+
+	static inline uint64_t NextRandom(uint64_t &State)
+	{
+		State ^= State << 13;
+		State ^= State >> 7;
+		State ^= State << 17;
+		return State;
+	}
+
+	static size_t TraceSize(TraceType Trace, uint64_t &State)
+	{
+		uint64_t r = NextRandom(State);
+		if (Trace == TraceBimodal)
+		{
+			/* Mostly small objects with a few big buffers */
+			if (r % 10 != 0)
+				return 16 + (r >> 8) % 113;
+			return 8192 + (r >> 8) % 57345;
+		}
+		return 16 + (r >> 8) % 4081;
+	}
+
+	/* Bookkeeping kept outside of the tested heap */
+	struct Slot
+	{
+		void *Address;
+		size_t Size;
+	};
+
+	struct RunState
+	{
+		const AllocatorBackend *b;
+		TraceType Trace;
+		Histogram *Latency;
+		size_t Baseline;
+		std::atomic_size_t Live;
+		std::atomic_size_t Failed;
+		size_t PeakLive;
+		size_t PeakUsed;
+
+		/* Producer/consumer ring */
+		Slot *Ring;
+		std::atomic_size_t Head;
+		std::atomic_size_t Tail;
+		Histogram *ConsumerLatency;
+		std::atomic_bool ProducerDone;
+		std::atomic_int Running;
+	};
+
+	static RunState State;
+	/* Not a lock, the runs sleep and yield */
+	static std::atomic_bool Running = false;
+
+	static inline void SamplePeak(RunState &s)
+	{
+		size_t Live = s.Live.load(std::memory_order_relaxed);
+		if (Live > s.PeakLive)
+			s.PeakLive = Live;
+
+		size_t Used = (size_t)KernelAllocator.GetUsedMemory();
+		if (Used > s.Baseline && Used - s.Baseline > s.PeakUsed)
+			s.PeakUsed = Used - s.Baseline;
+	}
+
+	static void *TimedAllocate(RunState &s, Histogram *h, size_t Size)
+	{
+		uint64_t Start = CPU::Counter();
+		void *Address = s.b->Allocate(Size);
+		h->Add(CPU::Counter() - Start);
+		if (unlikely(!Address))
+		{
+			s.Failed++;
+			return nullptr;
+		}
+
+		/* Make sure the memory is really there */
+		*(volatile uint8_t *)Address = 0xAA;
+		s.Live += Size;
+		SamplePeak(s);
+		return Address;
+	}
+
+	static void TimedFree(RunState &s, Histogram *h, Slot &Entry)
+	{
+		if (unlikely(!Entry.Address))
+			return;
+
+		uint64_t Start = CPU::Counter();
+		s.b->Free(Entry.Address, Entry.Size);
+		h->Add(CPU::Counter() - Start);
+		s.Live -= Entry.Size;
+	}
+
+	static bool RunSingleThread(RunState &s)
+	{
+		Slot *Slots = (Slot *)KernelAllocator.RequestPages(TO_PAGES(sizeof(Slot) * BENCH_SLOTS));
+		if (unlikely(Slots == nullptr))
+			return false;
+		memset(Slots, 0, sizeof(Slot) * BENCH_SLOTS);
+
+		uint64_t Random = BENCH_SEED;
+		for (size_t i = 0; i < BENCH_OPERATIONS; i++)
+		{
+			Slot &Entry = Slots[NextRandom(Random) % BENCH_SLOTS];
+			if (Entry.Address)
+			{
+				TimedFree(s, s.Latency, Entry);
+				Entry.Address = nullptr;
+				continue;
+			}
+
+			Entry.Size = TraceSize(s.Trace, Random);
+			Entry.Address = TimedAllocate(s, s.Latency, Entry.Size);
+		}
+
+		for (size_t i = 0; i < BENCH_SLOTS; i++)
+		{
+			if (Slots[i].Address)
+				TimedFree(s, s.Latency, Slots[i]);
+		}
+
+		KernelAllocator.FreePages(Slots, TO_PAGES(sizeof(Slot) * BENCH_SLOTS));
+		return true;
+	}
+
+	static void ProducerThread()
+	{
+		RunState &s = State;
+		uint64_t Random = BENCH_SEED;
+		for (size_t i = 0; i < BENCH_OPERATIONS / 2; i++)
+		{
+			while (s.Head.load() - s.Tail.load() == BENCH_SLOTS)
+				TaskManager->Yield();
+
+			Slot Entry;
+			Entry.Size = TraceSize(TraceUniform, Random);
+			Entry.Address = TimedAllocate(s, s.Latency, Entry.Size);
+
+			s.Ring[s.Head.load() % BENCH_SLOTS] = Entry;
+			s.Head.fetch_add(1, std::memory_order_release);
+		}
+
+		s.ProducerDone.store(true);
+		s.Running--;
+	}
+
+	static void ConsumerThread()
+	{
+		RunState &s = State;
+		while (true)
+		{
+			size_t Tail = s.Tail.load();
+			if (Tail == s.Head.load(std::memory_order_acquire))
+			{
+				if (s.ProducerDone.load() && Tail == s.Head.load())
+					break;
+				TaskManager->Yield();
+				continue;
+			}
+
+			TimedFree(s, s.ConsumerLatency, s.Ring[Tail % BENCH_SLOTS]);
+			s.Tail.store(Tail + 1);
+		}
+		s.Running--;
+	}
+
+	static bool RunProducerConsumer(RunState &s)
+	{
+		s.Ring = (Slot *)KernelAllocator.RequestPages(TO_PAGES(sizeof(Slot) * BENCH_SLOTS));
+		if (unlikely(s.Ring == nullptr))
+			return false;
+		s.ConsumerLatency = NewHistogram();
+		if (unlikely(s.ConsumerLatency == nullptr))
+		{
+			KernelAllocator.FreePages(s.Ring, TO_PAGES(sizeof(Slot) * BENCH_SLOTS));
+			return false;
+		}
+		s.Head = 0;
+		s.Tail = 0;
+		s.ProducerDone = false;
+		s.Running = 2;
+
+		/* Frees happen on another thread, maybe another core */
+		Tasking::PCB *Kernel = TaskManager->GetKernelProcess();
+		TaskManager->CreateThread(Kernel, Tasking::IP(ProducerThread))->Rename("Benchmark Producer");
+		TaskManager->CreateThread(Kernel, Tasking::IP(ConsumerThread))->Rename("Benchmark Consumer");
+		while (s.Running.load() > 0)
+			TaskManager->Sleep(1);
+
+		s.Latency->Merge(*s.ConsumerLatency);
+		DeleteHistogram(s.ConsumerLatency);
+		KernelAllocator.FreePages(s.Ring, TO_PAGES(sizeof(Slot) * BENCH_SLOTS));
+		return true;
+	}
+
+	static void RunOne(const AllocatorBackend &b, TraceType Trace, BenchmarkReport Report)
+	{
+		BenchmarkResult r{};
+		r.Backend = b.Name;
+		r.Trace = TraceNames[Trace];
+
+		if (!b.Setup())
+		{
+			trace("Allocator benchmark: %s is not available, skipped", b.Name);
+			return;
+		}
+
+		RunState &s = State;
+		s.b = &b;
+		s.Trace = Trace;
+		s.Latency = NewHistogram();
+		if (unlikely(s.Latency == nullptr))
+		{
+			error("Allocator benchmark: %s/%s: out of memory, skipped", b.Name, r.Trace);
+			b.Teardown();
+			return;
+		}
+		s.Live = 0;
+		s.Failed = 0;
+		s.PeakLive = 0;
+		s.PeakUsed = 0;
+		s.Baseline = (size_t)KernelAllocator.GetUsedMemory();
+
+		uint64_t Start = TimeManager->GetNanosecondsSinceClassCreation();
+		bool Ran = Trace == TraceProducerConsumer ? RunProducerConsumer(s)
+												  : RunSingleThread(s);
+		uint64_t Elapsed = TimeManager->GetNanosecondsSinceClassCreation() - Start;
+		if (unlikely(!Ran))
+		{
+			error("Allocator benchmark: %s/%s: out of memory, skipped", b.Name, r.Trace);
+			b.Teardown();
+			DeleteHistogram(s.Latency);
+			return;
+		}
+
+		size_t Used = (size_t)KernelAllocator.GetUsedMemory();
+		r.Retained = Used > s.Baseline ? Used - s.Baseline : 0;
+		b.Teardown();
+
+		r.Operations = s.Latency->Total;
+		r.Failed = s.Failed.load();
+		r.OpsPerSecond = Elapsed ? (r.Operations * 1000000000ULL) / Elapsed : 0;
+		r.P50 = s.Latency->Percentile(50);
+		r.P99 = s.Latency->Percentile(99);
+		r.PeakLive = s.PeakLive;
+		r.PeakUsed = s.PeakUsed;
+		DeleteHistogram(s.Latency);
+
+		trace("Allocator benchmark: %s/%s: %ld ops (%ld failed), %ld ops/s, p50 %ld p99 %ld cycles, peak %ld KiB live %ld KiB used, %ld KiB retained",
+			  r.Backend, r.Trace, r.Operations, r.Failed, r.OpsPerSecond, r.P50, r.P99,
+			  TO_KiB(r.PeakLive), TO_KiB(r.PeakUsed), TO_KiB(r.Retained));
+		if (Report)
+			Report(r);
+	}
+
+	int RunAllocatorBenchmark(const char *Backend, const char *Trace,
+							  BenchmarkReport Report)
+	{
+		int TraceIndex = -1;
+		if (Trace)
+		{
+			for (int i = 0; i < (int)(sizeof(TraceNames) / sizeof(TraceNames[0])); i++)
+				if (strcmp(Trace, TraceNames[i]) == 0)
+					TraceIndex = i;
+			if (TraceIndex < 0)
+				return -EINVAL;
+		}
+
+		const AllocatorBackend *Selected = nullptr;
+		if (Backend)
+		{
+			foreach (auto &b in Backends)
+				if (strcmp(Backend, b.Name) == 0)
+					Selected = &b;
+			if (Selected == nullptr)
+				return -EINVAL;
+		}
+
+		/* The state is shared with the producer/consumer threads */
+		bool Idle = false;
+		if (!Running.compare_exchange_strong(Idle, true))
+			return -EBUSY;
+
+		int Runs = 0;
+		foreach (auto &b in Backends)
+		{
+			if (Selected && Selected != &b)
+				continue;
+
+			for (int t = 0; t < (int)(sizeof(TraceNames) / sizeof(TraceNames[0])); t++)
+			{
+				if (TraceIndex >= 0 && TraceIndex != t)
+					continue;
+
+				RunOne(b, (TraceType)t, Report);
+				Runs++;
+			}
+		}
+
+		Running.store(false);
+		return Runs;
+	}
+}
@@ -16,7 +16,6 @@
 */
 
 #include <memory/brk.hpp>
-#include <memory/virtual.hpp>
 #include <memory/vma.hpp>
 #include <assert.h>
 #include <errno.h>
@@ -43,43 +42,26 @@ namespace Memory
 			return (void *)-ENOMEM;
 		}
 
-		Virtual vmm(this->Table);
+		uintptr_t OldEnd = ROUND_UP(Break, PAGE_SIZE);
+		uintptr_t NewEnd = ROUND_UP(uintptr_t(Address), PAGE_SIZE);
 
-		if ((uintptr_t)Address > Break)
+		if (NewEnd > OldEnd)
 		{
-			/* Allocate more memory. */
-			ssize_t Pages = TO_PAGES(uintptr_t(Address) - Break);
-			void *Allocated = vma->RequestPages(Pages);
-			if (Allocated == nullptr)
+			/* Reserve the range, pages are populated on first access. */
+			void *ret = vma->CreateCoWRegion((void *)OldEnd, NewEnd - OldEnd,
+											 true, true, false, true, false);
+			if ((intptr_t)ret < 0)
 				return (void *)-ENOMEM;
-
-			/* Map the allocated pages. */
-			for (ssize_t i = 0; i < Pages; i++)
-			{
-				void *VirtAddr = (void *)(Break + (i * PAGE_SIZE));
-				void *PhysAddr = (void *)(uintptr_t(Allocated) + (i * PAGE_SIZE));
-				debug("Mapping %#lx to %#lx", VirtAddr, PhysAddr);
-				vmm.Map(VirtAddr, PhysAddr, RW | US);
-			}
-
-			Break = ROUND_UP(uintptr_t(Address), PAGE_SIZE);
-			debug("Round up %#lx to %#lx", Address, Break);
-			return Address;
+			debug("Reserved %#lx-%#lx", OldEnd, NewEnd);
 		}
-
-		/* Free memory. */
-		ssize_t Pages = TO_PAGES(Break - uintptr_t(Address));
-		vma->FreePages((void *)Break, Pages);
-
-		/* Unmap the freed pages. */
-		for (ssize_t i = 0; i < Pages; i++)
+		else if (NewEnd < OldEnd)
 		{
-			uint64_t Page = Break - (i * 0x1000);
-			vmm.Remap((void *)Page, (void *)Page, RW);
-			debug("Unmapping %#lx", Page);
+			/* Free memory. */
+			vma->FreeRegion((void *)NewEnd, OldEnd - NewEnd);
+			debug("Released %#lx-%#lx", NewEnd, OldEnd);
 		}
 
-		Break = (uint64_t)Address;
+		Break = uintptr_t(Address);
 		return (void *)Break;
 	}
 
@@ -0,0 +1,169 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <task.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+namespace Memory
+{
+	int Physical::FindWindows(size_t Count, uint64_t *Start, int Max)
+	{
+		uint64_t Pages = TotalMemory.load() / PAGE_SIZE;
+		size_t Used[COMPACT_WINDOWS];
+		int Found = 0;
+		if (Max > COMPACT_WINDOWS)
+			Max = COMPACT_WINDOWS;
+
+		/* The first window holds the null page, it never comes free */
+		for (uint64_t Window = Count; Window + Count <= Pages; Window += Count)
+		{
+			size_t n = 0;
+			for (uint64_t i = Window; i < Window + Count; i++)
+			{
+				if (PageBitmap[i] == true)
+					n++;
+			}
+
+			/* Prefer higher windows, small allocations fill memory from the bottom */
+			int Position = Found;
+			while (Position > 0 && Used[Position - 1] >= n)
+			{
+				if (Position < Max)
+				{
+					Start[Position] = Start[Position - 1];
+					Used[Position] = Used[Position - 1];
+				}
+				Position--;
+			}
+
+			if (Position < Max)
+			{
+				Start[Position] = Window;
+				Used[Position] = n;
+				if (Found < Max)
+					Found++;
+			}
+		}
+		return Found;
+	}
+
+	struct MigrateWalk
+	{
+		uintptr_t Low;
+		uintptr_t High;
+		size_t Used;
+		size_t Moved;
+	};
+
+	static bool MigrateProcess(Tasking::PCB *pcb, void *Context)
+	{
+		MigrateWalk *Walk = (MigrateWalk *)Context;
+		if (Walk->Moved == Walk->Used)
+			return false;
+
+		if (pcb->State == Tasking::Terminated ||
+			pcb->State == Tasking::Zombie)
+			return true;
+
+		/* Kernel processes may hold physical addresses */
+		if (pcb->Security.ExecutionMode == Tasking::Kernel)
+			return true;
+
+		Walk->Moved += pcb->vma->MigratePages(Walk->Low, Walk->High);
+		return true;
+	}
+
+	void *Physical::Compact(size_t Count)
+	{
+		if (TaskManager == nullptr || Count < 2)
+			return nullptr;
+
+		if (Compacting.exchange(true, std::memory_order_acquire))
+			return nullptr;
+
+		/* One scan, the bitmap changes little while we move pages */
+		uint64_t Windows[COMPACT_WINDOWS];
+		MemoryLock.Lock(__FUNCTION__);
+		int Found = this->FindWindows(Count, Windows, COMPACT_WINDOWS);
+		MemoryLock.Unlock();
+
+		size_t Total = 0;
+		void *Run = nullptr;
+		for (int w = 0; w < Found && Run == nullptr; w++)
+		{
+			uint64_t Start = Windows[w];
+
+			MemoryLock.Lock(__FUNCTION__);
+			/* Every page moved out needs a free page outside the window */
+			if (FreeMemory.load() < FROM_PAGES(Count))
+			{
+				MemoryLock.Unlock();
+				break;
+			}
+
+			size_t Used = 0;
+			for (uint64_t i = Start; i < Start + Count; i++)
+			{
+				if (PageBitmap[i] == true)
+					Used++;
+			}
+
+			IsolateStart = Start;
+			IsolateEnd = Start + Count;
+			MemoryLock.Unlock();
+
+			debug("Compacting %#lx-%#lx (%ld pages used)",
+				  FROM_PAGES(Start), FROM_PAGES(Start + Count), Used);
+
+			MigrateWalk Walk = {FROM_PAGES(Start), FROM_PAGES(Start + Count), Used, 0};
+			TaskManager->ForEachProcess(MigrateProcess, &Walk);
+			Total += Walk.Moved;
+
+			MemoryLock.Lock(__FUNCTION__);
+			IsolateStart = IsolateEnd = 0;
+			if (PageBitmapIndex > Start)
+				PageBitmapIndex = Start;
+
+			bool Free = true;
+			for (uint64_t i = Start; i < Start + Count && Free; i++)
+				Free = PageBitmap[i] == false;
+
+			if (Free)
+			{
+				this->LockPages((void *)FROM_PAGES(Start), Count);
+				Run = (void *)FROM_PAGES(Start);
+			}
+			MemoryLock.Unlock();
+		}
+
+		/* A run that was free already is not worth counting */
+		MigratedPages += Total;
+		if (Run == nullptr)
+			CompactFailures++;
+		else if (Total > 0)
+			Compactions++;
+
+		debug("Compaction for %ld pages %s, %ld pages moved", Count,
+			  Run ? "succeeded" : "failed", Total);
+		Compacting.store(false, std::memory_order_release);
+		return Run;
+	}
+}
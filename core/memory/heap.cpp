@@ -0,0 +1,156 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <debug.h>
+
+namespace Memory
+{
+	static ObjectCache SizeClasses[HEAP_SIZE_CLASSES] = {
+		{"kmalloc-16", 16, 0, nullptr, nullptr, true},
+		{"kmalloc-32", 32, 0, nullptr, nullptr, true},
+		{"kmalloc-64", 64, 0, nullptr, nullptr, true},
+		{"kmalloc-128", 128, 0, nullptr, nullptr, true},
+		{"kmalloc-192", 192, 0, nullptr, nullptr, true},
+		{"kmalloc-256", 256, 0, nullptr, nullptr, true},
+		{"kmalloc-384", 384, 0, nullptr, nullptr, true},
+		{"kmalloc-512", 512, 0, nullptr, nullptr, true},
+		{"kmalloc-768", 768, 0, nullptr, nullptr, true},
+		{"kmalloc-1024", 1024, 0, nullptr, nullptr, true},
+		{"kmalloc-1536", 1536, 0, nullptr, nullptr, true},
+		{"kmalloc-2048", 2048, 0, nullptr, nullptr, true},
+		{"kmalloc-3072", 3072, 0, nullptr, nullptr, true},
+		{"kmalloc-4096", 4096, 0, nullptr, nullptr, true},
+	};
+
+	/* Size class of every 16 byte step up to HEAP_MAX_SMALL */
+	struct ClassLookup
+	{
+		uint8_t Index[HEAP_MAX_SMALL / 16 + 1];
+
+		constexpr ClassLookup() : Index()
+		{
+			const size_t Sizes[HEAP_SIZE_CLASSES] = {16, 32, 64, 128, 192, 256, 384, 512,
+													 768, 1024, 1536, 2048, 3072, 4096};
+			size_t Class = 0;
+			for (size_t i = 0; i <= HEAP_MAX_SMALL / 16; i++)
+			{
+				while (Sizes[Class] < i * 16)
+					Class++;
+				Index[i] = (uint8_t)Class;
+			}
+		}
+	};
+
+	static constexpr ClassLookup Lookup;
+
+	ObjectCache *SlabHeap::GetClass(size_t Size)
+	{
+		return &SizeClasses[Lookup.Index[(Size + 15) / 16]];
+	}
+
+	void *SlabHeap::AllocateLarge(size_t Size)
+	{
+		size_t Pages = TO_PAGES(Size + HEAP_LARGE_HEADER);
+		LargeHeader *hdr = (LargeHeader *)RequestAlignedPages(Pages, SLAB_ALIGNED_PAGES);
+		if (unlikely(hdr == nullptr))
+			return nullptr;
+
+		hdr->Cache = nullptr;
+		hdr->Pages = Pages;
+		return (void *)((uintptr_t)hdr + HEAP_LARGE_HEADER);
+	}
+
+	void *SlabHeap::malloc(size_t Size)
+	{
+		if (likely(Size <= HEAP_MAX_SMALL))
+			return GetClass(Size)->Allocate();
+		return AllocateLarge(Size);
+	}
+
+	void *SlabHeap::calloc(size_t n, size_t Size)
+	{
+		void *ret = this->malloc(n * Size);
+		if (likely(ret))
+			memset(ret, 0, n * Size);
+		return ret;
+	}
+
+	size_t SlabHeap::GetSize(void *Address)
+	{
+		ObjectCache *Cache = ObjectCache::FromObject(Address);
+		if (Cache)
+			return Cache->GetObjectSize();
+
+		LargeHeader *hdr = (LargeHeader *)((uintptr_t)Address - HEAP_LARGE_HEADER);
+		return FROM_PAGES(hdr->Pages) - HEAP_LARGE_HEADER;
+	}
+
+	void *SlabHeap::realloc(void *Address, size_t Size)
+	{
+		if (Address == nullptr)
+			return this->malloc(Size);
+
+		ObjectCache *Cache = ObjectCache::FromObject(Address);
+		if (Cache)
+		{
+			/* Same class, nothing to do */
+			if (Size <= HEAP_MAX_SMALL && GetClass(Size) == Cache)
+				return Address;
+		}
+		else
+		{
+			LargeHeader *hdr = (LargeHeader *)((uintptr_t)Address - HEAP_LARGE_HEADER);
+			size_t Pages = TO_PAGES(Size + HEAP_LARGE_HEADER);
+			if (Size > HEAP_MAX_SMALL && Pages <= hdr->Pages)
+			{
+				/* Shrink in place */
+				if (Pages < hdr->Pages)
+				{
+					KernelAllocator.FreePages((void *)((uintptr_t)hdr + FROM_PAGES(Pages)),
+											  hdr->Pages - Pages);
+					hdr->Pages = Pages;
+				}
+				return Address;
+			}
+		}
+
+		size_t OldSize = GetSize(Address);
+		void *ret = this->malloc(Size);
+		if (unlikely(ret == nullptr))
+			return nullptr;
+
+		memcpy(ret, Address, Size < OldSize ? Size : OldSize);
+		this->free(Address);
+		return ret;
+	}
+
+	void SlabHeap::free(void *Address)
+	{
+		ObjectCache *Cache = ObjectCache::FromObject(Address);
+		if (likely(Cache))
+		{
+			Cache->Free(Address);
+			return;
+		}
+
+		LargeHeader *hdr = (LargeHeader *)((uintptr_t)Address - HEAP_LARGE_HEADER);
+		assert(((uintptr_t)hdr & (FROM_PAGES(SLAB_ALIGNED_PAGES) - 1)) == 0);
+		KernelAllocator.FreePages(hdr, hdr->Pages);
+	}
+}
@@ -23,6 +23,7 @@
 #include <debug.h>
 
 typedef __UINT8_TYPE__ Xuint8_t;
+typedef __UINT64_TYPE__ Xuint64_t;
 typedef __SIZE_TYPE__ Xsize_t;
 typedef __UINTPTR_TYPE__ Xuintptr_t;
 
@@ -41,6 +42,11 @@ typedef __UINTPTR_TYPE__ Xuintptr_t;
 #define XallocV2_lock XallocV2Lock.Lock(__FUNCTION__)
 #define XallocV2_unlock XallocV2Lock.Unlock()
 
+/* Exact bins every 16 bytes below 256, then four per power of two */
+#define XallocV2_Bins 64
+/* Minimum number of pages requested from the system at once */
+#define XallocV2_ArenaPages 16
+
 namespace Xalloc
 {
 	class V1
@@ -125,23 +131,33 @@ namespace Xalloc
 	class V2
 	{
 	private:
-		class Block
+		/**
+		 * Boundary tagged chunk
+		 *
+		 * The size is also stored in the last word
+		 * of the chunk so free can find and merge
+		 * the previous chunk.
+		 */
+		struct Chunk
+		{
+			/* Chunk size, the lowest bit is set when in use */
+			Xsize_t Size;
+			Xsize_t Sanity;
+
+			/* Only valid while the chunk is free */
+			Chunk *Next;
+			Chunk *Prev;
+		};
+
+		/* A run of pages holding chunks */
+		struct Arena
 		{
-		public:
-			int Sanity = 0xA110C;
-			Block *Next = nullptr;
-			bool IsFree = true;
-			V2 *ctx = nullptr;
-
-			Xuint8_t *Data = nullptr;
-			Xsize_t DataSize = 0;
-
-			void Check();
-			Block(Xsize_t Size, V2 *ctx);
-			~Block();
-			void *operator new(Xsize_t);
-			void operator delete(void *Address);
-		} __attribute__((packed, aligned((16))));
+			Arena *Next;
+			Xsize_t Pages;
+			Xsize_t Reserved;
+			/* Footer of a fake used chunk before the first one */
+			Xsize_t Prologue;
+		};
 
 		/* The base address of the virtual memory */
 		Xuintptr_t BaseVirtualAddress = 0x0;
@@ -152,14 +168,31 @@ namespace Xalloc
 		/* The used size of the heap */
 		Xsize_t HeapUsed = 0x0;
 
-		Block *FirstBlock = nullptr;
+		Arena *FirstArena = nullptr;
+
+		/* One free list per size class */
+		Chunk *Bins[XallocV2_Bins] = {};
+
+		/* Bit set for every non-empty bin */
+		Xuint64_t BinMap = 0;
 
 		Xuint8_t *AllocateHeap(Xsize_t Size);
 		void FreeHeap(Xuint8_t *At, Xsize_t Size);
 
 		Xsize_t Align(Xsize_t Size);
-		void *FindFreeBlock(Xsize_t Size,
-							Block *&CurrentBlock);
+		Xsize_t ChunkSize(Xsize_t Size);
+		static Xsize_t BinIndex(Xsize_t Size);
+		static Xsize_t SearchIndex(Xsize_t Size);
+
+		void Check(Chunk *c);
+		void SetChunk(Chunk *c, Xsize_t Size, bool Used);
+		void InsertChunk(Chunk *c);
+		void RemoveChunk(Chunk *c);
+		Chunk *FindFreeChunk(Xsize_t Size);
+		void SplitChunk(Chunk *c, Xsize_t Size);
+		Chunk *Coalesce(Chunk *c);
+		Chunk *Grow(Xsize_t Size);
+		void ReleaseArena(Arena *a);
 
 	public:
 		/**
@@ -228,8 +261,6 @@ namespace Xalloc
 		 * Destroy the Allocator object
 		 */
 		~V2();
-
-		friend class Block;
 	};
 }
 
@@ -32,139 +32,258 @@ extern "C" void Xalloc_UNMAP_MEMORY(void *VirtualAddress);
 
 #define Xalloc_BlockSanityKey 0xA110C
 
-/*
-	[ IN DEVELOPMENT ]
-*/
+#define XallocV2_Used 0x1
+#define XallocV2_Header (sizeof(Xsize_t) * 2)
+#define XallocV2_Footer sizeof(Xsize_t)
+#define XallocV2_MinChunk sizeof(Chunk) + XallocV2_Footer
+#define XallocV2_Footer_Of(c, s) ((Xsize_t *)((Xuintptr_t)(c) + (s) - XallocV2_Footer))
+#define XallocV2_Chunk_Of(p) ((Chunk *)((Xuintptr_t)(p) - XallocV2_Header))
 
 namespace Xalloc
 {
-	void V2::Block::Check()
+	Xuint8_t *V2::AllocateHeap(Xsize_t Size)
 	{
-		if (unlikely(this->Sanity != Xalloc_BlockSanityKey))
-		{
-			Xalloc_err("Block %#lx has an invalid sanity key! (%#x != %#x)",
-					   this, this->Sanity, Xalloc_BlockSanityKey);
+		Xsize_t Pages = XStoP(Size);
 
-			while (Xalloc_StopOnFail)
-				;
+		void *Address = Xalloc_REQUEST_PAGES(Pages);
+		void *FinalAddress = Address;
+		if (Xalloc_MapPages)
+		{
+			FinalAddress = (void *)(this->BaseVirtualAddress + this->HeapSize);
+			for (Xsize_t i = 0; i < Pages; i++)
+			{
+				Xuintptr_t Page = i * Xalloc_PAGE_SIZE;
+				void *vAddress = (void *)((Xuintptr_t)FinalAddress + Page);
+				Xalloc_MAP_MEMORY(vAddress, (void *)((Xuintptr_t)Address + Page), 0x3);
+			}
 		}
+
+		this->HeapSize += XPtoS(Pages);
+		return (Xuint8_t *)FinalAddress;
 	}
 
-	V2::Block::Block(Xsize_t Size, V2 *ctx)
+	void V2::FreeHeap(Xuint8_t *At, Xsize_t Size)
 	{
-		this->ctx = ctx;
-		this->Data = ctx->AllocateHeap(Size);
-		this->DataSize = Size;
+		Xsize_t Pages = XStoP(Size);
+
+		if (Xalloc_MapPages)
+		{
+			for (Xsize_t i = 0; i < Pages; i++)
+			{
+				Xuintptr_t Page = i * Xalloc_PAGE_SIZE;
+				void *VirtualAddress = (void *)((Xuintptr_t)At + Page);
+				Xalloc_UNMAP_MEMORY(VirtualAddress);
+			}
+		}
+
+		Xalloc_FREE_PAGES(At, Pages);
+		this->HeapSize -= XPtoS(Pages);
 	}
 
-	V2::Block::~Block()
+	Xsize_t V2::Align(Xsize_t Size)
 	{
+		return (Size + 0xF) & ~0xF;
 	}
 
-	void *V2::Block::operator new(Xsize_t)
+	Xsize_t V2::ChunkSize(Xsize_t Size)
 	{
-		constexpr Xsize_t bPgs = XStoP(sizeof(Block));
-		void *ptr = Xalloc_REQUEST_PAGES(bPgs);
-		/* TODO: Do something with the rest of
-			the allocated memory */
-		return ptr;
+		Xsize_t ret = this->Align(Size + XallocV2_Header + XallocV2_Footer);
+		if (ret < this->Align(XallocV2_MinChunk))
+			ret = this->Align(XallocV2_MinChunk);
+		return ret;
 	}
 
-	void V2::Block::operator delete(void *Address)
+	Xsize_t V2::BinIndex(Xsize_t Size)
 	{
-		constexpr Xsize_t bPgs = XStoP(sizeof(Block));
-		Xalloc_FREE_PAGES(Address, bPgs);
+		if (Size < 256)
+			return Size / 16;
+
+		/* Four classes between two powers of two */
+		Xsize_t Log = 63 - __builtin_clzl(Size);
+		Xsize_t Sub = (Size >> (Log - 2)) & 3;
+		Xsize_t Index = 16 + (Log - 8) * 4 + Sub;
+		return Index < XallocV2_Bins ? Index : XallocV2_Bins - 1;
 	}
 
-	/* ========================================= */
-
-	Xuint8_t *V2::AllocateHeap(Xsize_t Size)
+	Xsize_t V2::SearchIndex(Xsize_t Size)
 	{
-		Size = this->Align(Size);
-		Xsize_t Pages = XStoP(Size);
+		/* Round up to the next class so every chunk
+		   in the bin we pick is big enough */
+		if (Size >= 256)
+		{
+			Xsize_t Log = 63 - __builtin_clzl(Size);
+			Size += (Xsize_t(1) << (Log - 2)) - 1;
+		}
+		return BinIndex(Size);
+	}
 
-		Xuint8_t *FinalAddress = 0x0;
-		if (this->HeapUsed + Size >= this->HeapSize)
+	void V2::Check(Chunk *c)
+	{
+		if (unlikely(c->Sanity != Xalloc_BlockSanityKey))
 		{
-			void *Address = Xalloc_REQUEST_PAGES(Pages);
-			void *VirtualAddress = (void *)(this->BaseVirtualAddress + this->HeapSize);
-			if (Xalloc_MapPages)
-			{
-				for (Xsize_t i = 0; i < Pages; i++)
-				{
-					Xuintptr_t Page = i * Xalloc_PAGE_SIZE;
-					void *vAddress = (void *)((Xuintptr_t)VirtualAddress + Page);
-					Xalloc_MAP_MEMORY(vAddress, (void *)((Xuintptr_t)Address + Page), 0x3);
-				}
-			}
+			Xalloc_err("Chunk %#lx has an invalid sanity key! (%#x != %#x)",
+					   c, c->Sanity, Xalloc_BlockSanityKey);
 
-			this->HeapSize += XPtoS(Pages);
-			FinalAddress = (Xuint8_t *)VirtualAddress;
+			while (Xalloc_StopOnFail)
+				;
 		}
-		else
-			FinalAddress = (Xuint8_t *)(this->BaseVirtualAddress + this->HeapUsed);
+	}
 
-		this->HeapUsed += Size;
-		return (uint8_t *)FinalAddress;
+	void V2::SetChunk(Chunk *c, Xsize_t Size, bool Used)
+	{
+		c->Size = Size | (Used ? XallocV2_Used : 0);
+		c->Sanity = Xalloc_BlockSanityKey;
+		*XallocV2_Footer_Of(c, Size) = c->Size;
 	}
 
-	void V2::FreeHeap(Xuint8_t *At, Xsize_t Size)
+	void V2::InsertChunk(Chunk *c)
 	{
-		Xsize_t Pages = XStoP(Size);
+		Xsize_t Index = BinIndex(c->Size);
+		c->Prev = nullptr;
+		c->Next = this->Bins[Index];
+		if (c->Next)
+			c->Next->Prev = c;
+		this->Bins[Index] = c;
+		this->BinMap |= Xuint64_t(1) << Index;
+	}
 
-		if (Xalloc_MapPages)
+	void V2::RemoveChunk(Chunk *c)
+	{
+		Xsize_t Index = BinIndex(c->Size);
+		if (c->Prev)
+			c->Prev->Next = c->Next;
+		else
+			this->Bins[Index] = c->Next;
+		if (c->Next)
+			c->Next->Prev = c->Prev;
+
+		if (this->Bins[Index] == nullptr)
+			this->BinMap &= ~(Xuint64_t(1) << Index);
+	}
+
+	V2::Chunk *V2::FindFreeChunk(Xsize_t Size)
+	{
+		Xsize_t Index = SearchIndex(Size);
+		if (Index < XallocV2_Bins - 1)
 		{
-			for (Xsize_t i = 0; i < Pages; i++)
+			Xuint64_t Map = this->BinMap & (~Xuint64_t(0) << Index);
+			if (Map)
 			{
-				Xuintptr_t Page = i * Xalloc_PAGE_SIZE;
-				void *VirtualAddress = (void *)((Xuintptr_t)At + Page);
-				Xalloc_UNMAP_MEMORY(VirtualAddress);
+				Chunk *c = this->Bins[__builtin_ctzl(Map)];
+				this->RemoveChunk(c);
+				return c;
 			}
+			Index = XallocV2_Bins - 1;
 		}
 
-		Xalloc_FREE_PAGES(At, Pages);
-		this->HeapUsed -= Size;
+		/* The last bin holds everything bigger, sizes vary */
+		for (Chunk *c = this->Bins[Index]; c; c = c->Next)
+		{
+			if (c->Size >= Size)
+			{
+				this->RemoveChunk(c);
+				return c;
+			}
+		}
+		return nullptr;
 	}
 
-	Xsize_t V2::Align(Xsize_t Size)
+	void V2::SplitChunk(Chunk *c, Xsize_t Size)
 	{
-		return (Size + 0xF) & ~0xF;
+		Xsize_t Total = c->Size & ~XallocV2_Used;
+		if (Total - Size < this->Align(XallocV2_MinChunk))
+		{
+			this->SetChunk(c, Total, true);
+			return;
+		}
+
+		this->SetChunk(c, Size, true);
+		Chunk *Rest = (Chunk *)((Xuintptr_t)c + Size);
+		this->SetChunk(Rest, Total - Size, false);
+		this->InsertChunk(this->Coalesce(Rest));
 	}
 
-	void *V2::FindFreeBlock(Xsize_t Size, Block *&CurrentBlock)
+	V2::Chunk *V2::Coalesce(Chunk *c)
 	{
-		if (this->FirstBlock == nullptr)
+		Xsize_t Size = c->Size & ~XallocV2_Used;
+
+		Chunk *Next = (Chunk *)((Xuintptr_t)c + Size);
+		if (!(Next->Size & XallocV2_Used))
 		{
-			this->FirstBlock = new Block(Size, this);
-			this->FirstBlock->IsFree = false;
-			return this->FirstBlock->Data;
+			this->Check(Next);
+			this->RemoveChunk(Next);
+			Size += Next->Size;
 		}
 
-		while (true)
+		Xsize_t PrevFooter = *(Xsize_t *)((Xuintptr_t)c - XallocV2_Footer);
+		if (!(PrevFooter & XallocV2_Used))
 		{
-			CurrentBlock->Check();
+			Chunk *Prev = (Chunk *)((Xuintptr_t)c - PrevFooter);
+			this->Check(Prev);
+			this->RemoveChunk(Prev);
+			Size += PrevFooter;
+			c = Prev;
+		}
 
-			/* FIXME: This will waste a lot of space
-				need better algorithm */
-			if (CurrentBlock->IsFree &&
-				CurrentBlock->DataSize >= Size)
-			{
-				CurrentBlock->IsFree = false;
-				return CurrentBlock->Data;
-			}
+		this->SetChunk(c, Size, false);
+		return c;
+	}
 
-			if (CurrentBlock->Next == nullptr)
-				break;
+	V2::Chunk *V2::Grow(Xsize_t Size)
+	{
+		/* Room for the arena header and the end marker */
+		Xsize_t Needed = Size + sizeof(Arena) + XallocV2_Header;
+		Xsize_t Pages = XStoP(Needed);
+		if (Pages < XallocV2_ArenaPages)
+			Pages = XallocV2_ArenaPages;
+
+		Arena *a = (Arena *)this->AllocateHeap(XPtoS(Pages));
+		if (a == nullptr)
+			return nullptr;
 
-			CurrentBlock = CurrentBlock->Next;
-		}
+		a->Next = this->FirstArena;
+		a->Pages = Pages;
+		a->Prologue = XallocV2_Used;
+		this->FirstArena = a;
 
-		return nullptr;
+		Xsize_t Usable = XPtoS(Pages) - sizeof(Arena) - XallocV2_Header;
+		Chunk *c = (Chunk *)((Xuintptr_t)a + sizeof(Arena));
+		this->SetChunk(c, Usable, false);
+
+		/* Zero sized used chunk, stops coalescing at the end */
+		Chunk *End = (Chunk *)((Xuintptr_t)c + Usable);
+		End->Size = XallocV2_Used;
+		End->Sanity = Xalloc_BlockSanityKey;
+		return c;
+	}
+
+	void V2::ReleaseArena(Arena *a)
+	{
+		Arena **itr = &this->FirstArena;
+		while (*itr && *itr != a)
+			itr = &(*itr)->Next;
+		if (*itr == nullptr)
+			return;
+		*itr = a->Next;
+
+		this->RemoveChunk((Chunk *)((Xuintptr_t)a + sizeof(Arena)));
+		this->FreeHeap((Xuint8_t *)a, XPtoS(a->Pages));
 	}
 
 	void V2::Arrange()
 	{
-		Xalloc_err("Arrange() is not implemented yet!");
+		XallocV2_lock;
+		Arena *a = this->FirstArena;
+		while (a)
+		{
+			Arena *Next = a->Next;
+			Chunk *c = (Chunk *)((Xuintptr_t)a + sizeof(Arena));
+			Xsize_t Usable = XPtoS(a->Pages) - sizeof(Arena) - XallocV2_Header;
+			if (c->Size == Usable)
+				this->ReleaseArena(a);
+			a = Next;
+		}
+		XallocV2_unlock;
 	}
 
 	void *V2::malloc(Xsize_t Size)
@@ -175,19 +294,25 @@ namespace Xalloc
 			return nullptr;
 		}
 
+		Xsize_t Needed = this->ChunkSize(Size);
+
 		XallocV2_lock;
-		Block *CurrentBlock = this->FirstBlock;
-		void *ret = this->FindFreeBlock(Size, CurrentBlock);
-		if (ret)
+		Chunk *c = this->FindFreeChunk(Needed);
+		if (c == nullptr)
 		{
-			XallocV2_unlock;
-			return ret;
+			c = this->Grow(Needed);
+			if (c == nullptr)
+			{
+				XallocV2_unlock;
+				Xalloc_err("Out of memory! (%ld bytes)", Size);
+				return nullptr;
+			}
 		}
 
-		CurrentBlock->Next = new Block(Size, this);
-		CurrentBlock->Next->IsFree = false;
+		this->SplitChunk(c, Needed);
+		this->HeapUsed += c->Size & ~XallocV2_Used;
 		XallocV2_unlock;
-		return CurrentBlock->Next->Data;
+		return (void *)((Xuintptr_t)c + XallocV2_Header);
 	}
 
 	void V2::free(void *Address)
@@ -198,26 +323,27 @@ namespace Xalloc
 			return;
 		}
 
-		XallocV2_lock;
+		Chunk *c = XallocV2_Chunk_Of(Address);
 
-		Block *CurrentBlock = ((Block *)this->FirstBlock);
-		while (CurrentBlock != nullptr)
+		XallocV2_lock;
+		this->Check(c);
+		if (!(c->Size & XallocV2_Used))
 		{
-			CurrentBlock->Check();
-
-			if (CurrentBlock->Data == Address)
-			{
-				if (CurrentBlock->IsFree)
-					Xalloc_warn("Attempted to free an already freed block! %#lx", Address);
-
-				CurrentBlock->IsFree = true;
-				XallocV2_unlock;
-				return;
-			}
-			CurrentBlock = CurrentBlock->Next;
+			Xalloc_warn("Attempted to free an already freed block! %#lx", Address);
+			XallocV2_unlock;
+			return;
 		}
 
-		Xalloc_err("Invalid address %#lx.", Address);
+		this->HeapUsed -= c->Size & ~XallocV2_Used;
+		c = this->Coalesce(c);
+		this->InsertChunk(c);
+
+		/* Give back arenas made for big allocations */
+		Arena *a = (Arena *)((Xuintptr_t)c - sizeof(Arena));
+		if (a->Prologue == XallocV2_Used &&
+			a->Pages > XallocV2_ArenaPages &&
+			c->Size == XPtoS(a->Pages) - sizeof(Arena) - XallocV2_Header)
+			this->ReleaseArena(a);
 		XallocV2_unlock;
 	}
 
@@ -246,16 +372,43 @@ namespace Xalloc
 			return nullptr;
 		}
 
-		// XallocV2_lock;
-		// ...
-		// XallocV2_unlock;
+		Chunk *c = XallocV2_Chunk_Of(Address);
+		Xsize_t Needed = this->ChunkSize(Size);
+
+		XallocV2_lock;
+		this->Check(c);
+		Xsize_t Old = c->Size & ~XallocV2_Used;
+		Xsize_t Current = Old;
+
+		/* Try to grow into the next chunk */
+		if (Needed > Current)
+		{
+			Chunk *Next = (Chunk *)((Xuintptr_t)c + Current);
+			if (!(Next->Size & XallocV2_Used) &&
+				Current + Next->Size >= Needed)
+			{
+				this->RemoveChunk(Next);
+				Current += Next->Size;
+				this->SetChunk(c, Current, true);
+			}
+		}
+
+		if (Needed <= Current)
+		{
+			this->SplitChunk(c, Needed);
+			this->HeapUsed = this->HeapUsed - Old + (c->Size & ~XallocV2_Used);
+			XallocV2_unlock;
+			return Address;
+		}
+		XallocV2_unlock;
 
-		// TODO: Implement realloc
-		static int once = 0;
-		if (!once++)
-			Xalloc_trace("realloc is stub!");
+		void *ret = this->malloc(Size);
+		if (ret == nullptr)
+			return nullptr;
+
+		memcpy(ret, Address, Current - XallocV2_Header - XallocV2_Footer);
 		this->free(Address);
-		return this->malloc(Size);
+		return ret;
 	}
 
 	V2::V2(void *VirtualBase)
@@ -275,7 +428,12 @@ namespace Xalloc
 	V2::~V2()
 	{
 		XallocV2_lock;
-		Xalloc_trace("Destructor not implemented yet.");
+		while (this->FirstArena)
+		{
+			Arena *a = this->FirstArena;
+			this->FirstArena = a->Next;
+			this->FreeHeap((Xuint8_t *)a, XPtoS(a->Pages));
+		}
 		XallocV2_unlock;
 	}
 }
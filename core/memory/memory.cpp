@@ -42,6 +42,10 @@
 using namespace Memory;
 
 Physical KernelAllocator;
+ZeroPool ZeroedPages;
+AllocationProfiler HeapProfiler;
+Reclaimer PageReclaimer;
+PageMerger SamePageMerger;
 PageTable *KernelPageTable = nullptr;
 bool Page1GBSupport = false;
 bool PSESupport = false;
@@ -49,6 +53,7 @@ bool PSESupport = false;
 MemoryAllocatorType AllocatorType = MemoryAllocatorType::Pages;
 Xalloc::V1 *XallocV1Allocator = nullptr;
 Xalloc::V2 *XallocV2Allocator = nullptr;
+SlabHeap KernelHeap;
 
 #ifdef DEBUG
 NIF void tracepagetable(PageTable *pt)
@@ -368,7 +373,8 @@ NIF void InitializeMemoryManagement()
 
 	trace("Initializing Virtual Memory Manager");
 	KernelPageTable = (PageTable *)KernelAllocator.RequestPages(TO_PAGES(PAGE_SIZE + 1));
-	memset(KernelPageTable, 0, PAGE_SIZE);
+	memset(KernelPageTable, 0, sizeof(PageTable));
+	KernelPageTable->Generation = TLB::NewGeneration();
 
 	CreatePageTable(KernelPageTable);
 
@@ -417,6 +423,11 @@ NIF void InitializeMemoryManagement()
 		rpmalloc_initialize_config(&config);
 		break;
 	}
+	case MemoryAllocatorType::Slab:
+	{
+		trace("Using slab heap");
+		break;
+	}
 	default:
 	{
 		error("Unknown allocator type %d", AllocatorType);
@@ -425,14 +436,8 @@ NIF void InitializeMemoryManagement()
 	}
 }
 
-void *malloc(size_t Size)
+static void *HeapMalloc(size_t Size)
 {
-	assert(Size > 0);
-
-	memdbg("malloc(%d)->[%s]", Size,
-		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
-							 : "Unknown");
-
 	void *ret = nullptr;
 	switch (AllocatorType)
 	{
@@ -461,6 +466,11 @@ void *malloc(size_t Size)
 		ret = rpmalloc(Size);
 		break;
 	}
+	case MemoryAllocatorType::Slab:
+	{
+		ret = KernelHeap.malloc(Size);
+		break;
+	}
 	default:
 	{
 		error("Unknown allocator type %d", AllocatorType);
@@ -468,24 +478,44 @@ void *malloc(size_t Size)
 	}
 	}
 
-	memset(ret, 0, Size);
 	return ret;
 }
 
-void *calloc(size_t n, size_t Size)
+void *malloc(size_t Size)
 {
 	assert(Size > 0);
 
-	memdbg("calloc(%d, %d)->[%s]", n, Size,
+	memdbg("malloc(%d)->[%s]", Size,
 		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
 							 : "Unknown");
 
+	void *ret = HeapMalloc(Size);
+	HeapProfiler.Allocated(ret, Size, __builtin_return_address(0));
+	return ret;
+}
+
+static void *HeapCalloc(size_t n, size_t Size)
+{
+	size_t Total = n * Size;
+	if (unlikely(n != 0 && Total / n != Size))
+	{
+		error("calloc(%ld, %ld) overflows", n, Size);
+		return nullptr;
+	}
+
 	void *ret = nullptr;
+	if (Total >= ZERO_POOL_THRESHOLD)
+	{
+		ret = ZeroedPages.Allocate(Total);
+		if (ret)
+			return ret;
+	}
+
 	switch (AllocatorType)
 	{
 	case MemoryAllocatorType::Pages:
 	{
-		ret = KernelAllocator.RequestPages(TO_PAGES(n * Size + 1));
+		ret = KernelAllocator.RequestPages(TO_PAGES(Total + 1));
 		break;
 	}
 	case MemoryAllocatorType::XallocV1:
@@ -500,13 +530,20 @@ void *calloc(size_t n, size_t Size)
 	}
 	case MemoryAllocatorType::liballoc11:
 	{
+		/* liballoc zeroes the memory itself */
 		void *ret = PREFIX(calloc)(n, Size);
 		return ret;
 	}
 	case MemoryAllocatorType::rpmalloc_:
 	{
+		/* So does rpmalloc */
 		ret = rpcalloc(n, Size);
-		break;
+		return ret;
+	}
+	case MemoryAllocatorType::Slab:
+	{
+		ret = KernelHeap.calloc(n, Size);
+		return ret;
 	}
 	default:
 	{
@@ -515,19 +552,37 @@ void *calloc(size_t n, size_t Size)
 	}
 	}
 
-	memset(ret, 0, n * Size);
+	memset(ret, 0, Total);
 	return ret;
 }
 
-void *realloc(void *Address, size_t Size)
+void *calloc(size_t n, size_t Size)
 {
 	assert(Size > 0);
 
-	memdbg("realloc(%#lx, %d)->[%s]", Address, Size,
+	memdbg("calloc(%d, %d)->[%s]", n, Size,
 		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
 							 : "Unknown");
 
+	void *ret = HeapCalloc(n, Size);
+	HeapProfiler.Allocated(ret, n * Size, __builtin_return_address(0));
+	return ret;
+}
+
+static void *HeapRealloc(void *Address, size_t Size)
+{
 	void *ret = nullptr;
+	size_t PoolSize = ZeroedPages.GetSize(Address);
+	if (PoolSize)
+	{
+		ret = HeapMalloc(Size);
+		if (unlikely(!ret))
+			return nullptr;
+		memcpy(ret, Address, Size < PoolSize ? Size : PoolSize);
+		ZeroedPages.Free(Address);
+		return ret;
+	}
+
 	switch (AllocatorType)
 	{
 	case unlikely(MemoryAllocatorType::Pages):
@@ -555,6 +610,11 @@ void *realloc(void *Address, size_t Size)
 		ret = rprealloc(Address, Size);
 		break;
 	}
+	case MemoryAllocatorType::Slab:
+	{
+		ret = KernelHeap.realloc(Address, Size);
+		break;
+	}
 	default:
 	{
 		error("Unknown allocator type %d", AllocatorType);
@@ -562,7 +622,20 @@ void *realloc(void *Address, size_t Size)
 	}
 	}
 
-	memset(ret, 0, Size);
+	return ret;
+}
+
+void *realloc(void *Address, size_t Size)
+{
+	assert(Size > 0);
+
+	memdbg("realloc(%#lx, %d)->[%s]", Address, Size,
+		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
+							 : "Unknown");
+
+	HeapProfiler.Freed(Address);
+	void *ret = HeapRealloc(Address, Size);
+	HeapProfiler.Allocated(ret, Size, __builtin_return_address(0));
 	return ret;
 }
 
@@ -574,6 +647,10 @@ void free(void *Address)
 		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
 							 : "Unknown");
 
+	HeapProfiler.Freed(Address);
+	if (ZeroedPages.Free(Address))
+		return;
+
 	switch (AllocatorType)
 	{
 	case unlikely(MemoryAllocatorType::Pages):
@@ -602,6 +679,11 @@ void free(void *Address)
 		rpfree(Address);
 		break;
 	}
+	case MemoryAllocatorType::Slab:
+	{
+		KernelHeap.free(Address);
+		break;
+	}
 	default:
 	{
 		error("Unknown allocator type %d", AllocatorType);
@@ -618,7 +700,8 @@ void *operator new(std::size_t Size)
 		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
 							 : "Unknown");
 
-	void *ret = malloc(Size);
+	void *ret = HeapMalloc(Size);
+	HeapProfiler.Allocated(ret, Size, __builtin_return_address(0));
 	return ret;
 }
 
@@ -630,7 +713,8 @@ void *operator new[](std::size_t Size)
 		   KernelSymbolTable ? KernelSymbolTable->GetSymbol((uintptr_t)__builtin_return_address(0))
 							 : "Unknown");
 
-	void *ret = malloc(Size);
+	void *ret = HeapMalloc(Size);
+	HeapProfiler.Allocated(ret, Size, __builtin_return_address(0));
 	return ret;
 }
 
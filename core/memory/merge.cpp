@@ -0,0 +1,250 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <crc32.h>
+#include <task.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+/* A stable slot that was freed, probing continues past it */
+#define MERGE_TOMBSTONE ((void *)1)
+
+namespace Memory
+{
+	uint32_t PageMerger::Checksum(void *Frame)
+	{
+		return crc32((const uint8_t *)Frame, PAGE_SIZE);
+	}
+
+	bool PageMerger::IsZero(void *Frame)
+	{
+		const uint64_t *Words = (const uint64_t *)Frame;
+		for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++)
+		{
+			if (Words[i] != 0)
+				return false;
+		}
+		return true;
+	}
+
+	PageMerger::StablePage *PageMerger::FindStable(void *Frame, uint32_t Checksum)
+	{
+		for (size_t i = 0; i < MERGE_PROBES; i++)
+		{
+			StablePage *s = &Stable[(Checksum + i) % MERGE_STABLE_SLOTS];
+			if (s->Frame == nullptr)
+				return nullptr;
+			if (s->Frame == Frame)
+				return s;
+		}
+		return nullptr;
+	}
+
+	void *PageMerger::Merge(void *Frame, uint32_t Checksum,
+							const void *Owner, uintptr_t Address)
+	{
+		SmartLock(MergeLock);
+		if (Stable == nullptr)
+			return nullptr;
+
+		StablePage *Free = nullptr;
+		for (size_t i = 0; i < MERGE_PROBES; i++)
+		{
+			StablePage *s = &Stable[(Checksum + i) % MERGE_STABLE_SLOTS];
+			if (s->Frame == nullptr || s->Frame == MERGE_TOMBSTONE)
+			{
+				if (Free == nullptr)
+					Free = s;
+				if (s->Frame == nullptr)
+					break;
+				continue;
+			}
+
+			if (s->Checksum != Checksum || s->Frame == Frame)
+				continue;
+
+			if (memcmp(s->Frame, Frame, PAGE_SIZE) != 0)
+				continue;
+
+			s->References++;
+			Sharing++;
+			return s->Frame;
+		}
+
+		/* Only keep pages that another page has matched */
+		Candidate *c = &Candidates[Checksum % MERGE_CANDIDATE_SLOTS];
+		if (c->Owner == nullptr || c->Checksum != Checksum)
+		{
+			*c = {Owner, Address, Checksum};
+			return nullptr;
+		}
+
+		if ((c->Owner == Owner && c->Address == Address) || Free == nullptr)
+			return nullptr;
+
+		/* The other page finds this one on its next scan */
+		*Free = {Frame, Checksum, 1};
+		c->Owner = nullptr;
+		Shared++;
+		debug("Page %#lx is now merged (%#x)", Frame, Checksum);
+		return Frame;
+	}
+
+	bool PageMerger::Get(void *Frame)
+	{
+		if (Stable == nullptr)
+			return false;
+
+		uint32_t Sum = Checksum(Frame);
+		SmartLock(MergeLock);
+		StablePage *s = FindStable(Frame, Sum);
+		if (s == nullptr)
+			return false;
+
+		s->References++;
+		Sharing++;
+		return true;
+	}
+
+	bool PageMerger::Put(void *Frame)
+	{
+		if (Stable == nullptr)
+			return false;
+
+		/* Merged pages are read-only, the checksum is still valid */
+		uint32_t Sum = Checksum(Frame);
+		SmartLock(MergeLock);
+		StablePage *s = FindStable(Frame, Sum);
+		if (s == nullptr)
+			return false;
+
+		if (--s->References > 0)
+		{
+			Sharing--;
+			return true;
+		}
+
+		s->Frame = MERGE_TOMBSTONE;
+		Shared--;
+		KernelAllocator.FreePage(Frame);
+		return true;
+	}
+
+	struct MergeWalk
+	{
+		pid_t Cursor;
+		pid_t Next;
+		size_t Budget;
+		size_t Done;
+	};
+
+	/* Next process after the cursor, in PID order */
+	static bool FindNext(Tasking::PCB *pcb, void *Context)
+	{
+		MergeWalk *Walk = (MergeWalk *)Context;
+		if (pcb->State == Tasking::Terminated ||
+			pcb->State == Tasking::Zombie ||
+			pcb->Security.ExecutionMode == Tasking::Kernel)
+			return true;
+
+		if (pcb->ID > Walk->Cursor && (Walk->Next == 0 || pcb->ID < Walk->Next))
+			Walk->Next = pcb->ID;
+		return true;
+	}
+
+	/* Merged under the walk, the process can't exit meanwhile */
+	static bool MergeNext(Tasking::PCB *pcb, void *Context)
+	{
+		MergeWalk *Walk = (MergeWalk *)Context;
+		if (pcb->ID != Walk->Next)
+			return true;
+
+		Walk->Done = pcb->vma->MergePages(Walk->Budget);
+		return false;
+	}
+
+	void PageMerger::ScanBatch()
+	{
+		size_t Budget = MERGE_BATCH;
+		while (Budget > 0)
+		{
+			MergeWalk Walk = {Cursor, 0, Budget, 0};
+			TaskManager->ForEachProcess(FindNext, &Walk);
+			if (Walk.Next == 0)
+			{
+				/* Pass done, checksums of the next one start fresh */
+				SmartLock(MergeLock);
+				memset(Candidates, 0, sizeof(Candidate) * MERGE_CANDIDATE_SLOTS);
+				FullScans++;
+				Cursor = 0;
+				return;
+			}
+
+			/* Gone since the first walk, Done stays 0 and it is skipped */
+			TaskManager->ForEachProcess(MergeNext, &Walk);
+			if (Walk.Done < Budget)
+				Cursor = Walk.Next;
+			Budget -= Walk.Done;
+		}
+	}
+
+	void PageMerger::DaemonEntry()
+	{
+		while (true)
+		{
+			if (SamePageMerger.Enabled.load())
+				SamePageMerger.ScanBatch();
+			TaskManager->Sleep(MERGE_INTERVAL);
+		}
+	}
+
+	void PageMerger::Enable()
+	{
+		SmartLock(MergeLock);
+		if (Stable == nullptr)
+		{
+			size_t Pages = TO_PAGES(sizeof(StablePage) * MERGE_STABLE_SLOTS);
+			Stable = (StablePage *)KernelAllocator.RequestPages(Pages);
+			memset(Stable, 0, FROM_PAGES(Pages));
+
+			Pages = TO_PAGES(sizeof(Candidate) * MERGE_CANDIDATE_SLOTS);
+			Candidates = (Candidate *)KernelAllocator.RequestPages(Pages);
+			memset(Candidates, 0, FROM_PAGES(Pages));
+		}
+
+		if (!Started)
+		{
+			Tasking::TCB *t = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+														Tasking::IP(DaemonEntry));
+			t->Rename("Page Merger");
+			t->SetPriority(Tasking::Idle);
+			Started = true;
+		}
+
+		Enabled.store(true);
+		trace("Same page merging enabled");
+	}
+
+	void PageMerger::Disable()
+	{
+		Enabled.store(false);
+		trace("Same page merging disabled");
+	}
+}
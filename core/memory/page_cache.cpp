@@ -0,0 +1,369 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory/page_cache.hpp>
+
+#include <memory.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+Memory::PageCache FilePageCache;
+
+namespace Memory
+{
+	PageCache::FileCache *PageCache::GetFile(vfs::Node *Node, bool Create)
+	{
+		foreach (auto File in Files)
+		{
+			if (File->Node == Node && !File->Orphan)
+				return File;
+		}
+
+		if (!Create)
+			return nullptr;
+
+		FileCache *File = new FileCache;
+		File->Node = Node;
+		Files.push_back(File);
+		debug("New page cache for %s(%#lx)", Node->FullPath, Node);
+		return File;
+	}
+
+	/* CacheLock must be held, it is dropped while waiting for I/O on Offset */
+	PageCache::FileCache *PageCache::GetIdleFile(vfs::Node *Node, off_t Offset, bool Create)
+	{
+		while (true)
+		{
+			/* Look it up again, the file may be gone after waiting */
+			FileCache *File = this->GetFile(Node, Create);
+			if (File == nullptr)
+				return nullptr;
+
+			auto itr = File->Pages.find(Offset);
+			if (itr == File->Pages.end() || !itr->second.Busy)
+				return File;
+
+			CacheLock.Unlock();
+			TaskManager->Yield();
+			CacheLock.Lock(__FUNCTION__);
+		}
+	}
+
+	/* CacheLock must be held, it is dropped around the write */
+	int PageCache::WritePage(FileCache *File, off_t Offset)
+	{
+		auto itr = File->Pages.find(Offset);
+		if (itr == File->Pages.end())
+			return 0;
+
+		CachedPage &Page = itr->second;
+		if (!Page.Dirty || Page.Busy || File->Orphan || File->Pinned)
+			return 0;
+
+		vfs::Node *Node = File->Node;
+		if (Offset >= Node->Size)
+		{
+			Page.Dirty = false;
+			return 0;
+		}
+
+		size_t Length = PAGE_SIZE;
+		if (Offset + (off_t)Length > Node->Size)
+			Length = (size_t)(Node->Size - Offset);
+
+		/* Busy keeps the page and the file around, stores
+			through a mapping during the write dirty it again */
+		void *Frame = Page.Frame;
+		Page.Busy = true;
+		Page.Dirty = false;
+		CacheLock.Unlock();
+		ssize_t ret = (ssize_t)Node->write((uint8_t *)Frame, Length, Offset);
+		CacheLock.Lock(__FUNCTION__);
+
+		CachedPage &Done = File->Pages.find(Offset)->second;
+		Done.Busy = false;
+		if (ret < 0)
+		{
+			error("Failed to write back %s+%#lx: %d",
+				  Node->FullPath, Offset, ret);
+			Done.Dirty = true;
+			return (int)ret;
+		}
+
+		debug("Wrote back %s+%#lx (%lld bytes)",
+			  Node->FullPath, Offset, Length);
+		return 0;
+	}
+
+	void *PageCache::RequestPage(vfs::Node *Node, off_t Offset)
+	{
+		assert(Offset % PAGE_SIZE == 0);
+
+		SmartLock(CacheLock);
+		FileCache *File = this->GetIdleFile(Node, Offset, true);
+		auto itr = File->Pages.find(Offset);
+		if (itr != File->Pages.end())
+		{
+			itr->second.References++;
+			return itr->second.Frame;
+		}
+
+		/* Hold the slot, others wait for the read instead of racing it */
+		File->Pages[Offset] = {nullptr, 1, false, true};
+		bool Fill = Offset < Node->Size && !File->Pinned;
+		CacheLock.Unlock();
+
+		void *Frame = KernelAllocator.RequestPage();
+		if (Frame != nullptr)
+		{
+			memset(Frame, 0, PAGE_SIZE);
+			if (Fill)
+			{
+				size_t Length = PAGE_SIZE;
+				if (Offset + (off_t)Length > Node->Size)
+					Length = (size_t)(Node->Size - Offset);
+
+				ssize_t ret = (ssize_t)Node->read((uint8_t *)Frame, Length, Offset);
+				if (ret < 0)
+				{
+					error("Failed to read %s+%#lx: %d",
+						  Node->FullPath, Offset, ret);
+					KernelAllocator.FreePage(Frame);
+					Frame = nullptr;
+				}
+			}
+		}
+
+		CacheLock.Lock(__FUNCTION__);
+		if (Frame == nullptr)
+		{
+			File->Pages.erase(Offset);
+			if (File->Orphan && File->Pages.empty())
+			{
+				Files.remove(File);
+				delete File;
+			}
+			return nullptr;
+		}
+
+		CachedPage &Page = File->Pages.find(Offset)->second;
+		Page.Frame = Frame;
+		Page.Busy = false;
+		CachedPages++;
+		debug("Cached %s+%#lx at %#lx", Node->FullPath, Offset, Frame);
+		return Frame;
+	}
+
+	void PageCache::ReleasePage(vfs::Node *Node, off_t Offset, void *Frame, bool Dirty)
+	{
+		SmartLock(CacheLock);
+	Retry:
+		foreach (auto File in Files)
+		{
+			if (File->Node != Node)
+				continue;
+
+			/* The frame is only ever in one cache */
+			auto itr = File->Pages.find(Offset);
+			if (itr == File->Pages.end() || itr->second.Frame != Frame)
+				continue;
+
+			/* Sync is writing it back */
+			if (itr->second.Busy)
+			{
+				CacheLock.Unlock();
+				TaskManager->Yield();
+				CacheLock.Lock(__FUNCTION__);
+				goto Retry;
+			}
+
+			CachedPage &Page = itr->second;
+			assert(Page.References > 0);
+			Page.Dirty |= Dirty;
+			if (--Page.References > 0)
+				return;
+
+			/* Last mapping is gone, don't keep dirty data around */
+			this->WritePage(File, Offset);
+			if (!File->Orphan)
+				return;
+
+			/* Files may have changed while the lock was dropped */
+			itr = File->Pages.find(Offset);
+			if (itr->second.References > 0)
+				return;
+
+			KernelAllocator.FreePage(itr->second.Frame);
+			CachedPages--;
+			File->Pages.erase(Offset);
+			if (File->Pages.empty())
+			{
+				Files.remove(File);
+				delete File;
+			}
+			return;
+		}
+
+		error("Page %s+%#lx is not cached", Node->FullPath, Offset);
+	}
+
+	void PageCache::MarkDirty(vfs::Node *Node, off_t Offset)
+	{
+		SmartLock(CacheLock);
+		FileCache *File = this->GetFile(Node, false);
+		if (File == nullptr)
+			return;
+
+		auto itr = File->Pages.find(Offset);
+		if (itr != File->Pages.end())
+			itr->second.Dirty = true;
+	}
+
+	int PageCache::Sync(vfs::Node *Node, off_t Offset, size_t Length)
+	{
+		SmartLock(CacheLock);
+		off_t Start = ALIGN_DOWN(Offset, PAGE_SIZE);
+		off_t End = Offset + (off_t)Length;
+		for (off_t i = Start; i < End; i += PAGE_SIZE)
+		{
+			/* A write back already in flight may predate our data */
+			FileCache *File = this->GetIdleFile(Node, i, false);
+			if (File == nullptr || File->Pinned)
+				return 0;
+
+			if (this->WritePage(File, i) < 0)
+				return -EIO;
+		}
+		return 0;
+	}
+
+	void PageCache::Pin(vfs::Node *Node)
+	{
+		SmartLock(CacheLock);
+		this->GetFile(Node, true)->Pinned = true;
+	}
+
+	void PageCache::Truncate(vfs::Node *Node, off_t Offset)
+	{
+		assert(Offset % PAGE_SIZE == 0);
+
+		SmartLock(CacheLock);
+		FileCache *File = this->GetFile(Node, false);
+		if (File == nullptr)
+			return;
+
+		std::list<off_t> Unused;
+		foreach (auto &Page in File->Pages)
+		{
+			if (Page.first < Offset || Page.second.References > 0 ||
+				Page.second.Busy)
+				continue;
+
+			KernelAllocator.FreePage(Page.second.Frame);
+			CachedPages--;
+			Unused.push_back(Page.first);
+		}
+
+		foreach (auto Page in Unused)
+			File->Pages.erase(Page);
+	}
+
+	void PageCache::Invalidate(vfs::Node *Node)
+	{
+		SmartLock(CacheLock);
+		FileCache *File = this->GetFile(Node, false);
+		if (File == nullptr)
+			return;
+
+		std::list<off_t> Unused;
+		foreach (auto &Page in File->Pages)
+		{
+			if (Page.second.References > 0 || Page.second.Busy)
+				continue;
+
+			KernelAllocator.FreePage(Page.second.Frame);
+			CachedPages--;
+			Unused.push_back(Page.first);
+		}
+
+		foreach (auto Offset in Unused)
+			File->Pages.erase(Offset);
+
+		if (File->Pages.empty())
+		{
+			Files.remove(File);
+			delete File;
+			return;
+		}
+
+		/* Still mapped or written back, free them on the last ReleasePage */
+		File->Orphan = true;
+	}
+
+	size_t PageCache::Shrink(size_t Pages)
+	{
+		/* Reclaim can run under one of our own allocations */
+		if (CacheLock.Locked())
+			return 0;
+
+		SmartLock(CacheLock);
+		size_t Freed = 0;
+		for (auto fItr = Files.begin(); fItr != Files.end() && Freed < Pages;)
+		{
+			FileCache *File = *fItr;
+			if (File->Pinned)
+			{
+				++fItr;
+				continue;
+			}
+
+			/* Collect first, erasing invalidates the iterator */
+			off_t Victims[RECLAIM_BATCH];
+			size_t Count = 0;
+			foreach (auto &Page in File->Pages)
+			{
+				if (Count == RECLAIM_BATCH || Freed + Count >= Pages)
+					break;
+
+				/* Writing back from here could recurse into the allocator */
+				if (Page.second.References > 0 || Page.second.Dirty ||
+					Page.second.Busy)
+					continue;
+
+				KernelAllocator.FreePage(Page.second.Frame);
+				Victims[Count++] = Page.first;
+			}
+
+			for (size_t i = 0; i < Count; i++)
+				File->Pages.erase(Victims[i]);
+			CachedPages -= Count;
+			Freed += Count;
+
+			if (Count == RECLAIM_BATCH)
+				continue;
+
+			++fItr;
+			if (File->Pages.empty())
+			{
+				Files.remove(File);
+				delete File;
+			}
+		}
+		return Freed;
+	}
+}
@@ -9,11 +9,7 @@ namespace Memory
 {
 	void PageTable::Update()
 	{
-#if defined(a86)
-		asmv("mov %0, %%cr3" ::"r"(this));
-#elif defined(aa64)
-		asmv("msr ttbr0_el1, %0" ::"r"(this));
-#endif
+		TLB::Load(this);
 	}
 
 	PageTable *PageTable::Fork()
@@ -22,6 +18,9 @@ namespace Memory
 		// memset(NewTable, 0, sizeof(PageTable));
 		// CreatePageTable(NewTable);
 		memcpy(NewTable, this, sizeof(PageTable));
+		NewTable->Generation = TLB::NewGeneration();
+		if (this == KernelPageTable)
+			NewTable->ShadowsDirectMap = false;
 
 		debug("Forking page table %#lx to %#lx", this, NewTable);
 #if defined(a64)
@@ -80,6 +79,48 @@ namespace Memory
 		return NewTable;
 	}
 
+	bool PageTable::SyncKernelMapping(uintptr_t Address)
+	{
+#if defined(a64)
+		if (this == KernelPageTable)
+			return false;
+
+		Virtual kvmm(KernelPageTable);
+		Virtual vmm(this);
+		void *Page = (void *)ALIGN_DOWN(Address, PAGE_SIZE);
+		if (vmm.Check(Page) || !kvmm.Check(Page))
+			return false;
+
+		Virtual::MapType Type = kvmm.GetMapType(Page);
+		uint64_t Flags;
+		switch (Type)
+		{
+		case Virtual::MapType::FourKiB:
+			Flags = kvmm.GetPTE(Page)->raw;
+			break;
+		case Virtual::MapType::TwoMiB:
+			Page = (void *)ALIGN_DOWN(Address, PAGE_SIZE_2M);
+			Flags = kvmm.GetPDE(Page, Type)->raw & ~(uint64_t)PTFlag::PS;
+			break;
+		case Virtual::MapType::OneGiB:
+			Page = (void *)ALIGN_DOWN(Address, PAGE_SIZE_1G);
+			Flags = kvmm.GetPDPTE(Page, Type)->raw & ~(uint64_t)PTFlag::PS;
+			break;
+		default:
+			return false;
+		}
+
+		/* Keep the attribute bits, the address comes from GetPhysical */
+		Flags &= 0xFFF | (1ULL << 63);
+		vmm.Map(Page, kvmm.GetPhysical(Page), Flags, Type);
+		debug("Synced kernel mapping %#lx to pt %#lx", Page, this);
+		return true;
+#else
+		UNUSED(Address);
+		return false;
+#endif
+	}
+
 	/* We can't have Memory::Virtual in the header */
 	void *PageTable::__getPhysical(void *Address)
 	{
@@ -50,24 +50,33 @@ namespace Memory
 
 	bool Physical::SwapPage(void *Address)
 	{
-		fixme("%p", Address);
+		if (Address == nullptr)
+			return KernelSwap.Evict(1) == 1;
+
+		fixme("Swapping out a specific page (%p)", Address);
 		return false;
 	}
 
 	bool Physical::SwapPages(void *Address, size_t PageCount)
 	{
+		if (Address == nullptr)
+			return KernelSwap.Evict(PageCount) == PageCount;
+
 		for (size_t i = 0; i < PageCount; i++)
 		{
 			if (!this->SwapPage((void *)((uintptr_t)Address + (i * PAGE_SIZE))))
 				return false;
 		}
-		return false;
+		return true;
 	}
 
 	bool Physical::UnswapPage(void *Address)
 	{
-		fixme("%p", Address);
-		return false;
+		if (TaskManager == nullptr)
+			return false;
+
+		Tasking::PCB *pcb = thisProcess;
+		return pcb->vma->HandleCoW((uintptr_t)Address, false);
 	}
 
 	bool Physical::UnswapPages(void *Address, size_t PageCount)
@@ -77,33 +86,53 @@ namespace Memory
 			if (!this->UnswapPage((void *)((uintptr_t)Address + (i * PAGE_SIZE))))
 				return false;
 		}
-		return false;
+		return true;
 	}
 
-	void *Physical::RequestPage()
+	bool Physical::Reclaim(size_t Count, int Attempt)
 	{
-		SmartLock(this->MemoryLock);
+		/* Caches first, then swap, then the largest process */
+		if (Attempt > RECLAIM_OOM_KILLS)
+			return false;
 
-		for (; PageBitmapIndex < PageBitmap.Size * 8; PageBitmapIndex++)
+		if (Attempt == 0)
 		{
-			if (PageBitmap[PageBitmapIndex] == true)
-				continue;
-
-			this->LockPage((void *)(PageBitmapIndex * PAGE_SIZE));
-			return (void *)(PageBitmapIndex * PAGE_SIZE);
+			if (PageReclaimer.Shrink(Count) < Count)
+				this->SwapPages(nullptr, Count);
+			return true;
 		}
 
-		if (this->SwapPage((void *)(PageBitmapIndex * PAGE_SIZE)))
+		return PageReclaimer.KillVictim();
+	}
+
+	void *Physical::RequestPage()
+	{
+		for (int Attempt = 0;; Attempt++)
 		{
-			this->LockPage((void *)(PageBitmapIndex * PAGE_SIZE));
-			return (void *)(PageBitmapIndex * PAGE_SIZE);
+			MemoryLock.Lock(__FUNCTION__);
+			for (; PageBitmapIndex < PageBitmap.Size * 8; PageBitmapIndex++)
+			{
+				if (this->Taken(PageBitmapIndex))
+					continue;
+
+				this->LockPage((void *)(PageBitmapIndex * PAGE_SIZE));
+				void *Page = (void *)(PageBitmapIndex * PAGE_SIZE);
+				MemoryLock.Unlock();
+				PageReclaimer.Check(FreeMemory.load());
+				return Page;
+			}
+			MemoryLock.Unlock();
+
+			/* Reclaim frees pages, so the lock must be released */
+			if (!this->Reclaim(1, Attempt))
+				break;
 		}
 
-		if (TaskManager && !TaskManager->IsPanic())
+		/* A victim is on its way out, fail this one instead of halting */
+		if (PageReclaimer.KillPending())
 		{
-			error("Out of memory! Killing current process...");
-			TaskManager->KillProcess(thisProcess, Tasking::KILL_OOM);
-			TaskManager->Yield();
+			warn("Out of memory, failing a 1 page request");
+			return nullptr;
 		}
 
 		error("Out of memory! (Free: %ld MiB; Used: %ld MiB; Reserved: %ld MiB)",
@@ -118,44 +147,57 @@ namespace Memory
 
 	void *Physical::RequestPages(size_t Count)
 	{
-		SmartLock(this->MemoryLock);
-
-		for (; PageBitmapIndex < PageBitmap.Size * 8; PageBitmapIndex++)
+		for (int Attempt = 0;; Attempt++)
 		{
-			if (PageBitmap[PageBitmapIndex] == true)
-				continue;
-
-			for (uint64_t Index = PageBitmapIndex; Index < PageBitmap.Size * 8; Index++)
+			MemoryLock.Lock(__FUNCTION__);
+			for (; PageBitmapIndex < PageBitmap.Size * 8; PageBitmapIndex++)
 			{
-				if (PageBitmap[Index] == true)
+				if (this->Taken(PageBitmapIndex))
 					continue;
 
-				for (size_t i = 0; i < Count; i++)
+				for (uint64_t Index = PageBitmapIndex; Index < PageBitmap.Size * 8; Index++)
 				{
-					if (PageBitmap[Index + i] == true)
-						goto NextPage;
+					if (this->Taken(Index))
+						continue;
+
+					for (size_t i = 0; i < Count; i++)
+					{
+						if (this->Taken(Index + i))
+							goto NextPage;
+					}
+
+					this->LockPages((void *)(Index * PAGE_SIZE), Count);
+					MemoryLock.Unlock();
+					PageReclaimer.Check(FreeMemory.load());
+					return (void *)(Index * PAGE_SIZE);
+
+				NextPage:
+					Index += Count;
+					continue;
 				}
+			}
+			MemoryLock.Unlock();
 
-				this->LockPages((void *)(Index * PAGE_SIZE), Count);
-				return (void *)(Index * PAGE_SIZE);
-
-			NextPage:
-				Index += Count;
-				continue;
+			/* Enough is free but scattered, move pages out of the way */
+			if (Count > 1 && FreeMemory.load() >= FROM_PAGES(Count))
+			{
+				void *Run = this->Compact(Count);
+				if (Run != nullptr)
+				{
+					PageReclaimer.Check(FreeMemory.load());
+					return Run;
+				}
 			}
-		}
 
-		if (this->SwapPages((void *)(PageBitmapIndex * PAGE_SIZE), Count))
-		{
-			this->LockPages((void *)(PageBitmapIndex * PAGE_SIZE), Count);
-			return (void *)(PageBitmapIndex * PAGE_SIZE);
+			/* Freed pages may not be contiguous */
+			if (!this->Reclaim(Count, Attempt))
+				break;
 		}
 
-		if (TaskManager && !TaskManager->IsPanic())
+		if (PageReclaimer.KillPending())
 		{
-			error("Out of memory! Killing current process...");
-			TaskManager->KillProcess(thisProcess, Tasking::KILL_OOM);
-			TaskManager->Yield();
+			warn("Out of memory, failing a %ld page(s) request", Count);
+			return nullptr;
 		}
 
 		error("Out of memory! (Free: %ld MiB; Used: %ld MiB; Reserved: %ld MiB)",
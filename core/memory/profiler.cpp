@@ -0,0 +1,183 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <debug.h>
+#include <topn.hpp>
+
+#include "../../kernel.h"
+
+/* Sample of a freed allocation, keeps the probe chains intact */
+#define PROFILER_TOMBSTONE ((uintptr_t)1)
+
+namespace Memory
+{
+	AllocationProfiler::Site *AllocationProfiler::GetSite(uintptr_t Caller)
+	{
+		size_t Start = HashPointer(Caller) % PROFILER_SITES;
+		for (size_t i = 0; i < PROFILER_PROBES; i++)
+		{
+			Site *s = &Sites[(Start + i) % PROFILER_SITES];
+			uintptr_t Current = s->Caller.load(std::memory_order_acquire);
+			if (Current == Caller)
+				return s;
+
+			if (Current == 0 &&
+				s->Caller.compare_exchange_strong(Current, Caller,
+												  std::memory_order_acq_rel))
+				return s;
+
+			/* Someone else took the slot, maybe for the same caller */
+			if (Current == Caller)
+				return s;
+		}
+		return nullptr;
+	}
+
+	void AllocationProfiler::Record(void *Address, size_t Size, void *Caller)
+	{
+		size_t Weight = Rate.load(std::memory_order_relaxed);
+		if (Counter.fetch_add(1, std::memory_order_relaxed) % Weight != 0)
+			return;
+
+		if (!Enabled.load(std::memory_order_acquire))
+			return;
+
+		Site *s = GetSite((uintptr_t)Caller);
+		if (unlikely(s == nullptr))
+		{
+			Dropped++;
+			return;
+		}
+
+		uintptr_t Key = (uintptr_t)Address;
+		size_t Start = HashPointer(Key) % PROFILER_SAMPLES;
+		for (size_t i = 0; i < PROFILER_PROBES; i++)
+		{
+			Sample *e = &Samples[(Start + i) % PROFILER_SAMPLES];
+			uintptr_t Current = e->Address.load(std::memory_order_acquire);
+			if (Current != 0 && Current != PROFILER_TOMBSTONE)
+				continue;
+
+			if (!e->Address.compare_exchange_strong(Current, Key,
+													std::memory_order_acq_rel))
+				continue;
+
+			/* Nobody can free it before we return it */
+			e->Owner = s;
+			e->Size = Size * Weight;
+			e->Weight = Weight;
+			s->Allocations += Weight;
+			s->TotalBytes += Size * Weight;
+			s->LiveBytes += Size * Weight;
+			Outstanding++;
+			return;
+		}
+		Dropped++;
+	}
+
+	void AllocationProfiler::Forget(void *Address)
+	{
+		uintptr_t Key = (uintptr_t)Address;
+		size_t Start = HashPointer(Key) % PROFILER_SAMPLES;
+		for (size_t i = 0; i < PROFILER_PROBES; i++)
+		{
+			Sample *e = &Samples[(Start + i) % PROFILER_SAMPLES];
+			uintptr_t Current = e->Address.load(std::memory_order_acquire);
+			if (Current == 0)
+				return;
+			if (Current != Key)
+				continue;
+
+			Site *s = e->Owner;
+			size_t Size = e->Size;
+			size_t Weight = e->Weight;
+			if (!e->Address.compare_exchange_strong(Current, PROFILER_TOMBSTONE,
+													std::memory_order_acq_rel))
+				return;
+
+			s->Frees += Weight;
+			s->LiveBytes -= Size;
+			Outstanding--;
+			return;
+		}
+	}
+
+	bool AllocationProfiler::Enable(size_t SampleRate)
+	{
+		SmartLock(ProfilerLock);
+		if (Sites == nullptr)
+		{
+			/* Never freed, samples may still be live after Disable */
+			Site *NewSites = (Site *)KernelAllocator.RequestPages(TO_PAGES(sizeof(Site) * PROFILER_SITES));
+			Sample *NewSamples = (Sample *)KernelAllocator.RequestPages(TO_PAGES(sizeof(Sample) * PROFILER_SAMPLES));
+			if (unlikely(NewSites == nullptr || NewSamples == nullptr))
+			{
+				if (NewSites)
+					KernelAllocator.FreePages(NewSites, TO_PAGES(sizeof(Site) * PROFILER_SITES));
+				if (NewSamples)
+					KernelAllocator.FreePages(NewSamples, TO_PAGES(sizeof(Sample) * PROFILER_SAMPLES));
+				error("Allocation profiler: out of memory");
+				return false;
+			}
+
+			memset(NewSites, 0, sizeof(Site) * PROFILER_SITES);
+			memset(NewSamples, 0, sizeof(Sample) * PROFILER_SAMPLES);
+			Samples = NewSamples;
+			Sites = NewSites;
+		}
+
+		Rate.store(SampleRate ? SampleRate : 1);
+		Enabled.store(true, std::memory_order_release);
+		trace("Allocation profiler enabled, sampling 1/%ld", Rate.load());
+		return true;
+	}
+
+	void AllocationProfiler::Disable()
+	{
+		SmartLock(ProfilerLock);
+		Enabled.store(false);
+		trace("Allocation profiler disabled, %ld samples live, %ld dropped",
+			  Outstanding.load(), Dropped.load());
+	}
+
+	size_t AllocationProfiler::GetSites(ProfileSite *Output, size_t Max)
+	{
+		if (Sites == nullptr || Max == 0)
+			return 0;
+
+		size_t Count = 0;
+		for (size_t i = 0; i < PROFILER_SITES; i++)
+		{
+			Site *s = &Sites[i];
+			ProfileSite Entry;
+			Entry.Caller = s->Caller.load(std::memory_order_acquire);
+			if (Entry.Caller == 0)
+				continue;
+
+			Entry.Allocations = s->Allocations.load(std::memory_order_relaxed);
+			Entry.Frees = s->Frees.load(std::memory_order_relaxed);
+			Entry.LiveBytes = s->LiveBytes.load(std::memory_order_relaxed);
+			Entry.TotalBytes = s->TotalBytes.load(std::memory_order_relaxed);
+
+			/* Leaks show up as live bytes, churn alone is not ranked */
+			Count = InsertTop(Output, Count, Max, Entry, &ProfileSite::LiveBytes);
+		}
+		return Count;
+	}
+}
@@ -0,0 +1,297 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <scheduler.hpp>
+#include <task.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+namespace Memory
+{
+	/* Thread running the shrinkers, to catch a shrinker that allocates */
+	static std::atomic<Tasking::TCB *> ReclaimOwner = nullptr;
+
+	/* Yielding with interrupts off or a lock held can stall the thread that would free memory */
+	static bool CanWait()
+	{
+		if (!CPU::Interrupts(CPU::Check) || TaskManager->IsPanic())
+			return false;
+
+		Tasking::TCB *Self = thisThread;
+		return Self != nullptr && Self->HeldLocks <= 0;
+	}
+
+	struct VictimWalk
+	{
+		Tasking::PCB *Victim;
+		uint64_t Size;
+		bool Killed;
+		pid_t Pending;
+		bool PendingFound;
+	};
+
+	static bool FindVictim(Tasking::PCB *pcb, void *Context)
+	{
+		VictimWalk *Walk = (VictimWalk *)Context;
+		if (pcb->ID == Walk->Pending)
+			Walk->PendingFound = true;
+
+		if (pcb->State == Tasking::Terminated ||
+			pcb->State == Tasking::Zombie)
+			return true;
+
+		if (pcb->Security.ExecutionMode == Tasking::Kernel ||
+			pcb->Security.IsCritical)
+			return true;
+
+		uint64_t Size = FROM_PAGES(pcb->vma->GetResidentPages());
+		if (Size > Walk->Size)
+		{
+			Walk->Victim = pcb;
+			Walk->Size = Size;
+		}
+		return true;
+	}
+
+	/* Only kill it if it is still in the list */
+	static bool KillFound(Tasking::PCB *pcb, void *Context)
+	{
+		VictimWalk *Walk = (VictimWalk *)Context;
+		if (pcb != Walk->Victim)
+			return true;
+
+		error("Out of memory! Killing \"%s\"(%d) using %ld KiB",
+			  pcb->Name, pcb->ID, TO_KiB(Walk->Size));
+		TaskManager->KillProcess(pcb, Tasking::KILL_OOM);
+		Walk->Killed = true;
+		return false;
+	}
+
+	static size_t SlabCount()
+	{
+		size_t Unused = 0;
+		for (ObjectCache *c = ObjectCache::GetFirst(); c; c = c->GetNext())
+			Unused += (c->GetTotalObjects() - c->GetActiveObjects()) * c->GetObjectSize();
+		return TO_PAGES(Unused);
+	}
+
+	static size_t SlabScan(size_t Pages)
+	{
+		size_t Freed = 0;
+		for (ObjectCache *c = ObjectCache::GetFirst(); c && Freed < Pages; c = c->GetNext())
+			Freed += c->Reap();
+		return Freed;
+	}
+
+	static size_t ZeroPoolCount() { return ZeroedPages.GetChunks() * ZERO_POOL_CHUNK_PAGES; }
+	static size_t ZeroPoolScan(size_t Pages) { return ZeroedPages.Drain(Pages); }
+
+	static size_t PageCacheCount() { return FilePageCache.GetCachedPages(); }
+	static size_t PageCacheScan(size_t Pages) { return FilePageCache.Shrink(Pages); }
+
+	/* Cheapest to rebuild first */
+	static Shrinker ZeroPoolShrinker = {"zero pool", ZeroPoolCount, ZeroPoolScan, nullptr};
+	static Shrinker SlabShrinker = {"slab", SlabCount, SlabScan, nullptr};
+	static Shrinker PageCacheShrinker = {"page cache", PageCacheCount, PageCacheScan, nullptr};
+
+	void Reclaimer::Register(Shrinker *s)
+	{
+		SmartLock(ShrinkerLock);
+		s->Next = Shrinkers;
+		Shrinkers = s;
+		debug("Registered shrinker %s", s->Name);
+	}
+
+	void Reclaimer::Unregister(Shrinker *s)
+	{
+		SmartLock(ShrinkerLock);
+		for (Shrinker **p = &Shrinkers; *p; p = &(*p)->Next)
+		{
+			if (*p != s)
+				continue;
+			*p = s->Next;
+			break;
+		}
+	}
+
+	size_t Reclaimer::Shrink(size_t Pages)
+	{
+		if (TaskManager == nullptr)
+			return 0;
+
+		Tasking::TCB *Self = thisThread;
+		while (Reclaiming.exchange(true, std::memory_order_acquire))
+		{
+			if (ReclaimOwner.load() == Self || !CanWait())
+				return 0;
+			TaskManager->Yield();
+		}
+		ReclaimOwner.store(Self);
+
+		size_t Freed = 0;
+		{
+			SmartLock(ShrinkerLock);
+			for (Shrinker *s = Shrinkers; s && Freed < Pages; s = s->Next)
+			{
+				/* Ask for at least a batch, small requests still leave some slack */
+				size_t Wanted = Pages - Freed;
+				if (Wanted < RECLAIM_BATCH)
+					Wanted = RECLAIM_BATCH;
+
+				if (s->Count() == 0)
+					continue;
+
+				size_t n = s->Scan(Wanted);
+				debug("Shrinker %s freed %ld/%ld pages", s->Name, n, Wanted);
+				Freed += n;
+			}
+		}
+
+		Reclaimed += Freed;
+		ReclaimOwner.store(nullptr);
+		Reclaiming.store(false, std::memory_order_release);
+		return Freed;
+	}
+
+	bool Reclaimer::KillVictim()
+	{
+		if (TaskManager == nullptr || TaskManager->IsPanic())
+			return false;
+
+		VictimWalk Walk = {nullptr, 0, false, VictimID.load(), false};
+		TaskManager->ForEachProcess(FindVictim, &Walk);
+		if (!Walk.PendingFound)
+			VictimID.store(-1);
+
+		/* Killing more won't free memory any sooner */
+		uint64_t Free = KernelAllocator.GetFreeMemory();
+		if (!Walk.PendingFound)
+		{
+			if (Walk.Victim == nullptr)
+				return false;
+
+			/* It may have exited while the list was unlocked */
+			TaskManager->ForEachProcess(KillFound, &Walk);
+			if (!Walk.Killed)
+				return false;
+			VictimID.store(Walk.Victim->ID);
+			Kills++;
+		}
+
+		/* The memory comes back later, this allocation fails */
+		if (!CanWait() || VictimID.load() == thisProcess->ID)
+			return false;
+
+		/* The scheduler frees it on its next run */
+		for (int i = 0; i < 100 && KernelAllocator.GetFreeMemory() <= Free; i++)
+			TaskManager->Yield();
+		return KernelAllocator.GetFreeMemory() > Free;
+	}
+
+	static bool FindPending(Tasking::PCB *pcb, void *Context)
+	{
+		VictimWalk *Walk = (VictimWalk *)Context;
+		if (pcb->ID != Walk->Pending)
+			return true;
+		Walk->PendingFound = true;
+		return false;
+	}
+
+	bool Reclaimer::KillPending()
+	{
+		VictimWalk Walk = {nullptr, 0, false, VictimID.load(), false};
+		if (Walk.Pending < 0 || TaskManager == nullptr)
+			return false;
+
+		TaskManager->ForEachProcess(FindPending, &Walk);
+		if (!Walk.PendingFound)
+			VictimID.store(-1);
+		return Walk.PendingFound;
+	}
+
+	/* Keep one free run around for huge pages and DMA buffers */
+	static bool CompactBackground()
+	{
+		if (KernelAllocator.GetFreeMemory() < FROM_PAGES(COMPACT_RUN_PAGES) * 2)
+			return true;
+
+		void *Run = KernelAllocator.Compact(COMPACT_RUN_PAGES);
+		if (Run == nullptr)
+			return false;
+
+		KernelAllocator.FreePages(Run, COMPACT_RUN_PAGES);
+		return true;
+	}
+
+	void Reclaimer::DaemonEntry()
+	{
+		/* Back off while compaction keeps failing */
+		int Ticks = 0, Backoff = 1;
+		while (true)
+		{
+			if (++Ticks * RECLAIM_INTERVAL >= COMPACT_INTERVAL * Backoff)
+			{
+				if (CompactBackground())
+					Backoff = 1;
+				else if (Backoff < 64)
+					Backoff *= 2;
+				Ticks = 0;
+			}
+
+			uint64_t Free = KernelAllocator.GetFreeMemory();
+			if (PageReclaimer.Pending.load() || Free < PageReclaimer.LowWatermark)
+			{
+				while (Free < PageReclaimer.HighWatermark)
+				{
+					size_t Wanted = TO_PAGES(PageReclaimer.HighWatermark - Free);
+					if (PageReclaimer.Shrink(Wanted) == 0)
+						break;
+					Free = KernelAllocator.GetFreeMemory();
+				}
+				PageReclaimer.Pending.store(false);
+			}
+			TaskManager->Sleep(RECLAIM_INTERVAL);
+		}
+	}
+
+	void Reclaimer::Start()
+	{
+		uint64_t Total = KernelAllocator.GetTotalMemory();
+		LowWatermark = Total * RECLAIM_LOW_WATERMARK / 100;
+		HighWatermark = Total * RECLAIM_HIGH_WATERMARK / 100;
+		if (LowWatermark < RECLAIM_MIN_WATERMARK)
+			LowWatermark = RECLAIM_MIN_WATERMARK;
+		if (HighWatermark < LowWatermark * 2)
+			HighWatermark = LowWatermark * 2;
+
+		/* Registered last runs first */
+		Register(&PageCacheShrinker);
+		Register(&SlabShrinker);
+		Register(&ZeroPoolShrinker);
+
+		trace("Reclaim watermarks: low %ld KiB, high %ld KiB",
+			  TO_KiB(LowWatermark), TO_KiB(HighWatermark));
+
+		Tasking::TCB *t = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													Tasking::IP(DaemonEntry));
+		t->Rename("Page Reclaimer");
+		t->SetPriority(Tasking::High);
+	}
+}
@@ -0,0 +1,490 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <smp.hpp>
+#include <debug.h>
+
+namespace Memory
+{
+	static ObjectCache *CacheList = nullptr;
+	NewLock(CacheListLock);
+
+	ObjectCache *ObjectCache::GetFirst() { return CacheList; }
+
+	bool ObjectCache::Setup()
+	{
+		if (Align == 0)
+		{
+			/* Small objects never straddle a cache line */
+			if (Size <= SLAB_CACHE_LINE)
+			{
+				Align = sizeof(void *) * 2;
+				while (Align < Size)
+					Align <<= 1;
+			}
+			else
+				Align = SLAB_CACHE_LINE;
+		}
+		assert((Align & (Align - 1)) == 0);
+
+		/* With a constructor the free list link
+		   can't overwrite the object, it goes after it */
+		size_t Base = ALIGN_UP(Size < sizeof(void *) ? sizeof(void *) : Size, sizeof(void *));
+		LinkOffset = Constructor ? Base : 0;
+		size_t Trailer = Constructor ? sizeof(void *) : 0;
+		size_t Header = ALIGN_UP(sizeof(Slab), Align);
+
+		Stride = ALIGN_UP(Base + Trailer, Align);
+		SlabPages = 1;
+		if (Aligned)
+		{
+			/* The slab is found by masking the object address */
+			SlabPages = SLAB_ALIGNED_PAGES;
+			assert(Header + Stride * SLAB_MIN_OBJECTS <= FROM_PAGES(SlabPages));
+		}
+		else if ((PAGE_SIZE - Header) / Stride < SLAB_MIN_OBJECTS)
+		{
+			/* Objects of multi-page slabs point back to their slab */
+			TagOffset = Base + Trailer;
+			Stride = ALIGN_UP(Base + Trailer + sizeof(Slab *), Align);
+			SlabPages = TO_PAGES(Header + Stride * SLAB_MIN_OBJECTS);
+		}
+		ObjectsPerSlab = (SlabPages * PAGE_SIZE - Header) / Stride;
+
+		ColorStep = Align > SLAB_CACHE_LINE ? Align : SLAB_CACHE_LINE;
+		ColorMax = SlabPages * PAGE_SIZE - Header - ObjectsPerSlab * Stride;
+
+		/* Published last, it marks the cache as ready */
+		Magazine **Array = (Magazine **)KernelAllocator.RequestPages(TO_PAGES(sizeof(Magazine *) * MAX_CPU));
+		if (unlikely(Array == nullptr))
+			return false;
+		memset(Array, 0, sizeof(Magazine *) * MAX_CPU);
+		__atomic_store_n(&Magazines, Array, __ATOMIC_RELEASE);
+
+		debug("Cache \"%s\": %ld bytes, stride %ld, %ld objects in %ld page(s)",
+			  Name, Size, Stride, ObjectsPerSlab, SlabPages);
+		return true;
+	}
+
+	ObjectCache::Slab *ObjectCache::GetSlab(void *Object)
+	{
+		if (SlabPages == 1 || Aligned)
+			return (Slab *)((uintptr_t)Object & ~(FROM_PAGES(SlabPages) - 1));
+		return *(Slab **)((uintptr_t)Object + TagOffset);
+	}
+
+	ObjectCache *ObjectCache::FromObject(void *Object)
+	{
+		Slab *s = (Slab *)((uintptr_t)Object & ~(FROM_PAGES(SLAB_ALIGNED_PAGES) - 1));
+		return s->Cache;
+	}
+
+	void **ObjectCache::Link(void *Object)
+	{
+		return (void **)((uintptr_t)Object + LinkOffset);
+	}
+
+	void ObjectCache::Push(Slab *&Head, Slab *s)
+	{
+		s->Prev = nullptr;
+		s->Next = Head;
+		if (Head)
+			Head->Prev = s;
+		Head = s;
+	}
+
+	void ObjectCache::Unlink(Slab *&Head, Slab *s)
+	{
+		if (s->Prev)
+			s->Prev->Next = s->Next;
+		else
+			Head = s->Next;
+		if (s->Next)
+			s->Next->Prev = s->Prev;
+		s->Prev = s->Next = nullptr;
+	}
+
+	ObjectCache::Slab *ObjectCache::CreateSlab()
+	{
+		Slab *s;
+		if (Aligned)
+			s = (Slab *)RequestAlignedPages(SlabPages, SlabPages);
+		else
+			s = (Slab *)KernelAllocator.RequestPages(SlabPages);
+		if (unlikely(s == nullptr))
+			return nullptr;
+
+		s->Cache = this;
+		s->Prev = s->Next = nullptr;
+		s->FreeList = nullptr;
+		s->InUse = 0;
+
+		/* Shift every slab by a cache line so objects
+		   at the same index don't share cache sets */
+		uintptr_t Object = (uintptr_t)s + ALIGN_UP(sizeof(Slab), Align) + ColorNext;
+		ColorNext += ColorStep;
+		if (ColorNext > ColorMax)
+			ColorNext = 0;
+
+		for (size_t i = 0; i < ObjectsPerSlab; i++, Object += Stride)
+		{
+			if (SlabPages > 1 && !Aligned)
+				*(Slab **)(Object + TagOffset) = s;
+			if (Constructor)
+				Constructor((void *)Object);
+			*Link((void *)Object) = s->FreeList;
+			s->FreeList = (void *)Object;
+		}
+
+		SlabCount++;
+		return s;
+	}
+
+	void ObjectCache::DestroySlab(Slab *s)
+	{
+		assert(s->InUse == 0);
+		if (Destructor)
+		{
+			for (void *Object = s->FreeList; Object; Object = *Link(Object))
+				Destructor(Object);
+		}
+
+		KernelAllocator.FreePages(s, SlabPages);
+		SlabCount--;
+	}
+
+	void *ObjectCache::TakeObject()
+	{
+		Slab *s = Partial;
+		if (s == nullptr)
+		{
+			s = Empty;
+			if (s)
+			{
+				Unlink(Empty, s);
+				EmptyCount--;
+			}
+			else
+			{
+				s = CreateSlab();
+				if (unlikely(s == nullptr))
+					return nullptr;
+			}
+			Push(Partial, s);
+		}
+
+		void *Object = s->FreeList;
+		s->FreeList = *Link(Object);
+		if (++s->InUse == ObjectsPerSlab)
+		{
+			Unlink(Partial, s);
+			Push(Full, s);
+		}
+		ActiveObjects++;
+		return Object;
+	}
+
+	void ObjectCache::PutObject(void *Object)
+	{
+		Slab *s = GetSlab(Object);
+		assert(s->Cache == this);
+
+		*Link(Object) = s->FreeList;
+		s->FreeList = Object;
+		ActiveObjects--;
+
+		if (s->InUse-- == ObjectsPerSlab)
+		{
+			Unlink(Full, s);
+			Push(Partial, s);
+		}
+
+		if (s->InUse == 0)
+		{
+			Unlink(Partial, s);
+			/* Keep one empty slab around to avoid
+			   thrashing at a slab boundary */
+			if (EmptyCount > 0)
+				DestroySlab(s);
+			else
+			{
+				Push(Empty, s);
+				EmptyCount++;
+			}
+		}
+	}
+
+	ObjectCache::Magazine *ObjectCache::GetMagazine()
+	{
+		int Core = GetCurrentCPU()->ID;
+		Magazine *m = Magazines[Core];
+		if (unlikely(m == nullptr))
+		{
+			/* Stays nullptr, callers go to the slabs directly */
+			m = NewMagazine();
+			Magazines[Core] = m;
+		}
+		return m;
+	}
+
+	/* Magazines can't come from the heap, it is built on top of us */
+	static void *MagazineList = nullptr;
+	NewLock(MagazineLock);
+
+	ObjectCache::Magazine *ObjectCache::NewMagazine()
+	{
+		SmartLock(MagazineLock);
+		if (MagazineList == nullptr)
+		{
+			uintptr_t Page = (uintptr_t)KernelAllocator.RequestPage();
+			if (unlikely(Page == 0))
+				return nullptr;
+			for (size_t i = 0; i + sizeof(Magazine) <= PAGE_SIZE; i += sizeof(Magazine))
+			{
+				*(void **)(Page + i) = MagazineList;
+				MagazineList = (void *)(Page + i);
+			}
+		}
+
+		Magazine *m = (Magazine *)MagazineList;
+		MagazineList = *(void **)m;
+		m->Count = 0;
+		m->Allocations = 0;
+		return m;
+	}
+
+	void ObjectCache::DeleteMagazine(Magazine *m)
+	{
+		SmartLock(MagazineLock);
+		*(void **)m = MagazineList;
+		MagazineList = m;
+	}
+
+	void *ObjectCache::Allocate()
+	{
+		/* The magazine belongs to this CPU as
+		   long as we can't be rescheduled */
+		CriticalSection cs;
+
+		if (unlikely(__atomic_load_n(&Magazines, __ATOMIC_ACQUIRE) == nullptr))
+		{
+			SmartLock(CacheLock);
+			if (Magazines == nullptr && !Setup())
+			{
+				error("Cache \"%s\" is out of memory", Name);
+				return nullptr;
+			}
+		}
+
+		Magazine *m = GetMagazine();
+		if (unlikely(m == nullptr))
+		{
+			SmartLock(CacheLock);
+			return TakeObject();
+		}
+
+		if (unlikely(m->Count == 0))
+		{
+			SmartLock(CacheLock);
+			while (m->Count < SLAB_MAGAZINE_SIZE / 2)
+			{
+				void *Object = TakeObject();
+				if (Object == nullptr)
+					break;
+				m->Objects[m->Count++] = Object;
+			}
+
+			if (unlikely(m->Count == 0))
+			{
+				error("Cache \"%s\" is out of memory", Name);
+				return nullptr;
+			}
+		}
+
+		m->Allocations++;
+		return m->Objects[--m->Count];
+	}
+
+	void ObjectCache::Free(void *Object)
+	{
+		if (unlikely(Object == nullptr))
+			return;
+
+		CriticalSection cs;
+		Magazine *m = GetMagazine();
+		if (unlikely(m == nullptr))
+		{
+			SmartLock(CacheLock);
+			PutObject(Object);
+			return;
+		}
+
+		if (unlikely(m->Count == SLAB_MAGAZINE_SIZE))
+		{
+			SmartLock(CacheLock);
+			while (m->Count > SLAB_MAGAZINE_SIZE / 2)
+				PutObject(m->Objects[--m->Count]);
+		}
+
+		m->Objects[m->Count++] = Object;
+	}
+
+	size_t ObjectCache::Reap()
+	{
+		if (Magazines == nullptr)
+			return 0;
+
+		CriticalSection cs;
+		/* Reclaim can run while this cache is growing */
+		if (CacheLock.Locked())
+			return 0;
+		SmartLock(CacheLock);
+
+		Magazine *m = GetMagazine();
+		while (m && m->Count > 0)
+			PutObject(m->Objects[--m->Count]);
+
+		size_t Freed = 0;
+		while (Empty)
+		{
+			Slab *s = Empty;
+			Unlink(Empty, s);
+			EmptyCount--;
+			DestroySlab(s);
+			Freed += SlabPages;
+		}
+		return Freed;
+	}
+
+	size_t ObjectCache::GetAllocations()
+	{
+		if (Magazines == nullptr)
+			return 0;
+
+		size_t Count = 0;
+		for (int i = 0; i < MAX_CPU; i++)
+		{
+			if (Magazines[i])
+				Count += Magazines[i]->Allocations;
+		}
+		return Count;
+	}
+
+	ObjectCache::ObjectCache(const char *Name, size_t Size, size_t Align,
+							 ObjectFunction Constructor,
+							 ObjectFunction Destructor,
+							 bool Aligned)
+		: Name(Name), Size(Size), Align(Align),
+		  Constructor(Constructor), Destructor(Destructor),
+		  Aligned(Aligned)
+	{
+		assert(Size > 0);
+
+		SmartLock(CacheListLock);
+		NextCache = CacheList;
+		CacheList = this;
+	}
+
+	ObjectCache::~ObjectCache()
+	{
+		{
+			SmartLock(CacheListLock);
+			ObjectCache **itr = &CacheList;
+			while (*itr && *itr != this)
+				itr = &(*itr)->NextCache;
+			if (*itr)
+				*itr = NextCache;
+		}
+
+		if (Magazines == nullptr)
+			return;
+
+		SmartLock(CacheLock);
+		for (int i = 0; i < MAX_CPU; i++)
+		{
+			Magazine *m = Magazines[i];
+			if (m == nullptr)
+				continue;
+
+			while (m->Count > 0)
+				PutObject(m->Objects[--m->Count]);
+			DeleteMagazine(m);
+		}
+
+		while (Empty)
+		{
+			Slab *s = Empty;
+			Unlink(Empty, s);
+			EmptyCount--;
+			DestroySlab(s);
+		}
+
+		if (Partial || Full)
+			warn("Cache \"%s\" destroyed with %ld objects in use",
+				 Name, ActiveObjects);
+
+		KernelAllocator.FreePages(Magazines, TO_PAGES(sizeof(Magazine *) * MAX_CPU));
+	}
+}
+
+namespace Memory
+{
+	void *RequestAlignedPages(size_t Count, size_t Align)
+	{
+		assert((Align & (Align - 1)) == 0);
+		if (Align <= 1)
+			return KernelAllocator.RequestPages(Count);
+
+		/* Over-allocate and give back what's outside the aligned range */
+		size_t Total = Count + Align - 1;
+		uintptr_t Base = (uintptr_t)KernelAllocator.RequestPages(Total);
+		if (unlikely(Base == 0))
+			return nullptr;
+		uintptr_t Aligned = ALIGN_UP(Base, FROM_PAGES(Align));
+
+		size_t Head = TO_PAGES(Aligned - Base);
+		if (Head)
+			KernelAllocator.FreePages((void *)Base, Head);
+		if (Total - Head - Count)
+			KernelAllocator.FreePages((void *)(Aligned + FROM_PAGES(Count)),
+									  Total - Head - Count);
+		return (void *)Aligned;
+	}
+}
+
+kmem_cache_t *kmem_cache_create(const char *Name, size_t Size, size_t Align,
+								void (*Constructor)(void *))
+{
+	return new Memory::ObjectCache(Name, Size, Align, Constructor);
+}
+
+void kmem_cache_destroy(kmem_cache_t *Cache)
+{
+	delete Cache;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *Cache)
+{
+	return Cache->Allocate();
+}
+
+void kmem_cache_free(kmem_cache_t *Cache, void *Object)
+{
+	Cache->Free(Object);
+}
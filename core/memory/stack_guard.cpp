@@ -43,6 +43,7 @@ namespace Memory
 			  roundFA, this->StackBottom, diff, stackPages);
 
 		void *AllocatedStack = vma->RequestPages(stackPages);
+		vma->Usage.Stack += stackPages;
 		debug("AllocatedStack: %#lx", AllocatedStack);
 
 		for (size_t i = 0; i < stackPages; i++)
@@ -83,6 +84,7 @@ namespace Memory
 		foreach (auto Page in ParentAllocatedPages)
 		{
 			void *NewPhysical = vma->RequestPages(1);
+			vma->Usage.Stack++;
 			debug("Forking address %#lx to %#lx", Page.PhysicalAddress, NewPhysical);
 			memcpy(NewPhysical, Page.PhysicalAddress, PAGE_SIZE);
 			vma->Remap(Page.VirtualAddress, NewPhysical, PTFlag::RW | PTFlag::US);
@@ -104,6 +106,7 @@ namespace Memory
 		if (this->UserMode)
 		{
 			void *AllocatedStack = vma->RequestPages(TO_PAGES(USER_STACK_SIZE));
+			vma->Usage.Stack += TO_PAGES(USER_STACK_SIZE);
 			this->StackBottom = (void *)USER_STACK_BASE;
 			this->StackTop = (void *)(USER_STACK_BASE + USER_STACK_SIZE);
 			this->StackPhysicalBottom = AllocatedStack;
@@ -129,6 +132,7 @@ namespace Memory
 		else
 		{
 			this->StackBottom = vma->RequestPages(TO_PAGES(STACK_SIZE));
+			vma->Usage.Stack += TO_PAGES(STACK_SIZE);
 			this->StackTop = (void *)((uintptr_t)this->StackBottom + STACK_SIZE);
 			this->StackPhysicalBottom = this->StackBottom;
 			this->StackPhysicalTop = this->StackTop;
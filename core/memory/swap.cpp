@@ -0,0 +1,249 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory/swap.hpp>
+
+#include <memory.hpp>
+#include <convert.h>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+Memory::SwapSpace KernelSwap;
+
+namespace Memory
+{
+	bool RamSwapDevice::Read(size_t Slot, void *Page)
+	{
+		if (Slot >= Slots)
+			return false;
+
+		memcpy(Page, (void *)((uintptr_t)Pages + FROM_PAGES(Slot)), PAGE_SIZE);
+		return true;
+	}
+
+	bool RamSwapDevice::Write(size_t Slot, void *Page)
+	{
+		if (Slot >= Slots)
+			return false;
+
+		memcpy((void *)((uintptr_t)Pages + FROM_PAGES(Slot)), Page, PAGE_SIZE);
+		return true;
+	}
+
+	RamSwapDevice::RamSwapDevice(size_t Slots)
+	{
+		this->Pages = KernelAllocator.RequestPages(Slots);
+		this->Slots = Slots;
+		debug("RAM swap with %lld slots at %#lx", Slots, Pages);
+	}
+
+	RamSwapDevice::~RamSwapDevice()
+	{
+		KernelAllocator.FreePages(Pages, Slots);
+	}
+
+	bool FileSwapDevice::Read(size_t Slot, void *Page)
+	{
+		if (Slot >= Slots)
+			return false;
+
+		ssize_t ret = (ssize_t)File->read((uint8_t *)Page, PAGE_SIZE,
+										  (off_t)FROM_PAGES(Slot));
+		return ret == PAGE_SIZE;
+	}
+
+	bool FileSwapDevice::Write(size_t Slot, void *Page)
+	{
+		if (Slot >= Slots)
+			return false;
+
+		ssize_t ret = (ssize_t)File->write((uint8_t *)Page, PAGE_SIZE,
+										   (off_t)FROM_PAGES(Slot));
+		return ret == PAGE_SIZE;
+	}
+
+	FileSwapDevice::FileSwapDevice(vfs::Node *File)
+	{
+		this->File = File;
+		this->Slots = (size_t)File->Size / PAGE_SIZE;
+		debug("File swap %s with %lld slots", File->FullPath, Slots);
+	}
+
+	int SwapSpace::SetDevice(SwapDevice *Device)
+	{
+		SmartLock(SwapLock);
+		if (UsedSlots > 0)
+			return -EBUSY;
+
+		if (SlotBitmap.Buffer)
+			delete[] SlotBitmap.Buffer;
+		SlotBitmap.Buffer = nullptr;
+		SlotBitmap.Size = 0;
+		SlotHint = 0;
+
+		this->Device = Device;
+		if (Device == nullptr)
+			return 0;
+
+		SlotBitmap.Size = (Device->GetSlots() + 7) / 8;
+		SlotBitmap.Buffer = new uint8_t[SlotBitmap.Size];
+		memset(SlotBitmap.Buffer, 0, SlotBitmap.Size);
+		return 0;
+	}
+
+	int SwapSpace::Setup(const char *Spec)
+	{
+		SwapDevice *dev = nullptr;
+		if (strncmp(Spec, "ram:", 4) == 0)
+		{
+			size_t MiB = strtoul(Spec + 4, nullptr, 10);
+			if (MiB == 0)
+				return -EINVAL;
+			dev = new RamSwapDevice(TO_PAGES(MiB * 1024 * 1024));
+		}
+		else
+		{
+			vfs::Node *File = fs->GetNodeFromPath(Spec);
+			if (File == nullptr)
+				return -ENOENT;
+			if (File->Size < PAGE_SIZE)
+				return -EINVAL;
+			dev = new FileSwapDevice(File);
+		}
+
+		int ret = this->SetDevice(dev);
+		if (ret < 0)
+			delete dev;
+		return ret;
+	}
+
+	bool SwapSpace::StorePage(void *Page, size_t &Slot)
+	{
+		SmartLock(SwapLock);
+		if (Device == nullptr)
+			return false;
+
+		size_t Slots = Device->GetSlots();
+		for (size_t i = 0; i < Slots; i++)
+		{
+			size_t Index = (SlotHint + i) % Slots;
+			if (SlotBitmap[Index])
+				continue;
+
+			if (!Device->Write(Index, Page))
+			{
+				error("Failed to write swap slot %lld", Index);
+				return false;
+			}
+
+			SlotBitmap.Set(Index, true);
+			UsedSlots++;
+			SlotHint = Index + 1;
+			Slot = Index;
+			return true;
+		}
+
+		debug("Swap is full (%lld slots)", Slots);
+		return false;
+	}
+
+	bool SwapSpace::LoadPage(size_t Slot, void *Page, bool Release)
+	{
+		SmartLock(SwapLock);
+		assert(Device != nullptr);
+		assert(SlotBitmap[Slot]);
+
+		if (!Device->Read(Slot, Page))
+		{
+			error("Failed to read swap slot %lld", Slot);
+			return false;
+		}
+
+		if (!Release)
+			return true;
+
+		SlotBitmap.Set(Slot, false);
+		UsedSlots--;
+		return true;
+	}
+
+	void SwapSpace::FreeSlot(size_t Slot)
+	{
+		SmartLock(SwapLock);
+		if (!SlotBitmap[Slot])
+		{
+			warn("Swap slot %lld is already free", Slot);
+			return;
+		}
+
+		SlotBitmap.Set(Slot, false);
+		UsedSlots--;
+	}
+
+	struct EvictWalk
+	{
+		size_t Wanted;
+		size_t Evicted;
+		size_t Index;
+		/* Processes in [From, To) are scanned */
+		size_t From;
+		size_t To;
+	};
+
+	static bool EvictProcess(Tasking::PCB *pcb, void *Context)
+	{
+		EvictWalk *Walk = (EvictWalk *)Context;
+		size_t Index = Walk->Index++;
+		if (Index < Walk->From || Index >= Walk->To ||
+			Walk->Evicted >= Walk->Wanted ||
+			pcb->PageTable == KernelPageTable)
+			return true;
+
+		Walk->Evicted += pcb->vma->SwapOut(Walk->Wanted - Walk->Evicted);
+		return true;
+	}
+
+	size_t SwapSpace::Evict(size_t Count)
+	{
+		if (Device == nullptr || TaskManager == nullptr)
+			return 0;
+
+		/* A backend that allocates memory must not recurse */
+		if (Reclaiming.exchange(true))
+			return 0;
+
+		/* Start at the hand and wrap around, the list is not copied */
+		EvictWalk Walk = {Count, 0, 0, ProcessHand, SIZE_MAX};
+		if (TaskManager->ForEachProcess(EvictProcess, &Walk))
+		{
+			size_t Processes = Walk.Index;
+			if (Walk.Evicted < Count)
+			{
+				Walk.Index = 0;
+				Walk.To = Walk.From;
+				Walk.From = 0;
+				TaskManager->ForEachProcess(EvictProcess, &Walk);
+			}
+			ProcessHand = Processes ? (ProcessHand + 1) % Processes : 0;
+		}
+
+		Reclaiming.store(false);
+		debug("Evicted %lld/%lld pages", Walk.Evicted, Count);
+		return Walk.Evicted;
+	}
+}
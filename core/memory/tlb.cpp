@@ -0,0 +1,308 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <cpu.hpp>
+#include <smp.hpp>
+#include <atomic>
+#include <debug.h>
+
+#if defined(a64)
+/* Keep the entries tagged with the loaded PCID */
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR3_PCID 0xFFF
+#endif
+
+namespace Memory
+{
+	struct PCIDSlot
+	{
+		PageTable *Table;
+		uint64_t Generation;
+	};
+
+	struct PCIDContext
+	{
+		/* PCID is the slot index plus one,
+		   raw CR3 loads keep using PCID 0 */
+		PCIDSlot Slots[TLB_PCID_SLOTS];
+		size_t Next;
+		/* Last KernelEpoch flushed on this core */
+		uint64_t KernelEpoch;
+	};
+
+	static PCIDContext Contexts[MAX_CPU]{};
+	static std::atomic_uint64_t Generations = 1;
+	/* Bumped on every KernelPageTable change. Its entries are
+	   cached under every PCID, not only the kernel table's. */
+	static std::atomic_uint64_t KernelEpoch = 0;
+
+	static inline bool PCIDEnabled()
+	{
+#if defined(a64)
+		return CPU::x64::readcr4().PCIDE;
+#else
+		return false;
+#endif
+	}
+
+#if defined(a64)
+	static inline PCIDContext *CurrentContext()
+	{
+		uint32_t Core;
+		asmv("rdtscp"
+			 : "=c"(Core)
+			 :
+			 : "rax", "rdx");
+		return &Contexts[Core];
+	}
+
+	static inline uintptr_t ReadCR3()
+	{
+		uintptr_t cr3;
+		asmv("mov %%cr3, %0"
+			 : "=r"(cr3));
+		return cr3;
+	}
+
+	static inline void WriteCR3(uintptr_t cr3)
+	{
+		asmv("mov %0, %%cr3"
+			 :
+			 : "r"(cr3)
+			 : "memory");
+	}
+
+	/* Toggling CR4.PGE drops the entries of every PCID, global ones too */
+	static void FlushAllContexts(PCIDContext *ctx)
+	{
+		uint64_t Epoch = KernelEpoch.load();
+		CPU::x64::CR4 cr4 = CPU::x64::readcr4();
+		cr4.PGE = !cr4.PGE;
+		CPU::x64::writecr4(cr4);
+		cr4.PGE = !cr4.PGE;
+		CPU::x64::writecr4(cr4);
+		ctx->KernelEpoch = Epoch;
+	}
+
+	/* Other cores see the new generation and flush on their next load.
+	   If the table is loaded here, it was already invalidated. */
+	static void Retire(PageTable *Table, bool Loaded)
+	{
+		bool Interrupts = CPU::Interrupts(CPU::Check);
+		CPU::Interrupts(CPU::Disable);
+
+		if (Table == KernelPageTable)
+		{
+			/* Kernel code also runs on process tables */
+			KernelEpoch++;
+			FlushAllContexts(CurrentContext());
+		}
+
+		uint64_t Generation = TLB::NewGeneration();
+		Table->Generation = Generation;
+
+		uintptr_t pcid = ReadCR3() & CR3_PCID;
+		if (Loaded && pcid != 0)
+		{
+			PCIDSlot *slot = &CurrentContext()->Slots[pcid - 1];
+			if (slot->Table == Table)
+				slot->Generation = Generation;
+		}
+
+		if (Interrupts)
+			CPU::Interrupts(CPU::Enable);
+	}
+#endif
+
+	void TLB::EnablePCID(int Core)
+	{
+#if defined(a64)
+		assert(Core < MAX_CPU);
+		CPU::x64::wrmsr(CPU::x64::MSR_TSC_AUX, (uint64_t)Core);
+
+		CPU::x64::CR4 cr4 = CPU::x64::readcr4();
+		cr4.PCIDE = true;
+		CPU::x64::writecr4(cr4);
+		debug("PCIDs enabled on core %d", Core);
+#else
+		UNUSED(Core);
+#endif
+	}
+
+	uint64_t TLB::NewGeneration()
+	{
+		return Generations.fetch_add(1);
+	}
+
+	bool TLB::IsLoaded(PageTable *Table)
+	{
+		return (PageTable *)CPU::PageTable() == Table;
+	}
+
+	void TLB::Load(PageTable *Table)
+	{
+#if defined(a64)
+		if (!PCIDEnabled())
+		{
+			WriteCR3((uintptr_t)Table);
+			return;
+		}
+
+		bool Interrupts = CPU::Interrupts(CPU::Check);
+		CPU::Interrupts(CPU::Disable);
+
+		PCIDContext *ctx = CurrentContext();
+		if (ctx->KernelEpoch != KernelEpoch.load())
+			FlushAllContexts(ctx);
+
+		uint64_t Generation = Table->Generation;
+		uintptr_t cr3 = (uintptr_t)Table;
+
+		size_t i = 0;
+		while (i < TLB_PCID_SLOTS && ctx->Slots[i].Table != Table)
+			i++;
+
+		if (i < TLB_PCID_SLOTS && ctx->Slots[i].Generation == Generation)
+			cr3 |= CR3_NOFLUSH;
+		else
+		{
+			/* Not tagged here or changed since, take a slot and flush it */
+			if (i == TLB_PCID_SLOTS)
+			{
+				i = ctx->Next;
+				ctx->Next = (ctx->Next + 1) % TLB_PCID_SLOTS;
+				ctx->Slots[i].Table = Table;
+			}
+			ctx->Slots[i].Generation = Generation;
+		}
+
+		WriteCR3(cr3 | (i + 1));
+
+		if (Interrupts)
+			CPU::Interrupts(CPU::Enable);
+#elif defined(a32)
+		asmv("mov %0, %%cr3" ::"r"(Table));
+#elif defined(aa64)
+		asmv("msr ttbr0_el1, %0" ::"r"(Table));
+#endif
+	}
+
+	void TLB::Invalidate(PageTable *Table, uintptr_t Address)
+	{
+		bool Loaded = IsLoaded(Table);
+#if defined(a64)
+		if (Loaded)
+			CPU::x64::invlpg((void *)Address);
+
+		if (PCIDEnabled())
+			Retire(Table, Loaded);
+#elif defined(a32)
+		if (Loaded)
+			CPU::x32::invlpg((void *)Address);
+#elif defined(aa64)
+		UNUSED(Loaded);
+		asmv("dsb sy");
+		asmv("tlbi vae1is, %0"
+			 :
+			 : "r"(Address)
+			 : "memory");
+		asmv("dsb sy");
+		asmv("isb");
+#endif
+	}
+
+	void TLB::InvalidateAll(PageTable *Table)
+	{
+		bool Loaded = IsLoaded(Table);
+#if defined(a64)
+		/* Without the no-flush bit this drops the loaded PCID */
+		if (Loaded)
+			WriteCR3(ReadCR3());
+
+		if (PCIDEnabled())
+			Retire(Table, Loaded);
+#elif defined(a32)
+		if (Loaded)
+			asmv("mov %0, %%cr3" ::"r"(Table));
+#else
+		UNUSED(Loaded);
+#endif
+	}
+
+	void TLBBatch::Add(uintptr_t Address)
+	{
+		if (this->Full)
+			return;
+
+		if (this->Count == TLB_FLUSH_THRESHOLD)
+		{
+			this->Full = true;
+			return;
+		}
+
+		this->Pages[this->Count++] = Address;
+	}
+
+	void TLBBatch::Add(uintptr_t Address, size_t Length)
+	{
+		uintptr_t Start = ALIGN_DOWN(Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP(Address + Length, PAGE_SIZE);
+		if (End - Start > TLB_FLUSH_THRESHOLD * PAGE_SIZE)
+		{
+			this->Full = true;
+			return;
+		}
+
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+			this->Add(va);
+	}
+
+	void TLBBatch::Flush()
+	{
+		if (this->Full)
+		{
+			TLB::InvalidateAll(this->Table);
+			this->Full = false;
+			this->Count = 0;
+			return;
+		}
+
+		if (this->Count == 0)
+			return;
+
+		bool Loaded = TLB::IsLoaded(this->Table);
+		if (Loaded)
+		{
+			for (size_t i = 0; i < this->Count; i++)
+			{
+#if defined(a64)
+				CPU::x64::invlpg((void *)this->Pages[i]);
+#elif defined(a32)
+				CPU::x32::invlpg((void *)this->Pages[i]);
+#endif
+			}
+		}
+
+#if defined(a64)
+		if (PCIDEnabled())
+			Retire(this->Table, Loaded);
+#endif
+		this->Count = 0;
+	}
+}
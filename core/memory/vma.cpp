@@ -17,6 +17,7 @@
 
 #include <memory/vma.hpp>
 #include <memory/table.hpp>
+#include <printf.h>
 #include <cpu.hpp>
 #include <debug.h>
 #include <bitset>
@@ -25,13 +26,333 @@
 
 namespace Memory
 {
-	uint64_t VirtualMemoryArea::GetAllocatedMemorySize()
+	/* Names the objects behind MAP_SHARED | MAP_ANONYMOUS */
+	static std::atomic_size_t AnonymousObjects = 0;
+
+	/* Read-only page shared by every untouched anonymous mapping */
+	static void *ZeroPage = nullptr;
+	NewLock(ZeroPageLock);
+
+	static void *GetZeroPage()
 	{
-		SmartLock(MgrLock);
-		uint64_t Size = 0;
-		foreach (auto ap in AllocatedPagesList)
-			Size += ap.PageCount;
-		return FROM_PAGES(Size);
+		SmartLock(ZeroPageLock);
+		if (unlikely(ZeroPage == nullptr))
+		{
+			ZeroPage = KernelAllocator.RequestPage();
+			memset(ZeroPage, 0, PAGE_SIZE);
+			debug("Zero page at %#lx", ZeroPage);
+		}
+		return ZeroPage;
+	}
+
+	/* Virtual::Remap keeps the old low bits, so write the entry ourselves.
+	   Remap already invalidated the old translation if there was one. */
+	static void SetPage(Virtual &vmm, uintptr_t VirtualAddress,
+						uintptr_t PhysicalAddress, uint64_t Flags)
+	{
+		vmm.Remap((void *)VirtualAddress, (void *)PhysicalAddress, Flags);
+		PageTableEntry *pte = vmm.GetPTE((void *)VirtualAddress);
+		assert(pte != nullptr);
+		pte->raw = (uintptr_t)(Flags | PTFlag::P);
+		pte->SetAddress(PhysicalAddress >> 12);
+	}
+
+	static void ClearPage(Virtual &vmm, TLBBatch &Batch, uintptr_t VirtualAddress,
+						  bool Keep = false)
+	{
+		/* Give back the identity mapping the table was forked with,
+		   unless the address stays in a region and must fault again */
+		if (!Keep && VirtualAddress < KernelAllocator.GetTotalMemory())
+		{
+			SetPage(vmm, VirtualAddress, VirtualAddress, PTFlag::RW);
+			return;
+		}
+
+		PageTableEntry *pte = vmm.GetPTE((void *)VirtualAddress);
+		if (pte == nullptr)
+			return;
+
+		bool Stale = pte->Present;
+		pte->raw = 0;
+		if (Stale)
+			Batch.Add(VirtualAddress);
+	}
+
+	/* Identity entries inside a region would look populated */
+	static void DropIdentity(Virtual &vmm, uintptr_t Start, uintptr_t End)
+	{
+		uintptr_t Limit = KernelAllocator.GetTotalMemory();
+		for (uintptr_t va = Start; va < End && va < Limit; va += PAGE_SIZE)
+		{
+			if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+				continue;
+
+			if (!vmm.GetPTE((void *)va)->UserSupervisor)
+				vmm.Unmap((void *)va);
+		}
+	}
+
+	/* With SMAP the kernel faults on user pages unless AC is set */
+	static inline void AllowUserAccess(bool Allow)
+	{
+#if defined(a64)
+		if (!CPU::x64::readcr4().SMAP)
+			return;
+#elif defined(a32)
+		if (!CPU::x32::readcr4().SMAP)
+			return;
+#endif
+
+#if defined(a86)
+		if (Allow)
+			asmv("stac" ::: "cc");
+		else
+			asmv("clac" ::: "cc");
+#else
+		UNUSED(Allow);
+#endif
+	}
+
+	/* Swapped out pages keep their slot in a non-present entry */
+	static inline bool IsSwapped(PageTableEntry *pte)
+	{
+		return pte && !pte->Present && pte->Available2;
+	}
+
+	/* The rest of a region a failed fork did not copy still points
+	   to the parent's frames and slots, the child must not free them */
+	static void DropForkedRange(Virtual &vmm, uintptr_t Start, uintptr_t End)
+	{
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+		{
+			PageTableEntry *Entry = vmm.LookupPTE((void *)va);
+			if (Entry != nullptr)
+				Entry->raw = 0;
+		}
+	}
+
+	/* Every copy of a file region holds its own reference */
+	static inline void HoldFile(VirtualMemoryArea::SharedRegion &sr)
+	{
+		sr.Handle = sr.File ? sr.File->CreateReference() : nullptr;
+	}
+
+	static inline void DropFile(VirtualMemoryArea::SharedRegion &sr)
+	{
+		if (sr.Handle)
+			delete sr.Handle;
+		sr.Handle = nullptr;
+	}
+
+	VirtualMemoryArea::SharedRegion *VirtualMemoryArea::FindRegion(uintptr_t Address)
+	{
+		forItr(itr, SharedRegions)
+		{
+			uintptr_t Start = (uintptr_t)itr->Address;
+			uintptr_t End = Start + itr->Length;
+			if (Address >= Start && Address < End)
+				return &(*itr);
+		}
+		return nullptr;
+	}
+
+	void VirtualMemoryArea::SplitRegion(uintptr_t Address)
+	{
+		SharedRegion *sr = this->FindRegion(Address);
+		if (sr == nullptr || (uintptr_t)sr->Address == Address)
+			return;
+
+		SharedRegion Tail = *sr;
+		Tail.Address = (void *)Address;
+		Tail.Length = (uintptr_t)sr->Address + sr->Length - Address;
+		Tail.Offset += (off_t)(Address - (uintptr_t)sr->Address);
+		sr->Length = Address - (uintptr_t)sr->Address;
+		HoldFile(Tail);
+		SharedRegions.push_back(Tail);
+	}
+
+	uintptr_t VirtualMemoryArea::FindFreeRange(size_t Length)
+	{
+		uintptr_t Base = USER_MMAP_BASE;
+		bool Overlap = true;
+		while (Overlap)
+		{
+			if (Base + Length > USER_MMAP_END || Base + Length < Base)
+				return 0;
+
+			Overlap = false;
+			foreach (auto &sr in SharedRegions)
+			{
+				uintptr_t Start = (uintptr_t)sr.Address;
+				uintptr_t End = Start + sr.Length;
+				if (Base < End && Base + Length > Start)
+				{
+					Base = End;
+					Overlap = true;
+				}
+			}
+		}
+		return Base;
+	}
+
+	bool VirtualMemoryArea::PopulatePage(SharedRegion *sr, uintptr_t Address, bool Write)
+	{
+		if (!sr->Read && !sr->Write)
+		{
+			debug("Region %#lx is not accessible", sr->Address);
+			return false;
+		}
+
+		if (Write && !sr->Write)
+		{
+			debug("Region %#lx is not writable", sr->Address);
+			return false;
+		}
+
+		Virtual vmm(this->Table, &Usage.PageTables);
+		PageTableEntry *Entry = vmm.LookupPTE((void *)Address);
+		if (IsSwapped(Entry))
+		{
+			void *Page = KernelAllocator.RequestPage();
+			if (Page == nullptr)
+				return false;
+
+			if (!KernelSwap.LoadPage(Entry->GetAddress(), Page))
+			{
+				KernelAllocator.FreePage(Page);
+				return false;
+			}
+
+			uint64_t Flags = PTFlag::US;
+			if (sr->Write)
+				Flags |= PTFlag::RW;
+			SetPage(vmm, Address, (uintptr_t)Page, Flags);
+			Charge(Usage.Anonymous, 1);
+			Usage.Swapped--;
+			debug("Swapped in %#lx (pt %#lx)", Address, this->Table);
+			return true;
+		}
+
+		off_t FileOffset = sr->Offset + (off_t)(Address - (uintptr_t)sr->Address);
+		void *Current = nullptr;
+		bool Cached = false;
+		bool WasMapped = false;
+		if (vmm.GetMapType((void *)Address) == Virtual::MapType::FourKiB &&
+			vmm.GetPTE((void *)Address)->UserSupervisor)
+		{
+			PageTableEntry *pte = vmm.GetPTE((void *)Address);
+			if (!pte->CopyOnWrite)
+			{
+				/* Already populated (e.g. by another thread) */
+				return !Write || pte->ReadWrite;
+			}
+
+			if (!Write)
+				return true;
+			Current = (void *)(pte->GetAddress() << 12);
+			Cached = pte->Available2;
+			WasMapped = Cached;
+		}
+
+		if (sr->File && (!Write || sr->Shared))
+		{
+			/* Map the page cache frame itself */
+			void *Frame = FilePageCache.RequestPage(sr->File, FileOffset);
+			if (Frame == nullptr)
+				return false;
+
+			uint64_t Flags = PTFlag::US | PTFlag::AVL2;
+			if (!sr->Shared)
+				Flags |= PTFlag::CoW;
+			else if (sr->Write)
+				Flags |= PTFlag::RW;
+
+			SetPage(vmm, Address, (uintptr_t)Frame, Flags);
+			Charge(Usage.Shared, 1);
+			return true;
+		}
+
+		if (!Write)
+		{
+			SetPage(vmm, Address, (uintptr_t)GetZeroPage(),
+					PTFlag::US | PTFlag::CoW);
+			return true;
+		}
+
+		if (sr->File && Current == nullptr)
+		{
+			Current = FilePageCache.RequestPage(sr->File, FileOffset);
+			if (Current == nullptr)
+				return false;
+			Cached = true;
+		}
+
+		void *Page = KernelAllocator.RequestPage();
+		if (Page == nullptr)
+			return false;
+
+		if (Current && Current != ZeroPage)
+			memcpy(Page, Current, PAGE_SIZE);
+		else
+			memset(Page, 0, PAGE_SIZE);
+
+		/* A merged page was charged to this area already */
+		if (!Cached && Current && Current != ZeroPage &&
+			SamePageMerger.Put(Current))
+			Usage.Anonymous--;
+
+		if (Cached)
+			FilePageCache.ReleasePage(sr->File, FileOffset, Current, false);
+		if (WasMapped)
+			Usage.Shared--;
+
+		SetPage(vmm, Address, (uintptr_t)Page, PTFlag::RW | PTFlag::US);
+		Charge(Usage.Anonymous, 1);
+		debug("Populated %#lx with %#lx (pt %#lx)",
+			  Address, Page, this->Table);
+		return true;
+	}
+
+	void VirtualMemoryArea::ReleaseRange(SharedRegion *sr, uintptr_t Start, uintptr_t End,
+										 bool Keep)
+	{
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+		{
+			PageTableEntry *Entry = vmm.LookupPTE((void *)va);
+			if (IsSwapped(Entry))
+			{
+				KernelSwap.FreeSlot(Entry->GetAddress());
+				Usage.Swapped--;
+				Entry->raw = 0;
+				ClearPage(vmm, Batch, va, Keep);
+				continue;
+			}
+
+			if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+				continue;
+
+			PageTableEntry *pte = vmm.GetPTE((void *)va);
+			if (!pte->UserSupervisor)
+				continue;
+
+			void *Frame = (void *)(pte->GetAddress() << 12);
+			if (pte->Available2)
+			{
+				off_t FileOffset = sr->Offset + (off_t)(va - (uintptr_t)sr->Address);
+				FilePageCache.ReleasePage(sr->File, FileOffset, Frame,
+										  sr->Shared && pte->Dirty);
+				Usage.Shared--;
+			}
+			else if (Frame != ZeroPage)
+			{
+				if (!pte->CopyOnWrite || !SamePageMerger.Put(Frame))
+					KernelAllocator.FreePage(Frame);
+				Usage.Anonymous--;
+			}
+			ClearPage(vmm, Batch, va, Keep);
+		}
 	}
 
 	void *VirtualMemoryArea::RequestPages(size_t Count, bool User, bool Protect)
@@ -49,12 +370,13 @@ namespace Memory
 		if (Protect)
 			Flags |= PTFlag::KRsv;
 
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 
 		SmartLock(MgrLock);
 
 		vmm.Map(Address, Address, FROM_PAGES(Count), Flags);
 		AllocatedPagesList.push_back({Address, Count, Protect});
+		Charge(Usage.Anonymous, Count);
 		debug("%#lx +{%#lx, %lld}", this, Address, Count);
 		return Address;
 	}
@@ -88,7 +410,7 @@ namespace Memory
 				return;
 			}
 
-			Virtual vmm(this->Table);
+			Virtual vmm(this->Table, &Usage.PageTables);
 			for (size_t i = 0; i < Count; i++)
 			{
 				void *AddressToMap = (void *)((uintptr_t)Address + (i * PAGE_SIZE));
@@ -97,6 +419,7 @@ namespace Memory
 
 			KernelAllocator.FreePages(Address, Count);
 			AllocatedPagesList.erase(itr);
+			Usage.Anonymous -= Count;
 			debug("%#lx -{%#lx, %lld}", this, Address, Count);
 			return;
 		}
@@ -117,6 +440,7 @@ namespace Memory
 					return;
 				}
 
+				Usage.Anonymous -= itr->PageCount;
 				AllocatedPagesList.erase(itr);
 				return;
 			}
@@ -126,16 +450,18 @@ namespace Memory
 	void *VirtualMemoryArea::CreateCoWRegion(void *Address,
 											 size_t Length,
 											 bool Read, bool Write, bool Exec,
-											 bool Fixed, bool Shared)
+											 bool Fixed, bool Shared,
+											 vfs::Node *File, off_t Offset)
 	{
-		function("%#lx, %lld, %s, %s, %s, %s, %s", Address, Length,
+		function("%#lx, %lld, %s, %s, %s, %s, %s, %#lx, %#lx", Address, Length,
 				 Read ? "true" : "false",
 				 Write ? "true" : "false",
 				 Exec ? "true" : "false",
 				 Fixed ? "true" : "false",
-				 Shared ? "true" : "false");
+				 Shared ? "true" : "false",
+				 File, Offset);
 
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 
 		// FIXME
 		// for (uintptr_t j = uintptr_t(Address);
@@ -150,28 +476,98 @@ namespace Memory
 		// 	}
 		// }
 
+		if (Length == 0)
+			return (void *)-EINVAL;
+		Length = ROUND_UP(Length, PAGE_SIZE);
+
 		bool AnyAddress = Address == nullptr;
 		debug("AnyAddress: %s", AnyAddress ? "true" : "false");
 
+		SmartLock(MgrLock);
+
+		/* A fixed mapping gives back the range it replaces */
+		size_t Replaced = 0;
+		if (!AnyAddress)
+		{
+			uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+			uintptr_t End = Start + Length;
+			foreach (auto &sr in SharedRegions)
+			{
+				uintptr_t rStart = (uintptr_t)sr.Address;
+				uintptr_t rEnd = rStart + sr.Length;
+				if (End <= rStart || Start >= rEnd)
+					continue;
+				Replaced += (End < rEnd ? End : rEnd) - (Start > rStart ? Start : rStart);
+			}
+		}
+
+		if (FROM_PAGES(Usage.Mapped.load()) + Length - Replaced > Limits.AddressSpace)
+		{
+			debug("RLIMIT_AS reached (%#lx + %#lx - %#lx)",
+				  FROM_PAGES(Usage.Mapped.load()), Length, Replaced);
+			return (void *)-ENOMEM;
+		}
+
 		if (AnyAddress)
 		{
-			Address = this->RequestPages(TO_PAGES(Length), true);
-			debug("Allocated %#lx-%#lx for pt %#lx",
-				  Address, (uintptr_t)Address + Length, this->Table);
-			return Address;
+			Address = (void *)this->FindFreeRange(Length);
+			if (Address == nullptr)
+			{
+				error("No free range for %lld bytes", Length);
+				return (void *)-ENOMEM;
+			}
 		}
+		else
+		{
+			uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+			uintptr_t End = Start + Length;
+			for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+			{
+				if (vmm.Check((void *)va, PTFlag::KRsv))
+				{
+					error("Cannot create CoW region at %#lx", va);
+					return (void *)-EPERM;
+				}
+			}
 
-		SmartLock(MgrLock);
-		if (vmm.Check(Address, PTFlag::KRsv))
+			/* Drop whatever was mapped there before */
+			MgrLock.Unlock();
+			this->FreeRegion((void *)Start, Length);
+			MgrLock.Lock(__FUNCTION__);
+			for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+			{
+				if (vmm.GetMapType((void *)va) == Virtual::MapType::FourKiB)
+					vmm.Unmap((void *)va);
+			}
+			Address = (void *)Start;
+		}
+
+		foreach (auto &sr in SharedRegions)
 		{
-			error("Cannot create CoW region at %#lx", Address);
-			return (void *)-EPERM;
+			if ((uintptr_t)sr.Address + sr.Length != (uintptr_t)Address ||
+				sr.Read != Read || sr.Write != Write || sr.Exec != Exec ||
+				sr.Fixed != Fixed || sr.Shared != Shared ||
+				sr.File != File || (File && sr.Offset + (off_t)sr.Length != Offset))
+				continue;
+
+			/* Grow the neighbour instead (e.g. brk) */
+			sr.Length += Length;
+			Usage.Mapped += TO_PAGES(Length);
+			debug("CoW region %#lx extended to %#lx for pt %#lx",
+				  sr.Address, (uintptr_t)sr.Address + sr.Length, this->Table);
+			return Address;
 		}
 
-		vmm.Unmap(Address, Length);
-		vmm.Map(Address, nullptr, Length, PTFlag::CoW);
-		debug("CoW region created at range %#lx-%#lx for pt %#lx",
-			  Address, (uintptr_t)Address + Length, this->Table);
+		if (Shared && File == nullptr && SharedMemoryFS != nullptr)
+		{
+			/* Shared anonymous memory must survive fork,
+			   back it with an object like Linux does. */
+			char Name[32];
+			sprintf(Name, "anon.%ld", AnonymousObjects.fetch_add(1));
+			File = new vfs::SharedMemory(Name, true);
+			File->Size = (off_t)Length;
+			Offset = 0;
+		}
 
 		SharedRegion sr{
 			.Address = Address,
@@ -182,83 +578,613 @@ namespace Memory
 			.Shared = Shared,
 			.Length = Length,
 			.ReferenceCount = 0,
+			.File = File,
+			.Offset = Offset,
 		};
+		HoldFile(sr);
 		SharedRegions.push_back(sr);
-		debug("CoW region created at %#lx for pt %#lx",
-			  Address, this->Table);
+		Usage.Mapped += TO_PAGES(Length);
+		debug("CoW region created at range %#lx-%#lx for pt %#lx",
+			  Address, (uintptr_t)Address + Length, this->Table);
 		return Address;
 	}
 
-	bool VirtualMemoryArea::HandleCoW(uintptr_t PFA)
+	bool VirtualMemoryArea::HandleCoW(uintptr_t PFA, bool Write)
 	{
-		function("%#lx", PFA);
-		Virtual vmm(this->Table);
-		PageTableEntry *pte = vmm.GetPTE((void *)PFA);
-
+		function("%#lx, %s", PFA, Write ? "true" : "false");
 		debug("ctx: %#lx", this);
 
-		if (!pte)
+		SmartLock(MgrLock);
+		SharedRegion *sr = this->FindRegion(PFA);
+		if (sr == nullptr)
 		{
-			/* Unmapped page */
-			debug("PTE is null!");
+			debug("%#lx not found in CoW regions", PFA);
 			return false;
 		}
 
-		if (!pte->CopyOnWrite)
+		return this->PopulatePage(sr, ALIGN_DOWN(PFA, PAGE_SIZE), Write);
+	}
+
+	int VirtualMemoryArea::Populate(void *Address, size_t Length, bool Write)
+	{
+		function("%#lx, %lld, %s", Address, Length, Write ? "true" : "false");
+
+		SmartLock(MgrLock);
+		uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP((uintptr_t)Address + Length, PAGE_SIZE);
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+		{
+			SharedRegion *sr = this->FindRegion(va);
+			if (sr == nullptr)
+				return -EINVAL;
+
+			if (!this->PopulatePage(sr, va, Write && sr->Write))
+				return -ENOMEM;
+		}
+		return 0;
+	}
+
+	bool VirtualMemoryArea::TrimRegions(uintptr_t Start, uintptr_t End, bool Release)
+	{
+		bool Found = false;
+		forItr(itr, SharedRegions)
 		{
-			debug("PFA %#lx is not CoW (pt %#lx) (flags %#lx)",
-				  PFA, this->Table, pte->raw);
+			uintptr_t rStart = (uintptr_t)itr->Address;
+			uintptr_t rEnd = rStart + itr->Length;
+			if (End <= rStart || Start >= rEnd)
+				continue;
+
+			Found = true;
+			uintptr_t fStart = Start > rStart ? Start : rStart;
+			uintptr_t fEnd = End < rEnd ? End : rEnd;
+			if (Release)
+				this->ReleaseRange(&(*itr), fStart, fEnd);
+			Usage.Mapped -= TO_PAGES(fEnd - fStart);
+
+			if (fStart > rStart && fEnd < rEnd)
+			{
+				/* Punched a hole, split the region */
+				SharedRegion Tail = *itr;
+				Tail.Address = (void *)fEnd;
+				Tail.Length = rEnd - fEnd;
+				Tail.Offset += (off_t)(fEnd - rStart);
+				itr->Length = fStart - rStart;
+				HoldFile(Tail);
+				SharedRegions.push_back(Tail);
+			}
+			else if (fStart > rStart)
+				itr->Length = fStart - rStart;
+			else if (fEnd < rEnd)
+			{
+				itr->Offset += (off_t)(fEnd - rStart);
+				itr->Address = (void *)fEnd;
+				itr->Length = rEnd - fEnd;
+			}
+			else
+			{
+				itr->Length = 0;
+				DropFile(*itr);
+			}
+		}
+
+		SharedRegions.remove_if([](const SharedRegion &sr)
+								{ return sr.Length == 0; });
+		return Found;
+	}
+
+	bool VirtualMemoryArea::RangeIsFree(uintptr_t Start, uintptr_t End)
+	{
+		if (End > USER_MMAP_END || End < Start)
 			return false;
+
+		foreach (auto &sr in SharedRegions)
+		{
+			uintptr_t rStart = (uintptr_t)sr.Address;
+			if (Start < rStart + sr.Length && End > rStart)
+				return false;
 		}
 
-		foreach (auto sr in SharedRegions)
+		Virtual vmm(this->Table, &Usage.PageTables);
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
 		{
-			uintptr_t Start = (uintptr_t)sr.Address;
-			uintptr_t End = (uintptr_t)sr.Address + sr.Length;
-			debug("Start: %#lx, End: %#lx (PFA: %#lx)",
-				  Start, End, PFA);
+			if (vmm.Check((void *)va, PTFlag::KRsv))
+				return false;
+		}
+		return true;
+	}
+
+	void VirtualMemoryArea::MovePages(uintptr_t From, uintptr_t To, size_t Length)
+	{
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		for (size_t i = 0; i < Length; i += PAGE_SIZE)
+		{
+			PageTableEntry *Entry = vmm.LookupPTE((void *)(From + i));
+			bool Swapped = IsSwapped(Entry);
+			if (!Swapped && vmm.GetMapType((void *)(From + i)) != Virtual::MapType::FourKiB)
+				continue;
+
+			/* Frames, cache references and swap slots
+			   stay the same, only the entry moves. */
+			uint64_t Raw = Entry->raw;
+			SetPage(vmm, To + i, 0, 0);
+			vmm.GetPTE((void *)(To + i))->raw = Raw;
+
+			if (Swapped)
+				Entry->raw = 0;
+			ClearPage(vmm, Batch, From + i);
+		}
+	}
+
+	int VirtualMemoryArea::FreeRegion(void *Address, size_t Length)
+	{
+		function("%#lx, %lld", Address, Length);
+
+		SmartLock(MgrLock);
+		uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP((uintptr_t)Address + Length, PAGE_SIZE);
+		if (!this->TrimRegions(Start, End, true))
+			return -EINVAL;
+
+		debug("Freed region range %#lx-%#lx for pt %#lx",
+			  Start, End, this->Table);
+		return 0;
+	}
+
+	void *VirtualMemoryArea::RemapRegion(void *Address, size_t OldLength,
+										 size_t NewLength, bool MayMove,
+										 void *NewAddress)
+	{
+		function("%#lx, %lld, %lld, %s, %#lx", Address, OldLength, NewLength,
+				 MayMove ? "true" : "false", NewAddress);
+
+		uintptr_t Start = (uintptr_t)Address;
+		OldLength = ROUND_UP(OldLength, PAGE_SIZE);
+		NewLength = ROUND_UP(NewLength, PAGE_SIZE);
+		if (NewLength == 0 || Start % PAGE_SIZE)
+			return (void *)-EINVAL;
+
+		SmartLock(MgrLock);
+		SharedRegion *sr = this->FindRegion(Start);
+		if (sr == nullptr ||
+			Start + OldLength > (uintptr_t)sr->Address + sr->Length)
+		{
+			debug("%#lx-%#lx is not a single region", Start, Start + OldLength);
+			return (void *)-EFAULT;
+		}
 
-			if (PFA >= Start && PFA < End)
+		if (NewLength > OldLength &&
+			FROM_PAGES(Usage.Mapped.load()) + (NewLength - OldLength) > Limits.AddressSpace)
+			return (void *)-ENOMEM;
+
+		if (NewAddress == nullptr)
+		{
+			if (NewLength <= OldLength)
+			{
+				this->TrimRegions(Start + NewLength, Start + OldLength, true);
+				return Address;
+			}
+
+			/* Grow in place if nothing follows the region */
+			uintptr_t End = Start + OldLength;
+			if (End == (uintptr_t)sr->Address + sr->Length &&
+				this->RangeIsFree(End, Start + NewLength))
+			{
+				Virtual vmm(this->Table, &Usage.PageTables);
+				DropIdentity(vmm, End, Start + NewLength);
+				sr->Length += NewLength - OldLength;
+				Usage.Mapped += TO_PAGES(NewLength - OldLength);
+				debug("Grew region %#lx to %#lx", sr->Address,
+					  (uintptr_t)sr->Address + sr->Length);
+				return Address;
+			}
+
+			if (!MayMove)
+				return (void *)-ENOMEM;
+		}
+
+		uintptr_t Target = (uintptr_t)NewAddress;
+		if (NewAddress != nullptr)
+		{
+			if (Target % PAGE_SIZE ||
+				(Target < Start + OldLength && Target + NewLength > Start))
+				return (void *)-EINVAL;
+
+			/* The target may cut the same region */
+			this->TrimRegions(Target, Target + NewLength, true);
+			sr = this->FindRegion(Start);
+			assert(sr != nullptr);
+		}
+		else
+		{
+			Target = this->FindFreeRange(NewLength);
+			if (Target == 0)
+				return (void *)-ENOMEM;
+		}
+
+		SharedRegion Moved = *sr;
+		Moved.Address = (void *)Target;
+		Moved.Length = NewLength;
+		Moved.Offset += (off_t)(Start - (uintptr_t)sr->Address);
+		HoldFile(Moved);
+
+		size_t Length = MIN(OldLength, NewLength);
+		if (OldLength > Length)
+			this->TrimRegions(Start + Length, Start + OldLength, true);
+		this->MovePages(Start, Target, Length);
+		this->TrimRegions(Start, Start + Length, false);
+		if (NewLength > Length)
+		{
+			Virtual vmm(this->Table, &Usage.PageTables);
+			DropIdentity(vmm, Target + Length, Target + NewLength);
+		}
+
+		SharedRegions.push_back(Moved);
+		Usage.Mapped += TO_PAGES(NewLength);
+		debug("Moved %#lx-%#lx to %#lx-%#lx", Start, Start + OldLength,
+			  Target, Target + NewLength);
+		return (void *)Target;
+	}
+
+	int VirtualMemoryArea::DiscardRange(void *Address, size_t Length)
+	{
+		function("%#lx, %lld", Address, Length);
+
+		SmartLock(MgrLock);
+		uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP((uintptr_t)Address + Length, PAGE_SIZE);
+		size_t Covered = 0;
+		foreach (auto &sr in SharedRegions)
+		{
+			uintptr_t rStart = (uintptr_t)sr.Address;
+			uintptr_t rEnd = rStart + sr.Length;
+			if (End <= rStart || Start >= rEnd)
+				continue;
+
+			uintptr_t fStart = Start > rStart ? Start : rStart;
+			uintptr_t fEnd = End < rEnd ? End : rEnd;
+			this->ReleaseRange(&sr, fStart, fEnd, true);
+			Covered += fEnd - fStart;
+		}
+
+		if (Covered != End - Start)
+			return -ENOMEM;
+		return 0;
+	}
+
+	int VirtualMemoryArea::ProtectRegion(void *Address, size_t Length,
+										 bool Read, bool Write, bool Exec)
+	{
+		function("%#lx, %lld, %s, %s, %s", Address, Length,
+				 Read ? "true" : "false",
+				 Write ? "true" : "false",
+				 Exec ? "true" : "false");
+
+		SmartLock(MgrLock);
+		uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP((uintptr_t)Address + Length, PAGE_SIZE);
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+		{
+			if (this->FindRegion(va) == nullptr)
+				return -EINVAL;
+		}
+
+		this->SplitRegion(Start);
+		this->SplitRegion(End);
+
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		foreach (auto &sr in SharedRegions)
+		{
+			uintptr_t rStart = (uintptr_t)sr.Address;
+			if (rStart < Start || rStart >= End)
+				continue;
+
+			sr.Read = Read;
+			sr.Write = Write;
+			sr.Exec = Exec;
+
+			for (uintptr_t va = rStart; va < rStart + sr.Length; va += PAGE_SIZE)
 			{
-				if (sr.Shared)
+				if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+					continue;
+
+				PageTableEntry *pte = vmm.GetPTE((void *)va);
+				if (!Read && !Write)
 				{
-					fixme("Shared CoW");
-					return false;
+					/* Keep the frame, the next access faults */
+					pte->UserSupervisor = false;
+					pte->ReadWrite = false;
 				}
+				else
+				{
+					pte->UserSupervisor = true;
+					/* Zero page stays read-only until written */
+					pte->ReadWrite = Write && !pte->CopyOnWrite;
+				}
+				Batch.Add(va);
+			}
+		}
+		return 0;
+	}
+
+	int VirtualMemoryArea::SyncRegion(void *Address, size_t Length)
+	{
+		function("%#lx, %lld", Address, Length);
+
+		SmartLock(MgrLock);
+		uintptr_t Start = ALIGN_DOWN((uintptr_t)Address, PAGE_SIZE);
+		uintptr_t End = ROUND_UP((uintptr_t)Address + Length, PAGE_SIZE);
+		for (uintptr_t va = Start; va < End; va += PAGE_SIZE)
+		{
+			if (this->FindRegion(va) == nullptr)
+				return -ENOMEM;
+		}
 
-				void *pAddr = this->RequestPages(1);
-				if (pAddr == nullptr)
-					return false;
-				memset(pAddr, 0, PAGE_SIZE);
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		foreach (auto &sr in SharedRegions)
+		{
+			if (!sr.File || !sr.Shared)
+				continue;
 
-				assert(pte->Present == true);
-				pte->ReadWrite = sr.Write;
-				pte->UserSupervisor = sr.Read;
-				pte->ExecuteDisable = sr.Exec;
+			uintptr_t rStart = (uintptr_t)sr.Address;
+			uintptr_t rEnd = rStart + sr.Length;
+			if (End <= rStart || Start >= rEnd)
+				continue;
 
-				pte->CopyOnWrite = false;
-				debug("PFA %#lx is CoW (pt %#lx, flags %#lx)",
-					  PFA, this->Table, pte->raw);
-#if defined(a64)
-				CPU::x64::invlpg((void *)PFA);
-#elif defined(a32)
-				CPU::x32::invlpg((void *)PFA);
-#endif
-				return true;
+			uintptr_t fStart = Start > rStart ? Start : rStart;
+			uintptr_t fEnd = End < rEnd ? End : rEnd;
+			for (uintptr_t va = fStart; va < fEnd; va += PAGE_SIZE)
+			{
+				if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+					continue;
+
+				/* Move the hardware dirty bit to the cache */
+				PageTableEntry *pte = vmm.GetPTE((void *)va);
+				if (!pte->Available2 || !pte->Dirty)
+					continue;
+
+				pte->Dirty = false;
+				Batch.Add(va);
+				FilePageCache.MarkDirty(sr.File, sr.Offset + (off_t)(va - rStart));
+			}
+
+			/* Later writes must set the dirty bit again */
+			Batch.Flush();
+			int ret = FilePageCache.Sync(sr.File, sr.Offset + (off_t)(fStart - rStart),
+										 fEnd - fStart);
+			if (ret < 0)
+				return ret;
+		}
+		return 0;
+	}
+
+	size_t VirtualMemoryArea::SwapOut(size_t Count)
+	{
+		/* Called from the page allocator, never wait for a busy area */
+		if (MgrLock.Locked())
+			return 0;
+
+		SmartLock(MgrLock);
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		size_t Evicted = 0;
+
+		/* Clock over the private anonymous pages. The first sweep
+		   resumes at the hand, accessed pages get a second chance. */
+		for (int Sweep = 0; Sweep < 3; Sweep++)
+		{
+			foreach (auto &sr in SharedRegions)
+			{
+				if (sr.File || sr.Shared)
+					continue;
+
+				uintptr_t Start = (uintptr_t)sr.Address;
+				for (uintptr_t va = Start; va < Start + sr.Length; va += PAGE_SIZE)
+				{
+					if (Sweep == 0 && va < SwapHand)
+						continue;
+
+					if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+						continue;
+
+					PageTableEntry *pte = vmm.GetPTE((void *)va);
+					void *Frame = (void *)(pte->GetAddress() << 12);
+					if (Frame == ZeroPage || pte->Available2 || pte->CopyOnWrite)
+						continue;
+
+					if (pte->Accessed)
+					{
+						pte->Accessed = false;
+						Batch.Add(va);
+						continue;
+					}
+
+					size_t Slot;
+					if (!KernelSwap.StorePage(Frame, Slot))
+						return Evicted;
+
+					pte->raw = 0;
+					pte->Available2 = true;
+					pte->SetAddress(Slot);
+					Batch.Add(va);
+
+					KernelAllocator.FreePage(Frame);
+					Usage.Anonymous--;
+					Usage.Swapped++;
+					SwapHand = va + PAGE_SIZE;
+					if (++Evicted == Count)
+						return Evicted;
+				}
 			}
 		}
 
-		debug("%#lx not found in CoW regions", PFA);
-		return false;
+		SwapHand = 0;
+		return Evicted;
+	}
+
+	size_t VirtualMemoryArea::MergePages(size_t Count)
+	{
+		SmartLock(MgrLock);
+		Virtual vmm(this->Table, &Usage.PageTables);
+		TLBBatch Batch(this->Table);
+		size_t Scanned = 0;
+		while (true)
+		{
+			/* Regions are not sorted, take the next one by address */
+			SharedRegion *sr = nullptr;
+			foreach (auto &r in SharedRegions)
+			{
+				if (r.File || r.Shared || !r.Write ||
+					(uintptr_t)r.Address + r.Length <= MergeHand)
+					continue;
+				if (sr == nullptr || r.Address < sr->Address)
+					sr = &r;
+			}
+
+			if (sr == nullptr)
+				break;
+
+			uintptr_t Start = (uintptr_t)sr->Address;
+			if (Start < MergeHand)
+				Start = MergeHand;
+			for (uintptr_t va = Start; va < (uintptr_t)sr->Address + sr->Length; va += PAGE_SIZE)
+			{
+				if (Scanned == Count)
+				{
+					MergeHand = va;
+					return Scanned;
+				}
+				Scanned++;
+				SamePageMerger.PageScanned();
+
+				if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+					continue;
+
+				PageTableEntry *pte = vmm.GetPTE((void *)va);
+				void *Frame = (void *)(pte->GetAddress() << 12);
+				if (Frame == ZeroPage || pte->Available2 ||
+					pte->CopyOnWrite || !pte->ReadWrite)
+					continue;
+
+				/* Written since the last pass, try again on the next one */
+				if (pte->Dirty)
+				{
+					pte->Dirty = false;
+					Batch.Add(va);
+					continue;
+				}
+
+				/* Write-protect before reading it, a write now
+				   faults into HandleCoW and waits for MgrLock */
+				pte->ReadWrite = false;
+				pte->CopyOnWrite = true;
+				TLB::Invalidate(this->Table, va);
+
+				if (PageMerger::IsZero(Frame))
+				{
+					SetPage(vmm, va, (uintptr_t)GetZeroPage(),
+							PTFlag::US | PTFlag::CoW);
+					TLB::Invalidate(this->Table, va);
+					KernelAllocator.FreePage(Frame);
+					Usage.Anonymous--;
+					SamePageMerger.ZeroPageMerged();
+					continue;
+				}
+
+				uint32_t Sum = PageMerger::Checksum(Frame);
+				void *Merged = SamePageMerger.Merge(Frame, Sum, this, va);
+				if (Merged == nullptr)
+				{
+					pte->ReadWrite = true;
+					pte->CopyOnWrite = false;
+					continue;
+				}
+
+				if (Merged == Frame)
+					continue;
+
+				SetPage(vmm, va, (uintptr_t)Merged, PTFlag::US | PTFlag::CoW);
+				TLB::Invalidate(this->Table, va);
+				KernelAllocator.FreePage(Frame);
+			}
+			MergeHand = (uintptr_t)sr->Address + sr->Length;
+		}
+
+		MergeHand = 0;
+		return Scanned;
+	}
+
+	size_t VirtualMemoryArea::MigratePages(uintptr_t Low, uintptr_t High)
+	{
+		/* The owner may be faulting into the allocator that is
+		   compacting on its behalf, skip the area instead */
+		if (MgrLock.Locked())
+			return 0;
+
+		SmartLock(MgrLock);
+		Virtual vmm(this->Table, &Usage.PageTables);
+		size_t Moved = 0;
+		foreach (auto &sr in SharedRegions)
+		{
+			if (sr.Shared)
+				continue;
+
+			uintptr_t Start = (uintptr_t)sr.Address;
+			for (uintptr_t va = Start; va < Start + sr.Length; va += PAGE_SIZE)
+			{
+				if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+					continue;
+
+				/* Identity mappings left by ClearPage are not ours */
+				PageTableEntry *pte = vmm.GetPTE((void *)va);
+				uintptr_t Frame = pte->GetAddress() << 12;
+				if (Frame < Low || Frame >= High || !pte->UserSupervisor)
+					continue;
+
+				if ((void *)Frame == ZeroPage || pte->Available2 || pte->CopyOnWrite)
+					continue;
+
+				void *Page = KernelAllocator.RequestPage();
+				if (Page == nullptr)
+					return Moved;
+
+				/* Write-protect before copying, a write now
+				   faults into HandleCoW and waits for MgrLock */
+				bool Writable = pte->ReadWrite;
+				pte->ReadWrite = false;
+				TLB::Invalidate(this->Table, va);
+
+				memcpy(Page, (void *)Frame, PAGE_SIZE);
+				pte->SetAddress((uintptr_t)Page >> 12);
+				pte->ReadWrite = Writable;
+				TLB::Invalidate(this->Table, va);
+
+				KernelAllocator.FreePage((void *)Frame);
+				Moved++;
+			}
+		}
+		return Moved;
 	}
 
 	void VirtualMemoryArea::FreeAllPages()
 	{
 		SmartLock(MgrLock);
+		foreach (auto &sr in SharedRegions)
+		{
+			uintptr_t Start = (uintptr_t)sr.Address;
+			this->ReleaseRange(&sr, Start, Start + sr.Length);
+			DropFile(sr);
+		}
+		SharedRegions.clear();
+		Usage.Mapped = 0;
+
 		foreach (auto ap in AllocatedPagesList)
 		{
 			KernelAllocator.FreePages(ap.Address, ap.PageCount);
-			Virtual vmm(this->Table);
+			Usage.Anonymous -= ap.PageCount;
+			Virtual vmm(this->Table, &Usage.PageTables);
 			for (size_t i = 0; i < ap.PageCount; i++)
 				vmm.Remap((void *)((uintptr_t)ap.Address + (i * PAGE_SIZE)),
 						  (void *)((uintptr_t)ap.Address + (i * PAGE_SIZE)),
@@ -267,7 +1193,7 @@ namespace Memory
 		AllocatedPagesList.clear();
 	}
 
-	void VirtualMemoryArea::Fork(VirtualMemoryArea *Parent)
+	int VirtualMemoryArea::Fork(VirtualMemoryArea *Parent)
 	{
 		function("%#lx", Parent);
 		assert(Parent);
@@ -277,8 +1203,9 @@ namespace Memory
 			  Parent->Table, this->Table);
 		debug("ctx: this: %#lx parent: %#lx", this, Parent);
 
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
+		Limits = Parent->Limits;
 		foreach (auto &ap in Parent->AllocatedPagesList)
 		{
 			if (ap.Protected)
@@ -292,7 +1219,7 @@ namespace Memory
 			void *Address = this->RequestPages(ap.PageCount);
 			MgrLock.Lock(__FUNCTION__);
 			if (Address == nullptr)
-				return;
+				return -ENOMEM;
 
 			memcpy(Address, ap.Address, FROM_PAGES(ap.PageCount));
 
@@ -331,23 +1258,88 @@ namespace Memory
 
 		foreach (auto &sr in Parent->SharedRegions)
 		{
-			MgrLock.Unlock();
-			void *Address = this->CreateCoWRegion(sr.Address, sr.Length,
-												  sr.Read, sr.Write, sr.Exec,
-												  sr.Fixed, sr.Shared);
-			MgrLock.Lock(__FUNCTION__);
-			if (Address == nullptr)
-				return;
-			memcpy(Address, sr.Address, sr.Length);
+			SharedRegions.push_back(sr);
+			HoldFile(SharedRegions.back());
+			Usage.Mapped += TO_PAGES(sr.Length);
+
+			/* The table is a copy of the parent's, populated
+			   pages still point to the parent's frames. */
+			uintptr_t Start = (uintptr_t)sr.Address;
+			for (uintptr_t va = Start; va < Start + sr.Length; va += PAGE_SIZE)
+			{
+				PageTableEntry *Entry = vmm.LookupPTE((void *)va);
+				if (IsSwapped(Entry))
+				{
+					/* The slot stays with the parent */
+					void *Page = KernelAllocator.RequestPage();
+					if (Page == nullptr)
+					{
+						DropForkedRange(vmm, va, Start + sr.Length);
+						return -ENOMEM;
+					}
+
+					if (!KernelSwap.LoadPage(Entry->GetAddress(), Page, false))
+					{
+						KernelAllocator.FreePage(Page);
+						DropForkedRange(vmm, va, Start + sr.Length);
+						return -EIO;
+					}
+
+					uint64_t Flags = PTFlag::US;
+					if (sr.Write)
+						Flags |= PTFlag::RW;
+					SetPage(vmm, va, (uintptr_t)Page, Flags);
+					Charge(Usage.Anonymous, 1);
+					continue;
+				}
+
+				if (vmm.GetMapType((void *)va) != Virtual::MapType::FourKiB)
+					continue;
+
+				PageTableEntry *pte = vmm.GetPTE((void *)va);
+				void *Frame = (void *)(pte->GetAddress() << 12);
+				if (Frame == ZeroPage)
+					continue;
+
+				if (pte->Available2)
+				{
+					/* Page cache frame, just take another reference */
+					off_t FileOffset = sr.Offset + (off_t)(va - Start);
+					FilePageCache.RequestPage(sr.File, FileOffset);
+					Charge(Usage.Shared, 1);
+					continue;
+				}
+
+				if (pte->CopyOnWrite && SamePageMerger.Get(Frame))
+				{
+					/* Merged page, the child shares it too */
+					Charge(Usage.Anonymous, 1);
+					continue;
+				}
+
+				void *Page = KernelAllocator.RequestPage();
+				if (Page == nullptr)
+				{
+					DropForkedRange(vmm, va, Start + sr.Length);
+					return -ENOMEM;
+				}
+
+				memcpy(Page, Frame, PAGE_SIZE);
+				uint64_t Flags = pte->raw & (PTFlag::RW | PTFlag::US);
+				SetPage(vmm, va, (uintptr_t)Page, Flags);
+				Charge(Usage.Anonymous, 1);
+			}
+
 			debug("Forked CoW region %#lx-%#lx", sr.Address,
 				  (uintptr_t)sr.Address + sr.Length);
 		}
+		return 0;
 	}
 
 	int VirtualMemoryArea::Map(void *VirtualAddress, void *PhysicalAddress,
 							   size_t Length, uint64_t Flags)
 	{
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
 
 		uintptr_t intVirtualAddress = (uintptr_t)VirtualAddress;
@@ -383,7 +1375,7 @@ namespace Memory
 
 	int VirtualMemoryArea::Remap(void *VirtualAddress, void *PhysicalAddress, uint64_t Flags)
 	{
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
 
 		if (vmm.Check(VirtualAddress, PTFlag::KRsv))
@@ -406,7 +1398,7 @@ namespace Memory
 
 	int VirtualMemoryArea::Unmap(void *VirtualAddress, size_t Length)
 	{
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
 
 		uintptr_t intVirtualAddress = (uintptr_t)VirtualAddress;
@@ -428,20 +1420,19 @@ namespace Memory
 
 	void *VirtualMemoryArea::__UserCheckAndGetAddress(void *Address, size_t Length)
 	{
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
 
-		void *pAddress = this->Table->Get(Address);
-		if (pAddress == nullptr)
-		{
-			debug("Virtual address %#lx returns nullptr", Address);
-			return nullptr;
-		}
-
 		uintptr_t intAddress = (uintptr_t)Address;
 		intAddress = ALIGN_DOWN(intAddress, PAGE_SIZE);
-		for (uintptr_t va = intAddress; va < intAddress + Length; va += PAGE_SIZE)
+		for (uintptr_t va = intAddress; va < (uintptr_t)Address + Length; va += PAGE_SIZE)
 		{
+			/* The kernel may write through the returned
+			   address, don't hand out the zero page. */
+			SharedRegion *sr = this->FindRegion(va);
+			if (sr && sr->Write)
+				this->PopulatePage(sr, va, true);
+
 			if (vmm.Check((void *)va, PTFlag::US))
 				continue;
 
@@ -449,14 +1440,26 @@ namespace Memory
 			return nullptr;
 		}
 
+		void *pAddress = this->Table->Get(Address);
+		if (pAddress == nullptr)
+		{
+			debug("Virtual address %#lx returns nullptr", Address);
+			return nullptr;
+		}
+
 		return pAddress;
 	}
 
 	int VirtualMemoryArea::__UserCheck(void *Address, size_t Length)
 	{
-		Virtual vmm(this->Table);
+		Virtual vmm(this->Table, &Usage.PageTables);
 		SmartLock(MgrLock);
 
+		/* Region pages may not be populated yet */
+		SharedRegion *sr = this->FindRegion((uintptr_t)Address);
+		if (sr && (sr->Read || sr->Write))
+			return 0;
+
 		if (vmm.Check(Address, PTFlag::US))
 			return 0;
 
@@ -464,6 +1467,100 @@ namespace Memory
 		return -EFAULT;
 	}
 
+	int VirtualMemoryArea::CopyUser(void *Kernel, uintptr_t User, size_t Length, bool ToUser)
+	{
+		if (Length == 0)
+			return 0;
+
+		uintptr_t End = User + Length;
+		if (End < User)
+			return -EFAULT;
+
+		/* Hold the lock so nothing is evicted while copying */
+		Virtual vmm(this->Table, &Usage.PageTables);
+		SmartLock(MgrLock);
+		for (uintptr_t va = ALIGN_DOWN(User, PAGE_SIZE); va < End; va += PAGE_SIZE)
+		{
+			SharedRegion *sr = this->FindRegion(va);
+			if (sr && !this->PopulatePage(sr, va, ToUser))
+				return -EFAULT;
+
+			if (!vmm.Check((void *)va, PTFlag::US) ||
+				(ToUser && !vmm.Check((void *)va, PTFlag::RW)))
+			{
+				debug("Address %#lx is not user accessible", va);
+				return -EFAULT;
+			}
+		}
+
+		if (TLB::IsLoaded(this->Table))
+		{
+			AllowUserAccess(true);
+			if (ToUser)
+				memcpy((void *)User, Kernel, Length);
+			else
+				memcpy(Kernel, (void *)User, Length);
+			AllowUserAccess(false);
+			return 0;
+		}
+
+		/* Not our address space, go through the identity mapping */
+		uint8_t *Buffer = (uint8_t *)Kernel;
+		while (User < End)
+		{
+			size_t Chunk = PAGE_SIZE - (User & (PAGE_SIZE - 1));
+			if (Chunk > End - User)
+				Chunk = End - User;
+
+			void *Physical = this->Table->Get((void *)User);
+			if (ToUser)
+				memcpy(Physical, Buffer, Chunk);
+			else
+				memcpy(Buffer, Physical, Chunk);
+
+			Buffer += Chunk;
+			User += Chunk;
+		}
+		return 0;
+	}
+
+	int VirtualMemoryArea::CopyFromUser(void *Destination, const void *Source, size_t Length)
+	{
+		return this->CopyUser(Destination, (uintptr_t)Source, Length, false);
+	}
+
+	int VirtualMemoryArea::CopyToUser(void *Destination, const void *Source, size_t Length)
+	{
+		return this->CopyUser((void *)Source, (uintptr_t)Destination, Length, true);
+	}
+
+	ssize_t VirtualMemoryArea::CopyStringFromUser(char *Destination, const char *Source, size_t Length)
+	{
+		uintptr_t User = (uintptr_t)Source;
+		size_t Copied = 0;
+		while (Copied < Length)
+		{
+			/* Never read past the page holding the terminator */
+			size_t Chunk = PAGE_SIZE - (User & (PAGE_SIZE - 1));
+			if (Chunk > Length - Copied)
+				Chunk = Length - Copied;
+
+			int ret = this->CopyUser(Destination + Copied, User, Chunk, false);
+			if (ret < 0)
+				return ret;
+
+			for (size_t i = 0; i < Chunk; i++)
+			{
+				if (Destination[Copied + i] == '\0')
+					return (ssize_t)(Copied + i);
+			}
+
+			Copied += Chunk;
+			User += Chunk;
+		}
+		return -ENAMETOOLONG;
+	}
+
 	VirtualMemoryArea::VirtualMemoryArea(PageTable *_Table)
 		: Table(_Table)
 	{
@@ -488,5 +1585,12 @@ namespace Memory
 		SmartLock(MgrLock);
 		foreach (auto ap in AllocatedPagesList)
 			KernelAllocator.FreePages(ap.Address, ap.PageCount);
+
+		foreach (auto &sr in SharedRegions)
+		{
+			uintptr_t Start = (uintptr_t)sr.Address;
+			this->ReleaseRange(&sr, Start, Start + sr.Length);
+			DropFile(sr);
+		}
 	}
 }
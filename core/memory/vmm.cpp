@@ -24,8 +24,18 @@
 
 namespace Memory
 {
-	Virtual::Virtual(PageTable *Table)
+	void *Virtual::NewTable(size_t Size)
 	{
+		size_t Pages = TO_PAGES(Size + 1);
+		void *Table = KernelAllocator.RequestPages(Pages);
+		if (this->TablePages)
+			this->TablePages->fetch_add(Pages);
+		return Table;
+	}
+
+	Virtual::Virtual(PageTable *Table, std::atomic_size_t *TablePages)
+	{
+		this->TablePages = TablePages;
 		if (Table)
 			this->pTable = Table;
 		else
@@ -0,0 +1,181 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory.hpp>
+
+#include <task.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+/* Slot of a freed allocation, keeps the probe chains intact */
+#define ZERO_POOL_TOMBSTONE ((void *)1)
+
+namespace Memory
+{
+	ZeroPool::Allocation *ZeroPool::FindSlot(void *Address, bool Empty)
+	{
+		size_t Start = ((uintptr_t)Address >> 12) % ZERO_POOL_SLOTS;
+		for (size_t i = 0; i < ZERO_POOL_SLOTS; i++)
+		{
+			Allocation *s = &Slots[(Start + i) % ZERO_POOL_SLOTS];
+			if (Empty)
+			{
+				if (s->Address == nullptr || s->Address == ZERO_POOL_TOMBSTONE)
+					return s;
+				continue;
+			}
+
+			if (s->Address == Address)
+				return s;
+			if (s->Address == nullptr)
+				return nullptr;
+		}
+		return nullptr;
+	}
+
+	void *ZeroPool::Allocate(size_t Size)
+	{
+		size_t Pages = TO_PAGES(Size);
+		if (Pages > ZERO_POOL_CHUNK_PAGES)
+			return nullptr;
+
+		void *Chunk;
+		{
+			SmartLock(PoolLock);
+			if (ChunkCount == 0)
+			{
+				Misses++;
+				return nullptr;
+			}
+
+			Chunk = Chunks[ChunkCount - 1];
+			Allocation *s = FindSlot(Chunk, true);
+			if (s == nullptr)
+			{
+				Misses++;
+				return nullptr;
+			}
+
+			ChunkCount--;
+			s->Address = Chunk;
+			s->Pages = Pages;
+			Outstanding++;
+			Hits++;
+		}
+
+		/* The tail is still zeroed but we don't track partial chunks */
+		if (Pages < ZERO_POOL_CHUNK_PAGES)
+			KernelAllocator.FreePages((void *)((uintptr_t)Chunk + FROM_PAGES(Pages)),
+									  ZERO_POOL_CHUNK_PAGES - Pages);
+		return Chunk;
+	}
+
+	size_t ZeroPool::GetSize(void *Address)
+	{
+		if (Address == nullptr ||
+			((uintptr_t)Address & (PAGE_SIZE - 1)) != 0 ||
+			Outstanding.load() == 0)
+			return 0;
+
+		SmartLock(PoolLock);
+		Allocation *s = FindSlot(Address, false);
+		return s ? FROM_PAGES(s->Pages) : 0;
+	}
+
+	bool ZeroPool::Free(void *Address)
+	{
+		if (Address == nullptr ||
+			((uintptr_t)Address & (PAGE_SIZE - 1)) != 0 ||
+			Outstanding.load() == 0)
+			return false;
+
+		size_t Pages;
+		{
+			SmartLock(PoolLock);
+			Allocation *s = FindSlot(Address, false);
+			if (s == nullptr)
+				return false;
+
+			Pages = s->Pages;
+			s->Address = ZERO_POOL_TOMBSTONE;
+			s->Pages = 0;
+			Outstanding--;
+		}
+
+		KernelAllocator.FreePages(Address, Pages);
+		return true;
+	}
+
+	size_t ZeroPool::Drain(size_t Pages)
+	{
+		if (PoolLock.Locked())
+			return 0;
+
+		size_t Freed = 0;
+		SmartLock(PoolLock);
+		while (ChunkCount > 0 && Freed < Pages)
+		{
+			KernelAllocator.FreePages(Chunks[--ChunkCount], ZERO_POOL_CHUNK_PAGES);
+			Freed += ZERO_POOL_CHUNK_PAGES;
+		}
+		return Freed;
+	}
+
+	void ZeroPool::Refill()
+	{
+		/* Don't hold on to memory the rest of the system needs */
+		const uint64_t Reserve = FROM_PAGES(ZERO_POOL_CHUNK_PAGES * ZERO_POOL_CHUNKS) * 4;
+
+		while (ChunkCount < ZERO_POOL_CHUNKS)
+		{
+			uint64_t Free = KernelAllocator.GetFreeMemory();
+			if (Free < Reserve || Free < PageReclaimer.GetHighWatermark())
+				break;
+
+			void *Chunk = KernelAllocator.RequestPages(ZERO_POOL_CHUNK_PAGES);
+			if (Chunk == nullptr)
+				break;
+			memset(Chunk, 0, FROM_PAGES(ZERO_POOL_CHUNK_PAGES));
+
+			SmartLock(PoolLock);
+			if (ChunkCount == ZERO_POOL_CHUNKS)
+			{
+				KernelAllocator.FreePages(Chunk, ZERO_POOL_CHUNK_PAGES);
+				break;
+			}
+			Chunks[ChunkCount++] = Chunk;
+		}
+	}
+
+	void ZeroPool::DaemonEntry()
+	{
+		while (true)
+		{
+			ZeroedPages.Refill();
+			TaskManager->Sleep(100);
+		}
+	}
+
+	void ZeroPool::Start()
+	{
+		Tasking::TCB *t = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													Tasking::IP(DaemonEntry));
+		t->Rename("Zero Page Pool");
+		t->SetPriority(Tasking::Idle);
+	}
+}
@@ -254,6 +254,18 @@ nsa void HandleException(CPU::ExceptionFrame *Frame)
 		HandleUnrecoverableException(Frame);
 	}
 
+#if defined(a64)
+	/* Kernel code runs on process page tables too,
+		copy mappings they are missing from the kernel one */
+	if (Frame->InterruptNumber == CPU::x86::PageFault &&
+		Frame->cs == GDT_KERNEL_CODE)
+	{
+		Memory::PageTable *pt = (Memory::PageTable *)(Frame->cr3 & ~0xFFFUL);
+		if (pt->SyncKernelMapping(Frame->cr2))
+			goto ExceptionExit;
+	}
+#endif
+
 	if (Frame->cs == GDT_USER_CODE && Frame->ss == GDT_USER_DATA)
 	{
 		if (UserModeExceptionHandler(Frame))
@@ -90,7 +90,13 @@ nsa bool UserModeExceptionHandler(CPU::ExceptionFrame *Frame)
 	{
 	case CPU::x86::PageFault:
 	{
-		bool Handled = proc->vma->HandleCoW(Frame->cr2);
+#if defined(a64)
+		CPU::x64::PageFaultErrorCode pfCode = {.raw = (uint32_t)Frame->ErrorCode};
+		bool Write = pfCode.W;
+#else
+		bool Write = Frame->ErrorCode & 0x2;
+#endif
+		bool Handled = proc->vma->HandleCoW(Frame->cr2, Write);
 		if (!Handled)
 			Handled = thread->Stack->Expand(Frame->cr2);
 
@@ -0,0 +1,201 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <rcu.hpp>
+
+#include <lock.hpp>
+#include <debug.h>
+#include <smp.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+namespace RCU
+{
+	/* Callbacks waiting for a grace period, in call order */
+	static Head *Pending = nullptr;
+	static Head **PendingTail = &Pending;
+	static TicketLock PendingLock;
+	static std::atomic_uint64_t GracePeriods = 0;
+
+	static inline void Report(CPUData *Core)
+	{
+		/* Only this core writes it, a plain store is enough.
+			Release keeps the section's loads before it. */
+		Core->RCUQuiescent.store(Core->RCUQuiescent.load(std::memory_order_relaxed) + 1,
+								 std::memory_order_release);
+	}
+
+	nsa void ReadLock()
+	{
+		bool Enabled = CPU::Interrupts(CPU::Check);
+		CPU::Interrupts(CPU::Disable);
+		CPUData *Core = GetCurrentCPU();
+		if (Core->RCUNesting++ == 0)
+			Core->RCURestore = Enabled;
+		CPU::MemBar::Barrier();
+	}
+
+	nsa void ReadUnlock()
+	{
+		CPU::MemBar::Barrier();
+		CPUData *Core = GetCurrentCPU();
+		assert(Core->RCUNesting > 0);
+		if (--Core->RCUNesting != 0)
+			return;
+
+		if (Core->RCUDeferred)
+		{
+			Core->RCUDeferred = false;
+			Report(Core);
+		}
+
+		if (Core->RCURestore)
+			CPU::Interrupts(CPU::Enable);
+	}
+
+	nsa void QuiescentState()
+	{
+		CPUData *Core = GetCurrentCPU();
+		if (Core->RCUNesting)
+		{
+			Core->RCUDeferred = true;
+			return;
+		}
+		Report(Core);
+	}
+
+	void EnterIdle()
+	{
+		CPUData *Core = GetCurrentCPU();
+		assert(Core->RCUNesting == 0);
+		Core->RCUIdle.store(true, std::memory_order_release);
+	}
+
+	nsa void InterruptEnter()
+	{
+		CPUData *Core = GetCurrentCPU();
+		if (likely(!Core->RCUIdle.load(std::memory_order_relaxed)))
+			return;
+
+		/* Full barrier, the handler's readers must not
+			load anything before the core looks busy. */
+		Core->RCUIdle.store(false, std::memory_order_seq_cst);
+		Core->RCUWoken = true;
+	}
+
+	nsa void InterruptExit()
+	{
+		CPUData *Core = GetCurrentCPU();
+		if (likely(!Core->RCUWoken))
+			return;
+
+		Core->RCUWoken = false;
+		Core->RCUIdle.store(true, std::memory_order_release);
+	}
+
+	static void Wait()
+	{
+		if (CPU::Interrupts(CPU::Check) &&
+			TaskManager &&
+			!TaskManager->IsPanic())
+		{
+			TaskManager->Yield();
+		}
+
+		CPU::Pause();
+	}
+
+	void Synchronize()
+	{
+		CPUData *Self = GetCurrentCPU();
+		assert(Self->RCUNesting == 0);
+
+		/* Order the caller's unpublish before the snapshots */
+		CPU::MemBar::Fence();
+
+		/* The caller is not a reader and readers can't be
+			preempted, so only the other cores are waited on.
+			Each one is checked in turn, a quiescent state after
+			its own snapshot is still after the fence above. */
+		for (int i = 0; i < MAX_CPU; i++)
+		{
+			CPUData *Core = GetCPU(i);
+			if (Core == Self || !Core->IsActive)
+				continue;
+
+			uint64_t Snapshot = Core->RCUQuiescent.load(std::memory_order_acquire);
+			while (!Core->RCUIdle.load(std::memory_order_acquire) &&
+				   Core->RCUQuiescent.load(std::memory_order_acquire) == Snapshot &&
+				   Core->IsActive)
+			{
+				Wait();
+			}
+		}
+
+		CPU::MemBar::Fence();
+		GracePeriods++;
+	}
+
+	void Call(Head *Rcu, void (*Function)(Head *))
+	{
+		Rcu->Next = nullptr;
+		Rcu->Function = Function;
+
+		SmartCriticalSection(PendingLock);
+		*PendingTail = Rcu;
+		PendingTail = &Rcu->Next;
+	}
+
+	static void DaemonEntry()
+	{
+		while (true)
+		{
+			Head *Batch;
+			{
+				SmartCriticalSection(PendingLock);
+				Batch = Pending;
+				Pending = nullptr;
+				PendingTail = &Pending;
+			}
+
+			if (Batch == nullptr)
+			{
+				TaskManager->Sleep(RCU_INTERVAL);
+				continue;
+			}
+
+			Synchronize();
+			while (Batch)
+			{
+				Head *Next = Batch->Next;
+				Batch->Function(Batch);
+				Batch = Next;
+			}
+		}
+	}
+
+	void Start()
+	{
+		Tasking::TCB *t = TaskManager->CreateThread(TaskManager->GetKernelProcess(),
+													Tasking::IP(DaemonEntry));
+		t->Rename("RCU");
+		t->SetPriority(Tasking::High);
+	}
+
+	uint64_t GetGracePeriods() { return GracePeriods.load(); }
+}
@@ -0,0 +1,67 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <ring.hpp>
+
+#include <debug.h>
+#include <smp.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+void RingWaiter::Sleep(const std::atomic_size_t &Tail, size_t Seen)
+{
+	Tasking::TCB *Self;
+	{
+		CriticalSection cs;
+		Self = thisThread;
+		if (!cs.IsInterruptsEnabled() ||
+			TaskManager == nullptr ||
+			TaskManager->IsPanic() ||
+			Self == nullptr)
+		{
+			/* Can't be scheduled out, let the caller poll */
+			CPU::Pause();
+			return;
+		}
+
+		/* Interrupts are off, the wake up cannot come before this */
+		Self->Block();
+		Sleeper.store(Self);
+		if (Tail.load() != Seen)
+		{
+			/* Raced with a push, unless it already took us */
+			if (Sleeper.exchange(nullptr) != nullptr)
+				Self->Unblock();
+			CPU::Pause();
+			return;
+		}
+	}
+
+	TaskManager->Yield();
+
+	/* Woken by something else, don't let a later push wake us */
+	Tasking::TCB *Expected = Self;
+	Sleeper.compare_exchange_strong(Expected, nullptr);
+}
+
+void RingWaiter::WakeSleeper()
+{
+	Tasking::TCB *t = Sleeper.exchange(nullptr);
+	if (t != nullptr)
+		t->Unblock();
+}
@@ -108,4 +108,33 @@ namespace Time
 		result.Counter = s_cst(uint64_t, (Timestamp));
 		return result;
 	}
+
+	static bool IsLeapYear(int Year)
+	{
+		return Year % 4 == 0 && (Year % 100 != 0 || Year % 400 == 0);
+	}
+
+	uint64_t ConvertToUnix(const Clock &c)
+	{
+		static const int DaysBeforeMonth[] = {0, 31, 59, 90, 120, 151,
+											  181, 212, 243, 273, 304, 334};
+
+		/* The RTC only keeps the last two digits */
+		int Year = c.Year < 100 ? c.Year + 2000 : c.Year;
+
+		uint64_t Days = 0;
+		for (int y = 1970; y < Year; y++)
+			Days += IsLeapYear(y) ? 366 : 365;
+
+		if (c.Month >= 1 && c.Month <= 12)
+			Days += s_cst(uint64_t, DaysBeforeMonth[c.Month - 1]);
+		if (c.Month > 2 && IsLeapYear(Year))
+			Days++;
+		if (c.Day > 0)
+			Days += s_cst(uint64_t, c.Day - 1);
+
+		uint64_t Hours = Days * 24 + s_cst(uint64_t, c.Hour);
+		uint64_t Minutes = Hours * 60 + s_cst(uint64_t, c.Minute);
+		return Minutes * 60 + s_cst(uint64_t, c.Second);
+	}
 }
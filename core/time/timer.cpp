@@ -196,6 +196,46 @@ namespace Time
 		else
 			KPrint("\eFF2200TSC is not invariant");
 #endif
+
+		if (ActiveTimer != NONE)
+			this->SetRealTime(ConvertToUnix(ReadClock()) * 1000000000ULL);
+	}
+
+	bool time::ChangeActiveTimer(TimeActiveTimer Timer)
+	{
+		if (!(SupportedTimers & Timer))
+			return false;
+
+		/* The new timer counts from its own creation, rebase the wall clock */
+		uint64_t Now = this->GetRealTime();
+		ClockLock.WriteLock();
+		ActiveTimer = Timer;
+		RealTimeBase = Now;
+		CounterBase = this->GetNanosecondsSinceClassCreation();
+		ClockLock.WriteUnlock();
+		return true;
+	}
+
+	uint64_t time::GetRealTime()
+	{
+		uint64_t Base, Counter, Now;
+		uint32_t Seq;
+		do
+		{
+			Seq = ClockLock.ReadBegin();
+			Base = RealTimeBase;
+			Counter = CounterBase;
+			Now = this->GetNanosecondsSinceClassCreation();
+		} while (ClockLock.ReadRetry(Seq));
+		return Base + (Now - Counter);
+	}
+
+	void time::SetRealTime(uint64_t Nanoseconds)
+	{
+		ClockLock.WriteLock();
+		RealTimeBase = Nanoseconds;
+		CounterBase = this->GetNanosecondsSinceClassCreation();
+		ClockLock.WriteUnlock();
 	}
 
 	time::time()
@@ -167,13 +167,15 @@ namespace CPU
 						uint32_t Reserved2 : 2;
 						uint32_t FMA : 1;
 						uint32_t CMPXCHG16B : 1;
-						uint32_t Reserved3 : 5;
+						uint32_t Reserved3 : 3;
+						uint32_t PCID : 1;
+						uint32_t Reserved4 : 1;
 						uint32_t SSE41 : 1;
 						uint32_t SSE42 : 1;
 						uint32_t x2APIC : 1;
 						uint32_t MOVBE : 1;
 						uint32_t POPCNT : 1;
-						uint32_t Reserved4 : 1;
+						uint32_t Reserved5 : 1;
 						uint32_t AES : 1;
 						uint32_t XSAVE : 1;
 						uint32_t OSXSAVE : 1;
@@ -1043,9 +1043,11 @@ namespace CPU
 						uint32_t SYSCALL : 1;
 						uint32_t Reserved1 : 8;
 						uint32_t ExecuteDisable : 1;
-						uint32_t Reserved2 : 8;
+						uint32_t Reserved2 : 6;
+						uint32_t RDTSCP : 1;
+						uint32_t Reserved3 : 1;
 						uint32_t EMT64T : 1;
-						uint32_t Reserved3 : 2;
+						uint32_t Reserved4 : 2;
 					};
 					cpuid_t raw;
 				} EDX;
@@ -25,25 +25,86 @@
 #include <memory.hpp>
 #include <ints.hpp>
 #include <lock.hpp>
+#include <ring.hpp>
 #include <task.hpp>
 #include <debug.h>
 #include <cpu.hpp>
 #include <pci.hpp>
 #include <vector>
+#include <mutex>
 #include <io.h>
 #include <list>
 
+/* Keys buffered per keyboard, the oldest key is dropped when full */
+#define KEY_QUEUE_SIZE 16
+
 namespace Driver
 {
 	char GetScanCode(uint8_t ScanCode, bool Upper);
 	bool IsValidChar(uint8_t ScanCode);
 
+	/**
+	 * Input ring read by any number of threads
+	 *
+	 * Readers take turns on a mutex, so only one
+	 * of them sleeps on the ring. A full queue
+	 * drops its oldest value to make room.
+	 */
+	template <typename T, size_t Size, template <typename, size_t> class Ring>
+	class InputQueue
+	{
+	private:
+		Ring<T, Size> Values;
+		/* Held by whoever takes values out, producers too when full */
+		TicketLock PopLock;
+		std::mutex Readers;
+
+		bool TryPop(T &Out)
+		{
+			CriticalSection cs;
+			PopLock.Lock(__FUNCTION__);
+			bool Popped = Values.Pop(Out);
+			PopLock.Unlock();
+			return Popped;
+		}
+
+	public:
+		/** @brief Safe from interrupts */
+		void Push(const T &Value)
+		{
+			T Oldest;
+			while (!Values.Push(Value))
+			{
+				/* The oldest slot is still being written */
+				if (!this->TryPop(Oldest))
+					return;
+			}
+		}
+
+		/** @brief Pop, sleeping until a value is pushed */
+		void PopWait(T &Out)
+		{
+			std::lock_guard<std::mutex> Guard(Readers);
+			while (!this->TryPop(Out))
+				Values.Wait();
+		}
+
+		void Clear()
+		{
+			CriticalSection cs;
+			PopLock.Lock(__FUNCTION__);
+			Values.Clear();
+			PopLock.Unlock();
+		}
+	};
+
 	class SlaveDeviceFile : public vfs::Node
 	{
 	private:
 		int /* DeviceDriverType */ DeviceType;
 
-		std::list<uint8_t> KeyQueue;
+		/* Fed by the driver only */
+		InputQueue<uint8_t, KEY_QUEUE_SIZE, SPSCRing> KeyQueue;
 
 	public:
 		typedef int (*drvOpen_t)(dev_t, dev_t, int, mode_t);
@@ -58,6 +119,9 @@ namespace Driver
 		drvWrite_t Write;
 		drvIoctl_t Ioctl;
 
+		/* Taken by the master's lookups, Unregister waits for them */
+		std::atomic_int Users = 0;
+
 		int open(int Flags, mode_t Mode) final;
 		int close() final;
 		size_t read(uint8_t *Buffer,
@@ -85,13 +149,21 @@ namespace Driver
 		char SlaveName[16];
 		vfs::Node *SlaveParent;
 		int /* DeviceDriverType */ DeviceType;
-		min_t SlaveIDCounter = 0;
+		std::atomic<min_t> SlaveIDCounter = 0;
 
 		typedef std::unordered_map<min_t, SlaveDeviceFile *> *Slaves;
 		std::unordered_map<maj_t, Slaves> SlavesMap;
+		/* Looked up from interrupts, writers must disable them */
+		RWLock SlavesLock;
+
+		/* Both take a use of the slave, give it back with PutSlave */
+		SlaveDeviceFile *GetSlave(maj_t ID, min_t MinorID);
+		SlaveDeviceFile *GetFirstSlave();
+		void PutSlave(SlaveDeviceFile *sdf);
 
-		std::list<uint8_t> RawKeyQueue;
-		std::list<uint8_t> KeyQueue;
+		/* Every keyboard reports here */
+		InputQueue<uint8_t, KEY_QUEUE_SIZE, MPSCRing> RawKeyQueue;
+		InputQueue<uint8_t, KEY_QUEUE_SIZE, MPSCRing> KeyQueue;
 		bool UpperCase = false;
 		bool CapsLock = false;
 
@@ -180,6 +252,9 @@ namespace Driver
 						   vfs::RefNode *rDrv);
 
 	public:
+		/* Held for reading while a driver from GetDriver is used */
+		RWSemaphore DriversLock;
+
 		MasterDeviceFile *InputMouseDev = nullptr;
 		MasterDeviceFile *InputKeyboardDev = nullptr;
 
@@ -194,6 +269,17 @@ namespace Driver
 		std::unordered_map<dev_t, DriverObject> &
 		GetDrivers() { return Drivers; }
 
+		/**
+		 * Look up a loaded driver
+		 *
+		 * The caller holds DriversLock for reading
+		 * until it is done with the driver.
+		 *
+		 * @param MajorID Major number of the driver
+		 * @return The driver or nullptr
+		 */
+		DriverObject *GetDriver(dev_t MajorID);
+
 		void LoadAllDrivers();
 		void UnloadAllDrivers();
 		void Panic();
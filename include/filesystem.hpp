@@ -21,6 +21,7 @@
 #include <types.h>
 
 #include <smart_ptr.hpp>
+#include <memory/slab.hpp>
 #include <lock.hpp>
 #include <errno.h>
 #include <vector>
@@ -206,31 +207,31 @@ namespace vfs
 
 		class Virtual *vFS = nullptr;
 		Node *Parent = nullptr;
-		const char *Name;
-		const char *FullPath;
-		NodeType Type;
-		ino_t IndexNode;
+		const char *Name = nullptr;
+		const char *FullPath = nullptr;
+		NodeType Type = NODE_TYPE_NONE;
+		ino_t IndexNode = 0;
 
-		const char *Symlink;
-		Node *SymlinkTarget;
+		const char *Symlink = nullptr;
+		Node *SymlinkTarget = nullptr;
 
-		mode_t Mode;
-		uid_t UserIdentifier;
-		gid_t GroupIdentifier;
+		mode_t Mode = 0;
+		uid_t UserIdentifier = 0;
+		gid_t GroupIdentifier = 0;
 
-		dev_t DeviceMajor;
-		dev_t DeviceMinor;
+		dev_t DeviceMajor = 0;
+		dev_t DeviceMinor = 0;
 
-		time_t AccessTime;
-		time_t ModifyTime;
-		time_t ChangeTime;
+		time_t AccessTime = 0;
+		time_t ModifyTime = 0;
+		time_t ChangeTime = 0;
 
-		off_t Size;
+		off_t Size = 0;
 		std::vector<Node *> Children;
 
 		std::vector<RefNode *> References;
 		RefNode *CreateReference();
-		void RemoveReference(RefNode *Reference);
+		virtual void RemoveReference(RefNode *Reference);
 
 		/**
 		 * Create a new node
@@ -261,11 +262,11 @@ namespace vfs
 	private:
 		std::atomic_int64_t FileOffset = 0;
 		off_t FileSize = 0;
-		Node *n;
-		RefNode *SymlinkTo;
+		Node *n = nullptr;
+		RefNode *SymlinkTo = nullptr;
 
 	public:
-		void *SpecialData;
+		void *SpecialData = nullptr;
 
 		decltype(FileSize) &Size = FileSize;
 		decltype(n) &node = n;
@@ -278,6 +279,8 @@ namespace vfs
 		RefNode(Node *node);
 		~RefNode();
 
+		SLAB_CACHED
+
 		friend class Virtual;
 		friend class FileDescriptorTable;
 	};
@@ -286,7 +289,7 @@ namespace vfs
 	{
 	private:
 		Node *FileSystemRoot = nullptr;
-		NewLock(VirtualLock);
+		RWSemaphore VirtualLock;
 
 		Node *GetParent(const char *Path, Node *Parent);
 		/** @note This function is NOT thread safe */
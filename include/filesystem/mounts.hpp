@@ -78,6 +78,20 @@ namespace vfs
 		~ZeroDevice();
 	};
 
+	class HeapProfileDevice : public Node
+	{
+	public:
+		size_t read(uint8_t *Buffer,
+					size_t Size,
+					off_t Offset) final;
+		size_t write(uint8_t *Buffer,
+					 size_t Size,
+					 off_t Offset) final;
+
+		HeapProfileDevice();
+		~HeapProfileDevice();
+	};
+
 	class KConDevice : public Node
 	{
 	public:
@@ -202,6 +216,77 @@ namespace vfs
 		PTMXDevice();
 		~PTMXDevice();
 	};
+
+	/**
+	 * Memory-backed file in /dev/shm
+	 *
+	 * The data only lives in the page cache, every
+	 * MAP_SHARED mapping uses the same frames.
+	 */
+	class SharedMemory : public Node
+	{
+	private:
+		/** @brief Delete the object with its last reference */
+		bool Transient;
+
+	public:
+		size_t read(uint8_t *Buffer,
+					size_t Size,
+					off_t Offset) final;
+		size_t write(uint8_t *Buffer,
+					 size_t Size,
+					 off_t Offset) final;
+		void RemoveReference(RefNode *Reference) final;
+
+		/**
+		 * Change the size of the object
+		 *
+		 * Pages past the new end are dropped
+		 * unless they are still mapped.
+		 *
+		 * @param Length New size in bytes
+		 * @return 0 on success, -EINVAL if Length is negative
+		 */
+		int Truncate(off_t Length);
+
+		/**
+		 * Remove the object once it is no longer
+		 * open or mapped
+		 */
+		void Unlink();
+
+		/**
+		 * Check if a path names an object in /dev/shm
+		 */
+		static bool IsObjectPath(const char *Path);
+
+		/**
+		 * @param Name Name in /dev/shm
+		 * @param Transient Delete with the last reference (memfd)
+		 */
+		SharedMemory(const char *Name, bool Transient);
+		~SharedMemory();
+	};
+
+	/**
+	 * /proc/<pid>/status
+	 *
+	 * Reads the process memory counters, the
+	 * cost does not depend on the address space size.
+	 */
+	class ProcessStatus : public Node
+	{
+	private:
+		Tasking::PCB *Process;
+
+	public:
+		size_t read(uint8_t *Buffer,
+					size_t Size,
+					off_t Offset) final;
+
+		ProcessStatus(Tasking::PCB *Process);
+		~ProcessStatus();
+	};
 }
 
 #endif // !__FENNIX_KERNEL_FILESYSTEM_DEV_H__
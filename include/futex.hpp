@@ -0,0 +1,131 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_FUTEX_H__
+#define __FENNIX_KERNEL_FUTEX_H__
+
+#include <types.h>
+
+namespace Tasking
+{
+	class TCB;
+}
+
+/* Wait queue buckets, must be a power of two */
+#define FUTEX_BUCKETS 256
+/* Longest nap before a waiter rechecks its deadline and signals (ms) */
+#define FUTEX_SIGNAL_CHECK 50
+/* Wake every waiter whatever its bitset */
+#define FUTEX_BITSET_ANY 0xFFFFFFFF
+
+namespace Futex
+{
+	/**
+	 * @brief Identity of a futex word
+	 *
+	 * Private futexes are keyed by address space and virtual
+	 * address, so they survive copy-on-write, migration and
+	 * same page merging. Shared ones are keyed by the physical
+	 * address of the word, which is the same in every process
+	 * mapping it.
+	 */
+	struct Key
+	{
+		/** @brief Address space for private futexes, nullptr for shared */
+		void *Space;
+
+		/** @brief Virtual or physical address of the word */
+		uintptr_t Address;
+
+		/** @brief Kernel pointer to the word, not part of the identity */
+		uint32_t *Word;
+
+		bool operator==(const Key &k) const
+		{
+			return Space == k.Space && Address == k.Address;
+		}
+	};
+
+	/**
+	 * @brief Resolve a user futex word of the current process
+	 *
+	 * @param UserAddress Address of the word in user space
+	 * @param Private Key by virtual address
+	 * @param Out Resolved key
+	 * @param Write The kernel will modify the word
+	 * @return 0 on success, -EINVAL if misaligned, -EFAULT if not
+	 * mapped or, with @p Write, not writable
+	 */
+	int GetKey(uint32_t *UserAddress, bool Private, Key &Out, bool Write = false);
+
+	/**
+	 * @brief Sleep while the word holds @p Expected
+	 *
+	 * The word is checked under the bucket lock, so a wake
+	 * after the user space change can't be missed.
+	 *
+	 * @param k Futex to wait on
+	 * @param Expected Value the caller saw
+	 * @param Deadline TimeManager counter to give up at, 0 for none
+	 * @param Bitset Wakers must match one of these bits
+	 * @return 0 when woken, -EAGAIN, -ETIMEDOUT or -EINTR
+	 */
+	int Wait(const Key &k, uint32_t Expected, uint64_t Deadline, uint32_t Bitset);
+
+	/**
+	 * @brief Wake up to @p Count waiters
+	 *
+	 * @return Number of woken waiters
+	 */
+	int Wake(const Key &k, int Count, uint32_t Bitset);
+
+	/**
+	 * @brief Wake up to @p Count waiters and move the others
+	 *
+	 * @param From Futex the waiters sleep on
+	 * @param To Futex to move up to @p Limit of the rest to
+	 * @param Count Waiters to wake
+	 * @param Limit Waiters to move
+	 * @param Compare Fail with -EAGAIN unless From holds @p Expected
+	 * @param Expected Value for @p Compare
+	 * @param Moved Number of moved waiters
+	 * @return Number of woken waiters or -EAGAIN
+	 */
+	int Requeue(const Key &From, const Key &To, int Count, int Limit,
+				bool Compare, uint32_t Expected, int &Moved);
+
+	/**
+	 * @brief Modify @p Second and wake waiters on both futexes
+	 *
+	 * Waiters on @p First are always woken, the ones on
+	 * @p Second only if the old value passes the comparison
+	 * encoded in @p Operation (FUTEX_OP layout).
+	 *
+	 * @return Number of woken waiters, -ENOSYS for an unknown operation
+	 */
+	int WakeOp(const Key &First, const Key &Second, int Count,
+			   int Count2, uint32_t Operation);
+
+	/**
+	 * @brief Drop the wait of a thread that is being destroyed
+	 *
+	 * Its waiter lives on the stack that is about to be freed.
+	 */
+	void Abandon(Tasking::TCB *Thread);
+}
+
+#endif // !__FENNIX_KERNEL_FUTEX_H__
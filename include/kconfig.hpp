@@ -40,6 +40,7 @@ struct KernelConfig
 	bool UnlockDeadLock;
 	bool SIMD;
 	bool Quiet;
+	char Swap[256];
 };
 
 void ParseConfig(char *ConfigString, KernelConfig *ModConfig);
@@ -25,17 +25,118 @@
 
 #ifdef __cplusplus
 
+/* Queued lock waiters spin on their own line */
+#define LOCK_CACHE_LINE 64
+/* Pauses before a queued lock waiter yields */
+#define LOCK_SPIN_LIMIT 0x400
+/* RWLock state bits, the rest counts readers */
+#define RWLOCK_WRITER 0x80000000
+#define RWLOCK_WAITING 0x40000000
+/* Lock and call site pairs tracked by lockstat */
+#define LOCKSTAT_SITES 512
+/* Probes before a lockstat lookup gives up */
+#define LOCKSTAT_PROBES 16
+
 /* Enabled ONLY on crash. */
 extern bool ForceUnlock;
 
 /**
  * @brief Get how many locks are currently in use.
  *
+ * @note Only counted in debug builds.
+ *
  * @return size_t
  */
 size_t GetLocksCount();
 
+/* Totals of one lock taken from one function, in CPU::Counter() cycles */
+struct LockStatSite
+{
+	uintptr_t Lock;
+	const char *Function;
+	uint64_t Acquired;
+	uint64_t Contended;
+	uint64_t WaitCycles;
+	uint64_t MaxWait;
+	uint64_t HoldCycles;
+	uint64_t MaxHold;
+};
+
+/**
+ * Lock contention profiler
+ *
+ * While enabled every lock records how long it was
+ * waited for and held, keyed by the lock address and
+ * the acquiring function. Disabled, the lock paths
+ * only pay one load.
+ */
+namespace LockStat
+{
+	struct Site;
+
+	/* Held locks remember where to charge the hold time */
+	struct Hold
+	{
+		Site *Owner = nullptr;
+		uint64_t Since = 0;
+	};
+
+	extern bool Enabled;
+
+	void Enable();
+	void Disable();
+	void Reset();
+	size_t GetDropped();
+
+	/**
+	 * Snapshot of the most contended sites
+	 *
+	 * @param Output Array to fill
+	 * @param Max Number of entries in Output
+	 * @return Number of entries written, sorted by wait cycles
+	 */
+	size_t GetSites(LockStatSite *Output, size_t Max);
+
+	Site *Acquired(const void *Lock, const char *Function,
+				   uint64_t Wait, bool Contended);
+	void Released(Site *s, uint64_t Hold);
+
+	/** @brief Start of the wait, 0 if disabled */
+	inline uint64_t Begin()
+	{
+		if (likely(!Enabled))
+			return 0;
+		return CPU::Counter();
+	}
+
+	/** @brief The lock is ours, charge the wait and start the hold */
+	inline void End(Hold &h, const void *Lock, const char *Function,
+					uint64_t Start, bool Contended)
+	{
+		if (likely(Start == 0))
+			return;
+		uint64_t Now = CPU::Counter();
+		h.Owner = Acquired(Lock, Function, Now - Start, Contended);
+		h.Since = Now;
+	}
+
+	/** @brief Called before the lock is given back */
+	inline void Drop(Hold &h)
+	{
+		if (likely(h.Owner == nullptr))
+			return;
+		Site *s = h.Owner;
+		h.Owner = nullptr;
+		Released(s, CPU::Counter() - h.Since);
+	}
+}
+
 /** @brief Please use this macro to create a new lock. */
+namespace Tasking
+{
+	class TCB;
+}
+
 class LockClass
 {
 public:
@@ -54,6 +155,9 @@ private:
 	SpinLockData LockData;
 	std::atomic_bool IsLocked = false;
 	std::atomic_ulong DeadLocks = 0;
+	LockStat::Hold Stat;
+	/* Thread whose HeldLocks counts this lock */
+	std::atomic<Tasking::TCB *> Owner = nullptr;
 
 	void DeadLock(SpinLockData &Lock);
 	void TimeoutDeadLock(SpinLockData &Lock, uint64_t Timeout);
@@ -61,6 +165,7 @@ private:
 
 public:
 	bool Locked() { return IsLocked.load(); }
+	Tasking::TCB *GetOwner() { return Owner.load(); }
 	SpinLockData *GetLockData() { return &LockData; }
 	int Lock(const char *FunctionName);
 	int Unlock();
@@ -68,11 +173,199 @@ public:
 	int TimeoutLock(const char *FunctionName, uint64_t Timeout);
 };
 
+/**
+ * FIFO spinlock for short critical sections
+ *
+ * Waiters take a ticket and spin until it is
+ * served, the lock is handed over in order.
+ * The holder must not sleep.
+ */
+class TicketLock
+{
+private:
+	std::atomic_uint32_t Next = 0;
+	std::atomic_uint32_t Serving = 0;
+	LockStat::Hold Stat;
+
+public:
+	bool Locked() { return Serving.load() != Next.load(); }
+	int Lock(const char *FunctionName);
+	int Unlock();
+};
+
+/**
+ * MCS queued spinlock for contended locks
+ *
+ * Every waiter spins on a node in its own stack
+ * frame and the holder hands the lock to the next
+ * node. The holder's place is kept in Head, so
+ * Lock and Unlock do not need a node from the caller.
+ */
+class MCSLock
+{
+public:
+	struct __aligned(LOCK_CACHE_LINE) Node
+	{
+		std::atomic<Node *> Next = nullptr;
+		std::atomic_bool Waiting = false;
+	};
+
+private:
+	Node Head;
+	std::atomic<Node *> Tail = nullptr;
+	LockStat::Hold Stat;
+
+	bool Acquire();
+
+public:
+	bool Locked() { return Tail.load() != nullptr; }
+	int Lock(const char *FunctionName);
+	int Unlock();
+};
+
+/**
+ * Reader-writer spinlock
+ *
+ * Any number of readers or a single writer.
+ * A waiting writer keeps new readers out.
+ * Holders must not sleep.
+ */
+class RWLock
+{
+private:
+	std::atomic_uint32_t State = 0;
+
+public:
+	bool Locked() { return (State.load() & ~RWLOCK_WAITING) != 0; }
+	int ReadLock(const char *FunctionName);
+	int ReadUnlock();
+	int WriteLock(const char *FunctionName);
+	bool TryWriteLock();
+	int WriteUnlock();
+};
+
+namespace Tasking
+{
+	class TCB;
+}
+
+/**
+ * Sleeping reader-writer semaphore
+ *
+ * Same rules as RWLock, but waiters block instead
+ * of spinning so holders may sleep or allocate.
+ * Waiters spin if they cannot be scheduled out.
+ */
+class RWSemaphore
+{
+private:
+	struct Waiter
+	{
+		Tasking::TCB *Thread;
+		Waiter *Next;
+	};
+
+	TicketLock Guard;
+	Waiter *Waiters = nullptr;
+	size_t Readers = 0;
+	size_t WritersWaiting = 0;
+	bool Writer = false;
+	LockStat::Hold Stat;
+
+	void Enqueue(Waiter &w, bool CanBlock);
+	void Sleep(Waiter &w);
+	void WakeAll();
+
+public:
+	bool Locked() { return Writer || Readers > 0; }
+	int ReadLock(const char *FunctionName);
+	int ReadUnlock();
+	int WriteLock(const char *FunctionName);
+	int WriteUnlock();
+};
+
+/**
+ * Sequence counter for multi-word data
+ *
+ * Readers copy the data between ReadBegin and
+ * ReadRetry and try again if a writer ran, they
+ * never write to shared memory. Writers must be
+ * serialized by the caller and a reader must not
+ * interrupt a writer on the same core.
+ */
+class SeqCount
+{
+private:
+	std::atomic_uint32_t Sequence = 0;
+
+public:
+	uint32_t ReadBegin() const
+	{
+		uint32_t Start;
+		while ((Start = Sequence.load(std::memory_order_acquire)) & 1)
+			CPU::Pause();
+		return Start;
+	}
+
+	bool ReadRetry(uint32_t Start) const
+	{
+		CPU::MemBar::Barrier();
+		return Sequence.load(std::memory_order_relaxed) != Start;
+	}
+
+	void WriteBegin()
+	{
+		Sequence.store(Sequence.load(std::memory_order_relaxed) + 1,
+					   std::memory_order_relaxed);
+		CPU::MemBar::Barrier();
+	}
+
+	void WriteEnd()
+	{
+		Sequence.store(Sequence.load(std::memory_order_relaxed) + 1,
+					   std::memory_order_release);
+	}
+};
+
+/**
+ * SeqCount with its own writer lock
+ *
+ * For data written from more than one place.
+ * Writers disable interrupts, so readers may
+ * run in interrupt handlers.
+ */
+class SeqLock : public SeqCount
+{
+private:
+	TicketLock Writer;
+	bool InterruptsEnabled = false;
+
+public:
+	void WriteLock()
+	{
+		bool Enabled = CPU::Interrupts(CPU::Check);
+		CPU::Interrupts(CPU::Disable);
+		Writer.Lock(__FUNCTION__);
+		InterruptsEnabled = Enabled;
+		WriteBegin();
+	}
+
+	void WriteUnlock()
+	{
+		WriteEnd();
+		bool Enabled = InterruptsEnabled;
+		Writer.Unlock();
+		if (Enabled)
+			CPU::Interrupts(CPU::Enable);
+	}
+};
+
 /** @brief Please use this macro to create a new smart lock. */
+template <typename T = LockClass>
 class SmartLockClass
 {
 private:
-	LockClass *LockPointer = nullptr;
+	T *LockPointer = nullptr;
 
 public:
 	bool Locked()
@@ -80,7 +373,7 @@ public:
 		return this->LockPointer->Locked();
 	}
 
-	SmartLockClass(LockClass &Lock, const char *FunctionName)
+	SmartLockClass(T &Lock, const char *FunctionName)
 	{
 		this->LockPointer = &Lock;
 		this->LockPointer->Lock(FunctionName);
@@ -88,6 +381,36 @@ public:
 	~SmartLockClass() { this->LockPointer->Unlock(); }
 };
 
+template <typename T>
+class SmartReadLockClass
+{
+private:
+	T *LockPointer = nullptr;
+
+public:
+	SmartReadLockClass(T &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->ReadLock(FunctionName);
+	}
+	~SmartReadLockClass() { this->LockPointer->ReadUnlock(); }
+};
+
+template <typename T>
+class SmartWriteLockClass
+{
+private:
+	T *LockPointer = nullptr;
+
+public:
+	SmartWriteLockClass(T &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->WriteLock(FunctionName);
+	}
+	~SmartWriteLockClass() { this->LockPointer->WriteUnlock(); }
+};
+
 class SmartTimeoutLockClass
 {
 private:
@@ -112,14 +435,15 @@ public:
 	}
 };
 
+template <typename T = LockClass>
 class SmartLockCriticalSectionClass
 {
 private:
-	LockClass *LockPointer = nullptr;
+	T *LockPointer = nullptr;
 	bool InterruptsEnabled = false;
 
 public:
-	SmartLockCriticalSectionClass(LockClass &Lock,
+	SmartLockCriticalSectionClass(T &Lock,
 								  const char *FunctionName)
 	{
 		if (CPU::Interrupts(CPU::Check))
@@ -176,6 +500,24 @@ public:
 	CONCAT(lock##_, __COUNTER__)(LockClassName, \
 								 __FUNCTION__)
 
+/**
+ * Shared hold of a RWLock or RWSemaphore
+ * that is released when the scope ends.
+ */
+#define SmartReadLock(LockClassName)            \
+	SmartReadLockClass                          \
+	CONCAT(lock##_, __COUNTER__)(LockClassName, \
+								 __FUNCTION__)
+
+/**
+ * Exclusive hold of a RWLock or RWSemaphore
+ * that is released when the scope ends.
+ */
+#define SmartWriteLock(LockClassName)           \
+	SmartWriteLockClass                         \
+	CONCAT(lock##_, __COUNTER__)(LockClassName, \
+								 __FUNCTION__)
+
 /**
  * Simple lock with timeout that is automatically
  * released when the scope ends.
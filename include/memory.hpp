@@ -57,14 +57,26 @@ namespace Memory
 		 * FIXME: This allocator is not working as expected.
 		 */
 		rpmalloc_,
+
+		/** Size class heap on top of the slab allocator. */
+		Slab,
 	};
 }
 
 #include <memory/smart_heap.hpp>
+#include <memory/page_cache.hpp>
 #include <memory/physical.hpp>
 #include <memory/virtual.hpp>
 #include <memory/swap_pt.hpp>
+#include <memory/swap.hpp>
+#include <memory/slab.hpp>
+#include <memory/heap.hpp>
+#include <memory/zero_pool.hpp>
+#include <memory/profiler.hpp>
+#include <memory/reclaim.hpp>
+#include <memory/merge.hpp>
 #include <memory/table.hpp>
+#include <memory/tlb.hpp>
 #include <memory/macro.hpp>
 #include <memory/stack.hpp>
 #include <memory/vma.hpp>
@@ -83,6 +95,12 @@ void operator delete[](void *Pointer, long unsigned int Size);
 
 extern Memory::Physical KernelAllocator;
 extern Memory::PageTable *KernelPageTable;
+extern Memory::PageCache FilePageCache;
+extern Memory::SwapSpace KernelSwap;
+extern Memory::ZeroPool ZeroedPages;
+extern Memory::AllocationProfiler HeapProfiler;
+extern Memory::Reclaimer PageReclaimer;
+extern Memory::PageMerger SamePageMerger;
 
 #endif // __cplusplus
 
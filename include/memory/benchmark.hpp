@@ -0,0 +1,74 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_BENCHMARK_H__
+#define __FENNIX_KERNEL_MEMORY_BENCHMARK_H__
+
+#include <types.h>
+
+/* Operations replayed by every trace */
+#define BENCH_OPERATIONS 100000
+/* Maximum number of live allocations */
+#define BENCH_SLOTS 1024
+/* Seed of the trace generator, same seed same trace */
+#define BENCH_SEED 0x5EED1234ABCDULL
+
+namespace Memory
+{
+	struct BenchmarkResult
+	{
+		const char *Backend;
+		const char *Trace;
+
+		size_t Operations;
+		/* Allocations that returned nullptr */
+		size_t Failed;
+		uint64_t OpsPerSecond;
+
+		/* Cycles per operation */
+		uint64_t P50;
+		uint64_t P99;
+
+		/* Bytes requested by the trace at its peak */
+		size_t PeakLive;
+		/* Physical memory used above the baseline at the peak */
+		size_t PeakUsed;
+		/* Physical memory still held after everything was freed */
+		size_t Retained;
+	};
+
+	typedef void (*BenchmarkReport)(const BenchmarkResult &Result);
+
+	/**
+	 * Replay allocation traces against the heap backends
+	 *
+	 * Traces are "uniform", "bimodal" and "prodcons".
+	 * Backends are "pages", "xallocv1", "xallocv2",
+	 * "liballoc11", "rpmalloc" and "slab". Every result
+	 * is also written to the serial log.
+	 *
+	 * @param Backend Backend name, nullptr for all
+	 * @param Trace Trace name, nullptr for all
+	 * @param Report Called for every result, can be nullptr
+	 * @return Number of runs, -EINVAL for an unknown name,
+	 * -EBUSY if another benchmark is running
+	 */
+	int RunAllocatorBenchmark(const char *Backend, const char *Trace,
+							  BenchmarkReport Report);
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_BENCHMARK_H__
@@ -0,0 +1,72 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_HEAP_H__
+#define __FENNIX_KERNEL_MEMORY_HEAP_H__
+
+#include <types.h>
+#include <memory/slab.hpp>
+
+/* Number of small size classes */
+#define HEAP_SIZE_CLASSES 14
+/* Biggest allocation served by a size class */
+#define HEAP_MAX_SMALL 4096
+/* Offset of the data in a large allocation */
+#define HEAP_LARGE_HEADER SLAB_CACHE_LINE
+
+namespace Memory
+{
+	/**
+	 * General purpose kernel heap
+	 *
+	 * Small allocations come from one aligned object
+	 * cache per size class, so they get the per-CPU
+	 * magazines of ObjectCache. A free goes to the
+	 * magazine of the CPU it runs on, whichever CPU
+	 * allocated the object, without taking a lock.
+	 *
+	 * Large allocations are aligned page runs with
+	 * a header that looks like an empty slab, free()
+	 * tells them apart by masking the address.
+	 */
+	class SlabHeap
+	{
+	private:
+		struct LargeHeader
+		{
+			/* Always nullptr, a slab has its cache here */
+			ObjectCache *Cache;
+			size_t Pages;
+		};
+
+		ObjectCache *GetClass(size_t Size);
+		void *AllocateLarge(size_t Size);
+
+	public:
+		void *malloc(size_t Size);
+		void *calloc(size_t n, size_t Size);
+		void *realloc(void *Address, size_t Size);
+		void free(void *Address);
+
+		/**
+		 * Usable size of an allocation
+		 */
+		size_t GetSize(void *Address);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_HEAP_H__
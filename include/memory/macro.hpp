@@ -53,6 +53,9 @@
 #define USER_ALLOC_BASE 0xFFFFA00000000000 /* 256 GiB */
 #define USER_ALLOC_END 0xFFFFB00000000000
 
+#define USER_MMAP_BASE 0xFFFFB00000000000 /* 16 TiB */
+#define USER_MMAP_END 0xFFFFC00000000000
+
 #define USER_STACK_END 0xFFFFEFFF00000000 /* 256 MiB */
 #define USER_STACK_BASE 0xFFFFEFFFFFFF0000
 #elif defined(a32)
@@ -61,6 +64,9 @@
 #define USER_ALLOC_BASE 0x80000000
 #define USER_ALLOC_END 0xA0000000
 
+#define USER_MMAP_BASE 0xA0000000
+#define USER_MMAP_END 0xC0000000
+
 #define USER_STACK_BASE 0xEFFFFFFF
 #define USER_STACK_END 0xE0000000
 #endif
@@ -0,0 +1,133 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_MERGE_H__
+#define __FENNIX_KERNEL_MEMORY_MERGE_H__
+
+#include <types.h>
+#include <lock.hpp>
+#include <atomic>
+
+/* Distinct merged pages tracked at most */
+#define MERGE_STABLE_SLOTS 4096
+/* Checksums remembered during one pass */
+#define MERGE_CANDIDATE_SLOTS 4096
+/* Slots probed before giving up */
+#define MERGE_PROBES 16
+/* Pages scanned per batch */
+#define MERGE_BATCH 256
+/* Milliseconds between batches */
+#define MERGE_INTERVAL 100
+
+namespace Memory
+{
+	/**
+	 * Same page merging
+	 *
+	 * An opt-in thread scans private anonymous pages.
+	 * A page that was not written since the previous pass
+	 * is checksummed, identical pages are replaced by one
+	 * read-only CoW frame and zeroed pages by the zero page.
+	 * A write to a merged page copies it in HandleCoW.
+	 */
+	class PageMerger
+	{
+	private:
+		struct StablePage
+		{
+			void *Frame;
+			uint32_t Checksum;
+			uint32_t References;
+		};
+
+		struct Candidate
+		{
+			const void *Owner;
+			uintptr_t Address;
+			uint32_t Checksum;
+		};
+
+		NewLock(MergeLock);
+		StablePage *Stable = nullptr;
+		Candidate *Candidates = nullptr;
+		std::atomic_bool Enabled = false;
+		bool Started = false;
+		pid_t Cursor = 0;
+
+		size_t Shared = 0;
+		size_t Sharing = 0;
+		std::atomic_size_t ZeroMerged = 0;
+		std::atomic_size_t Scanned = 0;
+		size_t FullScans = 0;
+
+		StablePage *FindStable(void *Frame, uint32_t Checksum);
+		void ScanBatch();
+		static void DaemonEntry();
+
+	public:
+		bool IsEnabled() { return Enabled.load(); }
+		size_t GetShared() { return Shared; }
+		size_t GetSharing() { return Sharing; }
+		size_t GetZeroMerged() { return ZeroMerged.load(); }
+		size_t GetScanned() { return Scanned.load(); }
+		size_t GetFullScans() { return FullScans; }
+
+		static uint32_t Checksum(void *Frame);
+		static bool IsZero(void *Frame);
+
+		/**
+		 * Offer a write-protected page for merging
+		 *
+		 * @param Frame Physical address of the page
+		 * @param Checksum Checksum of the page
+		 * @param Owner Area that maps the page
+		 * @param Address Virtual address of the page in Owner
+		 * @return The frame to map read-only instead, Frame itself
+		 * if it became the merged copy or nullptr to keep it writable
+		 */
+		void *Merge(void *Frame, uint32_t Checksum,
+					const void *Owner, uintptr_t Address);
+
+		/**
+		 * Take another reference to a merged page (fork)
+		 *
+		 * @return false if Frame is not a merged page
+		 */
+		bool Get(void *Frame);
+
+		/**
+		 * Drop a reference to a merged page
+		 *
+		 * The frame is freed with its last reference.
+		 *
+		 * @return false if Frame is not a merged page
+		 */
+		bool Put(void *Frame);
+
+		/** @brief Called by areas for every page replaced by the zero page */
+		void ZeroPageMerged() { ZeroMerged++; }
+		void PageScanned() { Scanned++; }
+
+		/** @brief Start scanning, the thread is created on first use */
+		void Enable();
+
+		/** @brief Stop scanning, merged pages stay merged */
+		void Disable();
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_MERGE_H__
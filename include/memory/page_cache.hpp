@@ -0,0 +1,132 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_PAGE_CACHE_H__
+#define __FENNIX_KERNEL_MEMORY_PAGE_CACHE_H__
+
+#include <types.h>
+#include <filesystem.hpp>
+#include <unordered_map>
+#include <lock.hpp>
+#include <list>
+
+namespace Memory
+{
+	/**
+	 * Per-inode cache of file pages
+	 *
+	 * Every file mapping of the same node shares
+	 * the same physical frames through this cache.
+	 */
+	class PageCache
+	{
+	public:
+		struct CachedPage
+		{
+			void *Frame = nullptr;
+			size_t References = 0;
+			bool Dirty = false;
+			/** @brief Being read or written back, CacheLock is not held */
+			bool Busy = false;
+		};
+
+	private:
+		struct FileCache
+		{
+			vfs::Node *Node = nullptr;
+			bool Orphan = false;
+			/** @brief Memory-backed, the cache holds the only copy */
+			bool Pinned = false;
+			std::unordered_map<off_t, CachedPage> Pages;
+		};
+
+		NewLock(CacheLock);
+		std::list<FileCache *> Files;
+		size_t CachedPages = 0;
+
+		FileCache *GetFile(vfs::Node *Node, bool Create);
+		FileCache *GetIdleFile(vfs::Node *Node, off_t Offset, bool Create);
+		int WritePage(FileCache *File, off_t Offset);
+
+	public:
+		size_t GetCachedPages() { return CachedPages; }
+
+		/**
+		 * Get a page of a file and take a reference to it
+		 *
+		 * @param Node File node
+		 * @param Offset Page aligned offset in the file
+		 * @return Physical address of the page or nullptr
+		 */
+		void *RequestPage(vfs::Node *Node, off_t Offset);
+
+		/**
+		 * Drop a reference taken with RequestPage
+		 *
+		 * @param Node File node
+		 * @param Offset Page aligned offset in the file
+		 * @param Frame Returned by RequestPage, tells an invalidated
+		 * cache of the node (or of a node at the same address) apart
+		 * @param Dirty The page was written through the mapping
+		 */
+		void ReleasePage(vfs::Node *Node, off_t Offset, void *Frame, bool Dirty);
+
+		/**
+		 * Mark a cached page as modified
+		 */
+		void MarkDirty(vfs::Node *Node, off_t Offset);
+
+		/**
+		 * Write back the dirty pages of a file range
+		 *
+		 * @return 0 on success, -errno on failure
+		 */
+		int Sync(vfs::Node *Node, off_t Offset, size_t Length);
+
+		/**
+		 * Keep the pages of a file in memory
+		 *
+		 * New pages are zero filled instead of read, they
+		 * are never written back or dropped by Shrink.
+		 * Used for objects without backing storage.
+		 */
+		void Pin(vfs::Node *Node);
+
+		/**
+		 * Drop the unreferenced pages past the end of a file
+		 *
+		 * @param Node File node
+		 * @param Offset Page aligned offset of the first page to drop
+		 */
+		void Truncate(vfs::Node *Node, off_t Offset);
+
+		/**
+		 * Forget all unreferenced pages of a file
+		 */
+		void Invalidate(vfs::Node *Node);
+
+		/**
+		 * Drop clean unreferenced pages of any file
+		 *
+		 * @param Pages Pages wanted
+		 * @return Pages freed, 0 if the cache is busy
+		 */
+		size_t Shrink(size_t Pages);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_PAGE_CACHE_H__
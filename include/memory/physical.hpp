@@ -23,12 +23,19 @@
 #include <bitmap.hpp>
 #include <lock.hpp>
 
+/* Free run background compaction keeps available (2 MiB) */
+#define COMPACT_RUN_PAGES 512
+/* Windows one compaction tries before giving up */
+#define COMPACT_WINDOWS 4
+/* Milliseconds between background compaction checks */
+#define COMPACT_INTERVAL 1000
+
 namespace Memory
 {
 	class Physical
 	{
 	private:
-		NewLock(MemoryLock);
+		MCSLock MemoryLock;
 
 		std::atomic_uint64_t TotalMemory = 0;
 		std::atomic_uint64_t FreeMemory = 0;
@@ -37,6 +44,39 @@ namespace Memory
 		uint64_t PageBitmapIndex = 0;
 		Bitmap PageBitmap;
 
+		/* Pages being compacted, skipped by the allocator */
+		uint64_t IsolateStart = 0;
+		uint64_t IsolateEnd = 0;
+		std::atomic_bool Compacting = false;
+		size_t Compactions = 0;
+		size_t CompactFailures = 0;
+		size_t MigratedPages = 0;
+
+		inline bool Taken(uint64_t Index)
+		{
+			return PageBitmap[Index] == true ||
+				   (Index >= IsolateStart && Index < IsolateEnd);
+		}
+
+		/**
+		 * Find the Count aligned windows with the fewest used pages
+		 *
+		 * @param Count Pages in a window
+		 * @param Start Index of the first page of each window
+		 * @param Max Entries in Start
+		 * @return Windows found, best first
+		 */
+		int FindWindows(size_t Count, uint64_t *Start, int Max);
+
+		/**
+		 * Try to make room after an allocation failed
+		 *
+		 * @param Count Pages needed
+		 * @param Attempt Failed attempts so far
+		 * @return false if there is nothing left to try
+		 */
+		bool Reclaim(size_t Count, int Attempt);
+
 		void ReserveEssentials();
 		void FindBitmapRegion(uintptr_t &BitmapAddress,
 							  size_t &BitmapAddressSize);
@@ -72,10 +112,15 @@ namespace Memory
 		 */
 		uint64_t GetUsedMemory();
 
+		size_t GetCompactions() { return Compactions; }
+		size_t GetCompactFailures() { return CompactFailures; }
+		size_t GetMigratedPages() { return MigratedPages; }
+
 		/**
 		 * @brief Swap page
 		 *
-		 * @param Address Address of the page
+		 * @param Address Address of the page, nullptr to
+		 * evict the coldest user page
 		 * @return true if swap was successful
 		 * @return false if swap was unsuccessful
 		 */
@@ -84,7 +129,8 @@ namespace Memory
 		/**
 		 * @brief Swap pages
 		 *
-		 * @param Address Address of the pages
+		 * @param Address Address of the pages, nullptr to
+		 * evict the coldest user pages
 		 * @param PageCount Number of pages
 		 * @return true if swap was successful
 		 * @return false if swap was unsuccessful
@@ -94,7 +140,8 @@ namespace Memory
 		/**
 		 * @brief Unswap page
 		 *
-		 * @param Address Address of the page
+		 * @param Address User address of the page
+		 * in the current process
 		 * @return true if unswap was successful
 		 * @return false if unswap was unsuccessful
 		 */
@@ -103,7 +150,8 @@ namespace Memory
 		/**
 		 * @brief Unswap pages
 		 *
-		 * @param Address Address of the pages
+		 * @param Address User address of the pages
+		 * in the current process
 		 * @param PageCount Number of pages
 		 * @return true if unswap was successful
 		 * @return false if unswap was unsuccessful
@@ -145,6 +193,18 @@ namespace Memory
 		 */
 		void *RequestPages(std::size_t Count);
 
+		/**
+		 * Assemble a contiguous free run
+		 *
+		 * Moves private user pages out of the emptiest
+		 * windows until one of them is entirely free.
+		 *
+		 * @param Count Number of pages
+		 * @return The run, already allocated, or nullptr
+		 * if compaction failed or is already running
+		 */
+		void *Compact(size_t Count);
+
 		/**
 		 * @brief Free page
 		 *
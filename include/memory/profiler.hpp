@@ -0,0 +1,136 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_PROFILER_H__
+#define __FENNIX_KERNEL_MEMORY_PROFILER_H__
+
+#include <types.h>
+#include <lock.hpp>
+#include <atomic>
+
+/* Distinct call sites that can be tracked */
+#define PROFILER_SITES 1024
+/* Sampled allocations that can be live at once */
+#define PROFILER_SAMPLES 8192
+/* Probes before a table lookup gives up */
+#define PROFILER_PROBES 16
+/* Default sampling rate, one every N allocations */
+#define PROFILER_RATE 16
+
+namespace Memory
+{
+	/* Estimated totals of one call site, already scaled by the rate */
+	struct ProfileSite
+	{
+		uintptr_t Caller;
+		size_t Allocations;
+		size_t Frees;
+		size_t LiveBytes;
+		size_t TotalBytes;
+	};
+
+	/**
+	 * Sampled heap profiler
+	 *
+	 * Every Nth allocation is recorded under the return
+	 * address of its caller. Both tables are open
+	 * addressing with atomic keys, so the allocation
+	 * paths never take a lock.
+	 */
+	class AllocationProfiler
+	{
+	private:
+		struct Site
+		{
+			std::atomic_uintptr_t Caller;
+			std::atomic_size_t Allocations;
+			std::atomic_size_t Frees;
+			std::atomic_size_t LiveBytes;
+			std::atomic_size_t TotalBytes;
+		};
+
+		struct Sample
+		{
+			std::atomic_uintptr_t Address;
+			Site *Owner;
+			size_t Size;
+			size_t Weight;
+		};
+
+		NewLock(ProfilerLock);
+		std::atomic_bool Enabled = false;
+		std::atomic_size_t Rate = PROFILER_RATE;
+		std::atomic_size_t Counter = 0;
+		std::atomic_size_t Outstanding = 0;
+		std::atomic_size_t Dropped = 0;
+
+		Site *Sites = nullptr;
+		Sample *Samples = nullptr;
+
+		Site *GetSite(uintptr_t Caller);
+		void Record(void *Address, size_t Size, void *Caller);
+		void Forget(void *Address);
+
+	public:
+		bool IsEnabled() { return Enabled.load(std::memory_order_relaxed); }
+		size_t GetRate() { return Rate.load(std::memory_order_relaxed); }
+		size_t GetDropped() { return Dropped.load(std::memory_order_relaxed); }
+
+		/**
+		 * Start sampling allocations
+		 *
+		 * @param SampleRate Record one every SampleRate allocations
+		 * @return false if the tables couldn't be allocated
+		 */
+		bool Enable(size_t SampleRate = PROFILER_RATE);
+
+		/**
+		 * Stop sampling new allocations
+		 *
+		 * Allocations already sampled are still
+		 * accounted for when they are freed.
+		 */
+		void Disable();
+
+		/** @brief Called by the heap after a successful allocation */
+		inline void Allocated(void *Address, size_t Size, void *Caller)
+		{
+			if (likely(!Enabled.load(std::memory_order_relaxed)) || Address == nullptr)
+				return;
+			Record(Address, Size, Caller);
+		}
+
+		/** @brief Called by the heap before the memory is released */
+		inline void Freed(void *Address)
+		{
+			if (likely(Outstanding.load(std::memory_order_relaxed) == 0) || Address == nullptr)
+				return;
+			Forget(Address);
+		}
+
+		/**
+		 * Snapshot of the busiest call sites
+		 *
+		 * @param Output Array to fill
+		 * @param Max Number of entries in Output
+		 * @return Number of entries written, sorted by live bytes
+		 */
+		size_t GetSites(ProfileSite *Output, size_t Max);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_PROFILER_H__
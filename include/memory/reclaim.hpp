@@ -0,0 +1,139 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_RECLAIM_H__
+#define __FENNIX_KERNEL_MEMORY_RECLAIM_H__
+
+#include <types.h>
+#include <lock.hpp>
+#include <atomic>
+
+/* Wake the reclaimer below this much free memory (percent) */
+#define RECLAIM_LOW_WATERMARK 2
+/* Reclaim until this much memory is free (percent) */
+#define RECLAIM_HIGH_WATERMARK 4
+/* Watermarks never go below this (4 MiB) */
+#define RECLAIM_MIN_WATERMARK (PAGE_SIZE * 1024)
+/* Pages asked from a shrinker at once */
+#define RECLAIM_BATCH 64
+/* Milliseconds between reclaimer checks */
+#define RECLAIM_INTERVAL 50
+/* OOM kill attempts by one allocation before giving up */
+#define RECLAIM_OOM_KILLS 3
+
+namespace Memory
+{
+	/**
+	 * Memory that a subsystem can give back on demand
+	 *
+	 * Callbacks may run in the middle of a page
+	 * allocation. They must not block on a lock
+	 * that may be held by an allocating thread.
+	 */
+	struct Shrinker
+	{
+		const char *Name;
+
+		/** @return Pages that Scan could free right now */
+		size_t (*Count)();
+
+		/**
+		 * Free up to Pages pages
+		 *
+		 * @return Number of pages freed
+		 */
+		size_t (*Scan)(size_t Pages);
+
+		Shrinker *Next;
+	};
+
+	/**
+	 * Page reclaim
+	 *
+	 * A background thread runs the shrinkers when
+	 * free memory falls below the low watermark and
+	 * stops once it is above the high watermark.
+	 * Allocations that fail reclaim directly and
+	 * fall back to killing the largest process.
+	 * The same thread compacts physical memory
+	 * every COMPACT_INTERVAL milliseconds.
+	 */
+	class Reclaimer
+	{
+	private:
+		NewLock(ShrinkerLock);
+		Shrinker *Shrinkers = nullptr;
+		std::atomic_bool Reclaiming = false;
+		std::atomic_bool Pending = false;
+
+		uint64_t LowWatermark = 0;
+		uint64_t HighWatermark = 0;
+		size_t Reclaimed = 0;
+		size_t Kills = 0;
+		/* Last process killed, -1 once it is gone */
+		std::atomic<pid_t> VictimID = -1;
+
+		static void DaemonEntry();
+
+	public:
+		uint64_t GetLowWatermark() { return LowWatermark; }
+		uint64_t GetHighWatermark() { return HighWatermark; }
+		size_t GetReclaimed() { return Reclaimed; }
+		size_t GetKills() { return Kills; }
+		Shrinker *GetFirst() { return Shrinkers; }
+
+		/** @brief Called by the page allocator with the free memory left */
+		inline void Check(uint64_t FreeMemory)
+		{
+			if (unlikely(FreeMemory < LowWatermark))
+				Pending.store(true, std::memory_order_relaxed);
+		}
+
+		void Register(Shrinker *s);
+		void Unregister(Shrinker *s);
+
+		/**
+		 * Run the shrinkers
+		 *
+		 * @param Pages Pages wanted
+		 * @return Pages freed, 0 if reclaim is already
+		 * running on this path or another thread, and
+		 * this thread cannot wait for it
+		 */
+		size_t Shrink(size_t Pages);
+
+		/**
+		 * Kill the process with the largest
+		 * resident set and wait for its memory
+		 *
+		 * Nobody else is killed while the last victim
+		 * is still around. Does not wait with interrupts
+		 * disabled or while the thread holds a lock.
+		 *
+		 * @return true only if memory was freed
+		 */
+		bool KillVictim();
+
+		/** @brief The last victim has not been freed yet */
+		bool KillPending();
+
+		/** @brief Set the watermarks and start the background thread */
+		void Start();
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_RECLAIM_H__
@@ -0,0 +1,223 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_SLAB_H__
+#define __FENNIX_KERNEL_MEMORY_SLAB_H__
+
+#include <types.h>
+#include <memory/macro.hpp>
+#include <lock.hpp>
+#include <assert.h>
+#include <cstring>
+#include <cstddef>
+
+/* Objects kept in a per-CPU magazine */
+#define SLAB_MAGAZINE_SIZE 32
+/* Minimum number of objects in a slab */
+#define SLAB_MIN_OBJECTS 8
+#define SLAB_CACHE_LINE 64
+/* Size of slabs aligned to their size (64 KiB) */
+#define SLAB_ALIGNED_PAGES 16
+
+namespace Memory
+{
+	/**
+	 * Cache of fixed-size objects
+	 *
+	 * Objects are carved out of slabs of pages and
+	 * stay constructed while they are cached. The
+	 * constructor runs once when a slab is created
+	 * and the destructor when it is given back, so
+	 * freed objects must be returned in their
+	 * constructed state.
+	 *
+	 * Every CPU keeps a magazine of free objects,
+	 * allocations and frees only take the cache
+	 * lock when the magazine is empty or full.
+	 */
+	class ObjectCache
+	{
+	public:
+		typedef void (*ObjectFunction)(void *Object);
+
+	private:
+		struct Slab
+		{
+			ObjectCache *Cache;
+			Slab *Prev, *Next;
+			void *FreeList;
+			size_t InUse;
+		};
+
+		struct Magazine
+		{
+			size_t Count;
+			size_t Allocations;
+			void *Objects[SLAB_MAGAZINE_SIZE];
+		};
+
+		NewLock(CacheLock);
+		const char *Name;
+		size_t Size;
+		size_t Align;
+		ObjectFunction Constructor;
+		ObjectFunction Destructor;
+		bool Aligned;
+
+		/* Computed on the first allocation */
+		size_t Stride = 0;
+		size_t LinkOffset = 0;
+		size_t TagOffset = 0;
+		size_t SlabPages = 0;
+		size_t ObjectsPerSlab = 0;
+		size_t ColorStep = 0;
+		size_t ColorMax = 0;
+		size_t ColorNext = 0;
+
+		Slab *Partial = nullptr;
+		Slab *Full = nullptr;
+		Slab *Empty = nullptr;
+		size_t EmptyCount = 0;
+		size_t SlabCount = 0;
+		size_t ActiveObjects = 0;
+
+		/* Indexed by CPU ID, allocated by Setup */
+		Magazine **Magazines = nullptr;
+		ObjectCache *NextCache = nullptr;
+
+		bool Setup();
+		void **Link(void *Object);
+		void Push(Slab *&Head, Slab *s);
+		void Unlink(Slab *&Head, Slab *s);
+		Slab *GetSlab(void *Object);
+		Slab *CreateSlab();
+		void DestroySlab(Slab *s);
+		void *TakeObject();
+		void PutObject(void *Object);
+		Magazine *GetMagazine();
+		static Magazine *NewMagazine();
+		static void DeleteMagazine(Magazine *m);
+
+	public:
+		const char *GetName() { return Name; }
+		size_t GetObjectSize() { return Size; }
+		size_t GetSlabs() { return SlabCount; }
+		size_t GetActiveObjects() { return ActiveObjects; }
+		size_t GetTotalObjects() { return SlabCount * ObjectsPerSlab; }
+		size_t GetAllocations();
+		size_t GetMemoryUsage() { return SlabCount * SlabPages * PAGE_SIZE; }
+
+		/**
+		 * Get a constructed object
+		 *
+		 * @return The object or nullptr if out of memory
+		 */
+		void *Allocate();
+
+		/**
+		 * Return an object to the cache
+		 *
+		 * @param Object An object from Allocate
+		 */
+		void Free(void *Object);
+
+		/**
+		 * Flush the magazine of the current CPU and
+		 * give the empty slabs back to the page allocator
+		 *
+		 * @return Number of pages freed, 0 if the cache is busy
+		 */
+		size_t Reap();
+
+		/**
+		 * Find the cache of an object
+		 *
+		 * @note Only for caches created with Aligned
+		 * and objects allocated from them.
+		 */
+		static ObjectCache *FromObject(void *Object);
+
+		static ObjectCache *GetFirst();
+		ObjectCache *GetNext() { return NextCache; }
+
+		/**
+		 * @param Name Name shown in the statistics
+		 * @param Size Object size
+		 * @param Align Object alignment, 0 to keep
+		 * small objects within one cache line and
+		 * bigger ones aligned to a cache line
+		 * @param Constructor Called once per object when a slab is created
+		 * @param Destructor Called when a slab is released
+		 * @param Aligned Use SLAB_ALIGNED_PAGES slabs aligned to
+		 * their size, see FromObject
+		 *
+		 * @note Does not allocate, caches can be global objects.
+		 */
+		ObjectCache(const char *Name, size_t Size, size_t Align = 0,
+					ObjectFunction Constructor = nullptr,
+					ObjectFunction Destructor = nullptr,
+					bool Aligned = false);
+		~ObjectCache();
+	};
+}
+
+/**
+ * Allocate objects of a class from its own cache
+ *
+ * Put it in the class declaration and
+ * define the cache in a source file with
+ * SLAB_CACHE_DEFINE. The object is zeroed
+ * here before the constructor runs, since
+ * the caches do not zero their objects.
+ */
+#define SLAB_CACHED                                         \
+public:                                                     \
+	static Memory::ObjectCache SlabCache;                   \
+	void *operator new(std::size_t Size)                    \
+	{                                                       \
+		assert(Size <= SlabCache.GetObjectSize());          \
+		void *Object = SlabCache.Allocate();                \
+		if (likely(Object))                                 \
+			memset(Object, 0, Size);                        \
+		return Object;                                      \
+	}                                                       \
+	void operator delete(void *Object) { SlabCache.Free(Object); }
+
+#define SLAB_CACHE_DEFINE(Type, Name) \
+	Memory::ObjectCache Type::SlabCache(Name, sizeof(Type))
+
+namespace Memory
+{
+	/**
+	 * Request pages aligned to a number of pages
+	 *
+	 * @param Count Number of pages
+	 * @param Align Alignment in pages, a power of two
+	 * @return nullptr if out of memory
+	 */
+	void *RequestAlignedPages(size_t Count, size_t Align);
+}
+
+typedef Memory::ObjectCache kmem_cache_t;
+
+kmem_cache_t *kmem_cache_create(const char *Name, size_t Size, size_t Align,
+								void (*Constructor)(void *));
+void kmem_cache_destroy(kmem_cache_t *Cache);
+void *kmem_cache_alloc(kmem_cache_t *Cache);
+void kmem_cache_free(kmem_cache_t *Cache, void *Object);
+
+#endif // !__FENNIX_KERNEL_MEMORY_SLAB_H__
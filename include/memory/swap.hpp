@@ -0,0 +1,141 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_SWAP_H__
+#define __FENNIX_KERNEL_MEMORY_SWAP_H__
+
+#include <types.h>
+#include <filesystem.hpp>
+#include <bitmap.hpp>
+#include <lock.hpp>
+#include <atomic>
+
+namespace Memory
+{
+	/** @brief Backing store for swapped out pages */
+	class SwapDevice
+	{
+	public:
+		virtual size_t GetSlots() = 0;
+		virtual bool Read(size_t Slot, void *Page) = 0;
+		virtual bool Write(size_t Slot, void *Page) = 0;
+		virtual ~SwapDevice() {}
+	};
+
+	/**
+	 * Swap kept in reserved kernel memory
+	 *
+	 * @note Only useful for testing
+	 */
+	class RamSwapDevice : public SwapDevice
+	{
+	private:
+		void *Pages = nullptr;
+		size_t Slots = 0;
+
+	public:
+		size_t GetSlots() final { return Slots; }
+		bool Read(size_t Slot, void *Page) final;
+		bool Write(size_t Slot, void *Page) final;
+
+		RamSwapDevice(size_t Slots);
+		~RamSwapDevice();
+	};
+
+	/** @brief Swap stored in a file or a block device node */
+	class FileSwapDevice : public SwapDevice
+	{
+	private:
+		vfs::Node *File = nullptr;
+		size_t Slots = 0;
+
+	public:
+		size_t GetSlots() final { return Slots; }
+		bool Read(size_t Slot, void *Page) final;
+		bool Write(size_t Slot, void *Page) final;
+
+		FileSwapDevice(vfs::Node *File);
+		~FileSwapDevice() {}
+	};
+
+	class SwapSpace
+	{
+	private:
+		NewLock(SwapLock);
+		SwapDevice *Device = nullptr;
+		Bitmap SlotBitmap{};
+		size_t UsedSlots = 0;
+		size_t SlotHint = 0;
+		size_t ProcessHand = 0;
+		std::atomic_bool Reclaiming = false;
+
+	public:
+		bool IsEnabled() { return Device != nullptr; }
+		size_t GetSlots() { return Device ? Device->GetSlots() : 0; }
+		size_t GetUsedSlots() { return UsedSlots; }
+
+		/**
+		 * Set the swap backend
+		 *
+		 * @param Device The backend, nullptr to disable swap
+		 * @return 0 on success, -EBUSY if pages are still swapped out
+		 */
+		int SetDevice(SwapDevice *Device);
+
+		/**
+		 * Create a backend from a kernel parameter
+		 *
+		 * @param Spec "ram:<MiB>" or a path to a file
+		 * @return 0 on success, -errno on failure
+		 */
+		int Setup(const char *Spec);
+
+		/**
+		 * Write a page to a free slot
+		 *
+		 * @param Page Physical address of the page
+		 * @param Slot The slot that now holds the page
+		 * @return true on success
+		 */
+		bool StorePage(void *Page, size_t &Slot);
+
+		/**
+		 * Read a slot back
+		 *
+		 * @param Slot The slot returned by StorePage
+		 * @param Page Physical address to read into
+		 * @param Release Free the slot after reading it
+		 * @return true on success
+		 */
+		bool LoadPage(size_t Slot, void *Page, bool Release = true);
+
+		void FreeSlot(size_t Slot);
+
+		/**
+		 * Evict cold user pages
+		 *
+		 * Walks the processes round-robin, each one
+		 * runs a clock over its anonymous pages.
+		 *
+		 * @param Count Number of pages to evict
+		 * @return Number of pages evicted
+		 */
+		size_t Evict(size_t Count);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_SWAP_H__
@@ -21,6 +21,7 @@
 #include <types.h>
 
 #include <memory/table.hpp>
+#include <cpu.hpp>
 
 extern Memory::PageTable *KernelPageTable;
 
@@ -37,10 +38,12 @@ namespace Memory
 			   PageTable *RestoreWith = nullptr)
 			: Replace(ReplaceWith)
 		{
+			/* Interrupts run on process tables,
+				restore whatever table was loaded */
 			if (RestoreWith)
 				Restore = RestoreWith;
 			else
-				Restore = KernelPageTable;
+				Restore = (PageTable *)CPU::PageTable();
 
 			Replace->Update();
 		}
@@ -561,6 +561,21 @@ namespace Memory
 #elif defined(aa64)
 #endif
 
+		/**
+		 * @brief Changes whenever translations cached
+		 * for this table may be stale
+		 */
+		uint64_t Generation;
+
+		/**
+		 * @brief A user page was mapped below the end of
+		 * physical memory over a different frame
+		 *
+		 * The identity map is hidden there, kernel code
+		 * touching those frames needs KernelPageTable.
+		 */
+		bool ShadowsDirectMap;
+
 		/**
 		 * @brief Update CR3 with this PageTable
 		 */
@@ -573,6 +588,15 @@ namespace Memory
 		 */
 		PageTable *Fork();
 
+		/**
+		 * @brief Copy a mapping KernelPageTable gained
+		 * after this table was forked
+		 *
+		 * @param Address The faulting virtual address
+		 * @return true if the mapping was copied
+		 */
+		bool SyncKernelMapping(uintptr_t Address);
+
 		void *__getPhysical(void *Address);
 
 		/**
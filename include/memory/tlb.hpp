@@ -0,0 +1,123 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_TLB_H__
+#define __FENNIX_KERNEL_MEMORY_TLB_H__
+
+#include <types.h>
+
+#include <memory/table.hpp>
+
+/** @brief Pages past which a batch flushes the whole address space */
+#define TLB_FLUSH_THRESHOLD 32
+
+/** @brief Page tables each core keeps tagged with a PCID */
+#define TLB_PCID_SLOTS 8
+
+namespace Memory
+{
+	namespace TLB
+	{
+		/**
+		 * @brief Enable process context identifiers on this core
+		 *
+		 * Must be called with a CR3 that has no PCID set.
+		 *
+		 * @param Core Core ID, kept in IA32_TSC_AUX
+		 */
+		void EnablePCID(int Core);
+
+		/**
+		 * @brief Get a generation no page table has used yet
+		 */
+		uint64_t NewGeneration();
+
+		/**
+		 * @brief Check if a page table is loaded on this core
+		 */
+		bool IsLoaded(PageTable *Table);
+
+		/**
+		 * @brief Load a page table on this core
+		 *
+		 * With PCIDs enabled, the table keeps its PCID and
+		 * the TLB is not flushed unless the table changed
+		 * since it was last loaded on this core.
+		 */
+		void Load(PageTable *Table);
+
+		/**
+		 * @brief Invalidate a page of a page table
+		 *
+		 * Changes to KernelPageTable flush every PCID, on
+		 * this core now and on the others at their next Load.
+		 *
+		 * @param Table The page table that changed
+		 * @param Address Virtual address of the page
+		 */
+		void Invalidate(PageTable *Table, uintptr_t Address);
+
+		/**
+		 * @brief Invalidate every page of a page table
+		 *
+		 * @param Table The page table that changed
+		 */
+		void InvalidateAll(PageTable *Table);
+	}
+
+	/**
+	 * @brief Batched TLB invalidation
+	 *
+	 * Pages are gathered and invalidated at once when the batch
+	 * is flushed or destroyed. Past TLB_FLUSH_THRESHOLD pages the
+	 * whole address space is flushed instead.
+	 */
+	class TLBBatch
+	{
+	private:
+		PageTable *Table;
+		uintptr_t Pages[TLB_FLUSH_THRESHOLD];
+		size_t Count = 0;
+		bool Full = false;
+
+	public:
+		/**
+		 * @brief Add a page to the batch
+		 *
+		 * @param Address Virtual address of the page
+		 */
+		void Add(uintptr_t Address);
+
+		/**
+		 * @brief Add a range of pages to the batch
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range in bytes
+		 */
+		void Add(uintptr_t Address, size_t Length);
+
+		/**
+		 * @brief Invalidate the gathered pages
+		 */
+		void Flush();
+
+		TLBBatch(PageTable *Table) : Table(Table) {}
+		~TLBBatch() { this->Flush(); }
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_TLB_H__
@@ -31,6 +31,10 @@ namespace Memory
 	private:
 		NewLock(MemoryLock);
 		PageTable *pTable = nullptr;
+		std::atomic_size_t *TablePages = nullptr;
+
+		/** @brief Allocate a paging structure and account for it */
+		void *NewTable(size_t Size);
 
 	public:
 		enum MapType
@@ -108,6 +112,13 @@ namespace Memory
 		PageDirectoryEntry *GetPDE(void *VirtualAddress, MapType Type = MapType::FourKiB);
 		PageTableEntry *GetPTE(void *VirtualAddress, MapType Type = MapType::FourKiB);
 
+		/**
+		 * @brief Get the page table entry even if the page is not present.
+		 * @param VirtualAddress Virtual address of the page.
+		 * @return nullptr if there is no page table for the address.
+		 */
+		PageTableEntry *LookupPTE(void *VirtualAddress);
+
 		/**
 		 * @brief Map page.
 		 *
@@ -293,8 +304,9 @@ namespace Memory
 		 * @brief Construct a new Virtual object
 		 *
 		 * @param Table Page table. If null, it will use the current page table.
+		 * @param TablePages Incremented by the pages of new paging structures
 		 */
-		Virtual(PageTable *Table = nullptr);
+		Virtual(PageTable *Table = nullptr, std::atomic_size_t *TablePages = nullptr);
 
 		/**
 		 * @brief Destroy the Virtual object
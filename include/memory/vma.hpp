@@ -25,6 +25,7 @@
 #include <list>
 
 #include <memory/table.hpp>
+#include <memory/macro.hpp>
 
 namespace Memory
 {
@@ -46,6 +47,40 @@ namespace Memory
 			bool Fixed = 0, Shared = 0;
 			size_t Length = 0;
 			size_t ReferenceCount = 0;
+
+			/** @brief Backing file, pages come from the page cache */
+			vfs::Node *File = nullptr;
+			off_t Offset = 0;
+			/** @brief Keeps File open while the region exists */
+			vfs::RefNode *Handle = nullptr;
+		};
+
+		/** @brief Page counts, kept up to date on map and unmap */
+		struct MemoryUsage
+		{
+			/** @brief Private frames, including AllocatedPagesList */
+			std::atomic_size_t Anonymous = 0;
+			/** @brief Page cache frames mapped in regions */
+			std::atomic_size_t Shared = 0;
+			/** @brief Paging structures allocated for this area */
+			std::atomic_size_t PageTables = 0;
+			/** @brief Thread stacks, also counted in Anonymous */
+			std::atomic_size_t Stack = 0;
+			std::atomic_size_t Swapped = 0;
+			/** @brief Length of all regions */
+			std::atomic_size_t Mapped = 0;
+			std::atomic_size_t PeakResident = 0;
+		};
+
+		/** @brief Resource limits in bytes */
+		struct MemoryLimits
+		{
+			/** @brief RLIMIT_AS, checked against Usage.Mapped */
+			uint64_t AddressSpace = UINT64_MAX;
+			/** @brief RLIMIT_AS hard limit, never below AddressSpace */
+			uint64_t AddressSpaceMax = UINT64_MAX;
+			/** @brief RLIMIT_RSS, advisory like on Linux */
+			uint64_t Resident = UINT64_MAX;
 		};
 
 	private:
@@ -54,10 +89,36 @@ namespace Memory
 
 		std::list<AllocatedPages> AllocatedPagesList;
 		std::list<SharedRegion> SharedRegions;
+		uintptr_t SwapHand = 0;
+		uintptr_t MergeHand = 0;
+
+		void Charge(std::atomic_size_t &Counter, size_t Pages)
+		{
+			Counter.fetch_add(Pages);
+			size_t Resident = GetResidentPages();
+			if (Resident > Usage.PeakResident.load())
+				Usage.PeakResident.store(Resident);
+		}
+
+		SharedRegion *FindRegion(uintptr_t Address);
+		void SplitRegion(uintptr_t Address);
+		uintptr_t FindFreeRange(size_t Length);
+		bool PopulatePage(SharedRegion *sr, uintptr_t Address, bool Write);
+		/** @param Keep The range stays in the region, leave it unmapped */
+		void ReleaseRange(SharedRegion *sr, uintptr_t Start, uintptr_t End,
+						  bool Keep = false);
+		bool TrimRegions(uintptr_t Start, uintptr_t End, bool Release);
+		bool RangeIsFree(uintptr_t Start, uintptr_t End);
+		void MovePages(uintptr_t From, uintptr_t To, size_t Length);
+		int CopyUser(void *Kernel, uintptr_t User, size_t Length, bool ToUser);
 
 	public:
 		PageTable *Table = nullptr;
-		uint64_t GetAllocatedMemorySize();
+		MemoryUsage Usage;
+		MemoryLimits Limits;
+
+		size_t GetResidentPages() { return Usage.Anonymous.load() + Usage.Shared.load(); }
+		uint64_t GetAllocatedMemorySize() { return FROM_PAGES(Usage.Anonymous.load()); }
 
 		void *RequestPages(size_t Count, bool User = false, bool Protect = false);
 		void FreePages(void *Address, size_t Count);
@@ -66,6 +127,9 @@ namespace Memory
 		/**
 		 * Create a Copy-on-Write region
 		 *
+		 * No memory is allocated here, pages are
+		 * populated on the first access by HandleCoW.
+		 *
 		 * @param Address Hint address
 		 * @param Length Length of the region
 		 * @param Read Make the region readable
@@ -73,15 +137,142 @@ namespace Memory
 		 * @param Exec Make the region executable
 		 * @param Fixed Fixed address
 		 * @param Shared Shared region
+		 * @param File Backing file, nullptr for anonymous memory
+		 * @param Offset Offset in the backing file
 		 * @return Address of the region
 		 */
 		void *CreateCoWRegion(void *Address, size_t Length,
 							  bool Read, bool Write, bool Exec,
-							  bool Fixed, bool Shared);
+							  bool Fixed, bool Shared,
+							  vfs::Node *File = nullptr, off_t Offset = 0);
+
+		/**
+		 * Handle a page fault inside a CoW region
+		 *
+		 * Read faults map the shared zero page,
+		 * write faults get a private copy.
+		 *
+		 * @param PFA Page fault address
+		 * @param Write The fault was caused by a write
+		 * @return true if the fault was handled
+		 */
+		bool HandleCoW(uintptr_t PFA, bool Write = true);
+
+		/**
+		 * Populate every page of a region range
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range
+		 * @param Write Populate with private writable pages
+		 * @return 0 on success, -errno on failure
+		 */
+		int Populate(void *Address, size_t Length, bool Write);
+
+		/**
+		 * Release a range of CoW regions
+		 *
+		 * Populated pages are freed and the
+		 * regions are trimmed or split.
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range
+		 * @return 0 on success, -EINVAL if no region was found
+		 */
+		int FreeRegion(void *Address, size_t Length);
+
+		/**
+		 * Resize or move a region
+		 *
+		 * Moving transfers the page table entries,
+		 * the data itself is never copied.
+		 *
+		 * @param Address Start of the old range, inside one region
+		 * @param OldLength Length of the old range
+		 * @param NewLength Length of the new range
+		 * @param MayMove Move the range if it cannot grow in place
+		 * @param NewAddress Fixed destination, nullptr for any
+		 * @return New address or -errno
+		 */
+		void *RemapRegion(void *Address, size_t OldLength,
+						  size_t NewLength, bool MayMove,
+						  void *NewAddress = nullptr);
+
+		/**
+		 * Drop the populated pages of a range
+		 *
+		 * The regions stay, the next access faults in
+		 * zeroed pages or the file contents again.
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range
+		 * @return 0 on success, -ENOMEM if the range is not fully mapped
+		 */
+		int DiscardRange(void *Address, size_t Length);
+
+		/**
+		 * Change the protection of a range of CoW regions
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range
+		 * @param Read Make the range readable
+		 * @param Write Make the range writable
+		 * @param Exec Make the range executable
+		 * @return 0 on success, -EINVAL if the range is not fully covered
+		 */
+		int ProtectRegion(void *Address, size_t Length,
+						  bool Read, bool Write, bool Exec);
+
+		/**
+		 * Write back the shared file pages of a range
+		 *
+		 * @param Address Start of the range
+		 * @param Length Length of the range
+		 * @return 0 on success, -ENOMEM if the range is not mapped
+		 */
+		int SyncRegion(void *Address, size_t Length);
+
+		/**
+		 * Move cold anonymous pages to swap
+		 *
+		 * @param Count Number of pages to evict
+		 * @return Number of pages evicted
+		 */
+		size_t SwapOut(size_t Count);
+		size_t GetSwappedPages() { return Usage.Swapped.load(); }
+
+		/**
+		 * Offer private anonymous pages to SamePageMerger
+		 *
+		 * Resumes where the previous call stopped.
+		 *
+		 * @param Count Pages to scan
+		 * @return Pages scanned, less than Count
+		 * once the whole area was scanned
+		 */
+		size_t MergePages(size_t Count);
+
+		/**
+		 * Move private pages out of a physical range
+		 *
+		 * Used by compaction. Shared, cached, swapped
+		 * and copy-on-write frames are left in place.
+		 *
+		 * @param Low First physical address
+		 * @param High End of the physical range
+		 * @return Pages moved
+		 */
+		size_t MigratePages(uintptr_t Low, uintptr_t High);
 
-		bool HandleCoW(uintptr_t PFA);
 		void FreeAllPages();
-		void Fork(VirtualMemoryArea *Parent);
+
+		/**
+		 * Copy the mappings of another area
+		 *
+		 * @param Parent The area to copy
+		 * @return 0 on success, -ENOMEM or -EIO if a page
+		 * could not be copied or swapped in
+		 */
+		int Fork(VirtualMemoryArea *Parent);
 
 		void Reserve(void *Address, size_t Length);
 		void Unreserve(void *Address, size_t Length);
@@ -93,6 +284,40 @@ namespace Memory
 		void *__UserCheckAndGetAddress(void *Address, size_t Length);
 		int __UserCheck(void *Address, size_t Length);
 
+		/**
+		 * Copy from user memory
+		 *
+		 * The pages are populated and checked before copying.
+		 * Unlike UserCheckAndGetAddress, the range may cross
+		 * pages that are not physically contiguous.
+		 *
+		 * @param Destination Kernel buffer
+		 * @param Source User address
+		 * @param Length Number of bytes to copy
+		 * @return 0 on success, -EFAULT if the range is not accessible
+		 */
+		int CopyFromUser(void *Destination, const void *Source, size_t Length);
+
+		/**
+		 * Copy to user memory
+		 *
+		 * @param Destination User address
+		 * @param Source Kernel buffer
+		 * @param Length Number of bytes to copy
+		 * @return 0 on success, -EFAULT if the range is not writable
+		 */
+		int CopyToUser(void *Destination, const void *Source, size_t Length);
+
+		/**
+		 * Copy a null-terminated string from user memory
+		 *
+		 * @param Destination Kernel buffer
+		 * @param Source User string
+		 * @param Length Size of the buffer, including the terminator
+		 * @return Length of the string, -EFAULT or -ENAMETOOLONG
+		 */
+		ssize_t CopyStringFromUser(char *Destination, const char *Source, size_t Length);
+
 		template <typename T>
 		T UserCheckAndGetAddress(T Address, size_t Length = 0)
 		{
@@ -0,0 +1,114 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_MEMORY_ZERO_POOL_H__
+#define __FENNIX_KERNEL_MEMORY_ZERO_POOL_H__
+
+#include <types.h>
+#include <memory/macro.hpp>
+#include <lock.hpp>
+#include <atomic>
+
+/* Pages in a pre-zeroed chunk (64 KiB) */
+#define ZERO_POOL_CHUNK_PAGES 16
+/* Chunks kept ready by the daemon */
+#define ZERO_POOL_CHUNKS 32
+/* Smallest calloc served from the pool */
+#define ZERO_POOL_THRESHOLD (PAGE_SIZE * 4)
+/* Maximum number of live pool allocations */
+#define ZERO_POOL_SLOTS 512
+
+namespace Memory
+{
+	/**
+	 * Page chunks zeroed ahead of time
+	 *
+	 * A background thread keeps a stock of zeroed
+	 * chunks so large calloc calls don't pay for the
+	 * memset. Allocations are page aligned and are
+	 * tracked here, free() hands them back with Free.
+	 */
+	class ZeroPool
+	{
+	private:
+		struct Allocation
+		{
+			void *Address;
+			size_t Pages;
+		};
+
+		NewLock(PoolLock);
+		void *Chunks[ZERO_POOL_CHUNKS]{};
+		size_t ChunkCount = 0;
+
+		Allocation Slots[ZERO_POOL_SLOTS]{};
+		std::atomic_size_t Outstanding = 0;
+
+		size_t Hits = 0;
+		size_t Misses = 0;
+
+		Allocation *FindSlot(void *Address, bool Empty);
+		static void DaemonEntry();
+
+	public:
+		size_t GetChunks() { return ChunkCount; }
+		size_t GetHits() { return Hits; }
+		size_t GetMisses() { return Misses; }
+
+		/**
+		 * Get zeroed memory from the pool
+		 *
+		 * @param Size Size in bytes, at most ZERO_POOL_CHUNK_PAGES pages
+		 * @return Page aligned zeroed memory, or nullptr
+		 * if the pool can't serve the request
+		 */
+		void *Allocate(size_t Size);
+
+		/**
+		 * Size of an allocation made by Allocate
+		 *
+		 * @return Size in bytes, 0 if the address is not from the pool
+		 */
+		size_t GetSize(void *Address);
+
+		/**
+		 * Free an allocation made by Allocate
+		 *
+		 * @return false if the address is not from the pool
+		 */
+		bool Free(void *Address);
+
+		/**
+		 * Give chunks back to the page allocator
+		 *
+		 * @param Pages Pages wanted
+		 * @return Pages freed, 0 if the pool is busy
+		 */
+		size_t Drain(size_t Pages);
+
+		/**
+		 * Zero chunks until the pool is full
+		 * or free memory is running low
+		 */
+		void Refill();
+
+		/** @brief Start the background thread */
+		void Start();
+	};
+}
+
+#endif // !__FENNIX_KERNEL_MEMORY_ZERO_POOL_H__
@@ -0,0 +1,207 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_RCU_H__
+#define __FENNIX_KERNEL_RCU_H__
+
+#include <types.h>
+
+#include <atomic>
+
+/* Idle time of the callback thread between batches (ms) */
+#define RCU_INTERVAL 10
+
+namespace RCU
+{
+	/**
+	 * @brief Deferred reclaim callback
+	 *
+	 * Embed this in the object that has to outlive
+	 * the readers and pass it to Call().
+	 */
+	struct Head
+	{
+		Head *Next;
+		void (*Function)(Head *);
+	};
+
+	/**
+	 * @brief Enter a read-side section
+	 *
+	 * Readers may nest and do not take any lock or
+	 * issue any atomic write. Interrupts are disabled
+	 * until the outermost ReadUnlock() so the section
+	 * can't be preempted, it must not sleep or yield.
+	 */
+	void ReadLock();
+
+	/** @brief Leave a read-side section */
+	void ReadUnlock();
+
+	/**
+	 * @brief Report a quiescent state for the current core
+	 *
+	 * Called on every context switch. If the core is in
+	 * a read-side section the report is deferred until
+	 * the outermost ReadUnlock().
+	 */
+	void QuiescentState();
+
+	/** @brief Park the current core, it has no readers until an interrupt */
+	void EnterIdle();
+
+	/** @brief Called on interrupt entry, wakes a parked core */
+	void InterruptEnter();
+
+	/** @brief Called on interrupt exit, parks the core again */
+	void InterruptExit();
+
+	/**
+	 * @brief Wait for a grace period
+	 *
+	 * Returns after every read-side section that was
+	 * active when it was called has finished. Must not
+	 * be called from a read-side section.
+	 */
+	void Synchronize();
+
+	/**
+	 * @brief Run @p Function after a grace period
+	 *
+	 * Never blocks, safe with interrupts disabled.
+	 * Callbacks run on the RCU thread.
+	 */
+	void Call(Head *Rcu, void (*Function)(Head *));
+
+	/** @brief Start the thread that runs the callbacks */
+	void Start();
+
+	/** @brief Number of grace periods completed */
+	uint64_t GetGracePeriods();
+
+	/**
+	 * @brief Load a pointer published with Assign()
+	 *
+	 * Only valid inside a read-side section or
+	 * while holding the writers lock.
+	 */
+	template <typename T>
+	inline T *Dereference(const std::atomic<T *> &Pointer)
+	{
+		return Pointer.load(std::memory_order_acquire);
+	}
+
+	/** @brief Publish a fully initialized object to readers */
+	template <typename T>
+	inline void Assign(std::atomic<T *> &Pointer, T *Value)
+	{
+		Pointer.store(Value, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Node of an RCU protected list
+	 *
+	 * Entries inherit from it. Readers only follow Next,
+	 * so a removed node keeps pointing into the list
+	 * until the grace period ends.
+	 */
+	struct Link
+	{
+		std::atomic<Link *> Next;
+		Link *Prev;
+	};
+
+	/**
+	 * @brief Circular doubly-linked list with lock-free readers
+	 *
+	 * Writers must be serialized by the caller and free
+	 * removed entries with Call() or after Synchronize().
+	 */
+	class List
+	{
+	private:
+		Link Root;
+
+	public:
+		/** @brief First entry or nullptr, for readers */
+		Link *First() const
+		{
+			Link *l = Root.Next.load(std::memory_order_acquire);
+			return l == &Root ? nullptr : l;
+		}
+
+		/** @brief Entry after @p Entry or nullptr, for readers */
+		Link *Next(Link *Entry) const
+		{
+			Link *l = Entry->Next.load(std::memory_order_acquire);
+			return l == &Root ? nullptr : l;
+		}
+
+		bool Empty() const { return First() == nullptr; }
+
+		void PushFront(Link *Entry) { InsertAfter(&Root, Entry); }
+		void PushBack(Link *Entry) { InsertAfter(Root.Prev, Entry); }
+
+		void InsertAfter(Link *Position, Link *Entry)
+		{
+			Link *After = Position->Next.load(std::memory_order_relaxed);
+			Entry->Next.store(After, std::memory_order_relaxed);
+			Entry->Prev = Position;
+			After->Prev = Entry;
+			Position->Next.store(Entry, std::memory_order_release);
+		}
+
+		void Remove(Link *Entry)
+		{
+			Link *After = Entry->Next.load(std::memory_order_relaxed);
+			Entry->Prev->Next.store(After, std::memory_order_release);
+			After->Prev = Entry->Prev;
+		}
+
+		/** @brief Swap @p Old for @p New in a single store */
+		void Replace(Link *Old, Link *New)
+		{
+			Link *After = Old->Next.load(std::memory_order_relaxed);
+			New->Next.store(After, std::memory_order_relaxed);
+			New->Prev = Old->Prev;
+			After->Prev = New;
+			Old->Prev->Next.store(New, std::memory_order_release);
+		}
+
+		List()
+		{
+			Root.Next.store(&Root, std::memory_order_relaxed);
+			Root.Prev = &Root;
+		}
+	};
+
+	class ReadSection
+	{
+	public:
+		ReadSection() { ReadLock(); }
+		~ReadSection() { ReadUnlock(); }
+	};
+}
+
+/**
+ * RCU read-side section that ends
+ * when the scope ends.
+ */
+#define SmartRCURead() \
+	RCU::ReadSection CONCAT(rcu_, __COUNTER__)
+
+#endif // !__FENNIX_KERNEL_RCU_H__
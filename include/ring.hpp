@@ -0,0 +1,317 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_RING_H__
+#define __FENNIX_KERNEL_RING_H__
+
+#include <types.h>
+#include <lock.hpp>
+#include <atomic>
+
+/* Keeps a field off the cache line of the one before it */
+#define RING_PAD(Used) (LOCK_CACHE_LINE - ((Used) % LOCK_CACHE_LINE))
+
+namespace Tasking
+{
+	class TCB;
+}
+
+/**
+ * Single consumer parked on an empty ring
+ *
+ * Producers pay one fence and one load when
+ * nobody sleeps.
+ */
+class RingWaiter
+{
+private:
+	std::atomic<Tasking::TCB *> Sleeper = nullptr;
+
+public:
+	/**
+	 * @brief Sleep while Tail still equals Seen
+	 *
+	 * Spurious returns are allowed, the caller must
+	 * check the ring again. Callers that can't be
+	 * scheduled out yield or spin instead.
+	 */
+	void Sleep(const std::atomic_size_t &Tail, size_t Seen);
+
+	/** @brief Called after the tail was published */
+	void Wake()
+	{
+		/* Pairs with the store of Sleeper before the tail check */
+		CPU::MemBar::Fence();
+		if (likely(Sleeper.load(std::memory_order_relaxed) == nullptr))
+			return;
+		this->WakeSleeper();
+	}
+
+private:
+	void WakeSleeper();
+};
+
+/**
+ * Lock-free single producer, single consumer ring
+ *
+ * The producer and consumer indexes are padded
+ * onto their own cache lines and each side keeps
+ * a cached copy of the other's, so the line only
+ * moves when the ring looks full or empty.
+ *
+ * Safe between an interrupt handler and a thread
+ * as long as each side has a single owner.
+ */
+template <typename T, size_t Size>
+class SPSCRing
+{
+	static_assert(Size > 0 && (Size & (Size - 1)) == 0,
+				  "Ring size must be a power of two");
+
+private:
+	/* Consumer side */
+	std::atomic_size_t Head = 0;
+	size_t CachedTail = 0;
+	uint8_t HeadPad[RING_PAD(sizeof(size_t) * 2)];
+
+	/* Producer side */
+	std::atomic_size_t Tail = 0;
+	size_t CachedHead = 0;
+	uint8_t TailPad[RING_PAD(sizeof(size_t) * 2)];
+
+	RingWaiter Consumer;
+	uint8_t WaiterPad[RING_PAD(sizeof(RingWaiter))];
+
+	T Slots[Size];
+
+public:
+	/** @return false if the ring is full */
+	bool Push(const T &Value) { return this->PushBatch(&Value, 1) == 1; }
+
+	/** @return Number of values queued, the rest did not fit */
+	size_t PushBatch(const T *Values, size_t Count)
+	{
+		size_t t = Tail.load(std::memory_order_relaxed);
+		if (Size - (t - CachedHead) < Count)
+			CachedHead = Head.load(std::memory_order_acquire);
+
+		size_t Free = Size - (t - CachedHead);
+		if (Count > Free)
+			Count = Free;
+		if (Count == 0)
+			return 0;
+
+		for (size_t i = 0; i < Count; i++)
+			Slots[(t + i) & (Size - 1)] = Values[i];
+		Tail.store(t + Count, std::memory_order_release);
+		Consumer.Wake();
+		return Count;
+	}
+
+	/** @return false if the ring is empty */
+	bool Pop(T &Out) { return this->PopBatch(&Out, 1) == 1; }
+
+	/** @return Number of values taken */
+	size_t PopBatch(T *Out, size_t Max)
+	{
+		size_t h = Head.load(std::memory_order_relaxed);
+		if (CachedTail - h < Max)
+			CachedTail = Tail.load(std::memory_order_acquire);
+
+		size_t Count = CachedTail - h;
+		if (Count > Max)
+			Count = Max;
+		if (Count == 0)
+			return 0;
+
+		for (size_t i = 0; i < Count; i++)
+			Out[i] = Slots[(h + i) & (Size - 1)];
+		Head.store(h + Count, std::memory_order_release);
+		return Count;
+	}
+
+	/** @brief Pop, sleeping until a value is pushed */
+	void PopWait(T &Out)
+	{
+		while (!this->Pop(Out))
+			Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed));
+	}
+
+	/** @brief Take at least one value, sleeping if needed */
+	size_t PopBatchWait(T *Out, size_t Max)
+	{
+		size_t Count;
+		while ((Count = this->PopBatch(Out, Max)) == 0)
+			Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed));
+		return Count;
+	}
+
+	/**
+	 * @brief Sleep until the ring may not be empty
+	 *
+	 * For consumers that serialize their own Pop calls,
+	 * only one of them may wait at a time.
+	 */
+	void Wait() { Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed)); }
+
+	/** @brief Drop everything queued, consumer side only */
+	void Clear()
+	{
+		CachedTail = Tail.load(std::memory_order_acquire);
+		Head.store(CachedTail, std::memory_order_release);
+	}
+
+	bool Empty() { return Count() == 0; }
+
+	size_t Count()
+	{
+		return Tail.load(std::memory_order_acquire) -
+			   Head.load(std::memory_order_acquire);
+	}
+};
+
+/**
+ * Lock-free multiple producer, single consumer ring
+ *
+ * Producers reserve slots by moving the tail with
+ * a CAS and publish each slot through its sequence
+ * number, so a slow producer only holds back the
+ * consumer, never the other producers.
+ *
+ * A full ring drops the new values, the consumer
+ * alone decides what leaves the ring.
+ */
+template <typename T, size_t Size>
+class MPSCRing
+{
+	static_assert(Size > 0 && (Size & (Size - 1)) == 0,
+				  "Ring size must be a power of two");
+
+private:
+	struct Slot
+	{
+		/* Index + 1 once the value is readable */
+		std::atomic_size_t Sequence;
+		T Value;
+	};
+
+	/* Consumer side */
+	std::atomic_size_t Head = 0;
+	uint8_t HeadPad[RING_PAD(sizeof(size_t))];
+
+	/* Producers reserve from here */
+	std::atomic_size_t Tail = 0;
+	uint8_t TailPad[RING_PAD(sizeof(size_t))];
+
+	RingWaiter Consumer;
+	uint8_t WaiterPad[RING_PAD(sizeof(RingWaiter))];
+
+	Slot Slots[Size]{};
+
+public:
+	/** @return false if the ring is full */
+	bool Push(const T &Value) { return this->PushBatch(&Value, 1) == 1; }
+
+	/** @return Number of values queued, the rest did not fit */
+	size_t PushBatch(const T *Values, size_t Count)
+	{
+		size_t t = Tail.load(std::memory_order_relaxed);
+		size_t n;
+		do
+		{
+			/* Slots below Head + Size were already read */
+			size_t Free = Size - (t - Head.load(std::memory_order_acquire));
+			n = Count < Free ? Count : Free;
+			if (n == 0)
+				return 0;
+		} while (!Tail.compare_exchange_weak(t, t + n,
+											 std::memory_order_relaxed));
+
+		for (size_t i = 0; i < n; i++)
+		{
+			Slot &s = Slots[(t + i) & (Size - 1)];
+			s.Value = Values[i];
+			s.Sequence.store(t + i + 1, std::memory_order_release);
+		}
+		Consumer.Wake();
+		return n;
+	}
+
+	/** @return false if the ring is empty */
+	bool Pop(T &Out) { return this->PopBatch(&Out, 1) == 1; }
+
+	/** @return Number of values taken, stops at a slot still being written */
+	size_t PopBatch(T *Out, size_t Max)
+	{
+		size_t h = Head.load(std::memory_order_relaxed);
+		size_t Count = 0;
+		while (Count < Max)
+		{
+			Slot &s = Slots[(h + Count) & (Size - 1)];
+			if (s.Sequence.load(std::memory_order_acquire) != h + Count + 1)
+				break;
+			Out[Count++] = s.Value;
+		}
+
+		if (Count != 0)
+			Head.store(h + Count, std::memory_order_release);
+		return Count;
+	}
+
+	/** @brief Pop, sleeping until a value is pushed */
+	void PopWait(T &Out)
+	{
+		while (!this->Pop(Out))
+			Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed));
+	}
+
+	/** @brief Take at least one value, sleeping if needed */
+	size_t PopBatchWait(T *Out, size_t Max)
+	{
+		size_t Count;
+		while ((Count = this->PopBatch(Out, Max)) == 0)
+			Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed));
+		return Count;
+	}
+
+	/**
+	 * @brief Sleep until the ring may not be empty
+	 *
+	 * For consumers that serialize their own Pop calls,
+	 * only one of them may wait at a time.
+	 */
+	void Wait() { Consumer.Sleep(Tail, Head.load(std::memory_order_relaxed)); }
+
+	/** @brief Drop everything published, consumer side only */
+	void Clear()
+	{
+		T Discard[8];
+		while (this->PopBatch(Discard, sizeof(Discard) / sizeof(T)) != 0)
+			;
+	}
+
+	bool Empty() { return Count() == 0; }
+
+	/** @note Counts slots that are reserved but not yet published */
+	size_t Count()
+	{
+		return Tail.load(std::memory_order_acquire) -
+			   Head.load(std::memory_order_acquire);
+	}
+};
+
+#endif // !__FENNIX_KERNEL_RING_H__
@@ -108,7 +108,7 @@ namespace Tasking::Scheduler
 				   public Interrupts::Handler
 	{
 	private:
-		NewLock(SchedulerLock);
+		TicketLock SchedulerLock;
 
 	public:
 		std::list<PCB *> ProcessList;
@@ -65,6 +65,24 @@ struct CPUData
 
 	/** @brief Is CPU online? */
 	bool IsActive;
+
+	/** @brief RCU read-side nesting depth. */
+	long RCUNesting;
+
+	/** @brief Were interrupts enabled before the outermost RCU read lock? */
+	bool RCURestore;
+
+	/** @brief A quiescent state was reported inside a read-side section. */
+	bool RCUDeferred;
+
+	/** @brief Woken from idle by the current interrupt. */
+	bool RCUWoken;
+
+	/** @brief Parked with no RCU readers. */
+	std::atomic_bool RCUIdle;
+
+	/** @brief Quiescent states passed, only written by this CPU. */
+	std::atomic_uint64_t RCUQuiescent;
 } __aligned(16);
 
 CPUData *GetCurrentCPU();
@@ -42,6 +42,11 @@ struct rlimit
 	rlim_t rlim_max;
 };
 
+namespace Futex
+{
+	struct Waiter;
+}
+
 namespace Tasking
 {
 	using vfs::FileDescriptorTable;
@@ -206,12 +211,26 @@ namespace Tasking
 
 		uint64_t SleepUntil = 0;
 		uint64_t KernelTime = 0, UserTime = 0, SpawnTime = 0, LastUpdateTime = 0;
+		/* Guards KernelTime and UserTime, written by the scheduler */
+		SeqCount UsageSeq;
 		uint64_t Year = 0, Month = 0, Day = 0, Hour = 0, Minute = 0, Second = 0;
 		bool Affinity[256] = {true}; // MAX_CPU
 		TaskPriority Priority = TaskPriority::Normal;
 		TaskArchitecture Architecture = TaskArchitecture::UnknownArchitecture;
 		TaskCompatibility Compatibility = TaskCompatibility::UnknownPlatform;
 		cwk_path_style PathStyle = CWK_STYLE_UNIX;
+
+		/** @brief Consistent snapshot of the accounted times */
+		void GetUsage(uint64_t &Kernel, uint64_t &User) const
+		{
+			uint32_t Seq;
+			do
+			{
+				Seq = UsageSeq.ReadBegin();
+				Kernel = KernelTime;
+				User = UserTime;
+			} while (UsageSeq.ReadRetry(Seq));
+		}
 	};
 
 	struct ThreadLocalStorage
@@ -335,13 +354,19 @@ namespace Tasking
 		IP EntryPoint = 0;
 
 		/* Statuses */
-		std::atomic_int ExitCode;
+		std::atomic_int ExitCode = 0;
 		std::atomic<TaskState> State = TaskState::Waiting;
-		int ErrorNumber;
+		int ErrorNumber = 0;
+
+		/* LockClass locks held, code waiting for other threads checks it */
+		int HeldLocks = 0;
+
+		/* Queued futex wait on our stack, unlinked if we are destroyed */
+		Futex::Waiter *FutexWait = nullptr;
 
 		/* Memory */
-		Memory::VirtualMemoryArea *vma;
-		Memory::StackGuard *Stack;
+		Memory::VirtualMemoryArea *vma = nullptr;
+		Memory::StackGuard *Stack = nullptr;
 
 		/* Signal */
 		ThreadSignal Signals;
@@ -349,14 +374,14 @@ namespace Tasking
 		/* CPU state */
 #if defined(a64)
 		CPU::x64::TrapFrame Registers{};
-		uintptr_t ShadowGSBase, GSBase, FSBase;
+		uintptr_t ShadowGSBase = 0, GSBase = 0, FSBase = 0;
 #elif defined(a32)
 		CPU::x32::TrapFrame Registers{};
-		uintptr_t ShadowGSBase, GSBase, FSBase;
+		uintptr_t ShadowGSBase = 0, GSBase = 0, FSBase = 0;
 #elif defined(aa64)
 		uintptr_t Registers; // TODO
 #endif
-		__aligned(16) CPU::x64::FXState FPU;
+		__aligned(16) CPU::x64::FXState FPU{};
 
 		/* Info & Security info */
 		struct
@@ -409,6 +434,8 @@ namespace Tasking
 			bool ThreadNotReady = false);
 
 		~TCB();
+
+		SLAB_CACHED
 	};
 
 	class PCB : public vfs::Node
@@ -436,7 +463,7 @@ namespace Tasking
 		PCB *Parent = nullptr;
 
 		/* Statuses */
-		std::atomic_int ExitCode;
+		std::atomic_int ExitCode = 0;
 		std::atomic<TaskState> State = Waiting;
 
 		/* Info & Security info */
@@ -464,19 +491,19 @@ namespace Tasking
 		ThreadLocalStorage TLS{};
 
 		/* Filesystem */
-		Node *CurrentWorkingDirectory;
-		Node *Executable;
-		FileDescriptorTable *FileDescriptors;
+		Node *CurrentWorkingDirectory = nullptr;
+		Node *Executable = nullptr;
+		FileDescriptorTable *FileDescriptors = nullptr;
 
 		/* stdio */
-		Node *stdin;
-		Node *stdout;
-		Node *stderr;
+		Node *stdin = nullptr;
+		Node *stdout = nullptr;
+		Node *stderr = nullptr;
 
 		/* Memory */
-		Memory::PageTable *PageTable;
-		Memory::VirtualMemoryArea *vma;
-		Memory::ProgramBreak *ProgramBreak;
+		Memory::PageTable *PageTable = nullptr;
+		Memory::VirtualMemoryArea *vma = nullptr;
+		Memory::ProgramBreak *ProgramBreak = nullptr;
 
 		/* Other */
 		Signal Signals;
@@ -507,6 +534,8 @@ namespace Tasking
 			uint16_t UserID = -1, uint16_t GroupID = -1);
 
 		~PCB();
+
+		SLAB_CACHED
 	};
 
 	class Task
@@ -539,6 +568,20 @@ namespace Tasking
 		void *GetScheduler() { return Scheduler; }
 		PCB *GetKernelProcess() { return KernelProcess; }
 		std::list<PCB *> GetProcessList();
+
+		/**
+		 * Walk the processes without copying the list
+		 *
+		 * The list is locked, no process is added or
+		 * removed until the walk is done. A callback may
+		 * start another walk on the same thread.
+		 *
+		 * @param Callback Called for each process, return false to stop
+		 * @param Context Passed to Callback
+		 * @return true once the walk is done
+		 */
+		bool ForEachProcess(bool (*Callback)(PCB *, void *), void *Context);
+
 		void Panic();
 		bool IsPanic();
 
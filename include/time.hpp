@@ -20,6 +20,7 @@
 
 #include <types.h>
 #include <debug.h>
+#include <lock.hpp>
 #include <cassert>
 
 namespace Time
@@ -32,6 +33,7 @@ namespace Time
 
 	Clock ReadClock();
 	Clock ConvertFromUnix(int Timestamp);
+	uint64_t ConvertToUnix(const Clock &c);
 
 	enum Units
 	{
@@ -147,16 +149,21 @@ namespace Time
 		HighPrecisionEventTimer *hpet;
 		TimeStampCounter *tsc;
 
+		/* Wall clock at CounterBase, read without locking */
+		SeqLock ClockLock;
+		uint64_t RealTimeBase = 0;
+		uint64_t CounterBase = 0;
+
 	public:
 		int GetSupportedTimers() { return SupportedTimers; }
 		TimeActiveTimer GetActiveTimer() { return ActiveTimer; }
-		bool ChangeActiveTimer(TimeActiveTimer Timer)
-		{
-			if (!(SupportedTimers & Timer))
-				return false;
-			ActiveTimer = Timer;
-			return true;
-		}
+		bool ChangeActiveTimer(TimeActiveTimer Timer);
+
+		/** @brief Nanoseconds since the Unix epoch */
+		uint64_t GetRealTime();
+
+		/** @brief Set the wall clock, in nanoseconds since the Unix epoch */
+		void SetRealTime(uint64_t Nanoseconds);
 
 		bool Sleep(size_t Duration, Units Unit);
 		uint64_t GetCounter();
@@ -0,0 +1,62 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_TOPN_H__
+#define __FENNIX_KERNEL_TOPN_H__
+
+#include <types.h>
+
+/**
+ * Spread a pointer sized key over the upper bits
+ *
+ * Code and heap addresses are aligned, so their
+ * low bits can't be used as a table index alone.
+ */
+static inline size_t HashPointer(uintptr_t Key)
+{
+	return (size_t)(((uint64_t)Key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/**
+ * Add an entry to a list of the heaviest ones
+ *
+ * Output stays sorted by Weight, heaviest first.
+ * Once Max entries are held the lightest falls off.
+ *
+ * @param Count Entries already in Output
+ * @return The new number of entries
+ */
+template <typename T, typename W>
+size_t InsertTop(T *Output, size_t Count, size_t Max,
+				 const T &Entry, W T::*Weight)
+{
+	size_t Position = Count;
+	while (Position > 0 && Output[Position - 1].*Weight < Entry.*Weight)
+	{
+		if (Position < Max)
+			Output[Position] = Output[Position - 1];
+		Position--;
+	}
+
+	if (Position >= Max)
+		return Count;
+
+	Output[Position] = Entry;
+	return Count < Max ? Count + 1 : Count;
+}
+
+#endif // !__FENNIX_KERNEL_TOPN_H__
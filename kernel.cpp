@@ -43,7 +43,7 @@ using vfs::NodeType;
 __aligned(16) BootInfo bInfo{};
 
 struct KernelConfig Config = {
-	.AllocatorType = Memory::liballoc11,
+	.AllocatorType = Memory::Slab,
 	.SchedulerType = Multi,
 	.DriverDirectory = {'/', 'u', 's', 'r', '/', 'l', 'i', 'b', '/', 'd', 'r', 'i', 'v', 'e', 'r', 's', '\0'},
 	.InitPath = {'/', 'b', 'i', 'n', '/', 'i', 'n', 'i', 't', '\0'},
@@ -54,6 +54,7 @@ struct KernelConfig Config = {
 	.UnlockDeadLock = false,
 	.SIMD = false,
 	.Quiet = false,
+	.Swap = {'\0'},
 };
 
 Video::Display *Display = nullptr;
@@ -52,6 +52,7 @@ extern vfs::Virtual *fs;
 extern vfs::Node *DevFS;
 extern vfs::Node *MntFS;
 extern vfs::Node *ProcFS;
+extern vfs::Node *SharedMemoryFS;
 extern vfs::Node *VarLogFS;
 extern vfs::PTMXDevice *ptmx;
 extern Tasking::Task *TaskManager;
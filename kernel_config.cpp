@@ -108,6 +108,12 @@ static struct cag_option ConfigOptions[] = {
 	 .value_name = "BOOL",
 	 .description = "Enable quiet boot"},
 
+	{.identifier = 'w',
+	 .access_letters = NULL,
+	 .access_name = "swap",
+	 .value_name = "VALUE",
+	 .description = "Swap backend (ram:<MiB> or a file path)"},
+
 	{.identifier = 'h',
 	 .access_letters = "h",
 	 .access_name = "help",
@@ -178,6 +184,11 @@ void ParseConfig(char *ConfigString, KernelConfig *ModConfig)
 				KPrint("\eAAFFAAUsing Pages as memory allocator");
 				ModConfig->AllocatorType = Memory::Pages;
 			}
+			else if (strcmp(value, "slab") == 0)
+			{
+				KPrint("\eAAFFAAUsing Slab as memory allocator");
+				ModConfig->AllocatorType = Memory::Slab;
+			}
 			break;
 		}
 		case 'c':
@@ -272,6 +283,13 @@ void ParseConfig(char *ConfigString, KernelConfig *ModConfig)
 			KPrint("\eAAFFAAQuiet boot: %s", value);
 			break;
 		}
+		case 'w':
+		{
+			value = cag_option_get_value(&context);
+			strncpy(ModConfig->Swap, value, sizeof(ModConfig->Swap) - 1);
+			KPrint("\eAAFFAAUsing %s as swap", value);
+			break;
+		}
 		case 'h':
 		{
 			KPrint("\n---------------------------------------------------------------------------\nUsage: fennix.elf [OPTION]...\nKernel configuration.");
@@ -26,6 +26,7 @@
 #include <lock.hpp>
 #include <printf.h>
 #include <exec.hpp>
+#include <rcu.hpp>
 #include <cwalk.h>
 #include <vm.hpp>
 #include <vector>
@@ -65,6 +66,8 @@ void KernelMainThread()
 
 #ifdef DEBUG
 	StressKernel();
+	TestLocks();
+	TestRings();
 	// TaskManager->CreateThread(thisProcess, Tasking::IP(tasking_test_fb));
 	// TaskManager->CreateThread(thisProcess, Tasking::IP(tasking_test_mutex));
 	// ilp;
@@ -81,6 +84,10 @@ void KernelMainThread()
 	if (IsVirtualizedEnvironment())
 		KPrint("Running in a virtualized environment");
 
+	PageReclaimer.Start();
+	ZeroedPages.Start();
+	RCU::Start();
+
 	KPrint("Initializing Disk Manager");
 	DiskManager = new Disk::Manager;
 
@@ -88,6 +95,14 @@ void KernelMainThread()
 	DriverManager = new Driver::Manager;
 	DriverManager->LoadAllDrivers();
 
+	if (Config.Swap[0] != '\0')
+	{
+		KPrint("Initializing Swap");
+		int ret = KernelSwap.Setup(Config.Swap);
+		if (ret < 0)
+			KPrint("\eE85230Failed to set up swap %s: %d", Config.Swap, ret);
+	}
+
 	// KPrint("Fetching Disks");
 	/* KernelCallback */
 	// if (DriverManager->GetModules().size() > 0)
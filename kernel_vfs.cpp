@@ -25,6 +25,7 @@ vfs::Virtual *fs = nullptr;
 vfs::Node *DevFS = nullptr;
 vfs::Node *MntFS = nullptr;
 vfs::Node *ProcFS = nullptr;
+vfs::Node *SharedMemoryFS = nullptr;
 vfs::Node *VarLogFS = nullptr;
 vfs::PTMXDevice *ptmx = nullptr;
 
@@ -143,9 +144,24 @@ EXTERNC NIF void KernelVFS()
 		}
 	}
 
+	if (!fs->PathExists("/dev/shm"))
+		SharedMemoryFS = new vfs::Node(DevFS, "shm", vfs::DIRECTORY);
+	else
+	{
+		vfs::RefNode *shm = fs->Open("/dev/shm", nullptr);
+		if (shm->node->Type != vfs::NodeType::DIRECTORY)
+		{
+			KPrint("\eE85230/dev/shm is not a directory!");
+			CPU::Stop();
+		}
+		SharedMemoryFS = shm->node;
+		delete shm;
+	}
+
 	new vfs::NullDevice();
 	new vfs::RandomDevice();
 	new vfs::ZeroDevice();
+	new vfs::HeapProfileDevice();
 	new vfs::KConDevice();
 	ptmx = new vfs::PTMXDevice();
 }
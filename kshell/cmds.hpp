@@ -32,6 +32,11 @@ void cmd_uptime(const char *args);
 void cmd_whoami(const char *args);
 void cmd_uname(const char *args);
 void cmd_mem(const char *args);
+void cmd_slabinfo(const char *args);
+void cmd_allocbench(const char *args);
+void cmd_heapprof(const char *args);
+void cmd_ksm(const char *args);
+void cmd_lockstat(const char *args);
 void cmd_kill(const char *args);
 void cmd_killall(const char *args);
 void cmd_top(const char *args);
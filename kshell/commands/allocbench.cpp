@@ -0,0 +1,61 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <memory/benchmark.hpp>
+#include <memory.hpp>
+
+#include "../../kernel.h"
+
+using namespace Memory;
+
+static void PrintResult(const BenchmarkResult &r)
+{
+	printf("%-10s %-8s %8ld  %6ld  %6ld  %8ld  %8ld  %8ld  %6ld\n",
+		   r.Backend, r.Trace, r.OpsPerSecond, r.P50, r.P99,
+		   TO_KiB(r.PeakLive), TO_KiB(r.PeakUsed), TO_KiB(r.Retained),
+		   r.Failed);
+}
+
+void cmd_allocbench(const char *args)
+{
+	/* allocbench [backend [trace]] */
+	char Backend[32] = {0};
+	const char *Trace = nullptr;
+	if (args && *args)
+	{
+		size_t i = 0;
+		while (args[i] && args[i] != ' ' && i < sizeof(Backend) - 1)
+		{
+			Backend[i] = args[i];
+			i++;
+		}
+
+		while (args[i] == ' ')
+			i++;
+		if (args[i])
+			Trace = args + i;
+	}
+
+	printf("BACKEND    TRACE       OPS/S     P50     P99  LIVE KiB  USED KiB  KEPT KiB  FAILED\n");
+	int Runs = RunAllocatorBenchmark(Backend[0] ? Backend : nullptr, Trace, PrintResult);
+	if (Runs == -EBUSY)
+		printf("Another benchmark is running\n");
+	else if (Runs < 0)
+		printf("Usage: allocbench [pages|xallocv1|xallocv2|liballoc11|rpmalloc|slab] [uniform|bimodal|prodcons]\n");
+}
@@ -47,7 +47,10 @@ void cmd_cat(const char *args)
 	uint8_t *buffer = new uint8_t[fd->Size + 1];
 	ssize_t rBytes = fd->read(buffer, fd->Size);
 	if (rBytes > 0)
+	{
+		buffer[rBytes] = '\0';
 		printf("%s\n", buffer);
+	}
 	else
 		printf("cat: %s: Could not read file\n", args);
 	delete[] buffer;
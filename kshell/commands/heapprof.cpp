@@ -0,0 +1,68 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <memory.hpp>
+#include <convert.h>
+
+#include "../../kernel.h"
+
+using namespace Memory;
+
+/* Sites shown by the command */
+#define HEAPPROF_TOP 20
+
+void cmd_heapprof(const char *args)
+{
+	/* heapprof [on [rate]|off] */
+	if (strncmp(args, "on", 2) == 0)
+	{
+		const char *Arg = args + 2;
+		while (*Arg == ' ')
+			Arg++;
+
+		int Rate = *Arg ? atoi(Arg) : 0;
+		if (!HeapProfiler.Enable(Rate > 0 ? Rate : PROFILER_RATE))
+			printf("heapprof: out of memory\n");
+		return;
+	}
+
+	if (strcmp(args, "off") == 0)
+	{
+		HeapProfiler.Disable();
+		return;
+	}
+
+	printf("Profiler %s, sampling 1/%ld, %ld samples dropped\n",
+		   HeapProfiler.IsEnabled() ? "on" : "off",
+		   HeapProfiler.GetRate(), HeapProfiler.GetDropped());
+
+	ProfileSite Sites[HEAPPROF_TOP];
+	size_t Count = HeapProfiler.GetSites(Sites, HEAPPROF_TOP);
+	printf("  LIVE KiB     ALLOCS      FREES  CHURN KiB  CALLER\n");
+	for (size_t i = 0; i < Count; i++)
+	{
+		ProfileSite &s = Sites[i];
+		const char *Symbol = KernelSymbolTable
+								 ? KernelSymbolTable->GetSymbol(s.Caller)
+								 : "Unknown";
+		printf("%10ld %10ld %10ld %10ld  %#lx %s\n",
+			   TO_KiB(s.LiveBytes), s.Allocations, s.Frees,
+			   TO_KiB(s.TotalBytes - s.LiveBytes), s.Caller, Symbol);
+	}
+}
@@ -0,0 +1,48 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <memory.hpp>
+
+#include "../../kernel.h"
+
+void cmd_ksm(const char *args)
+{
+	/* ksm [on|off] */
+	if (strcmp(args, "on") == 0)
+	{
+		SamePageMerger.Enable();
+		return;
+	}
+
+	if (strcmp(args, "off") == 0)
+	{
+		SamePageMerger.Disable();
+		return;
+	}
+
+	size_t Shared = SamePageMerger.GetShared();
+	size_t Sharing = SamePageMerger.GetSharing();
+	size_t Zero = SamePageMerger.GetZeroMerged();
+	printf("Same page merging %s, %ld full scans, %ld pages scanned\n",
+		   SamePageMerger.IsEnabled() ? "on" : "off",
+		   SamePageMerger.GetFullScans(), SamePageMerger.GetScanned());
+	printf("Shared: %ld pages (%ld KiB)\n", Shared, TO_KiB(FROM_PAGES(Shared)));
+	printf("Sharing: %ld pages (%ld KiB saved)\n", Sharing, TO_KiB(FROM_PAGES(Sharing)));
+	printf("Zero: %ld pages (%ld KiB saved)\n", Zero, TO_KiB(FROM_PAGES(Zero)));
+}
@@ -0,0 +1,63 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <lock.hpp>
+
+#include "../../kernel.h"
+
+/* Lock and function pairs listed, ranked by total wait */
+#define LOCKSTAT_TOP 20
+
+void cmd_lockstat(const char *args)
+{
+	/* lockstat [on|off|reset] */
+	if (strcmp(args, "on") == 0)
+	{
+		LockStat::Enable();
+		return;
+	}
+
+	if (strcmp(args, "off") == 0)
+	{
+		LockStat::Disable();
+		return;
+	}
+
+	if (strcmp(args, "reset") == 0)
+	{
+		LockStat::Reset();
+		return;
+	}
+
+	printf("Lock statistics %s, %ld acquisitions dropped\n",
+		   LockStat::Enabled ? "on" : "off", LockStat::GetDropped());
+
+	LockStatSite Sites[LOCKSTAT_TOP];
+	size_t Count = LockStat::GetSites(Sites, LOCKSTAT_TOP);
+	printf("  ACQUIRED  CONTENDED   AVG WAIT   MAX WAIT   AVG HOLD   MAX HOLD  LOCK\n");
+	for (size_t i = 0; i < Count; i++)
+	{
+		LockStatSite &s = Sites[i];
+		printf("%10ld %10ld %10ld %10ld %10ld %10ld  %#lx %s\n",
+			   s.Acquired, s.Contended,
+			   s.WaitCycles / s.Acquired, s.MaxWait,
+			   s.HoldCycles / s.Acquired, s.MaxHold,
+			   s.Lock, s.Function ? s.Function : "Unknown");
+	}
+}
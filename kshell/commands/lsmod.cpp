@@ -21,6 +21,7 @@
 
 void cmd_lsmod(const char *)
 {
+	SmartReadLock(DriverManager->DriversLock);
 	std::unordered_map<dev_t, Driver::DriverObject> drivers =
 		DriverManager->GetDrivers();
 
@@ -61,4 +61,24 @@ void cmd_mem(const char *)
 	printf("%d MiB    %d MiB    %d MiB    %d MiB\n",
 		   (int)(TO_MiB(total)), (int)(TO_MiB(used)),
 		   (int)(TO_MiB(free)), (int)(TO_MiB(reserved)));
+
+	if (KernelSwap.IsEnabled())
+	{
+		printf("SWAP: %d KiB used of %d KiB\n",
+			   (int)(TO_KiB(KernelSwap.GetUsedSlots() * PAGE_SIZE)),
+			   (int)(TO_KiB(KernelSwap.GetSlots() * PAGE_SIZE)));
+	}
+
+	printf("RECLAIM: low %d KiB, high %d KiB, %d KiB reclaimed, %d OOM kills\n",
+		   (int)(TO_KiB(PageReclaimer.GetLowWatermark())),
+		   (int)(TO_KiB(PageReclaimer.GetHighWatermark())),
+		   (int)(TO_KiB(PageReclaimer.GetReclaimed() * PAGE_SIZE)),
+		   (int)PageReclaimer.GetKills());
+	for (Memory::Shrinker *s = PageReclaimer.GetFirst(); s; s = s->Next)
+		printf("  %-12s %d KiB reclaimable\n", s->Name, (int)(TO_KiB(s->Count() * PAGE_SIZE)));
+
+	printf("COMPACT: %d runs assembled, %d failed, %d KiB migrated\n",
+		   (int)KernelAllocator.GetCompactions(),
+		   (int)KernelAllocator.GetCompactFailures(),
+		   (int)(TO_KiB(KernelAllocator.GetMigratedPages() * PAGE_SIZE)));
 }
@@ -29,6 +29,7 @@ void cmd_modinfo(const char *args)
 
 	dev_t id = atoi(args);
 
+	SmartReadLock(DriverManager->DriversLock);
 	std::unordered_map<dev_t, Driver::DriverObject> drivers =
 		DriverManager->GetDrivers();
 
@@ -0,0 +1,37 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <memory.hpp>
+
+#include "../../kernel.h"
+
+using namespace Memory;
+
+void cmd_slabinfo(const char *)
+{
+	printf("NAME             SIZE  ACTIVE   TOTAL  SLABS  ALLOCS      MEMORY\n");
+	for (ObjectCache *c = ObjectCache::GetFirst(); c; c = c->GetNext())
+	{
+		printf("%-16s %4ld  %6ld  %6ld  %5ld  %10ld  %4ld KiB\n",
+			   c->GetName(), c->GetObjectSize(),
+			   c->GetActiveObjects(), c->GetTotalObjects(),
+			   c->GetSlabs(), c->GetAllocations(),
+			   TO_KiB(c->GetMemoryUsage()));
+	}
+}
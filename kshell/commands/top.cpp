@@ -39,6 +39,13 @@ const char *TaskStateStrings[] = {
 	"Terminated", // Terminated
 };
 
+static uint64_t CPUTime(const Tasking::TaskInfo &Info)
+{
+	uint64_t Kernel, User;
+	Info.GetUsage(Kernel, User);
+	return User + Kernel;
+}
+
 void cmd_top(const char *)
 {
 	printf("\e9400A1PID    \e9CA100Name                \e00A15BState    \eCCCCCCPriority    Memory Usage    CPU Usage\n");
@@ -48,12 +55,12 @@ void cmd_top(const char *)
 		printf("\e9400A1%-4d \e9CA100%-20s \e00A15B%s       \eCCCCCC%d           %ld KiB         %ld\n",
 			   Proc->ID, Proc->Name, TaskStateStrings[Proc->State.load()],
 			   Proc->Info.Priority, TO_KiB(Proc->GetSize()),
-			   Proc->Info.UserTime + Proc->Info.KernelTime);
+			   CPUTime(Proc->Info));
 #elif defined(a32)
 		printf("\e9400A1%-4d \e9CA100%-20s \e00A15B%s       \eCCCCCC%d           %lld KiB         %lld\n",
 			   Proc->ID, Proc->Name, TaskStateStrings[Proc->State.load()],
 			   Proc->Info.Priority, TO_KiB(Proc->GetSize()),
-			   Proc->Info.UserTime + Proc->Info.KernelTime);
+			   CPUTime(Proc->Info));
 #endif
 
 		foreach (auto Thrd in Proc->Threads)
@@ -62,12 +69,12 @@ void cmd_top(const char *)
 			printf(" \eA80011%-4d \e9CA100%-20s \e00A15B%s       \eCCCCCC%d           %ld KiB         %ld\n",
 				   Thrd->ID, Thrd->Name, TaskStateStrings[Thrd->State.load()],
 				   Thrd->Info.Priority, TO_KiB(Thrd->GetSize()),
-				   Thrd->Info.UserTime + Thrd->Info.KernelTime);
+				   CPUTime(Thrd->Info));
 #elif defined(a32)
 			printf(" \eA80011%-4d \e9CA100%-20s \e00A15B%s       \eCCCCCC%d           %lld KiB         %lld\n",
 				   Thrd->ID, Thrd->Name, TaskStateStrings[Thrd->State.load()],
 				   Thrd->Info.Priority, TO_KiB(Thrd->GetSize()),
-				   Thrd->Info.UserTime + Thrd->Info.KernelTime);
+				   CPUTime(Thrd->Info));
 #endif
 		}
 	}
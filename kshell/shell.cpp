@@ -63,6 +63,11 @@ static Command commands[] = {
 	{"killall", cmd_killall},
 	{"top", cmd_top},
 	{"mem", cmd_mem},
+	{"slabinfo", cmd_slabinfo},
+	{"allocbench", cmd_allocbench},
+	{"heapprof", cmd_heapprof},
+	{"ksm", cmd_ksm},
+	{"lockstat", cmd_lockstat},
 	{"uname", cmd_uname},
 	{"whoami", cmd_whoami},
 	{"uptime", cmd_uptime},
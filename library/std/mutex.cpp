@@ -17,7 +17,6 @@
 
 #include <mutex>
 
-#include <algorithm>
 #include <assert.h>
 #include <cpu.hpp>
 
@@ -27,55 +26,143 @@ using namespace Tasking;
 
 namespace std
 {
+	/* True if we took it while the holder was running elsewhere */
+	bool mutex::Spin(TCB *Self)
+	{
+		for (int i = 0; i < LOCK_SPIN_LIMIT; i++)
+		{
+			TCB *Owner = this->Holder.load(std::memory_order_relaxed);
+			if (Owner == nullptr)
+			{
+				if (this->Holder.compare_exchange_weak(Owner, Self,
+													   std::memory_order_acquire))
+					return true;
+				continue;
+			}
+
+			/* A sleeping or preempted holder won't be back soon */
+			if (Owner == Self || Owner->State.load() != TaskState::Running)
+				return false;
+			CPU::Pause();
+		}
+		return false;
+	}
+
+	/* Called with Guard held and a waiter queued */
+	void mutex::Grant()
+	{
+		Waiter *w = this->Head;
+		this->Head = w->Next;
+		if (this->Head == nullptr)
+			this->Tail = nullptr;
+		this->Waiters.fetch_sub(1);
+
+		TCB *t = w->Thread;
+		this->Holder.store(t, std::memory_order_release);
+
+		/* The waiter's frame may go away once Guard is dropped */
+		w->Granted = true;
+		t->Unblock();
+	}
+
 	void mutex::lock()
 	{
-		bool Result = this->Locked.exchange(true, std::memory_order_acquire);
-		__sync;
+		TCB *Self = thisThread;
+		assert(Self != nullptr);
 
-		if (Result)
+		TCB *Free = nullptr;
+		if (likely(this->Holder.compare_exchange_strong(Free, Self,
+														std::memory_order_acquire)))
+			return;
+
+		/* We can't be scheduled out, spin until it's ours */
+		if (!CPU::Interrupts(CPU::Check) || TaskManager->IsPanic())
 		{
-			this->Waiting.push_back(thisThread);
-			thisThread->Block();
-			TaskManager->Yield();
+			while (!this->Spin(Self))
+				CPU::Pause();
 			return;
 		}
 
-		this->Holder = thisThread;
-		this->Waiting.erase(std::find(this->Waiting.begin(),
-									  this->Waiting.end(),
-									  thisThread));
-	}
+		if (this->Spin(Self))
+			return;
 
-	bool mutex::try_lock()
-	{
-		bool Result = this->Locked.exchange(true, std::memory_order_acquire);
-		__sync;
+		Waiter w = {Self, nullptr, false};
+		{
+			CriticalSection cs;
+			this->Guard.Lock(__FUNCTION__);
+			this->Waiters.fetch_add(1);
+
+			/* Released while we were spinning */
+			Free = nullptr;
+			if (this->Holder.compare_exchange_strong(Free, Self,
+													 std::memory_order_acquire))
+			{
+				this->Waiters.fetch_sub(1);
+				this->Guard.Unlock();
+				return;
+			}
+
+			if (this->Tail)
+				this->Tail->Next = &w;
+			else
+				this->Head = &w;
+			this->Tail = &w;
+
+			/* Interrupts are off, the grant cannot come before this */
+			Self->Block();
+			this->Guard.Unlock();
+		}
 
-		if (!Result)
+		while (true)
 		{
-			this->Holder = thisThread;
-			this->Waiting.erase(std::find(this->Waiting.begin(),
-										  this->Waiting.end(),
-										  thisThread));
+			TaskManager->Yield();
+
+			CriticalSection cs;
+			this->Guard.Lock(__FUNCTION__);
+			bool Granted = w.Granted;
+			if (!Granted)
+				Self->Block(); /* Woken by something else */
+			this->Guard.Unlock();
+
+			if (Granted)
+				return;
 		}
-		return !Result;
 	}
 
-	void mutex::unlock()
+	bool mutex::try_lock()
 	{
-		__sync;
-		this->Locked.store(false, std::memory_order_release);
+		TCB *Free = nullptr;
+		return this->Holder.compare_exchange_strong(Free, thisThread,
+													std::memory_order_acquire);
+	}
 
-		if (!this->Waiting.empty())
+	void mutex::unlock()
+	{
+		if (likely(this->Waiters.load() == 0))
 		{
-			this->Holder = this->Waiting[0];
+			this->Holder.store(nullptr, std::memory_order_seq_cst);
 
-			this->Holder = this->Waiting.front();
-			this->Waiting.erase(this->Waiting.begin());
-			this->Holder->Unblock();
-			TaskManager->Yield();
+			/* A waiter may have queued after the check */
+			if (likely(this->Waiters.load() == 0))
+				return;
+
+			CriticalSection cs;
+			this->Guard.Lock(__FUNCTION__);
+			TCB *Free = nullptr;
+			if (this->Head &&
+				this->Holder.compare_exchange_strong(Free, this->Head->Thread,
+													 std::memory_order_acquire))
+				this->Grant();
+			this->Guard.Unlock();
+			return;
 		}
+
+		CriticalSection cs;
+		this->Guard.Lock(__FUNCTION__);
+		if (this->Head)
+			this->Grant();
 		else
-			this->Holder = nullptr;
+			this->Holder.store(nullptr, std::memory_order_release);
+		this->Guard.Unlock();
 	}
 }
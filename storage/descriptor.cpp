@@ -183,23 +183,33 @@ namespace vfs
 
 		if (Flags & O_CREAT)
 		{
-			int ret;
+			int ret = 0;
 			bool absolute = cwk_path_is_absolute(AbsolutePath);
-			new Node(pcb->CurrentWorkingDirectory,
-					 AbsolutePath, NodeType::FILE,
-					 absolute, fs, &ret);
+			if (SharedMemory::IsObjectPath(AbsolutePath))
+			{
+				/* shm_open() */
+				if (fs->PathExists(AbsolutePath))
+					ret = -EEXIST;
+				else
+					new SharedMemory(strrchr(AbsolutePath, '/') + 1, false);
+			}
+			else
+				new Node(pcb->CurrentWorkingDirectory,
+						 AbsolutePath, NodeType::FILE,
+						 absolute, fs, &ret);
 
 			if (ret == -EEXIST)
 			{
+				if (Flags & O_EXCL)
+				{
+					debug("%s: File already exists, returning EEXIST",
+						  AbsolutePath);
+					return -EEXIST;
+				}
+
 				debug("%s: File already exists, continuing...",
 					  AbsolutePath);
 			}
-			else if (Flags & O_EXCL)
-			{
-				debug("%s: File already exists, returning EEXIST",
-					  AbsolutePath);
-				return -EEXIST;
-			}
 			else if (ret < 0)
 			{
 				error("Failed to create file %s: %d",
@@ -210,7 +220,14 @@ namespace vfs
 
 		if (Flags & O_TRUNC)
 		{
-			fixme("O_TRUNC");
+			if (SharedMemory::IsObjectPath(AbsolutePath))
+			{
+				Node *Object = fs->GetNodeFromPath(AbsolutePath);
+				if (Object)
+					((SharedMemory *)Object)->Truncate(0);
+			}
+			else
+				fixme("O_TRUNC");
 		}
 
 		if (Flags & O_CLOEXEC)
@@ -0,0 +1,90 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem/mounts.hpp>
+#include <memory.hpp>
+#include <convert.h>
+#include <printf.h>
+#include <errno.h>
+
+#include "../../kernel.h"
+
+/* Sites listed by a read */
+#define HEAPPROF_SITES 64
+/* Longest line, the symbol name is truncated */
+#define HEAPPROF_LINE 160
+
+namespace vfs
+{
+	size_t HeapProfileDevice::read(uint8_t *Buffer, size_t Size, off_t Offset)
+	{
+		Memory::ProfileSite *Sites = new Memory::ProfileSite[HEAPPROF_SITES];
+		size_t Count = HeapProfiler.GetSites(Sites, HEAPPROF_SITES);
+
+		size_t Length = HEAPPROF_LINE * (Count + 1);
+		char *Text = new char[Length];
+		int Written = snprintf(Text, Length, "%-18s %12s %12s %12s %12s %s\n",
+							   "CALLER", "LIVE", "ALLOCS", "FREES", "CHURN", "SYMBOL");
+		for (size_t i = 0; i < Count && (size_t)Written < Length; i++)
+		{
+			Memory::ProfileSite &s = Sites[i];
+			const char *Symbol = KernelSymbolTable
+									 ? KernelSymbolTable->GetSymbol(s.Caller)
+									 : "Unknown";
+			Written += snprintf(Text + Written, Length - Written,
+								"%#018lx %12ld %12ld %12ld %12ld %.60s\n",
+								s.Caller, s.LiveBytes, s.Allocations, s.Frees,
+								s.TotalBytes - s.LiveBytes, Symbol);
+		}
+		delete[] Sites;
+		if ((size_t)Written >= Length)
+			Written = (int)Length - 1;
+
+		size_t Copied = 0;
+		if ((size_t)Offset < (size_t)Written)
+		{
+			Copied = (size_t)Written - Offset;
+			if (Copied > Size)
+				Copied = Size;
+			memcpy(Buffer, Text + Offset, Copied);
+		}
+		delete[] Text;
+		return Copied;
+	}
+
+	size_t HeapProfileDevice::write(uint8_t *Buffer, size_t Size, off_t Offset)
+	{
+		/* "0" stops the profiler, any other number is the sampling rate */
+		char Command[16] = {0};
+		for (size_t i = 0; i < Size && i < sizeof(Command) - 1; i++)
+		{
+			if (Buffer[i] < '0' || Buffer[i] > '9')
+				break;
+			Command[i] = (char)Buffer[i];
+		}
+
+		int Rate = atoi(Command);
+		if (Rate <= 0)
+			HeapProfiler.Disable();
+		else if (!HeapProfiler.Enable(Rate))
+			return 0;
+		return Size;
+	}
+
+	HeapProfileDevice::HeapProfileDevice() : Node(DevFS, "heapprof", CHARDEVICE) {}
+	HeapProfileDevice::~HeapProfileDevice() {}
+}
@@ -79,6 +79,7 @@ namespace vfs
 		{
 			char *SegmentName = new char[segment.end - segment.begin + 1];
 			memcpy(SegmentName, segment.begin, segment.end - segment.begin);
+			SegmentName[segment.end - segment.begin] = '\0';
 			vfsdbg("GetNodeFromPath()->SegmentName: \"%s\"", SegmentName);
 		GetNodeFromPathNextParent:
 			foreach (auto Child in ReturnNode->Children)
@@ -111,7 +112,7 @@ namespace vfs
 
 	Node *Virtual::GetNodeFromPath(const char *Path, Node *Parent)
 	{
-		SmartLock(VirtualLock);
+		SmartReadLock(VirtualLock);
 		return GetNodeFromPath_Unsafe(Path, Parent);
 	}
 
@@ -218,7 +219,7 @@ namespace vfs
 		if (isempty((char *)Path))
 			return nullptr;
 
-		SmartLock(VirtualLock);
+		SmartWriteLock(VirtualLock);
 		Node *RootNode = FileSystemRoot->Children[0];
 		Node *CurrentParent = this->GetParent(Path, Parent);
 		vfsdbg("Virtual::Create( Path: \"%s\" Parent: \"%s\" )",
@@ -227,13 +228,15 @@ namespace vfs
 		const char *CleanPath = this->NormalizePath(Path, CurrentParent);
 		vfsdbg("CleanPath: \"%s\"", CleanPath);
 
-		VirtualLock.Unlock();
-		if (PathExists(CleanPath, CurrentParent))
+		/* Lookups take the lock for reading */
+		VirtualLock.WriteUnlock();
+		bool Exists = PathExists(CleanPath, CurrentParent);
+		VirtualLock.WriteLock(__FUNCTION__);
+		if (Exists)
 		{
 			error("Path \"%s\" already exists.", CleanPath);
 			goto CreatePathError;
 		}
-		VirtualLock.Lock(__FUNCTION__);
 
 		cwk_segment segment;
 		if (!cwk_path_get_first_segment(CleanPath, &segment))
@@ -246,6 +249,7 @@ namespace vfs
 		{
 			char *SegmentName = new char[segment.end - segment.begin + 1];
 			memcpy(SegmentName, segment.begin, segment.end - segment.begin);
+			SegmentName[segment.end - segment.begin] = '\0';
 			vfsdbg("SegmentName: \"%s\"", SegmentName);
 
 			auto GetChild = [](const char *Name, Node *Parent)
@@ -299,10 +303,10 @@ namespace vfs
 
 		vfsdbg("Virtual::Create()->\"%s\"", CurrentParent->Name);
 #ifdef DEBUG
-		VirtualLock.Unlock();
+		VirtualLock.WriteUnlock();
 		debug("Path created: \"%s\"",
 			  CurrentParent->FullPath);
-		VirtualLock.Lock(__FUNCTION__);
+		VirtualLock.WriteLock(__FUNCTION__);
 #endif
 		return CurrentParent;
 
@@ -318,9 +322,7 @@ namespace vfs
 		if (node)
 		{
 			node->Symlink = new char[strlen(Target) + 1];
-			strncpy((char *)node->Symlink,
-					Target,
-					strlen(Target));
+			strcpy((char *)node->Symlink, Target);
 
 			node->SymlinkTarget = node->vFS->GetNodeFromPath(node->Symlink);
 			return node;
@@ -417,7 +419,7 @@ namespace vfs
 
 	Virtual::Virtual()
 	{
-		SmartLock(VirtualLock);
+		SmartWriteLock(VirtualLock);
 		trace("Initializing virtual file system...");
 		FileSystemRoot = new Node(nullptr, "<root>", NodeType::MOUNTPOINT);
 		FileSystemRoot->vFS = this;
@@ -425,7 +427,7 @@ namespace vfs
 
 	Virtual::~Virtual()
 	{
-		SmartLock(VirtualLock);
+		SmartWriteLock(VirtualLock);
 		stub;
 		/* TODO: sync, cache */
 	}
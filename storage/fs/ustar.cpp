@@ -153,9 +153,7 @@ namespace vfs
 			if (type == NodeType::SYMLINK)
 			{
 				node->Symlink = new char[strlen(header->link) + 1];
-				strncpy((char *)node->Symlink,
-						header->link,
-						strlen(header->link));
+				strcpy((char *)node->Symlink, header->link);
 			}
 
 		NextFileAddress:
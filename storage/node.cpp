@@ -16,6 +16,7 @@
 */
 
 #include <filesystem.hpp>
+#include <memory.hpp>
 #include <cwalk.h>
 
 namespace vfs
@@ -177,6 +178,7 @@ namespace vfs
 			{
 				char *SegmentName = new char[segment.end - segment.begin + 1];
 				memcpy(SegmentName, segment.begin, segment.end - segment.begin);
+				SegmentName[segment.end - segment.begin] = '\0';
 
 				if (Parent)
 				{
@@ -229,8 +231,11 @@ namespace vfs
 		debug("Destroyed node %s(%#lx)", this->FullPath, this);
 		// assert(this->Children.size() == 0);
 
-		foreach (auto Child in this->Children)
-			delete Child;
+		FilePageCache.Invalidate(this);
+
+		/* Each child erases itself from this->Children */
+		while (!this->Children.empty())
+			delete this->Children.back();
 
 		if (this->Parent)
 		{
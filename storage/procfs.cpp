@@ -0,0 +1,96 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem/mounts.hpp>
+#include <memory.hpp>
+#include <printf.h>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+/* Longest status text */
+#define PROC_STATUS_LENGTH 512
+
+static const char *ProcessStateStrings[] = {
+	"U (unknown)",
+	"R (ready)",
+	"R (running)",
+	"S (sleeping)",
+	"D (blocked)",
+	"T (stopped)",
+	"S (waiting)",
+	"Z (core dump)",
+	"Z (zombie)",
+	"X (terminated)",
+};
+
+namespace vfs
+{
+	size_t ProcessStatus::read(uint8_t *Buffer, size_t Size, off_t Offset)
+	{
+		Memory::VirtualMemoryArea *vma = Process->vma;
+		Memory::VirtualMemoryArea::MemoryUsage &u = vma->Usage;
+
+		Tasking::TaskState State = Process->State.load();
+		if (State < Tasking::_StatusMin || State > Tasking::_StatusMax)
+			State = Tasking::UnknownStatus;
+
+		char *Text = new char[PROC_STATUS_LENGTH];
+		int Written = snprintf(Text, PROC_STATUS_LENGTH,
+							   "Name:\t%s\n"
+							   "State:\t%s\n"
+							   "Pid:\t%d\n"
+							   "PPid:\t%d\n"
+							   "VmSize:\t%8ld kB\n"
+							   "VmHWM:\t%8ld kB\n"
+							   "VmRSS:\t%8ld kB\n"
+							   "RssAnon:\t%8ld kB\n"
+							   "RssFile:\t%8ld kB\n"
+							   "VmStk:\t%8ld kB\n"
+							   "VmPTE:\t%8ld kB\n"
+							   "VmSwap:\t%8ld kB\n",
+							   Process->Name,
+							   ProcessStateStrings[State],
+							   Process->ID,
+							   Process->Parent ? Process->Parent->ID : 0,
+							   TO_KiB(FROM_PAGES(u.Mapped.load())),
+							   TO_KiB(FROM_PAGES(u.PeakResident.load())),
+							   TO_KiB(FROM_PAGES(vma->GetResidentPages())),
+							   TO_KiB(FROM_PAGES(u.Anonymous.load())),
+							   TO_KiB(FROM_PAGES(u.Shared.load())),
+							   TO_KiB(FROM_PAGES(u.Stack.load())),
+							   TO_KiB(FROM_PAGES(u.PageTables.load())),
+							   TO_KiB(FROM_PAGES(u.Swapped.load())));
+		if (Written >= PROC_STATUS_LENGTH)
+			Written = PROC_STATUS_LENGTH - 1;
+
+		size_t Copied = 0;
+		if ((size_t)Offset < (size_t)Written)
+		{
+			Copied = (size_t)Written - Offset;
+			if (Copied > Size)
+				Copied = Size;
+			memcpy(Buffer, Text + Offset, Copied);
+		}
+		delete[] Text;
+		return Copied;
+	}
+
+	ProcessStatus::ProcessStatus(Tasking::PCB *Process)
+		: Node(Process, "status", FILE), Process(Process) {}
+	ProcessStatus::~ProcessStatus() {}
+}
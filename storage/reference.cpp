@@ -26,6 +26,8 @@ const char *SeekStrings[] =
 
 namespace vfs
 {
+	SLAB_CACHE_DEFINE(RefNode, "RefNode");
+
 	size_t RefNode::read(uint8_t *Buffer, size_t Size)
 	{
 		if (this->SymlinkTo)
@@ -152,12 +154,13 @@ namespace vfs
 
 	RefNode::~RefNode()
 	{
+		debug("Destroying reference node for %s [%#lx]",
+			  this->node->FullPath, (uintptr_t)this);
+
 		if (this->SymlinkTo)
 			this->node->SymlinkTarget->RemoveReference(this);
 
+		/* The node may delete itself with its last reference */
 		this->node->RemoveReference(this);
-
-		debug("Destroyed reference node for %s [%#lx]",
-			  this->node->FullPath, (uintptr_t)this);
 	}
 }
@@ -0,0 +1,154 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem/mounts.hpp>
+#include <memory.hpp>
+#include <errno.h>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	size_t SharedMemory::read(uint8_t *Buffer, size_t Size, off_t Offset)
+	{
+		if (Offset >= this->Size)
+			return 0;
+		if (Offset + (off_t)Size > this->Size)
+			Size = (size_t)(this->Size - Offset);
+
+		size_t Done = 0;
+		while (Done < Size)
+		{
+			off_t Position = Offset + (off_t)Done;
+			off_t Page = ALIGN_DOWN(Position, PAGE_SIZE);
+			size_t Skip = (size_t)(Position - Page);
+			size_t Chunk = MIN(PAGE_SIZE - Skip, Size - Done);
+
+			void *Frame = FilePageCache.RequestPage(this, Page);
+			if (Frame == nullptr)
+			{
+				if (Done == 0)
+					return (size_t)-ENOMEM;
+				return Done;
+			}
+
+			memcpy(Buffer + Done, (uint8_t *)Frame + Skip, Chunk);
+			FilePageCache.ReleasePage(this, Page, Frame, false);
+			Done += Chunk;
+		}
+		return Done;
+	}
+
+	size_t SharedMemory::write(uint8_t *Buffer, size_t Size, off_t Offset)
+	{
+		size_t Done = 0;
+		while (Done < Size)
+		{
+			off_t Position = Offset + (off_t)Done;
+			off_t Page = ALIGN_DOWN(Position, PAGE_SIZE);
+			size_t Skip = (size_t)(Position - Page);
+			size_t Chunk = MIN(PAGE_SIZE - Skip, Size - Done);
+
+			/* Short write if some of it made it */
+			void *Frame = FilePageCache.RequestPage(this, Page);
+			if (Frame == nullptr)
+			{
+				if (Done == 0)
+					return (size_t)-ENOMEM;
+				break;
+			}
+
+			memcpy((uint8_t *)Frame + Skip, Buffer + Done, Chunk);
+			FilePageCache.ReleasePage(this, Page, Frame, true);
+			Done += Chunk;
+		}
+
+		if (Offset + (off_t)Done > this->Size)
+			this->Size = Offset + (off_t)Done;
+		return Done;
+	}
+
+	void SharedMemory::RemoveReference(RefNode *Reference)
+	{
+		Node::RemoveReference(Reference);
+
+		/* Closed and unmapped everywhere */
+		if (Transient && References.empty())
+			delete this;
+	}
+
+	int SharedMemory::Truncate(off_t Length)
+	{
+		if (Length < 0)
+			return -EINVAL;
+
+		if (Length < this->Size)
+		{
+			off_t End = ROUND_UP(Length, PAGE_SIZE);
+			FilePageCache.Truncate(this, End);
+
+			/* A later grow must read zeros past the old end */
+			if (Length != End)
+			{
+				off_t Page = ALIGN_DOWN(Length, PAGE_SIZE);
+				void *Frame = FilePageCache.RequestPage(this, Page);
+				if (Frame != nullptr)
+				{
+					memset((uint8_t *)Frame + (Length - Page), 0,
+						   (size_t)(End - Length));
+					FilePageCache.ReleasePage(this, Page, Frame, true);
+				}
+			}
+		}
+
+		debug("Resized %s from %lld to %lld bytes",
+			  this->FullPath, this->Size, Length);
+		this->Size = Length;
+		return 0;
+	}
+
+	void SharedMemory::Unlink()
+	{
+		Transient = true;
+		if (References.empty())
+			delete this;
+	}
+
+	bool SharedMemory::IsObjectPath(const char *Path)
+	{
+		if (SharedMemoryFS == nullptr)
+			return false;
+
+		size_t Length = strlen(SharedMemoryFS->FullPath);
+		if (strncmp(Path, SharedMemoryFS->FullPath, Length) != 0 ||
+			Path[Length] != '/')
+			return false;
+
+		const char *Name = Path + Length + 1;
+		return *Name != '\0' && strchr(Name, '/') == nullptr;
+	}
+
+	SharedMemory::SharedMemory(const char *Name, bool Transient)
+		: Node(SharedMemoryFS, Name, FILE), Transient(Transient)
+	{
+		this->Size = 0;
+		this->Mode = S_IRUSR | S_IWUSR;
+		FilePageCache.Pin(this);
+	}
+
+	SharedMemory::~SharedMemory() {}
+}
@@ -44,6 +44,7 @@
 #define sc_MAP_PRIVATE 2
 #define sc_MAP_FIXED 4
 #define sc_MAP_ANONYMOUS 8
+#define sc_MAP_POPULATE 16
 
 /* lseek */
 
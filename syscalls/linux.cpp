@@ -22,6 +22,7 @@
 #include <syscalls.hpp>
 
 #include <signal.hpp>
+#include <futex.hpp>
 #include <utsname.h>
 #include <rand.hpp>
 #include <limits.h>
@@ -605,6 +606,16 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 		new_flags |= sc_MAP_ANONYMOUS;
 		flags &= ~MAP_ANONYMOUS;
 	}
+	if (flags & MAP_POPULATE)
+	{
+		new_flags |= sc_MAP_POPULATE;
+		flags &= ~MAP_POPULATE;
+	}
+	if (flags & MAP_NORESERVE)
+	{
+		/* Nothing is reserved up front, pages are allocated on fault */
+		flags &= ~MAP_NORESERVE;
+	}
 	if (flags)
 		fixme("unhandled flags: %#x", flags);
 	flags = new_flags;
@@ -621,6 +632,7 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 	bool m_Private = flags & sc_MAP_PRIVATE;
 	bool m_Fixed = flags & sc_MAP_FIXED;
 	bool m_Anon = flags & sc_MAP_ANONYMOUS;
+	bool m_Populate = flags & sc_MAP_POPULATE;
 
 	UNUSED(p_None);
 	UNUSED(m_Anon);
@@ -628,13 +640,14 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 	debug("None:%d Read:%d Write:%d Exec:%d",
 		  p_None, p_Read, p_Write, p_Exec);
 
-	debug("Shared:%d Private:%d Fixed:%d Anon:%d",
-		  m_Shared, m_Private, m_Fixed, m_Anon);
+	debug("Shared:%d Private:%d Fixed:%d Anon:%d Populate:%d",
+		  m_Shared, m_Private, m_Fixed, m_Anon, m_Populate);
 
 	int UnknownFlags = flags & ~(sc_MAP_SHARED |
 								 sc_MAP_PRIVATE |
 								 sc_MAP_FIXED |
-								 sc_MAP_ANONYMOUS);
+								 sc_MAP_ANONYMOUS |
+								 sc_MAP_POPULATE);
 	if (UnknownFlags)
 	{
 		/* We still have some flags missing afaik... */
@@ -654,9 +667,9 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::Node *File = nullptr;
 	if (fildes != -1 && !m_Anon)
 	{
-		fixme("File mapping not fully implemented");
 		vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 		vfs::FileDescriptorTable::Fildes &_fd = fdt->GetDescriptor(fildes);
 		if (_fd.Descriptor != fildes)
@@ -665,73 +678,27 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 			return (void *)-EBADF;
 		}
 
-		if (p_Read)
+		int AccessMode = _fd.Flags & (O_WRONLY | O_RDWR);
+		if (AccessMode == O_WRONLY ||
+			(m_Shared && p_Write && AccessMode != O_RDWR))
 		{
-			void *pBuf = vma->RequestPages(TO_PAGES(length));
-			debug("created buffer at %#lx-%#lx",
-				  pBuf, (uintptr_t)pBuf + length);
-
-			uintptr_t mFlags = Memory::US;
-			if (p_Write)
-				mFlags |= Memory::RW;
-
-			if (m_Fixed)
-			{
-				if (m_Shared)
-					return (void *)-ENOSYS;
-
-				int mRet = vma->Map(addr, pBuf, length, mFlags);
-				if (mRet < 0)
-				{
-					debug("Failed to map file: %s", strerror(mRet));
-					return (void *)(uintptr_t)mRet;
-				}
-				off_t oldOff = fdt->_lseek(fildes, 0, SEEK_CUR);
-				fdt->_lseek(fildes, offset, SEEK_SET);
-
-				ssize_t ret = fdt->_read(fildes, pBuf, length);
-				fdt->_lseek(fildes, oldOff, SEEK_SET);
-
-				if (ret < 0)
-				{
-					debug("Failed to read file");
-					return (void *)ret;
-				}
-				return addr;
-			}
-			else
-			{
-				int mRet = vma->Map(pBuf, pBuf, length, mFlags);
-				if (mRet < 0)
-				{
-					debug("Failed to map file: %s", strerror(mRet));
-					return (void *)(uintptr_t)mRet;
-				}
-			}
-
-			off_t oldOff = fdt->_lseek(fildes, 0, SEEK_CUR);
-			fdt->_lseek(fildes, offset, SEEK_SET);
-
-			ssize_t ret = fdt->_read(fildes, pBuf, length);
-
-			fdt->_lseek(fildes, oldOff, SEEK_SET);
-
-			if (ret < 0)
-			{
-				debug("Failed to read file");
-				return (void *)ret;
-			}
-			return pBuf;
+			debug("File descriptor %d has wrong access mode", fildes);
+			return (void *)-EACCES;
 		}
 
-		debug("???");
-		return (void *)-ENOSYS;
+		File = _fd.Handle->node;
 	}
 
 	void *ret = vma->CreateCoWRegion(addr, length,
 									 p_Read, p_Write, p_Exec,
-									 m_Fixed, m_Shared);
-	return (void *)ret;
+									 m_Fixed, m_Shared,
+									 File, offset);
+	if ((intptr_t)ret < 0)
+		return ret;
+
+	if (m_Populate)
+		vma->Populate(ret, length, p_Write);
+	return ret;
 }
 #undef __FENNIX_KERNEL_SYSCALLS_LIST_H__
 
@@ -750,6 +717,10 @@ static int linux_mprotect(SysFrm *, void *addr, size_t len, int prot)
 	// bool p_Exec = prot & sc_PROT_EXEC;
 
 	PCB *pcb = thisProcess;
+	if (pcb->vma->ProtectRegion(addr, len, p_Read, p_Write,
+								prot & sc_PROT_EXEC) == 0)
+		return 0;
+
 	Memory::Virtual vmm = Memory::Virtual(pcb->PageTable);
 
 	for (uintptr_t i = uintptr_t(addr);
@@ -793,19 +764,7 @@ static int linux_mprotect(SysFrm *, void *addr, size_t len, int prot)
 			  p_Write ? "Write" : "",
 			  (prot & sc_PROT_EXEC) ? "Exec" : "");
 
-#if defined(a64)
-		CPU::x64::invlpg(addr);
-#elif defined(a32)
-		CPU::x32::invlpg(addr);
-#elif defined(aa64)
-		asmv("dsb sy");
-		asmv("tlbi vae1is, %0"
-			 :
-			 : "r"(addr)
-			 : "memory");
-		asmv("dsb sy");
-		asmv("isb");
-#endif
+		Memory::TLB::Invalidate(pcb->PageTable, (uintptr_t)addr);
 	}
 
 	return 0;
@@ -822,6 +781,9 @@ static int linux_munmap(SysFrm *, void *addr, size_t length)
 
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
+	if (vma->FreeRegion(addr, length) == 0)
+		return 0;
+
 	vma->FreePages((void *)addr, TO_PAGES(length));
 	return 0;
 }
@@ -990,6 +952,100 @@ static int linux_access(SysFrm *, const char *pathname, int mode)
 	return 0;
 }
 
+/* https://man7.org/linux/man-pages/man2/mremap.2.html */
+static void *linux_mremap(SysFrm *, void *old_address, size_t old_size,
+						  size_t new_size, int flags, void *new_address)
+{
+	if (flags & ~(MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP))
+		return (void *)-EINVAL;
+
+	if ((flags & MREMAP_FIXED) && !(flags & MREMAP_MAYMOVE))
+		return (void *)-EINVAL;
+
+	if (flags & MREMAP_DONTUNMAP)
+	{
+		fixme("MREMAP_DONTUNMAP is not implemented");
+		return (void *)-EINVAL;
+	}
+
+	if (old_size == 0)
+	{
+		/* Would duplicate a shared mapping */
+		fixme("mremap with old_size 0 is not implemented");
+		return (void *)-EINVAL;
+	}
+
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	return vma->RemapRegion(old_address, old_size, new_size,
+							flags & MREMAP_MAYMOVE,
+							(flags & MREMAP_FIXED) ? new_address : nullptr);
+}
+
+/* https://man7.org/linux/man-pages/man2/msync.2.html */
+static int linux_msync(SysFrm *, void *addr, size_t length, int flags)
+{
+	if (uintptr_t(addr) % PAGE_SIZE)
+		return -EINVAL;
+
+	if (flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC))
+		return -EINVAL;
+
+	if ((flags & MS_ASYNC) && (flags & MS_SYNC))
+		return -EINVAL;
+
+	if (length == 0)
+		return 0;
+
+	/* MS_ASYNC is handled like MS_SYNC and MS_INVALIDATE
+		is a no-op because every mapping shares the cache */
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	return vma->SyncRegion(addr, length);
+}
+
+/* https://man7.org/linux/man-pages/man2/madvise.2.html */
+static int linux_madvise(SysFrm *, void *addr, size_t length, int advice)
+{
+	if (uintptr_t(addr) % PAGE_SIZE)
+		return -EINVAL;
+
+	if (length == 0)
+		return 0;
+
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	switch (advice)
+	{
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+		return 0;
+	case MADV_WILLNEED:
+	{
+		/* Prefault read-only, writes still get their private copy */
+		if (vma->Populate(addr, length, false) == -EINVAL)
+			return -ENOMEM;
+		return 0;
+	}
+	case MADV_DONTNEED:
+	case MADV_FREE:
+		return vma->DiscardRange(addr, length);
+	case MADV_HUGEPAGE:
+	case MADV_NOHUGEPAGE:
+	{
+		/* Regions are always populated with 4 KiB pages */
+		debug("Ignoring huge page hint %d for %#lx", advice, addr);
+		return 0;
+	}
+	default:
+	{
+		debug("Invalid advice %d", advice);
+		return -EINVAL;
+	}
+	}
+}
+
 /* https://man7.org/linux/man-pages/man2/pipe.2.html */
 static int linux_pipe(SysFrm *, int pipefd[2])
 {
@@ -1158,7 +1214,13 @@ static pid_t linux_fork(SysFrm *sf)
 
 	NewProcess->PageTable = Parent->PageTable->Fork();
 	NewProcess->vma->Table = NewProcess->PageTable;
-	NewProcess->vma->Fork(Parent->vma);
+	int ret = NewProcess->vma->Fork(Parent->vma);
+	if (unlikely(ret < 0))
+	{
+		error("Failed to fork memory: %d", ret);
+		delete NewProcess;
+		return ret;
+	}
 	NewProcess->ProgramBreak->SetTable(NewProcess->PageTable);
 	NewProcess->FileDescriptors->Fork(Parent->FileDescriptors);
 	NewProcess->Executable = Parent->Executable;
@@ -1413,6 +1475,21 @@ static __noreturn void linux_exit(SysFrm *, int status)
 		  t->ID, status,
 		  status < 0 ? -status : status);
 
+	/* Let pthread_join() and friends see the exit,
+		the waiter may or may not use a private futex. */
+	if (t->Linux.clear_child_tid)
+	{
+		Futex::Key Shared, Private;
+		uint32_t *tid = (uint32_t *)t->Linux.clear_child_tid;
+		if (Futex::GetKey(tid, false, Shared) == 0 &&
+			Futex::GetKey(tid, true, Private) == 0)
+		{
+			__atomic_store_n(Shared.Word, 0, __ATOMIC_SEQ_CST);
+			Futex::Wake(Shared, 1, FUTEX_BITSET_ANY);
+			Futex::Wake(Private, 1, FUTEX_BITSET_ANY);
+		}
+	}
+
 	t->SetState(Tasking::Zombie);
 	t->SetExitCode(status);
 	while (true)
@@ -1447,8 +1524,7 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 			{
 				if (wstatus != nullptr)
 				{
-					int *pWstatus = pcb->PageTable->Get(wstatus);
-					*pWstatus = 0;
+					int kWstatus = 0;
 
 					bool ProcessExited = true;
 					int ExitStatus = child->ExitCode.load();
@@ -1456,13 +1532,16 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 					debug("Process returned %d", ExitStatus);
 
 					if (ProcessExited)
-						*pWstatus |= ExitStatus << 8;
+						kWstatus |= ExitStatus << 8;
+
+					if (vma->CopyToUser(wstatus, &kWstatus, sizeof(int)) < 0)
+						return -EFAULT;
 				}
 
 				if (rusage != nullptr)
 				{
-					size_t kTime = child->Info.KernelTime;
-					size_t uTime = child->Info.UserTime;
+					uint64_t kTime, uTime;
+					child->Info.GetUsage(kTime, uTime);
 					size_t _maxrss = child->GetSize();
 
 					struct rusage *pRusage = vma->UserCheckAndGetAddress(rusage);
@@ -1513,8 +1592,8 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 
 				if (rusage != nullptr)
 				{
-					size_t kTime = child->Info.KernelTime;
-					size_t uTime = child->Info.UserTime;
+					uint64_t kTime, uTime;
+					child->Info.GetUsage(kTime, uTime);
 					size_t _maxrss = child->GetSize();
 
 					struct rusage *pRusage = vma->UserCheckAndGetAddress(rusage);
@@ -1630,8 +1709,8 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 
 	if (rusage != nullptr)
 	{
-		size_t kTime = tPcb->Info.KernelTime;
-		size_t uTime = tPcb->Info.UserTime;
+		uint64_t kTime, uTime;
+		tPcb->Info.GetUsage(kTime, uTime);
 		size_t _maxrss = tPcb->GetSize();
 
 		struct rusage *pRusage = vma->UserCheckAndGetAddress(rusage);
@@ -1835,6 +1914,28 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 	}
 }
 
+/* https://man7.org/linux/man-pages/man2/ftruncate.2.html */
+static int linux_ftruncate(SysFrm *, int fd, off_t length)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	vfs::RefNode *ref = fdt->GetRefNode(fd);
+	if (ref == nullptr)
+		return -EBADF;
+
+	vfs::Node *node = ref->node;
+	if (node->Parent != SharedMemoryFS)
+	{
+		fixme("ftruncate is only implemented for shared memory objects");
+		return -EINVAL;
+	}
+
+	int ret = ((vfs::SharedMemory *)node)->Truncate(length);
+	if (ret == 0)
+		ref->Size = length;
+	return ret;
+}
+
 /* https://man7.org/linux/man-pages/man2/creat.2.html */
 static int linux_creat(SysFrm *, const char *pathname, mode_t mode)
 {
@@ -1883,6 +1984,39 @@ static int linux_mkdir(SysFrm *, const char *pathname, mode_t mode)
 	return 0;
 }
 
+/* https://man7.org/linux/man-pages/man2/unlink.2.html */
+static int linux_unlink(SysFrm *, const char *pathname)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	const char *pPathname = vma->UserCheckAndGetAddress(pathname, PAGE_SIZE);
+	if (pPathname == nullptr)
+		return -EFAULT;
+
+	vfs::Node *node = fs->GetNodeFromPath(pPathname, pcb->CurrentWorkingDirectory);
+	if (node == nullptr)
+		return -ENOENT;
+
+	if (node->Type == vfs::NodeType::DIRECTORY)
+		return -EISDIR;
+
+	/* shm_unlink(), the object lives on while it is open or mapped */
+	if (node->Parent == SharedMemoryFS)
+	{
+		((vfs::SharedMemory *)node)->Unlink();
+		return 0;
+	}
+
+	if (!node->References.empty())
+	{
+		fixme("%s is still open", pPathname);
+		return -EBUSY;
+	}
+
+	return fs->Delete(node);
+}
+
 /* https://man7.org/linux/man-pages/man2/readlink.2.html */
 static ssize_t linux_readlink(SysFrm *, const char *pathname,
 							  char *buf, size_t bufsiz)
@@ -1955,9 +2089,9 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 	{
 	case RUSAGE_SELF:
 	{
-		size_t kTime = pcb->Info.KernelTime;
-		size_t uTime = pcb->Info.UserTime;
-		size_t _maxrss = pcb->GetSize();
+		uint64_t kTime, uTime;
+		pcb->Info.GetUsage(kTime, uTime);
+		size_t _maxrss = TO_KiB(FROM_PAGES(vma->Usage.PeakResident.load()));
 
 		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
 		pUsage->ru_utime.tv_usec = uTime / 1000000000;		/* Microseconds */
@@ -1970,15 +2104,18 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 	}
 	case RUSAGE_CHILDREN:
 	{
-		size_t kTime = 0;
-		size_t uTime = 0;
+		uint64_t kTime = 0;
+		uint64_t uTime = 0;
 		size_t _maxrss = 0;
 
 		foreach (auto child in pcb->Children)
 		{
-			kTime += child->Info.KernelTime;
-			uTime += child->Info.UserTime;
-			_maxrss += child->GetSize();
+			uint64_t ckTime, cuTime;
+			child->Info.GetUsage(ckTime, cuTime);
+			kTime += ckTime;
+			uTime += cuTime;
+			size_t rss = FROM_PAGES(child->vma->Usage.PeakResident.load());
+			_maxrss = MAX(_maxrss, TO_KiB(rss));
 		}
 
 		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
@@ -1994,9 +2131,10 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 	{
 		TCB *tcb = thisThread;
 
-		size_t kTime = tcb->Info.KernelTime;
-		size_t uTime = tcb->Info.UserTime;
-		size_t _maxrss = tcb->GetSize();
+		uint64_t kTime, uTime;
+		tcb->Info.GetUsage(kTime, uTime);
+		/* Threads share the address space of their process */
+		size_t _maxrss = TO_KiB(FROM_PAGES(vma->Usage.PeakResident.load()));
 
 		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
 		pUsage->ru_utime.tv_usec = uTime / 1000000000;		/* Microseconds */
@@ -2261,32 +2399,34 @@ static int linux_sigaction(SysFrm *, int signum, const k_sigaction *act,
 
 	debug("signum=%d act=%#lx oldact=%#lx", signum, act, oldact);
 
-	if (vma->UserCheck(act) < 0 && act != nullptr)
+	k_sigaction kAct{};
+	k_sigaction kOldact{};
+	if (act && vma->CopyFromUser(&kAct, act, sizeof(k_sigaction)) < 0)
 		return -EFAULT;
-	if (vma->UserCheck(oldact) < 0 && oldact != nullptr)
+	if (oldact && vma->CopyFromUser(&kOldact, oldact, sizeof(k_sigaction)) < 0)
 		return -EFAULT;
 
-	auto pAct = pcb->PageTable->Get(act);
-	auto pOldact = pcb->PageTable->Get(oldact);
 	int ret = 0;
 
-	if (pOldact)
+	if (oldact)
 	{
 		Signals nSig = ConvertSignalToNative(signum);
 		assert(nSig != SIG_NULL);
 
 		SignalAction nSA{};
-		SetSigActToNative(pOldact, &nSA);
+		SetSigActToNative(&kOldact, &nSA);
 		ret = pcb->Signals.GetAction(nSig, &nSA);
-		SetSigActToLinux(&nSA, pOldact);
+		SetSigActToLinux(&nSA, &kOldact);
+		if (vma->CopyToUser(oldact, &kOldact, sizeof(k_sigaction)) < 0)
+			return -EFAULT;
 	}
 
 	if (unlikely(ret < 0))
 		return ret;
 
-	if (pAct)
+	if (act)
 	{
-		if (pAct->flags & SA_IMMUTABLE)
+		if (kAct.flags & SA_IMMUTABLE)
 		{
 			warn("Immutable signal %d", signum);
 			return -EINVAL;
@@ -2296,9 +2436,8 @@ static int linux_sigaction(SysFrm *, int signum, const k_sigaction *act,
 		assert(nSig != SIG_NULL);
 
 		SignalAction nSA{};
-		SetSigActToNative(pAct, &nSA);
+		SetSigActToNative(&kAct, &nSA);
 		ret = pcb->Signals.SetAction(nSig, &nSA);
-		SetSigActToLinux(&nSA, (k_sigaction *)pAct);
 	}
 
 	return ret;
@@ -2320,27 +2459,24 @@ static int linux_sigprocmask(SysFrm *, int how, const sigset_t *set,
 	PCB *pcb = tcb->Parent;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	if (vma->UserCheck(set) < 0 && set != nullptr)
-		return -EFAULT;
-	if (vma->UserCheck(oldset) < 0 && oldset != nullptr)
+	sigset_t kSet = 0;
+	if (set && vma->CopyFromUser(&kSet, set, sizeof(sigset_t)) < 0)
 		return -EFAULT;
 
-	const sigset_t *pSet = (const sigset_t *)pcb->PageTable->Get((void *)set);
-	sigset_t *pOldset = (sigset_t *)pcb->PageTable->Get(oldset);
-
 	debug("how=%#x set=%#lx oldset=%#lx",
-		  how, pSet ? *pSet : 0, pOldset ? *pOldset : 0);
+		  how, kSet, oldset);
 
-	if (pOldset)
+	if (oldset)
 	{
-		*pOldset = tcb->Signals.GetMask();
-		*pOldset = ConvertMaskToLinux(*pOldset);
+		sigset_t kOldset = ConvertMaskToLinux(tcb->Signals.GetMask());
+		if (vma->CopyToUser(oldset, &kOldset, sizeof(sigset_t)) < 0)
+			return -EFAULT;
 	}
 
-	if (!pSet)
+	if (!set)
 		return 0;
 
-	sigset_t nativeSet = ConvertMaskToNative(*pSet);
+	sigset_t nativeSet = ConvertMaskToNative(kSet);
 	switch (how)
 	{
 	case SIG_BLOCK:
@@ -2383,6 +2519,143 @@ static int linux_tkill(SysFrm *, int tid, int sig)
 	return tcb->SendSignal(nSig);
 }
 
+/* Counter deadline for a wait of Nanoseconds, saturating instead of wrapping */
+static uint64_t FutexRelativeDeadline(uint64_t Nanoseconds)
+{
+	if (Nanoseconds > UINT64_MAX / Time::ConvertUnit(Time::Nanoseconds))
+		return UINT64_MAX;
+
+	uint64_t Deadline = TimeManager->CalculateTarget(Nanoseconds, Time::Nanoseconds);
+	if (Deadline < TimeManager->GetCounter())
+		return UINT64_MAX;
+	return Deadline;
+}
+
+/* https://man7.org/linux/man-pages/man2/futex.2.html */
+static long linux_futex(SysFrm *, uint32_t *uaddr, int futex_op,
+						uint32_t val, const struct timespec *timeout,
+						uint32_t *uaddr2, uint32_t val3)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	bool Private = futex_op & FUTEX_PRIVATE_FLAG;
+	int cmd = futex_op & FUTEX_CMD_MASK;
+
+	if ((futex_op & FUTEX_CLOCK_REALTIME) &&
+		cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET)
+		return -ENOSYS;
+
+	/* The timeout argument doubles as val2 */
+	int val2 = int(uintptr_t(timeout));
+
+	Futex::Key k;
+	int ret = Futex::GetKey(uaddr, Private, k);
+	if (ret < 0)
+		return ret;
+
+	switch (cmd)
+	{
+	case FUTEX_WAIT:
+	case FUTEX_WAIT_BITSET:
+	{
+		uint32_t Bitset = cmd == FUTEX_WAIT ? FUTEX_BITSET_ANY : val3;
+		uint64_t Deadline = 0;
+		if (timeout)
+		{
+			const timespec *pTimeout = vma->UserCheckAndGetAddress(timeout);
+			if (pTimeout == nullptr)
+				return -EFAULT;
+
+			if (pTimeout->tv_sec < 0 ||
+				pTimeout->tv_nsec < 0 || pTimeout->tv_nsec > 999999999)
+				return -EINVAL;
+
+			uint64_t Sec = uint64_t(pTimeout->tv_sec);
+			uint64_t NSec = uint64_t(pTimeout->tv_nsec);
+			if (cmd == FUTEX_WAIT)
+			{
+				/* Relative, the clock flag does not change that */
+				uint64_t Total;
+				if (__builtin_mul_overflow(Sec, 1000000000ULL, &Total) ||
+					__builtin_add_overflow(Total, NSec, &Total))
+					Total = UINT64_MAX;
+				Deadline = FutexRelativeDeadline(Total);
+			}
+			else if (futex_op & FUTEX_CLOCK_REALTIME)
+			{
+				/* Absolute wall clock time, turned into a counter deadline */
+				uint64_t Total;
+				if (__builtin_mul_overflow(Sec, 1000000000ULL, &Total) ||
+					__builtin_add_overflow(Total, NSec, &Total))
+					Total = UINT64_MAX;
+
+				uint64_t Now = TimeManager->GetRealTime();
+				Deadline = FutexRelativeDeadline(Total > Now ? Total - Now : 0);
+			}
+			else
+			{
+				/* Absolute, in clock_gettime(CLOCK_MONOTONIC) units */
+				uint64_t SecPart, NSecPart;
+				if (__builtin_mul_overflow(Sec, Time::ConvertUnit(Time::Seconds), &SecPart) ||
+					__builtin_mul_overflow(NSec, Time::ConvertUnit(Time::Nanoseconds), &NSecPart) ||
+					__builtin_add_overflow(SecPart, NSecPart, &Deadline))
+					Deadline = UINT64_MAX;
+			}
+			if (Deadline == 0)
+				Deadline = 1;
+		}
+		return Futex::Wait(k, val, Deadline, Bitset);
+	}
+	case FUTEX_WAKE:
+		return Futex::Wake(k, int(val), FUTEX_BITSET_ANY);
+	case FUTEX_WAKE_BITSET:
+		return Futex::Wake(k, int(val), val3);
+	case FUTEX_REQUEUE:
+	case FUTEX_CMP_REQUEUE:
+	{
+		if (int(val) < 0 || val2 < 0)
+			return -EINVAL;
+
+		Futex::Key k2;
+		ret = Futex::GetKey(uaddr2, Private, k2);
+		if (ret < 0)
+			return ret;
+
+		int Moved;
+		ret = Futex::Requeue(k, k2, int(val), val2,
+							 cmd == FUTEX_CMP_REQUEUE, val3, Moved);
+		if (ret < 0 || cmd == FUTEX_REQUEUE)
+			return ret;
+		return ret + Moved;
+	}
+	case FUTEX_WAKE_OP:
+	{
+		Futex::Key k2;
+		ret = Futex::GetKey(uaddr2, Private, k2, true);
+		if (ret < 0)
+			return ret;
+		return Futex::WakeOp(k, k2, int(val), val2, val3);
+	}
+	case FUTEX_FD:
+	case FUTEX_LOCK_PI:
+	case FUTEX_LOCK_PI2:
+	case FUTEX_UNLOCK_PI:
+	case FUTEX_TRYLOCK_PI:
+	case FUTEX_WAIT_REQUEUE_PI:
+	case FUTEX_CMP_REQUEUE_PI:
+	{
+		fixme("futex op %d is stub", cmd);
+		return -ENOSYS;
+	}
+	default:
+	{
+		debug("Invalid futex op %#x", futex_op);
+		return -ENOSYS;
+	}
+	}
+}
+
 /* https://man7.org/linux/man-pages/man2/set_tid_address.2.html */
 static pid_t linux_set_tid_address(SysFrm *, int *tidptr)
 {
@@ -2434,6 +2707,22 @@ static ssize_t linux_getdents64(SysFrm *, int fd, struct linux_dirent64 *dirp,
 }
 
 /* https://man7.org/linux/man-pages/man3/clock_gettime.3.html */
+static long linux_time(SysFrm *, __kernel_old_time_t *tloc)
+{
+	__kernel_old_time_t now = __kernel_old_time_t(TimeManager->GetRealTime() / 1000000000ULL);
+	if (tloc)
+	{
+		PCB *pcb = thisProcess;
+		Memory::VirtualMemoryArea *vma = pcb->vma;
+
+		__kernel_old_time_t *pTloc = vma->UserCheckAndGetAddress(tloc);
+		if (pTloc == nullptr)
+			return -EFAULT;
+		*pTloc = now;
+	}
+	return now;
+}
+
 static int linux_clock_gettime(SysFrm *, clockid_t clockid, struct timespec *tp)
 {
 	static_assert(sizeof(struct timespec) < PAGE_SIZE);
@@ -2450,9 +2739,10 @@ static int linux_clock_gettime(SysFrm *, clockid_t clockid, struct timespec *tp)
 	{
 	case CLOCK_REALTIME:
 	{
-		uint64_t time = TimeManager->GetCounter();
-		pTp->tv_sec = time / Time::ConvertUnit(Time::Seconds);
-		pTp->tv_nsec = time / Time::ConvertUnit(Time::Nanoseconds);
+		/* Nanoseconds since the epoch */
+		uint64_t time = TimeManager->GetRealTime();
+		pTp->tv_sec = time / 1000000000ULL;
+		pTp->tv_nsec = time % 1000000000ULL;
 		debug("time=%ld sec=%ld nsec=%ld",
 			  time, pTp->tv_sec, pTp->tv_nsec);
 		break;
@@ -2698,21 +2988,32 @@ static int linux_prlimit64(SysFrm *, pid_t pid, int resource,
 	if (pNewLimit == nullptr && new_limit != nullptr)
 		return -EFAULT;
 
-	UNUSED(pOldLimit);
-	UNUSED(pNewLimit);
-
+	/* Copied first, old_limit may point at the same memory */
+	struct rlimit NewLimit = {};
 	if (new_limit)
 	{
+		NewLimit = *pNewLimit;
 		debug("new limit: rlim_cur:%lld rlim_max:%lld",
-			  pNewLimit->rlim_cur, pNewLimit->rlim_max);
+			  NewLimit.rlim_cur, NewLimit.rlim_max);
+
+		if (NewLimit.rlim_cur > NewLimit.rlim_max)
+			return -EINVAL;
 	}
 
-	if (old_limit)
+	PCB *target = pcb;
+	if (pid != 0)
 	{
-		debug("old limit: rlim_cur:%lld rlim_max:%lld",
-			  pOldLimit->rlim_cur, pOldLimit->rlim_max);
+		target = pcb->GetContext()->GetProcessByID(pid);
+		if (!target)
+			return -ESRCH;
 	}
 
+	bool Privileged = pcb->Security.Effective.UserID == 0;
+	if (target != pcb && !Privileged &&
+		target->Security.Real.UserID != pcb->Security.Real.UserID)
+		return -EPERM;
+
+	struct rlimit OldLimit;
 	switch (resource)
 	{
 	case RLIMIT_CPU:
@@ -2720,28 +3021,23 @@ static int linux_prlimit64(SysFrm *, pid_t pid, int resource,
 	case RLIMIT_DATA:
 	case RLIMIT_STACK:
 	case RLIMIT_CORE:
-	case RLIMIT_RSS:
 		goto __stub;
 	case RLIMIT_NPROC:
-	{
-		if (new_limit)
-			pcb->Limits.Threads = pNewLimit->rlim_max;
-		return 0;
-	}
+		OldLimit.rlim_cur = OldLimit.rlim_max = target->Limits.Threads;
+		break;
 	case RLIMIT_NOFILE:
-	{
-		if (new_limit)
-			pcb->Limits.OpenFiles = pNewLimit->rlim_max;
-		return 0;
-	}
+		OldLimit.rlim_cur = OldLimit.rlim_max = target->Limits.OpenFiles;
+		break;
 	case RLIMIT_MEMLOCK:
 		goto __stub;
 	case RLIMIT_AS:
-	{
-		if (new_limit)
-			pcb->Limits.Memory = pNewLimit->rlim_max;
-		return 0;
-	}
+		OldLimit.rlim_cur = target->vma->Limits.AddressSpace;
+		OldLimit.rlim_max = target->vma->Limits.AddressSpaceMax;
+		break;
+	case RLIMIT_RSS:
+		/* Advisory only, like on Linux */
+		OldLimit.rlim_cur = OldLimit.rlim_max = target->vma->Limits.Resident;
+		break;
 	case RLIMIT_LOCKS:
 	case RLIMIT_SIGPENDING:
 	case RLIMIT_MSGQUEUE:
@@ -2761,6 +3057,33 @@ static int linux_prlimit64(SysFrm *, pid_t pid, int resource,
 	}
 	}
 
+	if (new_limit && NewLimit.rlim_max > OldLimit.rlim_max && !Privileged)
+		return -EPERM;
+
+	if (old_limit)
+		*pOldLimit = OldLimit;
+
+	if (!new_limit)
+		return 0;
+
+	switch (resource)
+	{
+	case RLIMIT_NPROC:
+		target->Limits.Threads = NewLimit.rlim_max;
+		break;
+	case RLIMIT_NOFILE:
+		target->Limits.OpenFiles = NewLimit.rlim_max;
+		break;
+	case RLIMIT_AS:
+		target->vma->Limits.AddressSpaceMax = NewLimit.rlim_max;
+		target->vma->Limits.AddressSpace = NewLimit.rlim_cur;
+		break;
+	case RLIMIT_RSS:
+		target->vma->Limits.Resident = NewLimit.rlim_cur;
+		break;
+	default:
+		break;
+	}
 	return 0;
 }
 
@@ -2782,20 +3105,18 @@ static ssize_t linux_getrandom(SysFrm *, void *buf,
 		return -EINVAL;
 	}
 
-	auto pBuf = vma->UserCheckAndGetAddress(buf, buflen);
-	if (pBuf == nullptr)
-		return -EFAULT;
-
 	if (flags & GRND_RANDOM)
 	{
-		uint16_t random;
-		for (size_t i = 0; i < buflen; i++)
+		uint8_t random[64];
+		for (size_t i = 0; i < buflen; i += sizeof(random))
 		{
-			random = Random::rand16();
-			{
-				Memory::SwapPT swap(pcb->PageTable);
-				((uint8_t *)pBuf)[i] = uint8_t(random & 0xFF);
-			}
+			size_t len = MIN(sizeof(random), buflen - i);
+			for (size_t j = 0; j < len; j++)
+				random[j] = uint8_t(Random::rand16() & 0xFF);
+
+			int ret = vma->CopyToUser((uint8_t *)buf + i, random, len);
+			if (ret < 0)
+				return ret;
 		}
 		return buflen;
 	}
@@ -2803,6 +3124,43 @@ static ssize_t linux_getrandom(SysFrm *, void *buf,
 	return 0;
 }
 
+/* https://man7.org/linux/man-pages/man2/memfd_create.2.html */
+static int linux_memfd_create(SysFrm *, const char *name, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if (flags & ~(MFD_CLOEXEC | MFD_ALLOW_SEALING))
+	{
+		debug("Unsupported flags %#x", flags);
+		return -EINVAL;
+	}
+
+	/* Linux limits the name to 249 bytes */
+	char pName[250];
+	ssize_t len = vma->CopyStringFromUser(pName, name, sizeof(pName));
+	if (len < 0)
+		return len == -ENAMETOOLONG ? -EINVAL : (int)len;
+
+	/* The object needs a unique path, descriptors are reopened by path */
+	static std::atomic_size_t MemfdCount = 0;
+	char ObjectName[sizeof(pName) + 32];
+	sprintf(ObjectName, "memfd:%s.%ld", pName, MemfdCount.fetch_add(1));
+	for (char *c = ObjectName; *c; c++)
+	{
+		if (*c == '/')
+			*c = '_';
+	}
+
+	vfs::SharedMemory *Object = new vfs::SharedMemory(ObjectName, true);
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	int fd = fdt->_open(Object->FullPath, O_RDWR | (flags & MFD_CLOEXEC ? O_CLOEXEC : 0),
+						S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		Object->Unlink();
+	return fd;
+}
+
 static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_read] = {"read", (void *)linux_read},
 	[__NR_amd64_write] = {"write", (void *)linux_write},
@@ -2829,10 +3187,10 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_pipe] = {"pipe", (void *)linux_pipe},
 	[__NR_amd64_select] = {"select", (void *)nullptr},
 	[__NR_amd64_sched_yield] = {"sched_yield", (void *)nullptr},
-	[__NR_amd64_mremap] = {"mremap", (void *)nullptr},
-	[__NR_amd64_msync] = {"msync", (void *)nullptr},
+	[__NR_amd64_mremap] = {"mremap", (void *)linux_mremap},
+	[__NR_amd64_msync] = {"msync", (void *)linux_msync},
 	[__NR_amd64_mincore] = {"mincore", (void *)nullptr},
-	[__NR_amd64_madvise] = {"madvise", (void *)nullptr},
+	[__NR_amd64_madvise] = {"madvise", (void *)linux_madvise},
 	[__NR_amd64_shmget] = {"shmget", (void *)nullptr},
 	[__NR_amd64_shmat] = {"shmat", (void *)nullptr},
 	[__NR_amd64_shmctl] = {"shmctl", (void *)nullptr},
@@ -2881,7 +3239,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_fsync] = {"fsync", (void *)nullptr},
 	[__NR_amd64_fdatasync] = {"fdatasync", (void *)nullptr},
 	[__NR_amd64_truncate] = {"truncate", (void *)nullptr},
-	[__NR_amd64_ftruncate] = {"ftruncate", (void *)nullptr},
+	[__NR_amd64_ftruncate] = {"ftruncate", (void *)linux_ftruncate},
 	[__NR_amd64_getdents] = {"getdents", (void *)nullptr},
 	[__NR_amd64_getcwd] = {"getcwd", (void *)linux_getcwd},
 	[__NR_amd64_chdir] = {"chdir", (void *)nullptr},
@@ -2891,7 +3249,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_rmdir] = {"rmdir", (void *)nullptr},
 	[__NR_amd64_creat] = {"creat", (void *)linux_creat},
 	[__NR_amd64_link] = {"link", (void *)nullptr},
-	[__NR_amd64_unlink] = {"unlink", (void *)nullptr},
+	[__NR_amd64_unlink] = {"unlink", (void *)linux_unlink},
 	[__NR_amd64_symlink] = {"symlink", (void *)nullptr},
 	[__NR_amd64_readlink] = {"readlink", (void *)linux_readlink},
 	[__NR_amd64_chmod] = {"chmod", (void *)nullptr},
@@ -3005,8 +3363,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_lremovexattr] = {"lremovexattr", (void *)nullptr},
 	[__NR_amd64_fremovexattr] = {"fremovexattr", (void *)nullptr},
 	[__NR_amd64_tkill] = {"tkill", (void *)linux_tkill},
-	[__NR_amd64_time] = {"time", (void *)nullptr},
-	[__NR_amd64_futex] = {"futex", (void *)nullptr},
+	[__NR_amd64_time] = {"time", (void *)linux_time},
+	[__NR_amd64_futex] = {"futex", (void *)linux_futex},
 	[__NR_amd64_sched_setaffinity] = {"sched_setaffinity", (void *)nullptr},
 	[__NR_amd64_sched_getaffinity] = {"sched_getaffinity", (void *)nullptr},
 	[__NR_amd64_set_thread_area] = {"set_thread_area", (void *)nullptr},
@@ -3123,7 +3481,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_renameat2] = {"renameat2", (void *)nullptr},
 	[__NR_amd64_seccomp] = {"seccomp", (void *)nullptr},
 	[__NR_amd64_getrandom] = {"getrandom", (void *)linux_getrandom},
-	[__NR_amd64_memfd_create] = {"memfd_create", (void *)nullptr},
+	[__NR_amd64_memfd_create] = {"memfd_create", (void *)linux_memfd_create},
 	[__NR_amd64_kexec_file_load] = {"kexec_file_load", (void *)nullptr},
 	[__NR_amd64_bpf] = {"bpf", (void *)nullptr},
 	[__NR_amd64_execveat] = {"execveat", (void *)nullptr},
@@ -3264,7 +3622,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_waitpid] = {"waitpid", (void *)nullptr},
 	[__NR_i386_creat] = {"creat", (void *)linux_creat},
 	[__NR_i386_link] = {"link", (void *)nullptr},
-	[__NR_i386_unlink] = {"unlink", (void *)nullptr},
+	[__NR_i386_unlink] = {"unlink", (void *)linux_unlink},
 	[__NR_i386_execve] = {"execve", (void *)linux_execve},
 	[__NR_i386_chdir] = {"chdir", (void *)nullptr},
 	[__NR_i386_time] = {"time", (void *)nullptr},
@@ -3347,7 +3705,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_mmap] = {"mmap", (void *)linux_mmap},
 	[__NR_i386_munmap] = {"munmap", (void *)linux_munmap},
 	[__NR_i386_truncate] = {"truncate", (void *)nullptr},
-	[__NR_i386_ftruncate] = {"ftruncate", (void *)nullptr},
+	[__NR_i386_ftruncate] = {"ftruncate", (void *)linux_ftruncate},
 	[__NR_i386_fchmod] = {"fchmod", (void *)nullptr},
 	[__NR_i386_fchown] = {"fchown", (void *)nullptr},
 	[__NR_i386_getpriority] = {"getpriority", (void *)nullptr},
@@ -3398,7 +3756,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_getdents] = {"getdents", (void *)nullptr},
 	[__NR_i386__newselect] = {"_newselect", (void *)nullptr},
 	[__NR_i386_flock] = {"flock", (void *)nullptr},
-	[__NR_i386_msync] = {"msync", (void *)nullptr},
+	[__NR_i386_msync] = {"msync", (void *)linux_msync},
 	[__NR_i386_readv] = {"readv", (void *)linux_readv},
 	[__NR_i386_writev] = {"writev", (void *)linux_writev},
 	[__NR_i386_getsid] = {"getsid", (void *)nullptr},
@@ -3417,7 +3775,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_sched_get_priority_min] = {"sched_get_priority_min", (void *)nullptr},
 	[__NR_i386_sched_rr_get_interval] = {"sched_rr_get_interval", (void *)nullptr},
 	[__NR_i386_nanosleep] = {"nanosleep", (void *)nullptr},
-	[__NR_i386_mremap] = {"mremap", (void *)nullptr},
+	[__NR_i386_mremap] = {"mremap", (void *)linux_mremap},
 	[__NR_i386_setresuid] = {"setresuid", (void *)nullptr},
 	[__NR_i386_getresuid] = {"getresuid", (void *)nullptr},
 	[__NR_i386_vm86] = {"vm86", (void *)nullptr},
@@ -3473,7 +3831,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_setfsgid32] = {"setfsgid32", (void *)nullptr},
 	[__NR_i386_pivot_root] = {"pivot_root", (void *)nullptr},
 	[__NR_i386_mincore] = {"mincore", (void *)nullptr},
-	[__NR_i386_madvise] = {"madvise", (void *)nullptr},
+	[__NR_i386_madvise] = {"madvise", (void *)linux_madvise},
 	[__NR_i386_getdents64] = {"getdents64", (void *)linux_getdents64},
 	[__NR_i386_fcntl64] = {"fcntl64", (void *)nullptr},
 	[222] = {"reserved", (void *)nullptr},
@@ -3494,7 +3852,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_fremovexattr] = {"fremovexattr", (void *)nullptr},
 	[__NR_i386_tkill] = {"tkill", (void *)linux_tkill},
 	[__NR_i386_sendfile64] = {"sendfile64", (void *)nullptr},
-	[__NR_i386_futex] = {"futex", (void *)nullptr},
+	[__NR_i386_futex] = {"futex", (void *)linux_futex},
 	[__NR_i386_sched_setaffinity] = {"sched_setaffinity", (void *)nullptr},
 	[__NR_i386_sched_getaffinity] = {"sched_getaffinity", (void *)nullptr},
 	[__NR_i386_set_thread_area] = {"set_thread_area", (void *)nullptr},
@@ -3610,7 +3968,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_renameat2] = {"renameat2", (void *)nullptr},
 	[__NR_i386_seccomp] = {"seccomp", (void *)nullptr},
 	[__NR_i386_getrandom] = {"getrandom", (void *)linux_getrandom},
-	[__NR_i386_memfd_create] = {"memfd_create", (void *)nullptr},
+	[__NR_i386_memfd_create] = {"memfd_create", (void *)linux_memfd_create},
 	[__NR_i386_bpf] = {"bpf", (void *)nullptr},
 	[__NR_i386_execveat] = {"execveat", (void *)nullptr},
 	[__NR_i386_socket] = {"socket", (void *)nullptr},
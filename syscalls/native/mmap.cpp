@@ -49,6 +49,7 @@ void *sys_mmap(SysFrm *,
 	bool m_Private = flags & sc_MAP_PRIVATE;
 	bool m_Fixed = flags & sc_MAP_FIXED;
 	bool m_Anon = flags & sc_MAP_ANONYMOUS;
+	bool m_Populate = flags & sc_MAP_POPULATE;
 
 	UNUSED(p_None);
 	UNUSED(m_Anon);
@@ -57,14 +58,15 @@ void *sys_mmap(SysFrm *,
 		  p_None, p_Read, p_Write,
 		  p_Exec);
 
-	debug("S:%d P:%d F:%d A:%d",
+	debug("S:%d P:%d F:%d A:%d PP:%d",
 		  m_Shared, m_Private,
-		  m_Fixed, m_Anon);
+		  m_Fixed, m_Anon, m_Populate);
 
 	int UnknownFlags = flags & ~(sc_MAP_SHARED |
 								 sc_MAP_PRIVATE |
 								 sc_MAP_FIXED |
-								 sc_MAP_ANONYMOUS);
+								 sc_MAP_ANONYMOUS |
+								 sc_MAP_POPULATE);
 
 	if (UnknownFlags)
 	{
@@ -94,6 +96,11 @@ void *sys_mmap(SysFrm *,
 	intptr_t ret = (intptr_t)vma->CreateCoWRegion(addr, len,
 												  p_Read, p_Write, p_Exec,
 												  m_Fixed, m_Shared);
+	if (ret < 0)
+		return (void *)ret;
+
+	if (m_Populate)
+		vma->Populate((void *)ret, len, p_Write);
 
 	return (void *)ret;
 }
@@ -42,9 +42,12 @@ int sys_mprotect(SysFrm *,
 	bool p_None = prot & sc_PROT_NONE;
 	bool p_Read = prot & sc_PROT_READ;
 	bool p_Write = prot & sc_PROT_WRITE;
-	// bool p_Exec = prot & sc_PROT_EXEC;
+	bool p_Exec = prot & sc_PROT_EXEC;
 
 	PCB *pcb = thisProcess;
+	if (pcb->vma->ProtectRegion(addr, len, p_Read, p_Write, p_Exec) == 0)
+		return 0;
+
 	Virtual vmm = Virtual(pcb->PageTable);
 
 	for (uintptr_t i = uintptr_t(addr);
@@ -68,19 +71,7 @@ int sys_mprotect(SysFrm *,
 			pte->ReadWrite = p_Write;
 			// pte->ExecuteDisable = p_Exec;
 
-#if defined(a64)
-			CPU::x64::invlpg(addr);
-#elif defined(a32)
-			CPU::x32::invlpg(addr);
-#elif defined(aa64)
-			asmv("dsb sy");
-			asmv("tlbi vae1is, %0"
-				 :
-				 : "r"(addr)
-				 : "memory");
-			asmv("dsb sy");
-			asmv("isb");
-#endif
+			TLB::Invalidate(pcb->PageTable, (uintptr_t)addr);
 		}
 		else
 		{
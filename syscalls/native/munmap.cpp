@@ -41,6 +41,9 @@ int sys_munmap(SysFrm *,
 
 	PCB *pcb = thisProcess;
 	VirtualMemoryArea *vma = pcb->vma;
+	if (vma->FreeRegion(addr, len) == 0)
+		return 0;
+
 	Virtual vmm = Virtual(pcb->PageTable);
 
 	for (uintptr_t i = uintptr_t(addr);
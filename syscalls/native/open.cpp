@@ -38,11 +38,9 @@ int sys_open(SysFrm *,
 	PCB *pcb = thisProcess;
 	SmartHeap sh(512, pcb->vma);
 	safe_path = (const char *)sh.Get();
-	{
-		SwapPT swap(pcb->PageTable);
-		size_t len = strlen(path);
-		memcpy((void *)safe_path, path, MAX(len, size_t(511)));
-	}
+	ssize_t len = pcb->vma->CopyStringFromUser((char *)safe_path, path, 512);
+	if (len < 0)
+		return (int)len;
 
 	function("%s, %d, %d", safe_path, oflag, mode);
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
@@ -46,9 +46,8 @@ ssize_t sys_read(SysFrm *, int fildes,
 	else
 		return ret;
 
-	{
-		SwapPT swap(pcb->PageTable);
-		memcpy(buf, safe_buf, nbyte);
-	}
+	int err = pcb->vma->CopyToUser(buf, safe_buf, (size_t)ret);
+	if (err < 0)
+		return err;
 	return ret;
 }
@@ -44,15 +44,12 @@ ssize_t sys_readlink(SysFrm *, const char *path, char *buf,
 	}
 
 	PCB *pcb = thisProcess;
-	Memory::Virtual vmm(pcb->PageTable);
-	if (!vmm.Check((void *)buf, Memory::US))
-	{
-		warn("Invalid address %#lx", buf);
-		return -EFAULT;
-	}
+	SmartHeap sh(512, pcb->vma);
+	char *pPath = (char *)sh.Get();
+	ssize_t ret = pcb->vma->CopyStringFromUser(pPath, path, 512);
+	if (ret < 0)
+		return ret;
 
-	const char *pPath = pcb->PageTable->Get(path);
-	char *pBuf = pcb->PageTable->Get(buf);
 	function("%s %#lx %ld", pPath, buf, bufsize);
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 	int fd = fdt->_open(pPath, O_RDONLY, 0);
@@ -76,6 +73,8 @@ ssize_t sys_readlink(SysFrm *, const char *path, char *buf,
 	if (len > bufsize)
 		len = bufsize;
 
-	strncpy(pBuf, node->Symlink, len);
+	ret = pcb->vma->CopyToUser(buf, node->Symlink, len);
+	if (ret < 0)
+		return ret;
 	return len;
 }
@@ -36,15 +36,6 @@ int sys_uname(SysFrm *, struct utsname *buf)
 	assert(sizeof(struct utsname) < PAGE_SIZE);
 
 	Tasking::PCB *pcb = thisProcess;
-	Memory::Virtual vmm(pcb->PageTable);
-
-	if (!vmm.Check(buf, Memory::US))
-	{
-		warn("Invalid address %#lx", buf);
-		return -EFAULT;
-	}
-
-	auto pBuf = pcb->PageTable->Get(buf);
 
 	struct utsname uname =
 	{
@@ -64,6 +55,5 @@ int sys_uname(SysFrm *, struct utsname *buf)
 #endif
 	};
 
-	memcpy(pBuf, &uname, sizeof(struct utsname));
-	return 0;
+	return pcb->vma->CopyToUser(buf, &uname, sizeof(struct utsname));
 }
@@ -37,10 +37,9 @@ ssize_t sys_write(SysFrm *, int fildes,
 	PCB *pcb = thisProcess;
 	SmartHeap sh(nbyte, pcb->vma);
 	safe_buf = sh.Get();
-	{
-		SwapPT swap(pcb->PageTable);
-		memcpy((void *)safe_buf, buf, nbyte);
-	}
+	int err = pcb->vma->CopyFromUser((void *)safe_buf, buf, nbyte);
+	if (err < 0)
+		return err;
 
 	function("%d, %p, %d", fildes, buf, nbyte);
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
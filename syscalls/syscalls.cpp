@@ -24,39 +24,35 @@
 class AutoSwitchPageTable
 {
 private:
-	void *Original;
+	Memory::PageTable *Original;
 
 public:
 	AutoSwitchPageTable()
 	{
-#if defined(a86)
-		asmv("mov %%cr3, %0"
-			 : "=r"(Original));
+		/* Only needed where user pages hide the direct map */
+		Original = thisPageTable;
+		if (likely(!Original->ShadowsDirectMap))
+		{
+			Original = nullptr;
+			return;
+		}
 
-		asmv("mov %0, %%cr3"
-			 :
-			 : "r"(KernelPageTable));
-#endif
-		debug(" +    %#lx %s(%d)", Original,
-			  thisProcess->Name, thisProcess->ID);
+		/* Both tables keep their PCIDs, no flush here */
+		KernelPageTable->Update();
 	}
 
 	~AutoSwitchPageTable()
 	{
-		debug("-    %#lx %s(%d)", Original,
-			  thisProcess->Name, thisProcess->ID);
-#if defined(a86)
-		asmv("mov %0, %%cr3"
-			 :
-			 : "r"(Original));
-#endif
+		if (unlikely(Original != nullptr))
+			Original->Update();
 	}
 };
 
 extern "C" uintptr_t SystemCallsHandler(SyscallsFrame *Frame)
 {
-	/* Automatically switch to kernel page table
-		and switch back when this function returns. */
+	/* Syscalls run on the process table, its kernel half is a copy
+		of KernelPageTable kept in sync on fault. Processes with user
+		pages over the direct map still switch, see ShadowsDirectMap. */
 	AutoSwitchPageTable PageSwitcher;
 
 	uint64_t _ctime = TimeManager->GetCounter();
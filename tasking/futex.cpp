@@ -0,0 +1,424 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <futex.hpp>
+
+#include <syscall/linux/defs.hpp>
+#include <lock.hpp>
+#include <task.hpp>
+#include <debug.h>
+#include <smp.hpp>
+#include <errno.h>
+
+#include "../kernel.h"
+
+namespace Futex
+{
+	struct Bucket;
+
+	struct Waiter
+	{
+		Key Where;
+		Tasking::TCB *Thread;
+		uint32_t Bitset;
+		bool Woken;
+		Waiter *Next;
+		Waiter *Prev;
+
+		/* Changed by Requeue with both buckets locked */
+		std::atomic<Bucket *> Queue;
+	};
+
+	struct __aligned(LOCK_CACHE_LINE) Bucket
+	{
+		TicketLock Lock;
+		Waiter *Head;
+		Waiter *Tail;
+	};
+
+	static Bucket Buckets[FUTEX_BUCKETS];
+
+	static Bucket *Hash(const Key &k)
+	{
+		uint64_t h = (uint64_t(k.Address) ^ uint64_t(uintptr_t(k.Space))) *
+					 0x9E3779B97F4A7C15;
+		return &Buckets[(h >> 32) & (FUTEX_BUCKETS - 1)];
+	}
+
+	static void Append(Bucket *b, Waiter *w)
+	{
+		w->Next = nullptr;
+		w->Prev = b->Tail;
+		if (b->Tail)
+			b->Tail->Next = w;
+		else
+			b->Head = w;
+		b->Tail = w;
+		w->Queue.store(b, std::memory_order_release);
+	}
+
+	static void Unlink(Bucket *b, Waiter *w)
+	{
+		if (w->Prev)
+			w->Prev->Next = w->Next;
+		else
+			b->Head = w->Next;
+		if (w->Next)
+			w->Next->Prev = w->Prev;
+		else
+			b->Tail = w->Prev;
+	}
+
+	static bool IsDead(Tasking::TaskState State)
+	{
+		return State == Tasking::Terminated ||
+			   State == Tasking::Zombie ||
+			   State == Tasking::CoreDump;
+	}
+
+	/* Called with the bucket locked, the waiter may
+		return as soon as the lock is dropped. A killed
+		waiter is dropped without using up a wake. */
+	static bool WakeWaiter(Bucket *b, Waiter *w)
+	{
+		Unlink(b, w);
+		w->Woken = true;
+
+		Tasking::TCB *t = w->Thread;
+		Tasking::TaskState State = t->State.load();
+		if (IsDead(State))
+			return false;
+
+		/* Not asleep yet, it sees Woken before sleeping.
+			Unblock would also revive a thread killed now. */
+		t->Info.SleepUntil = 0;
+		while ((State == Tasking::Blocked || State == Tasking::Sleeping) &&
+			   !t->State.compare_exchange_weak(State, Tasking::Ready))
+			;
+		return true;
+	}
+
+	static int WakeLocked(Bucket *b, const Key &k, int Count, uint32_t Bitset)
+	{
+		int Woken = 0;
+		Waiter *w = b->Head;
+		while (w && Woken < Count)
+		{
+			Waiter *Next = w->Next;
+			if (w->Where == k && (w->Bitset & Bitset) &&
+				WakeWaiter(b, w))
+				Woken++;
+			w = Next;
+		}
+		return Woken;
+	}
+
+	/* Requeue may move the waiter while we wait for its bucket */
+	static Bucket *LockQueue(Waiter &w)
+	{
+		while (true)
+		{
+			Bucket *b = w.Queue.load(std::memory_order_acquire);
+			b->Lock.Lock(__FUNCTION__);
+			if (b == w.Queue.load(std::memory_order_relaxed))
+				return b;
+			b->Lock.Unlock();
+		}
+	}
+
+	/* Always in the same order so two callers can't deadlock */
+	static void LockPair(Bucket *a, Bucket *b)
+	{
+		if (a == b)
+		{
+			a->Lock.Lock(__FUNCTION__);
+			return;
+		}
+
+		if (a > b)
+		{
+			Bucket *t = a;
+			a = b;
+			b = t;
+		}
+		a->Lock.Lock(__FUNCTION__);
+		b->Lock.Lock(__FUNCTION__);
+	}
+
+	static void UnlockPair(Bucket *a, Bucket *b)
+	{
+		a->Lock.Unlock();
+		if (a != b)
+			b->Lock.Unlock();
+	}
+
+	int GetKey(uint32_t *UserAddress, bool Private, Key &Out, bool Write)
+	{
+		if (uintptr_t(UserAddress) % sizeof(uint32_t))
+			return -EINVAL;
+
+		Tasking::PCB *pcb = thisProcess;
+		Memory::VirtualMemoryArea *vma = pcb->vma;
+
+		/* Writable regions are populated with a private
+			copy, the word can't move under the kernel. */
+		uint32_t *Word = vma->UserCheckAndGetAddress(UserAddress);
+		if (Word == nullptr)
+			return -EFAULT;
+
+		/* A read-only page may be a frame shared with others */
+		if (Write && !Memory::Virtual(pcb->PageTable).Check(UserAddress, Memory::PTFlag::RW))
+			return -EFAULT;
+
+		Out.Word = Word;
+		if (Private)
+		{
+			Out.Space = vma;
+			Out.Address = uintptr_t(UserAddress);
+		}
+		else
+		{
+			Out.Space = nullptr;
+			Out.Address = uintptr_t(Word);
+		}
+		return 0;
+	}
+
+	int Wait(const Key &k, uint32_t Expected, uint64_t Deadline, uint32_t Bitset)
+	{
+		if (Bitset == 0)
+			return -EINVAL;
+
+		Tasking::TCB *Thread = thisThread;
+		Tasking::PCB *pcb = thisProcess;
+
+		Waiter w{};
+		w.Where = k;
+		w.Thread = Thread;
+		w.Bitset = Bitset;
+		w.Woken = false;
+
+		{
+			Bucket *b = Hash(k);
+			CriticalSection cs;
+			b->Lock.Lock(__FUNCTION__);
+			if (__atomic_load_n(k.Word, __ATOMIC_SEQ_CST) != Expected)
+			{
+				b->Lock.Unlock();
+				return -EAGAIN;
+			}
+			Append(b, &w);
+			Thread->FutexWait = &w;
+			b->Lock.Unlock();
+		}
+
+		int ret = 0;
+		while (true)
+		{
+			{
+				CriticalSection cs;
+				Bucket *b = LockQueue(w);
+				if (w.Woken)
+				{
+					Thread->FutexWait = nullptr;
+					b->Lock.Unlock();
+					break;
+				}
+
+				uint64_t Now = TimeManager->GetCounter();
+				if (Deadline && Now >= Deadline)
+					ret = -ETIMEDOUT;
+				else if (pcb->Signals.HasPendingSignal())
+					ret = -EINTR;
+
+				if (ret != 0)
+				{
+					Unlink(b, &w);
+					Thread->FutexWait = nullptr;
+					b->Lock.Unlock();
+					break;
+				}
+
+				/* Signals don't wake sleeping threads, nap
+					and check again. A wake up sets us Ready. */
+				uint64_t Nap = TimeManager->CalculateTarget(FUTEX_SIGNAL_CHECK,
+															Time::Units::Milliseconds);
+				if (Deadline && Deadline < Nap)
+					Nap = Deadline;
+				Thread->Info.SleepUntil = Nap;
+				Thread->State.store(Tasking::TaskState::Sleeping);
+				b->Lock.Unlock();
+			}
+			TaskManager->Yield();
+		}
+
+		Thread->Info.SleepUntil = 0;
+		return ret;
+	}
+
+	void Abandon(Tasking::TCB *Thread)
+	{
+		Waiter *w = Thread->FutexWait;
+		if (w == nullptr)
+			return;
+
+		CriticalSection cs;
+		Bucket *b = LockQueue(*w);
+		if (!w->Woken)
+			Unlink(b, w);
+		Thread->FutexWait = nullptr;
+		b->Lock.Unlock();
+	}
+
+	int Wake(const Key &k, int Count, uint32_t Bitset)
+	{
+		if (Bitset == 0)
+			return -EINVAL;
+
+		Bucket *b = Hash(k);
+		CriticalSection cs;
+		b->Lock.Lock(__FUNCTION__);
+		int Woken = WakeLocked(b, k, Count, Bitset);
+		b->Lock.Unlock();
+		return Woken;
+	}
+
+	int Requeue(const Key &From, const Key &To, int Count, int Limit,
+				bool Compare, uint32_t Expected, int &Moved)
+	{
+		Moved = 0;
+		Bucket *b1 = Hash(From);
+		Bucket *b2 = Hash(To);
+
+		CriticalSection cs;
+		LockPair(b1, b2);
+		if (Compare && __atomic_load_n(From.Word, __ATOMIC_SEQ_CST) != Expected)
+		{
+			UnlockPair(b1, b2);
+			return -EAGAIN;
+		}
+
+		int Woken = WakeLocked(b1, From, Count, FUTEX_BITSET_ANY);
+
+		Waiter *w = b1->Head;
+		while (w && Moved < Limit)
+		{
+			Waiter *Next = w->Next;
+			if (w->Where == From)
+			{
+				w->Where = To;
+				if (b1 != b2)
+				{
+					Unlink(b1, w);
+					Append(b2, w);
+				}
+				Moved++;
+			}
+			w = Next;
+		}
+
+		UnlockPair(b1, b2);
+		return Woken;
+	}
+
+	static int SignExtend12(uint32_t v)
+	{
+		return int(v << 20) >> 20;
+	}
+
+	int WakeOp(const Key &First, const Key &Second, int Count,
+			   int Count2, uint32_t Operation)
+	{
+		uint32_t Op = (Operation >> 28) & 0xF;
+		uint32_t Cmp = (Operation >> 24) & 0xF;
+		int OpArg = SignExtend12((Operation >> 12) & 0xFFF);
+		int CmpArg = SignExtend12(Operation & 0xFFF);
+
+		if (Op & FUTEX_OP_OPARG_SHIFT)
+		{
+			if (OpArg < 0 || OpArg > 31)
+				return -EINVAL;
+			OpArg = int(1U << OpArg);
+			Op &= ~FUTEX_OP_OPARG_SHIFT;
+		}
+
+		if (Op > FUTEX_OP_XOR || Cmp > FUTEX_OP_CMP_GE)
+			return -ENOSYS;
+
+		Bucket *b1 = Hash(First);
+		Bucket *b2 = Hash(Second);
+
+		CriticalSection cs;
+		LockPair(b1, b2);
+
+		uint32_t Arg = uint32_t(OpArg);
+		uint32_t Old = 0;
+		switch (Op)
+		{
+		case FUTEX_OP_SET:
+			Old = __atomic_exchange_n(Second.Word, Arg, __ATOMIC_SEQ_CST);
+			break;
+		case FUTEX_OP_ADD:
+			Old = __atomic_fetch_add(Second.Word, Arg, __ATOMIC_SEQ_CST);
+			break;
+		case FUTEX_OP_OR:
+			Old = __atomic_fetch_or(Second.Word, Arg, __ATOMIC_SEQ_CST);
+			break;
+		case FUTEX_OP_ANDN:
+			Old = __atomic_fetch_and(Second.Word, ~Arg, __ATOMIC_SEQ_CST);
+			break;
+		case FUTEX_OP_XOR:
+			Old = __atomic_fetch_xor(Second.Word, Arg, __ATOMIC_SEQ_CST);
+			break;
+		default:
+			assert(!"unreachable");
+		}
+
+		bool Pass = false;
+		int iOld = int(Old);
+		switch (Cmp)
+		{
+		case FUTEX_OP_CMP_EQ:
+			Pass = iOld == CmpArg;
+			break;
+		case FUTEX_OP_CMP_NE:
+			Pass = iOld != CmpArg;
+			break;
+		case FUTEX_OP_CMP_LT:
+			Pass = iOld < CmpArg;
+			break;
+		case FUTEX_OP_CMP_LE:
+			Pass = iOld <= CmpArg;
+			break;
+		case FUTEX_OP_CMP_GT:
+			Pass = iOld > CmpArg;
+			break;
+		case FUTEX_OP_CMP_GE:
+			Pass = iOld >= CmpArg;
+			break;
+		default:
+			assert(!"unreachable");
+		}
+
+		int Woken = WakeLocked(b1, First, Count, FUTEX_BITSET_ANY);
+		if (Pass)
+			Woken += WakeLocked(b2, Second, Count2, FUTEX_BITSET_ANY);
+
+		UnlockPair(b1, b2);
+		return Woken;
+	}
+}
@@ -17,6 +17,7 @@
 
 #include <task.hpp>
 
+#include <filesystem/mounts.hpp>
 #include <dumper.hpp>
 #include <signal.hpp>
 #include <convert.h>
@@ -49,6 +50,8 @@ using namespace vfs;
 
 namespace Tasking
 {
+	SLAB_CACHE_DEFINE(PCB, "PCB");
+
 	TCB *PCB::GetThread(TID ID)
 	{
 		auto it = std::find_if(this->Threads.begin(), this->Threads.end(),
@@ -216,6 +219,7 @@ namespace Tasking
 
 		this->vma = new Memory::VirtualMemoryArea(this->PageTable);
 		this->ProgramBreak = new Memory::ProgramBreak(this->PageTable, this->vma);
+		new vfs::ProcessStatus(this);
 
 		debug("Process page table: %#lx", this->PageTable);
 		debug("Created %s process \"%s\"(%d). Parent \"%s\"(%d)",
@@ -230,6 +234,7 @@ namespace Tasking
 		this->AllocatedMemory += FROM_PAGES(TO_PAGES(sizeof(Memory::PageTable) + 1));
 		this->AllocatedMemory += sizeof(Memory::VirtualMemoryArea);
 		this->AllocatedMemory += sizeof(Memory::ProgramBreak);
+		this->AllocatedMemory += sizeof(vfs::ProcessStatus);
 		this->AllocatedMemory += sizeof(SymbolResolver::Symbols);
 
 		this->Info.SpawnTime = TimeManager->GetCounter();
@@ -21,6 +21,7 @@
 #include <convert.h>
 #include <lock.hpp>
 #include <printf.h>
+#include <rcu.hpp>
 #include <smp.hpp>
 #include <io.h>
 
@@ -276,13 +277,15 @@ namespace Tasking::Scheduler
 	{
 		UNUSED(Core);
 		uint64_t CurrentTime = TimeManager->GetCounter();
-		uint64_t TimePassed = Info->LastUpdateTime - CurrentTime;
+		uint64_t TimePassed = CurrentTime - Info->LastUpdateTime;
 		Info->LastUpdateTime = CurrentTime;
 
+		Info->UsageSeq.WriteBegin();
 		if (Mode == TaskExecutionMode::User)
 			Info->UserTime += TimePassed;
 		else
 			Info->KernelTime += TimePassed;
+		Info->UsageSeq.WriteEnd();
 	}
 
 	nsa NIF bool Custom::FindNewProcess(void *CPUDataPointer)
@@ -549,6 +552,7 @@ namespace Tasking::Scheduler
 
 	nsa NIF void Custom::Schedule(CPU::TrapFrame *Frame)
 	{
+		RCU::QuiescentState();
 		if (unlikely(StopScheduler))
 		{
 			warn("Scheduler stopped.");
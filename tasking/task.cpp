@@ -72,6 +72,25 @@ namespace Tasking
 		return ((Scheduler::Base *)Scheduler)->GetProcessList();
 	}
 
+	bool Task::ForEachProcess(bool (*Callback)(PCB *, void *), void *Context)
+	{
+		/* Reclaim from inside a walk walks again on the same thread */
+		TCB *Self = thisThread;
+		bool Nested = Self != nullptr && SchedulerLock.GetOwner() == Self;
+		if (!Nested)
+			SchedulerLock.Lock(__FUNCTION__);
+
+		foreach (auto pcb in((Scheduler::Base *)Scheduler)->GetProcessList())
+		{
+			if (!Callback(pcb, Context))
+				break;
+		}
+
+		if (!Nested)
+			SchedulerLock.Unlock();
+		return true;
+	}
+
 	void Task::Panic()
 	{
 		((Scheduler::Base *)Scheduler)->StopScheduler.store(true);
@@ -95,11 +114,13 @@ namespace Tasking
 
 	void Task::PushProcess(PCB *pcb)
 	{
+		SmartLock(SchedulerLock);
 		((Scheduler::Base *)Scheduler)->PushProcess(pcb);
 	}
 
 	void Task::PopProcess(PCB *pcb)
 	{
+		SmartLock(SchedulerLock);
 		((Scheduler::Base *)Scheduler)->PopProcess(pcb);
 	}
 
@@ -19,6 +19,7 @@
 
 #include <filesystem/ioctl.hpp>
 #include <dumper.hpp>
+#include <futex.hpp>
 #include <convert.h>
 #include <lock.hpp>
 #include <printf.h>
@@ -62,6 +63,8 @@ void ThreadDoExit()
 
 namespace Tasking
 {
+	SLAB_CACHE_DEFINE(TCB, "TCB");
+
 	int TCB::SendSignal(int sig)
 	{
 		return this->Parent->Signals.SendSignal((enum Signals)sig, {0}, this->ID);
@@ -652,6 +655,9 @@ namespace Tasking
 								Threads.end(),
 								this));
 
+		/* A futex waiter may still point into the stack */
+		Futex::Abandon(this);
+
 		/* Free CPU Stack */
 		delete this->Stack;
 
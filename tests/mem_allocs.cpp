@@ -291,6 +291,31 @@ void TestMemoryAllocation()
 				assert(prq1 == prq2);
 		}
 
+		debug("Large calloc Test");
+		{
+			for (size_t i = 0; i < 16; i++)
+			{
+				/* Dirty the memory first, calloc must still return zeroes */
+				uint8_t *d = (uint8_t *)kmalloc(0x8000);
+				memset(d, 0xAA, 0x8000);
+				kfree(d);
+
+				uint8_t *t = (uint8_t *)kcalloc(0x8000, 1);
+				for (size_t j = 0; j < 0x8000; j++)
+				{
+					if (t[j] != 0)
+					{
+						error("calloc returned dirty memory at %ld", j);
+						inf_loop;
+					}
+				}
+				kfree(t);
+			}
+
+			debug(" Result:\tpool hits %ld, misses %ld",
+				  ZeroedPages.GetHits(), ZeroedPages.GetMisses());
+		}
+
 		debug("realloc Test");
 		{
 			uintptr_t prq1 = (uintptr_t)kmalloc(0x1000);
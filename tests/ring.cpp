@@ -0,0 +1,126 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef DEBUG
+
+#include "t.h"
+
+#include "../kernel.h"
+
+#include <ring.hpp>
+#include <assert.h>
+
+constexpr size_t RingItems = 100000;
+constexpr size_t RingProducers = 4;
+static SPSCRing<size_t, 64> TestSPSC;
+static MPSCRing<uint64_t, 64> TestMPSC;
+static std::atomic_size_t NextProducer = 0;
+
+static void RingSingleThread()
+{
+	SPSCRing<int, 8> r;
+	int v;
+	assert(r.Empty());
+	assert(!r.Pop(v));
+
+	for (int i = 0; i < 8; i++)
+		assert(r.Push(i));
+	assert(!r.Push(8));
+	assert(r.Count() == 8);
+
+	for (int i = 0; i < 8; i++)
+	{
+		assert(r.Pop(v));
+		assert(v == i);
+	}
+	assert(r.Empty());
+
+	/* Batches wrap around the end of the buffer */
+	int In[6] = {10, 11, 12, 13, 14, 15};
+	int Out[6];
+	assert(r.PushBatch(In, 6) == 6);
+	assert(r.PushBatch(In, 6) == 2);
+	assert(r.PopBatch(Out, 6) == 6);
+	for (int i = 0; i < 6; i++)
+		assert(Out[i] == In[i]);
+	assert(r.PopBatch(Out, 6) == 2);
+	assert(Out[0] == 10 && Out[1] == 11);
+
+	MPSCRing<int, 8> m;
+	assert(m.PushBatch(In, 6) == 6);
+	assert(m.PushBatch(In, 6) == 2);
+	assert(!m.Push(0));
+	m.Clear();
+	assert(m.Empty());
+}
+
+static void spsc_producer()
+{
+	for (size_t i = 0; i < RingItems; i++)
+	{
+		while (!TestSPSC.Push(i))
+			TaskManager->Yield();
+	}
+}
+
+static void mpsc_producer()
+{
+	uint64_t ID = NextProducer++;
+	for (uint64_t i = 0; i < RingItems; i++)
+	{
+		while (!TestMPSC.Push((ID << 32) | i))
+			TaskManager->Yield();
+	}
+}
+
+void TestRings()
+{
+	RingSingleThread();
+
+	/* One producer, values must come out in order */
+	TaskManager->CreateThread(thisProcess, Tasking::IP(spsc_producer));
+	for (size_t i = 0; i < RingItems; i++)
+	{
+		size_t v;
+		TestSPSC.PopWait(v);
+		assert(v == i);
+	}
+	assert(TestSPSC.Empty());
+
+	/* Several producers, each one's values in order and none lost */
+	uint64_t Seen[RingProducers] = {};
+	NextProducer = 0;
+	for (size_t i = 0; i < RingProducers; i++)
+		TaskManager->CreateThread(thisProcess, Tasking::IP(mpsc_producer));
+
+	for (size_t i = 0; i < RingItems * RingProducers; i++)
+	{
+		uint64_t v;
+		TestMPSC.PopWait(v);
+		uint64_t ID = v >> 32;
+		assert(ID < RingProducers);
+		assert((v & UINT32_MAX) == Seen[ID]);
+		Seen[ID]++;
+	}
+
+	for (size_t i = 0; i < RingProducers; i++)
+		assert(Seen[i] == RingItems);
+	assert(TestMPSC.Empty());
+	debug("SPSC and MPSC rings passed");
+}
+
+#endif // DEBUG
@@ -27,6 +27,8 @@ void Test_std();
 void TestMemoryAllocation();
 void tasking_test_fb();
 void tasking_test_mutex();
+void TestLocks();
+void TestRings();
 void lsof();
 void TaskMgr();
 void TreeFS(vfs::Node *node, int Depth);
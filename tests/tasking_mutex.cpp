@@ -22,6 +22,8 @@
 #include "../kernel.h"
 
 #include <mutex>
+#include <lock.hpp>
+#include <assert.h>
 std::mutex test_mutex;
 
 void mutex_test_long()
@@ -64,4 +66,73 @@ void tasking_test_mutex()
 	ilp;
 }
 
+/* Every thread bumps a plain counter under the lock, a lost update shows in the total */
+constexpr size_t CounterThreads = 8;
+constexpr size_t CounterLoops = 10000;
+static size_t Counter = 0;
+static std::atomic_size_t CounterDone = 0;
+static TicketLock test_ticket;
+static MCSLock test_mcs;
+
+static void counter_mutex()
+{
+	for (size_t i = 0; i < CounterLoops; i++)
+	{
+		test_mutex.lock();
+		Counter++;
+		test_mutex.unlock();
+	}
+	CounterDone++;
+}
+
+static void counter_ticket()
+{
+	for (size_t i = 0; i < CounterLoops; i++)
+	{
+		test_ticket.Lock(__FUNCTION__);
+		Counter++;
+		test_ticket.Unlock();
+	}
+	CounterDone++;
+}
+
+static void counter_mcs()
+{
+	for (size_t i = 0; i < CounterLoops; i++)
+	{
+		test_mcs.Lock(__FUNCTION__);
+		Counter++;
+		test_mcs.Unlock();
+	}
+	CounterDone++;
+}
+
+static void RunCounter(void (*Worker)(), const char *Name)
+{
+	Counter = 0;
+	CounterDone = 0;
+	for (size_t i = 0; i < CounterThreads; i++)
+		TaskManager->CreateThread(thisProcess, Tasking::IP(Worker));
+
+	while (CounterDone.load() < CounterThreads)
+		TaskManager->Yield();
+
+	debug("%s: counter %ld, expected %ld",
+		  Name, Counter, CounterThreads * CounterLoops);
+	assert(Counter == CounterThreads * CounterLoops);
+}
+
+void TestLocks()
+{
+	RunCounter(counter_mutex, "std::mutex");
+	assert(test_mutex.try_lock());
+	test_mutex.unlock();
+
+	RunCounter(counter_ticket, "TicketLock");
+	assert(!test_ticket.Locked());
+
+	RunCounter(counter_mcs, "MCSLock");
+	assert(!test_mcs.Locked());
+}
+
 #endif // DEBUG